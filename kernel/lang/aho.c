@@ -0,0 +1,348 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <lang/module.h>
+#include <lang/qbuff.h>
+#include <lang/aho.h>
+
+#include <pfq/printk.h>
+
+#include <linux/vmalloc.h>
+
+
+/* scan the payload window: offset and depth are relative to the end of the transport header */
+
+static uint16_t
+payload_scan(arguments_t args, struct qbuff * buff)
+{
+	struct pfq_aho const *ac = GET_ARG_0(struct pfq_aho *, args);
+	int offset = GET_ARG_1(int, args);
+	int depth  = GET_ARG_2(int, args);
+	struct qbuff_ip_level const *level = qbuff_ip_level(buff);
+	uint16_t state = 0, id;
+	int start, end;
+
+	if (level == NULL)
+		return 0;
+
+	start = level->l4off;
+
+	switch(level->l4proto)
+	{
+	case IPPROTO_TCP: {
+		struct tcphdr _tcp;
+		const struct tcphdr *tcp;
+
+		tcp = qbuff_header_pointer(buff, start, sizeof(_tcp), &_tcp);
+		if (tcp == NULL)
+			return 0;
+		start += tcp->doff << 2;
+	} break;
+	case IPPROTO_UDP:
+		start += (int)sizeof(struct udphdr);
+		break;
+	}
+
+	start += offset;
+	end = (int)qbuff_len(buff);
+	if (depth > 0 && start + depth < end)
+		end = start + depth;
+
+	while (start < end)
+	{
+		uint8_t _chunk[64];
+		const uint8_t *chunk;
+		int len = min_t(int, end - start, sizeof(_chunk));
+
+		chunk = qbuff_header_pointer(buff, start, len, _chunk);
+		if (chunk == NULL)
+			return 0;
+
+		id = pfq_aho_run(ac, &state, chunk, len);
+		if (id)
+			return id;
+
+		start += len;
+	}
+
+	return 0;
+}
+
+
+static bool
+payload_match(arguments_t args, struct qbuff * buff)
+{
+	return payload_scan(args, buff) != 0;
+}
+
+
+static ActionQbuff
+payload_filter(arguments_t args, struct qbuff * buff)
+{
+	if (payload_scan(args, buff))
+		return Pass(buff);
+	return Drop(buff);
+}
+
+
+/* the id of the matching pattern: its position in the list, starting from 1 */
+
+static uint64_t
+payload_id(arguments_t args, struct qbuff * buff)
+{
+	uint16_t id = payload_scan(args, buff);
+	if (id)
+		return (uint64_t)JUST(id);
+	return NOTHING;
+}
+
+
+static ActionQbuff
+payload_mark(arguments_t args, struct qbuff * buff)
+{
+	uint16_t id = payload_scan(args, buff);
+	if (id)
+		set_mark(buff, id);
+	return Pass(buff);
+}
+
+
+static ActionQbuff
+payload_state(arguments_t args, struct qbuff * buff)
+{
+	uint16_t id = payload_scan(args, buff);
+	if (id)
+		set_state(buff, id);
+	return Pass(buff);
+}
+
+
+/* steer by the id of the matching pattern (unmatched packets are dropped) */
+
+static ActionQbuff
+steering_payload(arguments_t args, struct qbuff * buff)
+{
+	uint16_t id = payload_scan(args, buff);
+	if (id)
+		return Steering(buff, id);
+	return Drop(buff);
+}
+
+
+/* decode a pattern: the escapes \xHH and \\ allow arbitrary bytes */
+
+static int
+aho_decode(const char *str, uint8_t *out)
+{
+	int len = 0;
+
+	while (*str)
+	{
+		if (str[0] == '\\' && str[1] == 'x') {
+			int hi = hex_to_bin(str[2]), lo = hi < 0 ? -1 : hex_to_bin(str[3]);
+			if (lo < 0)
+				return -EINVAL;
+			out[len++] = (uint8_t)(hi << 4 | lo);
+			str += 4;
+		}
+		else if (str[0] == '\\' && str[1] == '\\') {
+			out[len++] = '\\';
+			str += 2;
+		}
+		else
+			out[len++] = (uint8_t)*str++;
+	}
+
+	return len;
+}
+
+
+static int
+aho_build(struct pfq_aho **pac, const char **patterns, size_t n)
+{
+	struct pfq_aho *ac = NULL;
+	uint16_t *queue = NULL, *fail = NULL;
+	uint8_t *bytes, used[256] = { 0 };
+	int *len, err = -ENOMEM;
+	size_t total = 0, i, nc, head, tail;
+	uint32_t nstates, s, c;
+
+	if (n == 0 || n >= AHO_MAX_STATES)
+		return -EINVAL;
+
+	for(i = 0; i < n; i++)
+		total += strlen(patterns[i]);
+
+	if (total + 1 > AHO_MAX_STATES)
+		return -E2BIG;
+
+	len = kmalloc(n * sizeof(int), GFP_KERNEL);
+	bytes = vmalloc(total + 1);
+	if (len == NULL || bytes == NULL)
+		goto out;
+
+	/* decode the patterns and compute the byte classes */
+
+	for(i = 0, total = 0; i < n; total += len[i++])
+	{
+		int j;
+
+		len[i] = aho_decode(patterns[i], bytes + total);
+		if (len[i] <= 0) {
+			err = -EINVAL;
+			goto out;
+		}
+
+		for(j = 0; j < len[i]; j++)
+			used[bytes[total + j]] = 1;
+	}
+
+	for(c = 0, nc = 1; c < 256; c++)
+		nc += used[c];
+
+	ac = vzalloc(sizeof(*ac) + (total + 1) * (nc + 1) * sizeof(uint16_t));
+	queue = vmalloc((total + 1) * sizeof(uint16_t));
+	fail = vmalloc((total + 1) * sizeof(uint16_t));
+	if (ac == NULL || queue == NULL || fail == NULL)
+		goto out;
+
+	for(c = 0, nc = 1; c < 256; c++)
+		ac->class[c] = used[c] ? (uint8_t)nc++ : 0;
+
+	ac->nclasses = (uint32_t)nc;
+	ac->out = ac->delta + (total + 1) * nc;
+
+	/* trie of the patterns (0 is the root: no transition leads back to it yet) */
+
+	for(i = 0, total = 0, nstates = 1; i < n; total += len[i++])
+	{
+		int j;
+
+		for(s = 0, j = 0; j < len[i]; j++)
+		{
+			uint16_t *next = &ac->delta[s * nc + ac->class[bytes[total + j]]];
+			if (*next == 0)
+				*next = (uint16_t)nstates++;
+			s = *next;
+		}
+
+		if (ac->out[s] == 0)
+			ac->out[s] = (uint16_t)(i + 1);
+	}
+
+	ac->nstates = nstates;
+
+	/* breadth-first: failure links and the missing transitions of the DFA */
+
+	head = tail = 0;
+
+	for(c = 0; c < nc; c++)
+	{
+		uint16_t child = ac->delta[c];
+		if (child) {
+			fail[child] = 0;
+			queue[tail++] = child;
+		}
+	}
+
+	while (head < tail)
+	{
+		s = queue[head++];
+
+		for(c = 0; c < nc; c++)
+		{
+			uint16_t *next = &ac->delta[s * nc + c];
+			uint16_t f = ac->delta[fail[s] * nc + c];
+
+			if (*next) {
+				fail[*next] = f;
+				if (ac->out[*next] == 0)
+					ac->out[*next] = ac->out[f];
+				queue[tail++] = *next;
+			}
+			else
+				*next = f;
+		}
+	}
+
+	*pac = ac;
+	ac = NULL;
+	err = 0;
+out:
+	vfree(fail);
+	vfree(queue);
+	vfree(ac);
+	vfree(bytes);
+	kfree(len);
+	return err;
+}
+
+
+static int payload_init(arguments_t args)
+{
+	const char **patterns = GET_ARRAY_0(const char *, args);
+	size_t n = LEN_ARRAY_0(args);
+	int offset = GET_ARG_1(int, args);
+	int depth  = GET_ARG_2(int, args);
+	struct pfq_aho *ac;
+	int err;
+
+	if (offset < 0 || depth < 0) {
+		printk(KERN_INFO "[PFQ|init] payload: invalid window (offset=%d depth=%d)!\n", offset, depth);
+		return -EINVAL;
+	}
+
+	err = aho_build(&ac, patterns, n);
+	if (err < 0) {
+		printk(KERN_INFO "[PFQ|init] payload: could not compile %zu patterns (%d)!\n", n, err);
+		return err;
+	}
+
+	SET_ARG_0(args, ac);
+
+	pr_devel("[PFQ|init] payload@%p: patterns=%zu states=%u classes=%u offset=%d depth=%d\n",
+		 ac, n, ac->nstates, ac->nclasses, offset, depth);
+	return 0;
+}
+
+
+static int payload_fini(arguments_t args)
+{
+	struct pfq_aho *ac = GET_ARG_0(struct pfq_aho *, args);
+
+	vfree(ac);
+	pr_devel("[PFQ|init] payload: memory freed@%p!\n", ac);
+
+	return 0;
+}
+
+
+struct pfq_lang_function_descr aho_functions[] = {
+
+	{"payload_match",	"[String] -> CInt -> CInt -> Qbuff -> Bool",		payload_match,		payload_init,	payload_fini},
+	{"payload_filter",	"[String] -> CInt -> CInt -> Qbuff -> Action Qbuff",	payload_filter,		payload_init,	payload_fini},
+	{"payload_id",		"[String] -> CInt -> CInt -> Qbuff -> Word64",		payload_id,		payload_init,	payload_fini},
+	{"payload_mark",	"[String] -> CInt -> CInt -> Qbuff -> Action Qbuff",	payload_mark,		payload_init,	payload_fini},
+	{"payload_state",	"[String] -> CInt -> CInt -> Qbuff -> Action Qbuff",	payload_state,		payload_init,	payload_fini},
+	{"steer_payload",	"[String] -> CInt -> CInt -> Qbuff -> Action Qbuff",	steering_payload,	payload_init,	payload_fini},
+	{ NULL }};
@@ -0,0 +1,71 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#ifndef PFQ_LANG_AHO_H
+#define PFQ_LANG_AHO_H
+
+#include <pfq/kcompat.h>
+
+
+/*
+ * Aho-Corasick automaton compiled into a DFA: one transition per (state, byte
+ * class), where the bytes not used by any pattern share the class 0. The
+ * state numbers fit 16 bits, which bounds the total length of the patterns.
+ */
+
+#define AHO_MAX_STATES		(1 << 16)
+
+
+struct pfq_aho
+{
+	uint32_t	nstates;
+	uint32_t	nclasses;
+	uint8_t		class[256];
+	uint16_t	*out;		/* id (1-based) of the pattern that ends in the state, 0 none */
+	uint16_t	delta[];	/* nstates x nclasses */
+};
+
+
+/* run the automaton over the bytes: return the id of the first pattern found */
+
+static inline uint16_t
+pfq_aho_run(struct pfq_aho const *ac, uint16_t *state, const uint8_t *p, int len)
+{
+	uint32_t s = *state;
+	int i;
+
+	for(i = 0; i < len; i++)
+	{
+		s = ac->delta[s * ac->nclasses + ac->class[p[i]]];
+		if (ac->out[s]) {
+			*state = (uint16_t)s;
+			return ac->out[s];
+		}
+	}
+
+	*state = (uint16_t)s;
+	return 0;
+}
+
+
+#endif /* PFQ_LANG_AHO_H */
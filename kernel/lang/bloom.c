@@ -32,24 +32,17 @@ bloom_src(arguments_t args, struct qbuff * buff)
 {
 	struct iphdr _iph;
 	const struct iphdr *ip;
-	uint32_t fold, addr;
+	struct pfq_bloom *bf;
 	__be32 mask;
-	char *mem;
 
 	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
 	if (ip == NULL)
 		return false;
 
-	fold = GET_ARG_0(uint32_t, args);
-	mem  = GET_ARG_1(char *,   args);
-	mask = GET_ARG_2(__be32,   args);
+	bf   = GET_ARG_0(struct pfq_bloom *, args);
+	mask = GET_ARG_2(__be32, args);
 
-	addr = be32_to_cpu(ip->saddr & mask);
-
-	return ( BF_TEST(mem, hfun1(addr) & fold) &&
-	         BF_TEST(mem, hfun2(addr) & fold) &&
-	         BF_TEST(mem, hfun3(addr) & fold) &&
-	         BF_TEST(mem, hfun4(addr) & fold) );
+	return bloom_test_addr(bf, ip->saddr & mask);
 }
 
 
@@ -58,24 +51,17 @@ bloom_dst(arguments_t args, struct qbuff * buff)
 {
 	struct iphdr _iph;
 	const struct iphdr *ip;
-	uint32_t fold, addr;
+	struct pfq_bloom *bf;
 	__be32 mask;
-	char *mem;
 
 	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
 	if (ip == NULL)
 		return false;
 
-	fold = GET_ARG_0(uint32_t, args);
-	mem  = GET_ARG_1(char *,   args);
-	mask = GET_ARG_2(__be32,   args);
-
-	addr = be32_to_cpu(ip->daddr & mask);
+	bf   = GET_ARG_0(struct pfq_bloom *, args);
+	mask = GET_ARG_2(__be32, args);
 
-	return ( BF_TEST(mem, hfun1(addr) & fold) &&
-	         BF_TEST(mem, hfun2(addr) & fold) &&
-	         BF_TEST(mem, hfun3(addr) & fold) &&
-	         BF_TEST(mem, hfun4(addr) & fold) );
+	return bloom_test_addr(bf, ip->daddr & mask);
 }
 
 static bool
@@ -83,39 +69,21 @@ bloom(arguments_t args, struct qbuff * buff)
 {
 	struct iphdr _iph;
 	const struct iphdr *ip;
-	uint32_t fold, addr;
+	struct pfq_bloom *bf;
 	__be32 mask;
-	char *mem;
 
 	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
 	if (ip == NULL)
 		return false;
 
-	fold = GET_ARG_0(uint32_t, args);
-	mem  = GET_ARG_1(char *,   args);
-	mask = GET_ARG_2(__be32,   args);
-
-	if (buff->monad->ep_ctx & EPOINT_DST)
-	{
-		addr = be32_to_cpu(ip->daddr & mask);
+	bf   = GET_ARG_0(struct pfq_bloom *, args);
+	mask = GET_ARG_2(__be32, args);
 
-		if ( BF_TEST(mem, hfun1(addr) & fold) &&
-		     BF_TEST(mem, hfun2(addr) & fold) &&
-		     BF_TEST(mem, hfun3(addr) & fold) &&
-		     BF_TEST(mem, hfun4(addr) & fold) )
-			return true;
-	}
-
-	if (buff->monad->ep_ctx & EPOINT_SRC)
-	{
-		addr = be32_to_cpu(ip->saddr & mask);
+	if ((buff->monad->ep_ctx & EPOINT_DST) && bloom_test_addr(bf, ip->daddr & mask))
+		return true;
 
-		if ( BF_TEST(mem, hfun1(addr) & fold) &&
-		     BF_TEST(mem, hfun2(addr) & fold) &&
-		     BF_TEST(mem, hfun3(addr) & fold) &&
-		     BF_TEST(mem, hfun4(addr) & fold) )
-			return true;
-	}
+	if ((buff->monad->ep_ctx & EPOINT_SRC) && bloom_test_addr(bf, ip->saddr & mask))
+		return true;
 
 	return false;
 }
@@ -147,36 +115,35 @@ bloom_dst_filter(arguments_t args, struct qbuff * buff)
 }
 
 
+/* m bits (rounded up to cache line blocks), k = m/n ln2 up to Q_BLOOM_LANG_MAX_K:
+ * the probes beyond cost more on the Rx path than the false positives they save */
+
 static int bloom_init(arguments_t args)
 {
 	unsigned int m = GET_ARG_0(unsigned int, args);
 	size_t n = LEN_ARRAY_1(args);
 	__be32 *ips = GET_ARRAY_1(__be32, args);
+	struct pfq_bloom *bf;
 	__be32 mask;
+	u32 k;
 	size_t i;
 
-	char *mem;
-
-	m = clp2(m);
-
-	/* set bloom filter fold mask */
-
-	SET_ARG_0(args, m-1);
-
 	if (m > (1UL << 24)) {
 		printk(KERN_INFO "[PFQ|init] bloom filter: maximum number of bins exceeded (2^24)!\n");
 		return -EPERM;
 	}
 
-	mem = kzalloc(m >> 3, GFP_KERNEL);
-	if (!mem) {
+	k = n ? clamp_t(u32, (u32)(((u64)m * 45426 / n + (1 << 15)) >> 16), 1, Q_BLOOM_LANG_MAX_K) : 1;
+
+	bf = pfq_bloom_create(max_t(u32, DIV_ROUND_UP(m, Q_BLOOM_BLOCK_BITS), 1), k, (u32)n);
+	if (!bf) {
 		printk(KERN_INFO "[PFQ|init] bloom filter: out of memory!\n");
 		return -ENOMEM;
 	}
 
-	/* set bloom filter memory */
+	/* set bloom filter */
 
-	SET_ARG_1(args, mem);
+	SET_ARG_0(args, bf);
 
 	mask = inet_make_mask(GET_ARG_2(int, args));
 
@@ -184,19 +151,13 @@ static int bloom_init(arguments_t args)
 
 	SET_ARG_2(args, mask);
 
-	pr_devel("[PFQ|init] bloom filter@%p: k=4, n=%zu, m=%u size=%u netmask=%pI4 bytes.\n", mem, n, m, m>>3, &mask);
+	pr_devel("[PFQ|init] bloom filter@%p: k=%u, n=%zu, blocks=%u netmask=%pI4.\n", bf, k, n, bf->nblocks, &mask);
 
 	for(i = 0; i < n; i++)
 	{
-		uint32_t h1 = hfun1(be32_to_cpu(ips[i] & mask)) & (m-1);
-		uint32_t h2 = hfun2(be32_to_cpu(ips[i] & mask)) & (m-1);
-		uint32_t h3 = hfun3(be32_to_cpu(ips[i] & mask)) & (m-1);
-		uint32_t h4 = hfun4(be32_to_cpu(ips[i] & mask)) & (m-1);
+		__be32 addr = ips[i] & mask;
 
-		BF_SET(mem, h1);
-		BF_SET(mem, h2);
-		BF_SET(mem, h3);
-		BF_SET(mem, h4);
+		pfq_bloom_add(bf, pfq_bloom_hash(&addr, sizeof(addr), 0), 0);
 
 		pr_devel("[PFQ|init] bloom filter: -> set address %pI4\n", ips+i);
 	}
@@ -207,10 +168,10 @@ static int bloom_init(arguments_t args)
 
 static int bloom_fini(arguments_t args)
 {
-	char *mem = GET_ARG_1(char *, args);
+	struct pfq_bloom *bf = GET_ARG_0(struct pfq_bloom *, args);
 
-	kfree(mem);
-	pr_devel("[PFQ|init] bloom filter: memory freed@%p!\n", mem);
+	pfq_bloom_destroy(bf);
+	pr_devel("[PFQ|init] bloom filter: memory freed@%p!\n", bf);
 
 	return 0;
 }
@@ -27,60 +27,13 @@
 
 #include <lang/module.h>
 
+#include <pfq/bloom.h>
 
-/* macros to test/set bits in bitwise array */
 
-
-#define BF_TEST(mem, x)  (mem[(x) >> 3] &  (char)(1<<((x) & 7)))
-#define BF_SET(mem, x)   (mem[(x) >> 3] |= (char)(1<<((x) & 7)))
-
-#define A(value)   (((value) & 0xff000000) >> 24)
-#define B(value)   (((value) & 0x00ff0000) >> 16)
-#define C(value)   (((value) & 0x0000ff00) >>  8)
-#define D(value)   ( (value) & 0x000000ff)
-
-
-static inline uint32_t mix(uint32_t a, uint32_t b, uint32_t c)
-{
-	return ((a ^ b ^ c) & 0xff) | ((b ^ c) & 0xff) << 8 | ((c) & 0xff) << 16;
-}
-
-
-static inline uint32_t hfun1(uint32_t value)
-{
-	return mix(A(value), B(value), C(value));
-}
-
-static inline uint32_t hfun2(uint32_t value)
-{
-	return mix(A(value), B(value), D(value));
-}
-
-static inline uint32_t hfun3(uint32_t value)
-{
-	return mix(A(value), C(value), D(value));
-}
-
-static inline uint32_t hfun4(uint32_t value)
-{
-	return mix(B(value), C(value), D(value));
-}
-
-/*
- * Find the next power of two.
- * from "Hacker's Delight, Henry S. Warren."
- */
-
-static inline
-unsigned clp2(unsigned int x)
+static inline bool
+bloom_test_addr(struct pfq_bloom const *bf, __be32 addr)
 {
-        x = x - 1;
-        x = x | (x >> 1);
-        x = x | (x >> 2);
-        x = x | (x >> 4);
-        x = x | (x >> 8);
-        x = x | (x >> 16);
-        return x + 1;
+	return pfq_bloom_test(bf, pfq_bloom_hash(&addr, sizeof(addr), 0), 0);
 }
 
 
@@ -73,14 +73,10 @@ shift(arguments_t args, struct qbuff * b)
 	ActionQbuff ret;
 
 	b->monad->shift++;
-	b->monad->ipoff = 0;
-	b->monad->ipproto = IPPROTO_NONE;
 
 	ret = EVAL_FUNCTION(fun_, b);
 
 	b->monad->shift--;
-	b->monad->ipoff = 0;
-	b->monad->ipproto = IPPROTO_NONE;
 
 	return ret;
 }
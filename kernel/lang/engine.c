@@ -22,6 +22,7 @@
  ****************************************************************/
 
 #include <lang/engine.h>
+#include <lang/exec.h>
 #include <lang/headers.h>
 #include <lang/symtable.h>
 #include <lang/signature.h>
@@ -30,6 +31,9 @@
 #include <pfq/global.h>
 #include <pfq/printk.h>
 
+#include <linux/percpu.h>
+#include <linux/vmalloc.h>
+
 
 const char *
 pfq_lang_signature_by_user_symbol(const char __user *symb)
@@ -149,6 +153,11 @@ pfq_lang_bind(struct qbuff * buff, struct pfq_lang_functional_node *node)
 ActionQbuff
 pfq_lang_run(struct qbuff * buff, struct pfq_lang_computation_tree *prg)
 {
+	struct pfq_lang_exec const *exec = rcu_dereference(prg->exec);
+
+	if (likely(exec) && !pfq_lang_prof_enabled())
+		return pfq_lang_exec_run(buff, exec);
+
 	return pfq_lang_bind(buff, prg->entry_point);
 }
 
@@ -156,15 +165,33 @@ pfq_lang_run(struct qbuff * buff, struct pfq_lang_computation_tree *prg)
 struct pfq_lang_computation_tree *
 pfq_lang_computation_alloc (struct pfq_lang_computation_descr const *descr)
 {
-        struct pfq_lang_computation_tree * c = kzalloc(sizeof(size_t) + descr->size * sizeof(struct pfq_lang_functional_node),
+        struct pfq_lang_computation_tree * c = kzalloc(sizeof(struct pfq_lang_computation_tree) + descr->size * sizeof(struct pfq_lang_functional_node),
 						  GFP_KERNEL);
-	if (c)
-		c->size = descr->size;
+	if (c == NULL)
+		return NULL;
+
+	c->size = descr->size;
+	c->prof = __alloc_percpu(descr->size * sizeof(struct pfq_lang_prof), __alignof__(struct pfq_lang_prof));
+	if (c->prof == NULL) {
+		kfree(c);
+		return NULL;
+	}
 
         return c;
 }
 
 
+void
+pfq_lang_computation_free(struct pfq_lang_computation_tree *comp)
+{
+	if (comp == NULL)
+		return;
+
+	free_percpu(comp->prof);
+	kfree(comp);
+}
+
+
 void *
 pfq_lang_context_alloc(struct pfq_lang_computation_descr const *descr)
 {
@@ -190,7 +217,11 @@ pfq_lang_context_alloc(struct pfq_lang_computation_descr const *descr)
 		}
         }
 
-        ret = kmalloc(size, GFP_KERNEL);
+        /* large vectors (e.g. prefix lists) do not fit a kmalloc */
+
+        ret = kmalloc(size, GFP_KERNEL | __GFP_NOWARN);
+        if (ret == NULL)
+                ret = vmalloc(size);
         if (ret == NULL) {
                 printk(KERN_INFO "[PFQ] context_alloc: could not allocate %zu bytes!\n", size);
                 return NULL;
@@ -201,6 +232,16 @@ pfq_lang_context_alloc(struct pfq_lang_computation_descr const *descr)
 }
 
 
+void
+pfq_lang_context_free(void *context)
+{
+	if (is_vmalloc_addr(context))
+		vfree(context);
+	else
+		kfree(context);
+}
+
+
 size_t
 pfq_lang_number_of_arguments(struct pfq_lang_functional_descr const *fun)
 {
@@ -359,7 +400,7 @@ pfq_lang_check_computation_descr(struct pfq_lang_computation_descr const *descr)
 		{
 			string_view_t sarg = pfq_lang_signature_arg(make_string_view(signature), i);
 
-			if (fun->arg[i].nelem > 65536 &&
+			if (fun->arg[i].nelem > Q_FUN_MAX_ARRAY_LEN &&
 			    fun->arg[i].nelem != -1) {
 				printk(KERN_INFO "[PFQ] function[%zu]: invalid argument(%d): number of array elements is %zu!\n",
 				       n, i, fun->arg[i].nelem);
@@ -395,8 +436,8 @@ pfq_lang_check_computation_descr(struct pfq_lang_computation_descr const *descr)
 
 
 static void *
-resolve_user_symbol(struct symtable *table, const char __user *symb, const char **signature,
-		    init_ptr_t *init, fini_ptr_t *fini)
+resolve_user_symbol(struct symtable *table, const char __user *symb, const char **name,
+		    const char **signature, init_ptr_t *init, fini_ptr_t *fini)
 {
 	struct symtable_entry *entry;
         char *symbol;
@@ -413,6 +454,7 @@ resolve_user_symbol(struct symtable *table, const char __user *symb, const char
                 return NULL;
         }
 
+        *name = entry->symbol;
         *signature = entry->signature;
 	*init = entry->init;
 	*fini = entry->fini;
@@ -423,11 +465,13 @@ resolve_user_symbol(struct symtable *table, const char __user *symb, const char
 
 
 int
-pfq_lang_computation_init(struct pfq_lang_computation_tree *comp)
+pfq_lang_computation_init(struct pfq_lang_computation_tree *comp, pfq_id_t owner)
 {
 	size_t n;
 	for (n = 0; n < comp->size; n++)
 	{
+		comp->node[n].owner = owner;
+
 		if (comp->node[n].init) {
 
 			pr_devel("[PFQ] %zu: initializing computation %pF...\n", n, comp->node[n].init);
@@ -459,6 +503,11 @@ pfq_lang_computation_destruct(struct pfq_lang_computation_tree *comp)
 			}
 		}
 	}
+
+	/* the computation is no longer running */
+
+	kfree(rcu_dereference_protected(comp->exec, 1));
+	RCU_INIT_POINTER(comp->exec, NULL);
 	return 0;
 }
 
@@ -497,14 +546,14 @@ pfq_lang_computation_rtlink(struct pfq_lang_computation_descr const *descr, stru
         {
 		struct pfq_lang_functional_descr const *fun;
 		struct pfq_lang_functional_node *next;
-		const char *signature;
+		const char *signature, *symbol;
 		init_ptr_t init, fini;
 		void *addr;
                 size_t i;
 
                 fun = &descr->fun[n];
 
-		addr = resolve_user_symbol(&global->functions, fun->symbol, &signature, &init, &fini);
+		addr = resolve_user_symbol(&global->functions, fun->symbol, &symbol, &signature, &init, &fini);
 		if (addr == NULL) {
 			printk(KERN_INFO "[PFQ] %zu: rtlink: bad descriptor!\n", n);
 			return -EPERM;
@@ -515,6 +564,9 @@ pfq_lang_computation_rtlink(struct pfq_lang_computation_descr const *descr, stru
 		comp->node[n].init = init;
 		comp->node[n].fini = fini;
 
+		comp->node[n].symbol = symbol;
+		comp->node[n].prof   = comp->prof + n;
+
 		comp->node[n].fun.run  = addr;
                 comp->node[n].fun.next = next ? &next->fun : NULL;
 
@@ -66,11 +66,13 @@ extern int pfq_lang_computation_rtlink(struct pfq_lang_computation_descr const *
 				  struct pfq_lang_computation_tree *comp,
 				  void *context);
 
-extern int pfq_lang_computation_init(struct pfq_lang_computation_tree *comp);
+extern int pfq_lang_computation_init(struct pfq_lang_computation_tree *comp, pfq_id_t owner);
 extern int pfq_lang_computation_destruct(struct pfq_lang_computation_tree *comp);
 
 extern struct pfq_lang_computation_tree * pfq_lang_computation_alloc(struct pfq_lang_computation_descr const *);
+extern void pfq_lang_computation_free(struct pfq_lang_computation_tree *comp);
 extern void * pfq_lang_context_alloc(struct pfq_lang_computation_descr const *);
+extern void pfq_lang_context_free(void *context);
 extern const char *pfq_lang_signature_by_user_symbol(const char __user *symb);
 extern size_t pfq_lang_number_of_arguments(struct pfq_lang_functional_descr const *fun);
 
@@ -0,0 +1,820 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <lang/engine.h>
+#include <lang/exec.h>
+#include <lang/filter.h>
+#include <lang/forward.h>
+#include <lang/module.h>
+#include <lang/steering.h>
+#include <lang/types.h>
+
+#include <pfq/global.h>
+#include <pfq/printk.h>
+#include <pfq/qbuff.h>
+#include <pfq/sparse.h>
+
+#include <linux/pf_q.h>
+#include <linux/slab.h>
+#include <linux/err.h>
+#include <linux/rcupdate.h>
+
+
+/* operands of the fused filters (Q_OP_TEST) */
+
+static inline bool
+exec_test(int op, struct pfq_lang_functional *fun, struct qbuff *buff)
+{
+	switch(op)
+	{
+	case Q_OP_UNIT:		return true;
+	case Q_OP_IP:		return is_ip(buff);
+	case Q_OP_UDP:		return is_udp(buff);
+	case Q_OP_TCP:		return is_tcp(buff);
+	case Q_OP_ICMP:		return is_icmp(buff);
+	case Q_OP_FLOW:		return is_flow(buff);
+	case Q_OP_VLAN:		return has_vlan(buff);
+
+	case Q_OP_PORT:		return has_port(buff, GET_ARG_0(uint16_t, fun));
+	case Q_OP_SRC_PORT:	return has_src_port(buff, GET_ARG_0(uint16_t, fun));
+	case Q_OP_DST_PORT:	return has_dst_port(buff, GET_ARG_0(uint16_t, fun));
+
+	case Q_OP_ADDR:		return has_addr(buff, GET_PTR_0(struct CIDR_, fun)->addr, GET_PTR_0(struct CIDR_, fun)->mask);
+	case Q_OP_SRC_ADDR:	return has_src_addr(buff, GET_PTR_0(struct CIDR_, fun)->addr, GET_PTR_0(struct CIDR_, fun)->mask);
+	case Q_OP_DST_ADDR:	return has_dst_addr(buff, GET_PTR_0(struct CIDR_, fun)->addr, GET_PTR_0(struct CIDR_, fun)->mask);
+
+	case Q_OP_L4_PROTO:	return is_l4_proto(buff, GET_ARG_0(uint8_t, fun));
+	case Q_OP_FILTER:	return EVAL_PREDICATE(GET_ARG_0(predicate_t, fun), buff);
+	}
+
+	return false;
+}
+
+
+static inline bool
+exec_test_all(struct pfq_lang_instr const *pc, struct qbuff *buff)
+{
+	struct pfq_lang_instr const *t = pc + 1, *end = pc + 1 + pc->jump;
+
+	for(; t != end; t++)
+	{
+		if (!exec_test(t->op, t->fun, buff))
+			return false;
+	}
+
+	return true;
+}
+
+
+/* run each instruction over the packets that reach it */
+
+#define EXEC_BATCH(call) \
+	for_each_qbuff_with_mask(sel, queue, buff, n) \
+	{ \
+		buff = (call).qbuff; \
+		if (buff == NULL) \
+			continue; \
+		if (is_drop(buff->monad->fanout)) \
+			pass |= (unsigned __int128)1 << n; \
+		else \
+			next |= (unsigned __int128)1 << n; \
+	}
+
+
+unsigned __int128
+pfq_lang_exec_run_batch(struct pfq_qbuff_queue *queue, unsigned __int128 mask,
+			struct pfq_lang_exec const *exec, unsigned __int128 *pending)
+{
+	unsigned __int128 pass = 0;
+	struct qbuff *buff;
+	unsigned int n;
+	size_t i;
+
+	memset(pending, 0, exec->len * sizeof(unsigned __int128));
+	pending[0] = mask;
+
+	for(i = 0; i < exec->len; i++)
+	{
+		struct pfq_lang_instr const *pc = &exec->instr[i];
+		unsigned __int128 sel = pending[i], next = 0;
+
+		if (!sel)
+			continue;
+
+		switch(pc->op)
+		{
+		case Q_OP_END:		pass |= sel; continue;
+		case Q_OP_JUMP:		pending[pc->jump] |= sel; continue;
+
+		case Q_OP_WHEN:
+		case Q_OP_UNLESS: {
+			unsigned __int128 skip = 0;
+			for_each_qbuff_with_mask(sel, queue, buff, n)
+			{
+				if (EVAL_PREDICATE(GET_ARG_0(predicate_t, pc->fun), buff) == (pc->op == Q_OP_WHEN))
+					next |= (unsigned __int128)1 << n;
+				else
+					skip |= (unsigned __int128)1 << n;
+			}
+			pending[pc->jump] |= skip;
+			pending[i+1] |= next;
+		} continue;
+
+		case Q_OP_UNIT:		EXEC_BATCH(unit(pc->fun, buff)); break;
+		case Q_OP_IP:		EXEC_BATCH(filter_ip(pc->fun, buff)); break;
+		case Q_OP_UDP:		EXEC_BATCH(filter_udp(pc->fun, buff)); break;
+		case Q_OP_TCP:		EXEC_BATCH(filter_tcp(pc->fun, buff)); break;
+		case Q_OP_ICMP:		EXEC_BATCH(filter_icmp(pc->fun, buff)); break;
+		case Q_OP_FLOW:		EXEC_BATCH(filter_flow(pc->fun, buff)); break;
+		case Q_OP_VLAN:		EXEC_BATCH(filter_vlan(pc->fun, buff)); break;
+
+		case Q_OP_DROP:		EXEC_BATCH(forward_drop(pc->fun, buff)); break;
+		case Q_OP_BROADCAST:	EXEC_BATCH(forward_broadcast(pc->fun, buff)); break;
+		case Q_OP_KERNEL:	EXEC_BATCH(forward_kernel(pc->fun, buff)); break;
+		case Q_OP_DETOUR:	EXEC_BATCH(detour_kernel(pc->fun, buff)); break;
+		case Q_OP_CLASSIFY:	EXEC_BATCH(forward_class(pc->fun, buff)); break;
+
+		case Q_OP_STEER_RSS:	EXEC_BATCH(steering_rss(pc->fun, buff)); break;
+		case Q_OP_STEER_FLOW:	EXEC_BATCH(steering_flow(pc->fun, buff)); break;
+
+		case Q_OP_TEST: {
+			for_each_qbuff_with_mask(sel, queue, buff, n)
+			{
+				if (exec_test_all(pc, buff))
+					next |= (unsigned __int128)1 << n;
+				else {
+					Drop(buff);
+					pass |= (unsigned __int128)1 << n;
+				}
+			}
+			pending[i + 1 + pc->jump] |= next;
+		} continue;
+
+		case Q_OP_CALL:
+		default:		EXEC_BATCH(((function_ptr_t)pc->fun->run)(pc->fun, buff)); break;
+		}
+
+		pending[i+1] |= next;
+	}
+
+	return pass;
+}
+
+#undef EXEC_BATCH
+
+
+#ifdef PFQ_LANG_BENCH
+#include <linux/if_ether.h>
+#include <linux/ip.h>
+#include <linux/udp.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/vmalloc.h>
+#endif
+
+
+static const struct
+{
+	const char *	symbol;
+	int		op;
+
+} exec_builtins[] =
+{
+	{ "unit",		Q_OP_UNIT	  },
+	{ "ip",			Q_OP_IP		  },
+	{ "udp",		Q_OP_UDP	  },
+	{ "tcp",		Q_OP_TCP	  },
+	{ "icmp",		Q_OP_ICMP	  },
+	{ "flow",		Q_OP_FLOW	  },
+	{ "vlan",		Q_OP_VLAN	  },
+	{ "drop",		Q_OP_DROP	  },
+	{ "broadcast",		Q_OP_BROADCAST	  },
+	{ "kernel",		Q_OP_KERNEL	  },
+	{ "detour",		Q_OP_DETOUR	  },
+	{ "classify",		Q_OP_CLASSIFY	  },
+	{ "steer_rss",		Q_OP_STEER_RSS	  },
+	{ "steer_flow",		Q_OP_STEER_FLOW	  },
+	{ "port",		Q_OP_PORT	  },
+	{ "src_port",		Q_OP_SRC_PORT	  },
+	{ "dst_port",		Q_OP_DST_PORT	  },
+	{ "addr",		Q_OP_ADDR	  },
+	{ "src_addr",		Q_OP_SRC_ADDR	  },
+	{ "dst_addr",		Q_OP_DST_ADDR	  },
+	{ "l4_proto",		Q_OP_L4_PROTO	  },
+	{ "filter",		Q_OP_FILTER	  },
+	{ "when",		Q_OP_WHEN	  },
+	{ "unless",		Q_OP_UNLESS	  },
+	{ "conditional",	Q_OP_CONDITIONAL  },
+	{ NULL,			Q_OP_CALL	  }
+};
+
+
+struct exec_builder
+{
+	struct pfq_lang_computation_tree *comp;
+	int const *			ops;
+	struct pfq_lang_instr *		code;
+	size_t				len;
+	size_t				calls;
+	size_t				tests;		/* filters removed by the optimizer */
+	bool				reorder;	/* reorder the filters by the profiling counters */
+};
+
+
+static int
+exec_opcode_by_symbol(const char *symbol)
+{
+	int n;
+
+	if (symbol == NULL)
+		return Q_OP_CALL;
+
+	for(n = 0; exec_builtins[n].symbol; n++)
+	{
+		if (strcmp(exec_builtins[n].symbol, symbol) == 0)
+			return exec_builtins[n].op;
+	}
+
+	return Q_OP_CALL;
+}
+
+
+/* filters: side-effect free, they commute with each other */
+
+static inline bool
+exec_is_test(int op)
+{
+	return (op >= Q_OP_UNIT && op <= Q_OP_VLAN) ||
+	       (op >= Q_OP_PORT && op <= Q_OP_FILTER);
+}
+
+
+/* transport protocols admitted by a filter (bit 0: UDP, 1: TCP, 2: ICMP) */
+
+static inline unsigned int
+exec_test_l4(int op)
+{
+	switch(op)
+	{
+	case Q_OP_UDP:	return 1;
+	case Q_OP_TCP:	return 2;
+	case Q_OP_ICMP:	return 4;
+	case Q_OP_FLOW:	return 1|2;
+	}
+	return 7;
+}
+
+
+/* filters that succeed on IPv4 packets only */
+
+static inline bool
+exec_test_implies_ip(int op)
+{
+	return (op >= Q_OP_UDP  && op <= Q_OP_FLOW) ||
+	       (op >= Q_OP_PORT && op <= Q_OP_DST_ADDR);
+}
+
+
+static int
+exec_emit(struct exec_builder *b, int op, struct pfq_lang_functional *fun)
+{
+	if (b->len == Q_LANG_EXEC_MAX_INSTR)
+		return -ENOSPC;
+
+	b->code[b->len].op   = op;
+	b->code[b->len].jump = 0;
+	b->code[b->len].fun  = fun;
+
+	if (op == Q_OP_CALL)
+		b->calls++;
+
+	return (int)b->len++;
+}
+
+
+static inline int
+exec_op(struct exec_builder *b, struct pfq_lang_functional *fun)
+{
+	return b->ops[container_of(fun, struct pfq_lang_functional_node, fun) - b->comp->node];
+}
+
+
+/* rank of a filter: cycles per drop (lower first), from the profiling counters */
+
+static bool
+exec_test_rank(struct pfq_lang_functional *fun, uint64_t *cost, uint64_t *drop)
+{
+	struct pfq_lang_functional_node *node = container_of(fun, struct pfq_lang_functional_node, fun);
+	long invoke  = sparse_read(node->prof, invoke);
+	long samples = sparse_read(node->prof, samples);
+
+	if (invoke <= 0 || samples <= 0)
+		return false;
+
+	*cost = (uint64_t)sparse_read(node->prof, cycles) / (uint64_t)samples;
+	*drop = (uint64_t)sparse_read(node->prof, drop) * 1024 / (uint64_t)invoke;
+	return true;
+}
+
+
+static void
+exec_reorder_tests(struct pfq_lang_functional **run, int *ops, size_t len)
+{
+	uint64_t cost[Q_LANG_EXEC_MAX_TEST], drop[Q_LANG_EXEC_MAX_TEST];
+	size_t i, j;
+
+	for(i = 0; i < len; i++)
+	{
+		if (!exec_test_rank(run[i], &cost[i], &drop[i]))
+			return;
+	}
+
+	/* cost_i/drop_i < cost_j/drop_j: the selective and cheap checks first (insertion sort) */
+
+	for(i = 1; i < len; i++)
+	{
+		struct pfq_lang_functional *f = run[i];
+		uint64_t c = cost[i], d = drop[i];
+		int op = ops[i];
+
+		for(j = i; j > 0 && c * drop[j-1] < cost[j-1] * d; j--)
+		{
+			run[j] = run[j-1]; ops[j] = ops[j-1]; cost[j] = cost[j-1]; drop[j] = drop[j-1];
+		}
+
+		run[j] = f; ops[j] = op; cost[j] = c; drop[j] = d;
+	}
+}
+
+
+/*
+ * A run of adjacent filters: drop unit, duplicates and implied checks (e.g. ip >-> udp),
+ * then emit the remaining ones as a single compound check. The run ends at *fun.
+ */
+
+static int
+exec_emit_tests(struct exec_builder *b, struct pfq_lang_functional **fun)
+{
+	struct pfq_lang_functional *run[Q_LANG_EXEC_MAX_TEST], *f = *fun;
+	int ops[Q_LANG_EXEC_MAX_TEST];
+	unsigned int l4 = 7, flow = 0;
+	bool ip = false;
+	size_t n, i, len = 0, total = 0;
+	int rc, op;
+
+	for(; f && len < Q_LANG_EXEC_MAX_TEST && exec_is_test(op = exec_op(b, f)); f = f->next)
+	{
+		*fun = f;
+		total++;
+
+		l4 &= exec_test_l4(op);
+		ip |= exec_test_implies_ip(op);
+		flow |= (op == Q_OP_UDP || op == Q_OP_TCP);
+
+		if (op == Q_OP_UNIT)
+			continue;
+
+		for(i = 0; i < len; i++)
+		{
+			if (ops[i] == op && run[i]->arg[0].value == f->arg[0].value &&
+					    run[i]->arg[0].nelem == f->arg[0].nelem)
+				break;
+		}
+
+		if (i == len) {
+			run[len] = f;
+			ops[len++] = op;
+		}
+	}
+
+	/* the transport protocols admitted are disjoint: the run always drops */
+
+	if (l4 == 0) {
+		b->tests += total - 1;
+		return exec_emit(b, Q_OP_DROP, run[0]);
+	}
+
+	for(n = 0, i = 0; i < len; i++)
+	{
+		if ((ops[i] == Q_OP_IP && ip) || (ops[i] == Q_OP_FLOW && flow))
+			continue;
+		run[n] = run[i];
+		ops[n++] = ops[i];
+	}
+
+	b->tests += total - n;
+
+	if (n == 0)
+		return 0;
+
+	if (b->reorder)
+		exec_reorder_tests(run, ops, n);
+
+	if (n == 1 && ops[0] < Q_OP_TEST)
+		return exec_emit(b, ops[0], run[0]);
+
+	if ((rc = exec_emit(b, Q_OP_TEST, NULL)) < 0)
+		return rc;
+
+	b->code[rc].jump = (int)n;
+
+	for(i = 0; i < n; i++)
+	{
+		int k = exec_emit(b, ops[i], run[i]);
+		if (k < 0)
+			return k;
+	}
+
+	return 0;
+}
+
+
+static int
+exec_emit_chain(struct exec_builder *b, struct pfq_lang_functional *fun, int depth)
+{
+	if (depth > Q_LANG_EXEC_MAX_DEPTH)
+		return -ELOOP;
+
+	for(; fun; fun = fun->next)
+	{
+		struct pfq_lang_functional_node *node = container_of(fun, struct pfq_lang_functional_node, fun);
+		int op = b->ops[node - b->comp->node];
+		int i, j, rc;
+
+		switch(op)
+		{
+		case Q_OP_WHEN:
+		case Q_OP_UNLESS: {
+
+			if ((i = exec_emit(b, op, fun)) < 0)
+				return i;
+			if ((rc = exec_emit_chain(b, GET_ARG_1(function_t, fun).fun, depth + 1)) < 0)
+				return rc;
+
+			b->code[i].jump = (int)b->len;
+
+		} break;
+		case Q_OP_CONDITIONAL: {
+
+			if ((i = exec_emit(b, Q_OP_WHEN, fun)) < 0)
+				return i;
+			if ((rc = exec_emit_chain(b, GET_ARG_1(function_t, fun).fun, depth + 1)) < 0)
+				return rc;
+			if ((j = exec_emit(b, Q_OP_JUMP, NULL)) < 0)
+				return j;
+
+			b->code[i].jump = (int)b->len;
+
+			if ((rc = exec_emit_chain(b, GET_ARG_2(function_t, fun).fun, depth + 1)) < 0)
+				return rc;
+
+			b->code[j].jump = (int)b->len;
+
+		} break;
+		default: {
+			if (exec_is_test(op)) {
+				if ((rc = exec_emit_tests(b, &fun)) < 0)
+					return rc;
+				break;
+			}
+
+			if ((i = exec_emit(b, op, fun)) < 0)
+				return i;
+		}
+		}
+	}
+
+	return 0;
+}
+
+
+static struct pfq_lang_exec *
+exec_build(struct pfq_lang_computation_tree *comp, bool reorder)
+{
+	struct pfq_lang_exec *exec = NULL;
+	struct exec_builder b;
+	int *ops, rc = 0;
+	size_t n;
+
+	ops = kmalloc(comp->size * sizeof(int), GFP_KERNEL);
+	b.code = kmalloc(Q_LANG_EXEC_MAX_INSTR * sizeof(struct pfq_lang_instr), GFP_KERNEL);
+	if (!ops || !b.code) {
+		rc = -ENOMEM;
+		goto done;
+	}
+
+	for(n = 0; n < comp->size; n++)
+		ops[n] = exec_opcode_by_symbol(comp->node[n].symbol);
+
+	b.comp    = comp;
+	b.ops     = ops;
+	b.len     = 0;
+	b.calls   = 0;
+	b.tests   = 0;
+	b.reorder = reorder;
+
+	rc = exec_emit_chain(&b, &comp->entry_point->fun, 0);
+	if (rc >= 0)
+		rc = exec_emit(&b, Q_OP_END, NULL);
+	if (rc < 0)
+		goto done;
+
+	exec = kmalloc(sizeof(struct pfq_lang_exec) + b.len * sizeof(struct pfq_lang_instr), GFP_KERNEL);
+	if (!exec) {
+		rc = -ENOMEM;
+		goto done;
+	}
+
+	exec->len = b.len;
+	memcpy(exec->instr, b.code, b.len * sizeof(struct pfq_lang_instr));
+
+	pr_devel("[PFQ] exec_compile: %zu instructions (%zu indirect calls, %zu filters removed)\n", b.len, b.calls, b.tests);
+done:
+	if (rc < 0)
+		printk(KERN_INFO "[PFQ] exec_compile: computation not flattened (%d), tree walking engine in use.\n", rc);
+	kfree(b.code);
+	kfree(ops);
+	return rc < 0 ? ERR_PTR(rc) : exec;
+}
+
+
+/*
+ * Prerequisite: linked computation (pfq_lang_computation_rtlink), not yet running.
+ * On failure the computation is left to the tree walking engine.
+ */
+
+int
+pfq_lang_exec_compile(struct pfq_lang_computation_tree *comp, bool reorder)
+{
+	struct pfq_lang_exec *exec = exec_build(comp, reorder);
+
+	if (IS_ERR(exec))
+		return (int)PTR_ERR(exec);
+
+	kfree(rcu_dereference_protected(comp->exec, 1));
+	RCU_INIT_POINTER(comp->exec, exec);
+	return 0;
+}
+
+
+/*
+ * Recompile a running computation, reordering the filters by the profiling
+ * counters collected so far. The caller guarantees the computation is alive
+ * (groups lock held).
+ */
+
+int
+pfq_lang_exec_optimize(struct pfq_lang_computation_tree *comp)
+{
+	struct pfq_lang_exec *exec = exec_build(comp, true), *old;
+
+	if (IS_ERR(exec))
+		return (int)PTR_ERR(exec);
+
+	old = rcu_replace_pointer(comp->exec, exec, lockdep_is_held(&global->groups_lock));
+
+	synchronize_rcu();   /* wait for the readers of the old program */
+
+	kfree(old);
+	return 0;
+}
+
+
+ActionQbuff
+pfq_lang_exec_run(struct qbuff *buff, struct pfq_lang_exec const *exec)
+{
+	struct pfq_lang_instr const *pc = exec->instr;
+	ActionQbuff a;
+
+	for(;;)
+	{
+		switch(pc->op)
+		{
+		case Q_OP_END:		return Pass(buff);
+		case Q_OP_JUMP:		pc = exec->instr + pc->jump; continue;
+
+		case Q_OP_WHEN:		pc = EVAL_PREDICATE(GET_ARG_0(predicate_t, pc->fun), buff) ? pc + 1 : exec->instr + pc->jump;
+					continue;
+		case Q_OP_UNLESS:	pc = EVAL_PREDICATE(GET_ARG_0(predicate_t, pc->fun), buff) ? exec->instr + pc->jump : pc + 1;
+					continue;
+
+		case Q_OP_UNIT:		a = unit(pc->fun, buff); break;
+		case Q_OP_IP:		a = filter_ip(pc->fun, buff); break;
+		case Q_OP_UDP:		a = filter_udp(pc->fun, buff); break;
+		case Q_OP_TCP:		a = filter_tcp(pc->fun, buff); break;
+		case Q_OP_ICMP:		a = filter_icmp(pc->fun, buff); break;
+		case Q_OP_FLOW:		a = filter_flow(pc->fun, buff); break;
+		case Q_OP_VLAN:		a = filter_vlan(pc->fun, buff); break;
+
+		case Q_OP_DROP:		a = forward_drop(pc->fun, buff); break;
+		case Q_OP_BROADCAST:	a = forward_broadcast(pc->fun, buff); break;
+		case Q_OP_KERNEL:	a = forward_kernel(pc->fun, buff); break;
+		case Q_OP_DETOUR:	a = detour_kernel(pc->fun, buff); break;
+		case Q_OP_CLASSIFY:	a = forward_class(pc->fun, buff); break;
+
+		case Q_OP_STEER_RSS:	a = steering_rss(pc->fun, buff); break;
+		case Q_OP_STEER_FLOW:	a = steering_flow(pc->fun, buff); break;
+
+		case Q_OP_TEST:		if (!exec_test_all(pc, buff))
+						return Pass(Drop(buff).qbuff);
+					pc += 1 + pc->jump;
+					continue;
+
+		case Q_OP_CALL:
+		default:		a = ((function_ptr_t)pc->fun->run)(pc->fun, buff); break;
+		}
+
+		buff = a.qbuff;
+		if (buff == NULL || is_drop(buff->monad->fanout))
+			return Pass(buff);
+
+		pc++;
+	}
+}
+
+
+#ifdef PFQ_LANG_BENCH
+
+#define Q_LANG_BENCH_LOOP	1000000
+
+static struct sk_buff *
+exec_bench_skb(void)
+{
+	struct sk_buff *skb;
+	struct ethhdr *eth;
+	struct iphdr *ip;
+	struct udphdr *udp;
+
+	skb = alloc_skb(128, GFP_KERNEL);
+	if (!skb)
+		return NULL;
+
+	eth = (struct ethhdr *)skb_put(skb, sizeof(struct ethhdr));
+	ip  = (struct iphdr  *)skb_put(skb, sizeof(struct iphdr));
+	udp = (struct udphdr *)skb_put(skb, sizeof(struct udphdr));
+
+	memset(skb->data, 0, skb->len);
+
+	eth->h_proto = htons(ETH_P_IP);
+
+	ip->version  = 4;
+	ip->ihl	     = 5;
+	ip->ttl	     = 64;
+	ip->protocol = IPPROTO_UDP;
+	ip->tot_len  = htons(sizeof(struct iphdr) + sizeof(struct udphdr));
+	ip->saddr    = htonl(0x0a000001);
+	ip->daddr    = htonl(0x0a000002);
+
+	udp->source  = htons(1024);
+	udp->dest    = htons(80);
+	udp->len     = htons(sizeof(struct udphdr));
+
+	skb->protocol = htons(ETH_P_IP);
+	skb_reset_mac_header(skb);
+	skb_set_network_header(skb, ETH_HLEN);
+	skb->mac_len = ETH_HLEN;
+	return skb;
+}
+
+
+static uint64_t
+exec_bench_loop(struct pfq_lang_computation_tree *comp, struct sk_buff *skb)
+{
+	struct pfq_lang_monad monad;
+	struct qbuff buff;
+	ktime_t start;
+	size_t n;
+
+	start = ktime_get();
+
+	for(n = 0; n < Q_LANG_BENCH_LOOP; n++)
+	{
+		qbuff_init(&buff, skb, &monad, n);
+
+		monad.fanout.class_mask = Q_CLASS_DEFAULT;
+		monad.fanout.type = fanout_copy;
+		monad.group = NULL;
+		monad.state = 0;
+		monad.shift = 0;
+		monad.ep_ctx = EPOINT_SRC | EPOINT_DST;
+		monad.prio = false;
+
+		pfq_lang_run(&buff, comp);
+	}
+
+	return div_u64((uint64_t)ktime_to_ns(ktime_sub(ktime_get(), start)) * 1000, Q_LANG_BENCH_LOOP);
+}
+
+
+static uint64_t
+exec_bench_batch(struct pfq_lang_computation_tree *comp, struct sk_buff *skb)
+{
+	struct pfq_lang_exec const *exec = rcu_dereference_protected(comp->exec, 1);
+	struct pfq_qbuff_batch_queue *queue;
+	struct pfq_lang_batch *batch;
+	uint64_t ret = 0;
+	ktime_t start;
+	size_t n, loop;
+
+	queue = vmalloc(sizeof(struct pfq_qbuff_batch_queue));
+	batch = vmalloc(sizeof(struct pfq_lang_batch));
+	if (!queue || !batch)
+		goto out;
+
+	queue->len = Q_BUFF_BATCH_LEN - 1;
+
+	local_bh_disable();
+
+	start = ktime_get();
+
+	for(loop = 0; loop < Q_LANG_BENCH_LOOP/queue->len; loop++)
+	{
+		for(n = 0; n < queue->len; n++)
+		{
+			struct pfq_lang_monad *monad = &batch->monad[n];
+
+			qbuff_init(&queue->queue[n], skb, monad, n);
+
+			monad->fanout.class_mask = Q_CLASS_DEFAULT;
+			monad->fanout.type = fanout_copy;
+			monad->group = NULL;
+			monad->state = 0;
+			monad->shift = 0;
+			monad->ep_ctx = EPOINT_SRC | EPOINT_DST;
+			monad->prio = false;
+		}
+
+		pfq_lang_exec_run_batch(PFQ_QBUFF_QUEUE(queue), ((unsigned __int128)1 << queue->len) - 1,
+					exec, batch->pending);
+	}
+
+	ret = div_u64((uint64_t)ktime_to_ns(ktime_sub(ktime_get(), start)) * 1000, loop * queue->len);
+
+	local_bh_enable();
+out:
+	vfree(batch);
+	vfree(queue);
+	return ret;
+}
+
+
+/* debug only: functions with side effects (counters, forwarders, log) run
+ * Q_LANG_BENCH_LOOP times on a synthetic UDP packet.
+ */
+
+void
+pfq_lang_exec_bench(struct pfq_lang_computation_tree *comp)
+{
+	struct pfq_lang_exec *exec = rcu_dereference_protected(comp->exec, 1);	/* not running yet */
+	uint64_t tree, flat = 0, batch = 0;
+	struct sk_buff *skb;
+
+	skb = exec_bench_skb();
+	if (!skb)
+		return;
+
+	local_bh_disable();
+
+	RCU_INIT_POINTER(comp->exec, NULL);
+	tree = exec_bench_loop(comp, skb);
+	RCU_INIT_POINTER(comp->exec, exec);
+
+	if (exec)
+		flat = exec_bench_loop(comp, skb);
+
+	local_bh_enable();
+
+	if (exec)
+		batch = exec_bench_batch(comp, skb);
+
+	printk(KERN_INFO "[PFQ] lang bench: tree walking %llu.%03llu ns/pkt, flattened %llu.%03llu ns/pkt (%zu instructions)\n",
+	       tree/1000, tree%1000, flat/1000, flat%1000, exec ? exec->len : 0);
+
+	if (batch)
+		printk(KERN_INFO "[PFQ] lang bench: batch %llu.%03llu ns/pkt (%llu Kpps per core)\n",
+		       batch/1000, batch%1000, div64_u64(1000000000ULL, batch));
+
+	kfree_skb(skb);
+}
+
+#endif
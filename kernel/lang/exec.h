@@ -0,0 +1,130 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#ifndef PFQ_LANG_EXEC_H
+#define PFQ_LANG_EXEC_H
+
+#include <lang/module.h>
+
+#define Q_LANG_EXEC_MAX_INSTR		256
+#define Q_LANG_EXEC_MAX_DEPTH		16
+#define Q_LANG_EXEC_MAX_TEST		16
+
+
+/* flattened pfq-lang program: kleisli chains and control combinators
+ * (when, unless, conditional) are laid out as a linear array of instructions;
+ * built-in functions are dispatched by opcode, the others are called through
+ * their function pointer (Q_OP_CALL).
+ *
+ * Runs of adjacent filters are optimized: redundant and implied checks are
+ * removed and the remaining ones are fused into a single compound check
+ * (Q_OP_TEST), whose operands are the next 'jump' instructions.
+ */
+
+enum pfq_lang_opcode
+{
+	Q_OP_END = 0,
+	Q_OP_CALL,
+	Q_OP_JUMP,
+	Q_OP_WHEN,
+	Q_OP_UNLESS,
+
+	Q_OP_UNIT,
+	Q_OP_IP,
+	Q_OP_UDP,
+	Q_OP_TCP,
+	Q_OP_ICMP,
+	Q_OP_FLOW,
+	Q_OP_VLAN,
+
+	Q_OP_DROP,
+	Q_OP_BROADCAST,
+	Q_OP_KERNEL,
+	Q_OP_DETOUR,
+	Q_OP_CLASSIFY,
+
+	Q_OP_STEER_RSS,
+	Q_OP_STEER_FLOW,
+
+	Q_OP_TEST,
+
+	Q_OP_PORT,		/* operands of Q_OP_TEST only */
+	Q_OP_SRC_PORT,
+	Q_OP_DST_PORT,
+	Q_OP_ADDR,
+	Q_OP_SRC_ADDR,
+	Q_OP_DST_ADDR,
+	Q_OP_L4_PROTO,
+	Q_OP_FILTER,
+
+	Q_OP_CONDITIONAL	/* compile time only: WHEN + JUMP */
+};
+
+
+struct pfq_lang_instr
+{
+	int				op;
+	int				jump;		/* target of JUMP, WHEN and UNLESS (operands of TEST) */
+	struct pfq_lang_functional *	fun;
+};
+
+
+struct pfq_lang_exec
+{
+	size_t			len;
+	struct pfq_lang_instr	instr[];
+};
+
+
+/* batch evaluation: per-cpu scratch data. Each instruction runs over the
+ * selection mask of the packets that reach it (jumps are forward only).
+ */
+
+struct pfq_lang_batch
+{
+	struct pfq_lang_monad	monad[Q_BUFF_BATCH_LEN];
+	unsigned long		group_mask[Q_BUFF_BATCH_LEN];
+	size_t			fwd_dev_num[Q_BUFF_BATCH_LEN];	/* before the computation (stats) */
+	bool			to_kernel[Q_BUFF_BATCH_LEN];
+	unsigned long		chain_mask[Q_BUFF_BATCH_LEN];	/* before the computation (stats) */
+	unsigned long		visited[Q_BUFF_BATCH_LEN];	/* groups that evaluated the packet */
+	unsigned __int128	pending[Q_LANG_EXEC_MAX_INSTR];
+};
+
+
+struct pfq_lang_computation_tree;
+struct pfq_qbuff_queue;
+
+extern int pfq_lang_exec_compile(struct pfq_lang_computation_tree *comp, bool reorder);
+extern int pfq_lang_exec_optimize(struct pfq_lang_computation_tree *comp);
+
+extern ActionQbuff pfq_lang_exec_run(struct qbuff *buff, struct pfq_lang_exec const *exec);
+
+extern unsigned __int128 pfq_lang_exec_run_batch(struct pfq_qbuff_queue *queue, unsigned __int128 mask,
+						 struct pfq_lang_exec const *exec, unsigned __int128 *pending);
+
+#ifdef PFQ_LANG_BENCH
+extern void pfq_lang_exec_bench(struct pfq_lang_computation_tree *comp);
+#endif
+
+#endif /* PFQ_LANG_EXEC_H */
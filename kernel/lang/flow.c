@@ -0,0 +1,424 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <lang/module.h>
+#include <lang/qbuff.h>
+#include <lang/flow.h>
+
+#include <pfq/bitops.h>
+#include <pfq/global.h>
+#include <pfq/group.h>
+#include <pfq/io.h>
+#include <pfq/printk.h>
+#include <pfq/sock.h>
+#include <pfq/sparse.h>
+
+#include <linux/jhash.h>
+#include <linux/ktime.h>
+#include <linux/rculist.h>
+#include <linux/spinlock.h>
+#include <linux/vmalloc.h>
+#include <linux/slab.h>
+
+
+/*
+ * Flow export: per-cpu tables of the flows (5-tuple of the IP level selected
+ * by the monad) with packet/byte counters, first/last timestamp and the OR of
+ * the TCP flags. A flow is exported as a pfq_flow_record to the flow queue of
+ * the sockets of the group when it is idle for longer than the idle timeout,
+ * lasts longer than the active timeout, ends (TCP FIN or RST) or is evicted by
+ * a new flow (bucket full).
+ *
+ * Tables are swept FLOW_SWEEP buckets per packet, and entirely by the timer
+ * heartbeat of the cpu. Flows still in the tables when the computation is
+ * removed are not exported.
+ */
+
+#define FLOW_BUCKETS		1024
+#define FLOW_WAYS		4
+#define FLOW_SWEEP		2
+
+#define FLOW_TCP_FIN		0x01
+#define FLOW_TCP_RST		0x04
+
+
+struct flow_key
+{
+	__be32		saddr[4];
+	__be32		daddr[4];
+	__be16		sport;
+	__be16		dport;
+	uint8_t		proto;
+	uint8_t		ipver;
+	uint16_t	pad;
+};
+
+
+struct flow_entry
+{
+	struct flow_key key;
+	int		ifindex;
+	uint8_t		tcp_flags;
+	bool		used;
+	uint64_t	packets;
+	uint64_t	bytes;
+	uint64_t	first;		/* ns since the epoch */
+	uint64_t	last;
+};
+
+
+struct flow_table
+{
+	struct pfq_group *group;	/* the group running the computation */
+	unsigned int	hand;		/* next bucket to sweep */
+	struct flow_entry bucket[FLOW_BUCKETS][FLOW_WAYS];
+};
+
+
+struct flow_context
+{
+	uint64_t	idle;		/* timeouts, ns */
+	uint64_t	active;
+	struct flow_table **table;	/* per cpu */
+	struct list_head list;
+};
+
+
+/* contexts swept by the timer heartbeat (RCU) */
+
+static LIST_HEAD(flow_contexts);
+static DEFINE_SPINLOCK(flow_lock);
+
+
+static bool
+flow_get_key(struct qbuff * buff, struct flow_key *key, uint8_t *tcp_flags)
+{
+	struct qbuff_ip_level const *level = qbuff_ip_level(buff);
+
+	if (level == NULL)
+		return false;
+
+	memset(key, 0, sizeof(*key));
+	*tcp_flags = 0;
+
+	if (level->proto == IPPROTO_IP) {
+		struct iphdr _iph;
+		const struct iphdr *ip;
+
+		ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+		if (ip == NULL)
+			return false;
+
+		key->saddr[0] = ip->saddr;
+		key->daddr[0] = ip->daddr;
+		key->ipver = 4;
+	}
+	else {
+		struct ipv6hdr _ip6h;
+		const struct ipv6hdr *ip6;
+
+		ip6 = qbuff_ip6_header_pointer(buff, 0, sizeof(_ip6h), &_ip6h);
+		if (ip6 == NULL)
+			return false;
+
+		memcpy(key->saddr, ip6->saddr.s6_addr32, sizeof(key->saddr));
+		memcpy(key->daddr, ip6->daddr.s6_addr32, sizeof(key->daddr));
+		key->ipver = 6;
+	}
+
+	key->proto = level->l4proto;
+
+	if (level->l4proto == IPPROTO_TCP || level->l4proto == IPPROTO_UDP ||
+	    level->l4proto == IPPROTO_SCTP) {
+		__be16 _pp[2];
+		const __be16 *pp;
+
+		pp = qbuff_header_pointer(buff, level->l4off, sizeof(_pp), _pp);
+		if (pp) {
+			key->sport = pp[0];
+			key->dport = pp[1];
+		}
+	}
+
+	if (level->l4proto == IPPROTO_TCP) {
+		uint8_t _flags;
+		const uint8_t *flags;
+
+		flags = qbuff_header_pointer(buff, level->l4off + 13, sizeof(_flags), &_flags);
+		if (flags)
+			*tcp_flags = *flags;
+	}
+
+	return true;
+}
+
+
+/* write the record to the flow queue of the sockets of the group and release the entry */
+
+static void
+flow_export_entry(struct flow_table *t, struct flow_entry *e, uint8_t reason)
+{
+	struct pfq_flow_record rec;
+	unsigned long mask, bit;
+
+	e->used = false;
+
+	if (unlikely(t->group == NULL))
+		return;
+
+	memcpy(rec.saddr, e->key.saddr, sizeof(rec.saddr));
+	memcpy(rec.daddr, e->key.daddr, sizeof(rec.daddr));
+	rec.sport     = (__force uint16_t)e->key.sport;
+	rec.dport     = (__force uint16_t)e->key.dport;
+	rec.proto     = e->key.proto;
+	rec.ipver     = e->key.ipver;
+	rec.tcp_flags = e->tcp_flags;
+	rec.reason    = reason;
+	rec.ifindex   = e->ifindex;
+	rec.packets   = e->packets;
+	rec.bytes     = e->bytes;
+	rec.first     = e->first;
+	rec.last      = e->last;
+
+	mask = pfq_group_get_all_sock_mask((__force pfq_gid_t)(int)(t->group - global->groups));
+
+	pfq_bitwise_foreach(mask, bit,
+	{
+		struct pfq_sock *so = pfq_sock_get_by_id((__force pfq_id_t)pfq_ctz(bit));
+
+		if (so == NULL || so->flow_queue_len == 0)
+			continue;
+
+		if (likely(pfq_sk_queue_flow(so, &rec))) {
+			sparse_inc(so->stats, fexp);
+			sparse_inc(global->percpu_stats, fexp);
+		}
+		else {
+			sparse_inc(so->stats, flst);
+			sparse_inc(global->percpu_stats, flst);
+		}
+	});
+}
+
+
+/* the entry of the flow: a free way, or the least recently used one (evicted) */
+
+static struct flow_entry *
+flow_lookup(struct flow_table *t, struct flow_key const *key)
+{
+	uint32_t hash = jhash2((const u32 *)key, sizeof(*key)/sizeof(u32), global->sample_seed);
+	struct flow_entry *e = t->bucket[hash & (FLOW_BUCKETS-1)], *victim = NULL;
+	int w;
+
+	for(w = 0; w < FLOW_WAYS; w++)
+	{
+		if (!e[w].used) {
+			if (victim == NULL || victim->used)
+				victim = &e[w];
+			continue;
+		}
+
+		if (memcmp(&e[w].key, key, sizeof(*key)) == 0)
+			return &e[w];
+
+		if (victim == NULL || (victim->used && e[w].last < victim->last))
+			victim = &e[w];
+	}
+
+	if (victim->used)
+		flow_export_entry(t, victim, Q_FLOW_END_EVICTED);
+
+	victim->key = *key;
+	victim->used = true;
+	victim->tcp_flags = 0;
+	victim->packets = 0;
+	victim->bytes = 0;
+	return victim;
+}
+
+
+static void
+flow_sweep(struct flow_context const *ctx, struct flow_table *t, uint64_t now, unsigned int buckets)
+{
+	for(; buckets; buckets--)
+	{
+		struct flow_entry *e = t->bucket[t->hand];
+		int w;
+
+		t->hand = (t->hand + 1) & (FLOW_BUCKETS-1);
+
+		for(w = 0; w < FLOW_WAYS; w++)
+		{
+			if (!e[w].used)
+				continue;
+
+			if ((int64_t)(now - e[w].last) >= (int64_t)ctx->idle)
+				flow_export_entry(t, &e[w], Q_FLOW_END_IDLE);
+			else if ((int64_t)(now - e[w].first) >= (int64_t)ctx->active)
+				flow_export_entry(t, &e[w], Q_FLOW_END_ACTIVE);
+		}
+	}
+}
+
+
+void
+pfq_lang_flow_expire(int cpu)
+{
+	struct flow_context *ctx;
+	uint64_t now;
+
+	if (list_empty(&flow_contexts))
+		return;
+
+	now = ktime_to_ns(ktime_get_real());
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(ctx, &flow_contexts, list)
+	{
+		struct flow_table *t = ctx->table[cpu];
+		if (t->group)
+			flow_sweep(ctx, t, now, FLOW_BUCKETS);
+	}
+	rcu_read_unlock();
+}
+
+
+static ActionQbuff
+flow_export(arguments_t args, struct qbuff * buff)
+{
+	struct flow_context *ctx = GET_ARG_0(struct flow_context *, args);
+	struct flow_table *t = ctx->table[smp_processor_id()];
+	uint64_t now = ktime_to_ns(qbuff_get_ktime(buff));
+	struct flow_entry *e;
+	struct flow_key key;
+	uint8_t tcp_flags;
+
+	t->group = buff->monad->group;
+
+	if (flow_get_key(buff, &key, &tcp_flags)) {
+
+		e = flow_lookup(t, &key);
+
+		if (e->packets == 0) {
+			e->first = now;
+			e->ifindex = qbuff_get_ifindex(buff);
+		}
+
+		e->packets++;
+		e->bytes += qbuff_len(buff);
+		e->last = now;
+		e->tcp_flags |= tcp_flags;
+
+		if (tcp_flags & (FLOW_TCP_FIN | FLOW_TCP_RST))
+			flow_export_entry(t, e, Q_FLOW_END_OF_FLOW);
+		else if ((int64_t)(now - e->first) >= (int64_t)ctx->active)
+			flow_export_entry(t, e, Q_FLOW_END_ACTIVE);
+	}
+
+	flow_sweep(ctx, t, now, FLOW_SWEEP);
+	return Pass(buff);
+}
+
+
+static void
+flow_context_free(struct flow_context *ctx)
+{
+	int cpu;
+
+	if (ctx->table) {
+		for_each_possible_cpu(cpu)
+			vfree(ctx->table[cpu]);
+		kfree(ctx->table);
+	}
+	kfree(ctx);
+}
+
+
+static int flow_export_init(arguments_t args)
+{
+	uint32_t idle = GET_ARG_0(uint32_t, args);
+	uint32_t active = GET_ARG_1(uint32_t, args);
+	struct flow_context *ctx;
+	int cpu;
+
+	if (idle == 0 || active == 0) {
+		printk(KERN_INFO "[PFQ|init] flow_export: timeouts must be at least 1 msec!\n");
+		return -EINVAL;
+	}
+
+	ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+	if (ctx == NULL)
+		goto nomem;
+
+	ctx->idle   = (uint64_t)idle * NSEC_PER_MSEC;
+	ctx->active = (uint64_t)active * NSEC_PER_MSEC;
+
+	ctx->table = kcalloc(nr_cpu_ids, sizeof(struct flow_table *), GFP_KERNEL);
+	if (ctx->table == NULL)
+		goto nomem;
+
+	for_each_possible_cpu(cpu)
+	{
+		ctx->table[cpu] = vzalloc(sizeof(struct flow_table));
+		if (ctx->table[cpu] == NULL)
+			goto nomem;
+	}
+
+	spin_lock(&flow_lock);
+	list_add_rcu(&ctx->list, &flow_contexts);
+	spin_unlock(&flow_lock);
+
+	SET_ARG_0(args, ctx);
+
+	pr_devel("[PFQ|init] flow_export: idle=%u msec, active=%u msec, %d flows per cpu\n",
+		 idle, active, FLOW_BUCKETS * FLOW_WAYS);
+	return 0;
+
+nomem:
+	printk(KERN_INFO "[PFQ|init] flow_export: out of memory!\n");
+	if (ctx)
+		flow_context_free(ctx);
+	return -ENOMEM;
+}
+
+
+static int flow_export_fini(arguments_t args)
+{
+	struct flow_context *ctx = GET_ARG_0(struct flow_context *, args);
+
+	spin_lock(&flow_lock);
+	list_del_rcu(&ctx->list);
+	spin_unlock(&flow_lock);
+
+	synchronize_rcu();
+
+	flow_context_free(ctx);
+	return 0;
+}
+
+
+struct pfq_lang_function_descr flow_functions[] = {
+
+	{ "flow_export", "Word32 -> Word32 -> Qbuff -> Action Qbuff", flow_export, flow_export_init, flow_export_fini },
+	{ NULL }};
+
@@ -24,6 +24,7 @@
 #include <lang/forward.h>
 
 #include <pfq/global.h>
+#include <pfq/group.h>
 #include <pfq/percpu.h>
 #include <pfq/netdev.h>
 #include <pfq/io.h>
@@ -245,6 +246,42 @@ tee(arguments_t args, struct qbuff * buff)
 }
 
 
+static ActionQbuff
+forward_class_high(arguments_t args, struct qbuff * b)
+{
+	b->monad->prio = true;
+	return Pass(b);
+}
+
+
+static ActionQbuff
+forward_to_group(arguments_t args, struct qbuff * b)
+{
+	const int gid = GET_ARG_0(int, args);
+	b->chain_mask |= 1UL << gid;
+	return Pass(b);
+}
+
+
+static int
+forward_to_group_init(arguments_t args)
+{
+	const int gid = GET_ARG_0(int, args);
+	if (gid < 0 || gid >= Q_MAX_GID) {
+		printk(KERN_INFO "[PFQ|init] to_group: gid=%d out of range!\n", gid);
+		return -EINVAL;
+	}
+
+	if (!pfq_group_access((__force pfq_gid_t)gid, INIT_OWNER(args))) {
+		printk(KERN_INFO "[PFQ|init] to_group: gid=%d permission denied!\n", gid);
+		return -EACCES;
+	}
+
+	pr_devel("[PFQ|init] to_group: chained to group %d\n", gid);
+	return 0;
+}
+
+
 static ActionQbuff
 forward_if_kernel(arguments_t args, struct qbuff * b)
 {
@@ -273,6 +310,8 @@ struct pfq_lang_function_descr forward_functions[] = {
         { "classify",	"CInt -> Qbuff -> Action Qbuff",	forward_class	   , NULL, NULL     },
         { "kernel",	"Qbuff -> Action Qbuff",		forward_kernel	   , NULL, NULL     },
         { "detour",	"Qbuff -> Action Qbuff",		detour_kernel	   , NULL, NULL     },
+        { "class_high",	"Qbuff -> Action Qbuff",		forward_class_high , NULL, NULL     },
+        { "to_group",	"CInt -> Qbuff -> Action Qbuff",	forward_to_group   , forward_to_group_init, NULL },
 
         { "kernel_if",	"(Qbuff -> Bool) -> Qbuff -> Action Qbuff",	forward_if_kernel  , NULL, NULL     },
         { "detour_if",	"(Qbuff -> Bool) -> Qbuff -> Action Qbuff",	detour_if_kernel   , NULL, NULL     },
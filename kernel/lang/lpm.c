@@ -0,0 +1,480 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <lang/module.h>
+#include <lang/qbuff.h>
+#include <lang/types.h>
+#include <lang/lpm.h>
+
+#include <pfq/printk.h>
+
+#include <linux/vmalloc.h>
+
+
+static bool
+lpm_match(arguments_t args, struct qbuff * buff, int ep, uint32_t *tag)
+{
+	struct pfq_lpm const *lpm = GET_ARG_0(struct pfq_lpm *, args);
+
+	if (lpm->keylen == 4) {
+
+		struct iphdr _iph;
+		const struct iphdr *ip;
+
+		ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+		if (ip == NULL)
+			return false;
+
+		if ((ep & EPOINT_DST) && pfq_lpm_lookup(lpm, (const uint8_t *)&ip->daddr, tag))
+			return true;
+
+		if ((ep & EPOINT_SRC) && pfq_lpm_lookup(lpm, (const uint8_t *)&ip->saddr, tag))
+			return true;
+	}
+	else {
+		struct ipv6hdr _ip6h;
+		const struct ipv6hdr *ip6;
+
+		ip6 = qbuff_ip6_header_pointer(buff, 0, sizeof(_ip6h), &_ip6h);
+		if (ip6 == NULL)
+			return false;
+
+		if ((ep & EPOINT_DST) && pfq_lpm_lookup(lpm, ip6->daddr.s6_addr, tag))
+			return true;
+
+		if ((ep & EPOINT_SRC) && pfq_lpm_lookup(lpm, ip6->saddr.s6_addr, tag))
+			return true;
+	}
+
+	return false;
+}
+
+
+/* predicates */
+
+static bool
+lpm(arguments_t args, struct qbuff * buff)
+{
+	uint32_t tag;
+	return lpm_match(args, buff, buff->monad->ep_ctx, &tag);
+}
+
+static bool
+lpm_src(arguments_t args, struct qbuff * buff)
+{
+	uint32_t tag;
+	return lpm_match(args, buff, EPOINT_SRC, &tag);
+}
+
+static bool
+lpm_dst(arguments_t args, struct qbuff * buff)
+{
+	uint32_t tag;
+	return lpm_match(args, buff, EPOINT_DST, &tag);
+}
+
+
+/* filters */
+
+static ActionQbuff
+lpm_filter(arguments_t args, struct qbuff * buff)
+{
+	if (lpm(args, buff))
+		return Pass(buff);
+	return Drop(buff);
+}
+
+static ActionQbuff
+lpm_src_filter(arguments_t args, struct qbuff * buff)
+{
+	if (lpm_src(args, buff))
+		return Pass(buff);
+	return Drop(buff);
+}
+
+static ActionQbuff
+lpm_dst_filter(arguments_t args, struct qbuff * buff)
+{
+	if (lpm_dst(args, buff))
+		return Pass(buff);
+	return Drop(buff);
+}
+
+
+/* properties: the tag of the matching prefix */
+
+static uint64_t
+lpm_src_tag(arguments_t args, struct qbuff * buff)
+{
+	uint32_t tag;
+	if (lpm_match(args, buff, EPOINT_SRC, &tag))
+		return (uint64_t)JUST(tag);
+	return NOTHING;
+}
+
+static uint64_t
+lpm_dst_tag(arguments_t args, struct qbuff * buff)
+{
+	uint32_t tag;
+	if (lpm_match(args, buff, EPOINT_DST, &tag))
+		return (uint64_t)JUST(tag);
+	return NOTHING;
+}
+
+
+/* mark the packet with the tag of the matching prefix (unmatched packets pass untouched) */
+
+static ActionQbuff
+lpm_src_mark(arguments_t args, struct qbuff * buff)
+{
+	uint32_t tag;
+	if (lpm_match(args, buff, EPOINT_SRC, &tag))
+		set_mark(buff, tag);
+	return Pass(buff);
+}
+
+static ActionQbuff
+lpm_dst_mark(arguments_t args, struct qbuff * buff)
+{
+	uint32_t tag;
+	if (lpm_match(args, buff, EPOINT_DST, &tag))
+		set_mark(buff, tag);
+	return Pass(buff);
+}
+
+
+/* steer by the tag of the matching prefix (unmatched packets are dropped) */
+
+static ActionQbuff
+steering_lpm_src(arguments_t args, struct qbuff * buff)
+{
+	uint32_t tag;
+	if (lpm_match(args, buff, EPOINT_SRC, &tag))
+		return Steering(buff, tag);
+	return Drop(buff);
+}
+
+static ActionQbuff
+steering_lpm_dst(arguments_t args, struct qbuff * buff)
+{
+	uint32_t tag;
+	if (lpm_match(args, buff, EPOINT_DST, &tag))
+		return Steering(buff, tag);
+	return Drop(buff);
+}
+
+static ActionQbuff
+steering_lpm(arguments_t args, struct qbuff * buff)
+{
+	uint32_t src_tag, dst_tag;
+	bool src, dst;
+
+	src = lpm_match(args, buff, EPOINT_SRC, &src_tag);
+	dst = lpm_match(args, buff, EPOINT_DST, &dst_tag);
+
+	if (src && dst)
+		return DoubleSteering(buff, src_tag, dst_tag);
+	if (src)
+		return Steering(buff, src_tag);
+	if (dst)
+		return Steering(buff, dst_tag);
+
+	return Drop(buff);
+}
+
+
+/* table construction */
+
+static inline uint32_t *
+lpm_slot(struct pfq_lpm *lpm, size_t pos)
+{
+	return pos < LPM_ROOT_SIZE ? &lpm->root[pos] : &lpm->group[pos - LPM_ROOT_SIZE];
+}
+
+
+static long
+lpm_new_group(struct pfq_lpm *lpm, uint32_t fill)
+{
+	uint32_t *group;
+	size_t n;
+
+	if (lpm->ngroups == lpm->capacity) {
+
+		size_t capacity = lpm->capacity ? lpm->capacity * 2 : 64;
+
+		if (capacity > LPM_MAX_GROUPS)
+			capacity = LPM_MAX_GROUPS;
+		if (capacity == lpm->ngroups)
+			return -ENOSPC;
+
+		group = vmalloc(capacity * LPM_GROUP_SIZE * sizeof(uint32_t));
+		if (group == NULL)
+			return -ENOMEM;
+
+		if (lpm->group) {
+			memcpy(group, lpm->group, lpm->ngroups * LPM_GROUP_SIZE * sizeof(uint32_t));
+			vfree(lpm->group);
+		}
+
+		lpm->group = group;
+		lpm->capacity = capacity;
+	}
+
+	/* a new group inherits the entry it replaces */
+
+	group = lpm->group + lpm->ngroups * LPM_GROUP_SIZE;
+	for(n = 0; n < LPM_GROUP_SIZE; n++)
+		group[n] = fill;
+
+	return (long)lpm->ngroups++;
+}
+
+
+/*
+ * Prefixes must be inserted by increasing length: a longer prefix then
+ * overrides the slots expanded by the shorter ones it is nested in.
+ */
+
+static int
+lpm_insert(struct pfq_lpm *lpm, const uint8_t *key, int plen, uint32_t tag)
+{
+	uint32_t value = LPM_VALID | tag;
+	size_t pos, n, count;
+	int i;
+
+	pos = (size_t)((key[0] << 8) | key[1]);
+
+	if (plen <= 16) {
+		pos &= ~((1UL << (16 - plen)) - 1);
+		count = 1UL << (16 - plen);
+		for(n = 0; n < count; n++)
+			lpm->root[pos + n] = value;
+		return 0;
+	}
+
+	plen -= 16;
+
+	for(i = 2;; i++)
+	{
+		uint32_t e = *lpm_slot(lpm, pos);
+		long g;
+
+		if (e & LPM_EXT)
+			g = LPM_DATA(e);
+		else {
+			g = lpm_new_group(lpm, e);
+			if (g < 0)
+				return (int)g;
+			*lpm_slot(lpm, pos) = LPM_EXT | (uint32_t)g;
+		}
+
+		pos = LPM_ROOT_SIZE + (size_t)g * LPM_GROUP_SIZE;
+
+		if (plen <= 8) {
+			pos += key[i] & (0xff << (8 - plen)) & 0xff;
+			count = 1UL << (8 - plen);
+			for(n = 0; n < count; n++)
+				*lpm_slot(lpm, pos + n) = value;
+			return 0;
+		}
+
+		pos += key[i];
+		plen -= 8;
+	}
+}
+
+
+static void
+lpm_free(struct pfq_lpm *lpm)
+{
+	if (lpm == NULL)
+		return;
+
+	vfree(lpm->group);
+	vfree(lpm->root);
+	kfree(lpm);
+}
+
+
+static const uint8_t *
+lpm_prefix(arguments_t args, int keylen, size_t n, int *plen)
+{
+	if (keylen == 4) {
+		struct CIDR *cidr = GET_ARRAY_0(struct CIDR, args) + n;
+		*plen = cidr->prefix;
+		return (const uint8_t *)&cidr->addr;
+	}
+	else {
+		struct CIDR6 *cidr = GET_ARRAY_0(struct CIDR6, args) + n;
+		*plen = cidr->prefix;
+		return cidr->addr.s6_addr;
+	}
+}
+
+
+static int
+lpm_build(arguments_t args, int keylen)
+{
+	size_t n, size = LEN_ARRAY_0(args), ntags = LEN_ARRAY_1(args);
+	uint32_t *tags = GET_ARRAY_1(uint32_t, args);
+	uint32_t count[129] = { 0 }, pos = 0;
+	uint32_t *order = NULL;
+	struct pfq_lpm *lpm;
+	int plen, l, err = 0;
+
+	if (ntags && ntags != size) {
+		printk(KERN_INFO "[PFQ|init] lpm: %zu tags given for %zu prefixes!\n", ntags, size);
+		return -EINVAL;
+	}
+
+	/* sort the prefixes by length (counting sort) */
+
+	for(n = 0; n < size; n++)
+	{
+		lpm_prefix(args, keylen, n, &plen);
+		if (plen < 0 || plen > keylen * 8) {
+			printk(KERN_INFO "[PFQ|init] lpm: prefix %zu: invalid length /%d!\n", n, plen);
+			return -EINVAL;
+		}
+		if (ntags && tags[n] > LPM_MAX_TAG) {
+			printk(KERN_INFO "[PFQ|init] lpm: prefix %zu: tag %u out of range!\n", n, tags[n]);
+			return -EINVAL;
+		}
+		count[plen]++;
+	}
+
+	for(l = 0; l <= keylen * 8; l++)
+	{
+		uint32_t c = count[l];
+		count[l] = pos;
+		pos += c;
+	}
+
+	if (size) {
+		order = vmalloc(size * sizeof(uint32_t));
+		if (order == NULL) {
+			printk(KERN_INFO "[PFQ|init] lpm: out of memory!\n");
+			return -ENOMEM;
+		}
+	}
+
+	for(n = 0; n < size; n++)
+	{
+		lpm_prefix(args, keylen, n, &plen);
+		order[count[plen]++] = (uint32_t)n;
+	}
+
+	lpm = kzalloc(sizeof(*lpm), GFP_KERNEL);
+	if (lpm)
+		lpm->root = vzalloc(LPM_ROOT_SIZE * sizeof(uint32_t));
+
+	if (lpm == NULL || lpm->root == NULL) {
+		printk(KERN_INFO "[PFQ|init] lpm: out of memory!\n");
+		err = -ENOMEM;
+		goto out;
+	}
+
+	lpm->keylen = keylen;
+
+	/* untagged prefixes are tagged with their (1-based) position in the list */
+
+	for(n = 0; n < size; n++)
+	{
+		size_t i = order[n];
+		const uint8_t *key = lpm_prefix(args, keylen, i, &plen);
+
+		err = lpm_insert(lpm, key, plen, ntags ? tags[i] : (uint32_t)(i + 1));
+		if (err < 0) {
+			printk(KERN_INFO "[PFQ|init] lpm: could not insert prefix %zu (%d)!\n", i, err);
+			goto out;
+		}
+	}
+
+	/* the table replaces the prefix list */
+
+	SET_ARG_0(args, lpm);
+
+	pr_devel("[PFQ|init] lpm@%p: IPv%d, %zu prefixes, %zu groups (%zu bytes)\n", lpm, keylen == 4 ? 4 : 6,
+		 size, lpm->ngroups, (LPM_ROOT_SIZE + lpm->ngroups * LPM_GROUP_SIZE) * sizeof(uint32_t));
+out:
+	if (err < 0)
+		lpm_free(lpm);
+	vfree(order);
+	return err;
+}
+
+
+static int lpm_init(arguments_t args)
+{
+	return lpm_build(args, 4);
+}
+
+
+static int lpm6_init(arguments_t args)
+{
+	return lpm_build(args, 16);
+}
+
+
+static int lpm_fini(arguments_t args)
+{
+	struct pfq_lpm *lpm = GET_ARG_0(struct pfq_lpm *, args);
+
+	lpm_free(lpm);
+	pr_devel("[PFQ|init] lpm: memory freed@%p!\n", lpm);
+
+	return 0;
+}
+
+
+struct pfq_lang_function_descr lpm_functions[] = {
+
+	{"lpm",			"[CIDR] -> [Word32] -> Qbuff -> Bool",		lpm,			lpm_init,	lpm_fini},
+	{"lpm_src",		"[CIDR] -> [Word32] -> Qbuff -> Bool",		lpm_src,		lpm_init,	lpm_fini},
+	{"lpm_dst",		"[CIDR] -> [Word32] -> Qbuff -> Bool",		lpm_dst,		lpm_init,	lpm_fini},
+	{"lpm_filter",		"[CIDR] -> [Word32] -> Qbuff -> Action Qbuff",	lpm_filter,		lpm_init,	lpm_fini},
+	{"lpm_src_filter",	"[CIDR] -> [Word32] -> Qbuff -> Action Qbuff",	lpm_src_filter,		lpm_init,	lpm_fini},
+	{"lpm_dst_filter",	"[CIDR] -> [Word32] -> Qbuff -> Action Qbuff",	lpm_dst_filter,		lpm_init,	lpm_fini},
+	{"lpm_src_tag",		"[CIDR] -> [Word32] -> Qbuff -> Word64",	lpm_src_tag,		lpm_init,	lpm_fini},
+	{"lpm_dst_tag",		"[CIDR] -> [Word32] -> Qbuff -> Word64",	lpm_dst_tag,		lpm_init,	lpm_fini},
+	{"lpm_src_mark",	"[CIDR] -> [Word32] -> Qbuff -> Action Qbuff",	lpm_src_mark,		lpm_init,	lpm_fini},
+	{"lpm_dst_mark",	"[CIDR] -> [Word32] -> Qbuff -> Action Qbuff",	lpm_dst_mark,		lpm_init,	lpm_fini},
+	{"steer_lpm",		"[CIDR] -> [Word32] -> Qbuff -> Action Qbuff",	steering_lpm,		lpm_init,	lpm_fini},
+	{"steer_lpm_src",	"[CIDR] -> [Word32] -> Qbuff -> Action Qbuff",	steering_lpm_src,	lpm_init,	lpm_fini},
+	{"steer_lpm_dst",	"[CIDR] -> [Word32] -> Qbuff -> Action Qbuff",	steering_lpm_dst,	lpm_init,	lpm_fini},
+
+	{"lpm6",		"[CIDR6] -> [Word32] -> Qbuff -> Bool",		lpm,			lpm6_init,	lpm_fini},
+	{"lpm6_src",		"[CIDR6] -> [Word32] -> Qbuff -> Bool",		lpm_src,		lpm6_init,	lpm_fini},
+	{"lpm6_dst",		"[CIDR6] -> [Word32] -> Qbuff -> Bool",		lpm_dst,		lpm6_init,	lpm_fini},
+	{"lpm6_filter",		"[CIDR6] -> [Word32] -> Qbuff -> Action Qbuff",	lpm_filter,		lpm6_init,	lpm_fini},
+	{"lpm6_src_filter",	"[CIDR6] -> [Word32] -> Qbuff -> Action Qbuff",	lpm_src_filter,		lpm6_init,	lpm_fini},
+	{"lpm6_dst_filter",	"[CIDR6] -> [Word32] -> Qbuff -> Action Qbuff",	lpm_dst_filter,		lpm6_init,	lpm_fini},
+	{"lpm6_src_tag",	"[CIDR6] -> [Word32] -> Qbuff -> Word64",	lpm_src_tag,		lpm6_init,	lpm_fini},
+	{"lpm6_dst_tag",	"[CIDR6] -> [Word32] -> Qbuff -> Word64",	lpm_dst_tag,		lpm6_init,	lpm_fini},
+	{"lpm6_src_mark",	"[CIDR6] -> [Word32] -> Qbuff -> Action Qbuff",	lpm_src_mark,		lpm6_init,	lpm_fini},
+	{"lpm6_dst_mark",	"[CIDR6] -> [Word32] -> Qbuff -> Action Qbuff",	lpm_dst_mark,		lpm6_init,	lpm_fini},
+	{"steer_lpm6",		"[CIDR6] -> [Word32] -> Qbuff -> Action Qbuff",	steering_lpm,		lpm6_init,	lpm_fini},
+	{"steer_lpm6_src",	"[CIDR6] -> [Word32] -> Qbuff -> Action Qbuff",	steering_lpm_src,	lpm6_init,	lpm_fini},
+	{"steer_lpm6_dst",	"[CIDR6] -> [Word32] -> Qbuff -> Action Qbuff",	steering_lpm_dst,	lpm6_init,	lpm_fini},
+	{ NULL }};
+
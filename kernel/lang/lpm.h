@@ -0,0 +1,75 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#ifndef PFQ_LANG_LPM_H
+#define PFQ_LANG_LPM_H
+
+#include <pfq/kcompat.h>
+
+
+/*
+ * Longest prefix match table (DIR-16-8-8...): the first 16 bits of the key
+ * index the root table, each further byte indexes a group of 256 entries.
+ * Shorter prefixes are expanded over the slots they cover, so that a lookup
+ * costs 1 memory access for prefixes up to /16, 2 up to /24, 3 up to /32
+ * (IPv4), 1 + (len-16)/8 for IPv6.
+ */
+
+#define LPM_ROOT_SIZE		(1 << 16)
+#define LPM_GROUP_SIZE		(1 << 8)
+#define LPM_MAX_GROUPS		(1 << 20)
+#define LPM_MAX_TAG		((1U << 30) - 1)
+
+#define LPM_VALID		(1U << 31)
+#define LPM_EXT			(1U << 30)
+#define LPM_DATA(e)		((e) & LPM_MAX_TAG)
+
+
+struct pfq_lpm
+{
+	uint32_t	*root;
+	uint32_t	*group;
+	size_t		ngroups;
+	size_t		capacity;
+	int		keylen;		/* 4: IPv4, 16: IPv6 */
+};
+
+
+static inline bool
+pfq_lpm_lookup(struct pfq_lpm const *lpm, const uint8_t *key, uint32_t *tag)
+{
+	uint32_t e = lpm->root[(key[0] << 8) | key[1]];
+	int i;
+
+	for(i = 2; (e & LPM_EXT) && i < lpm->keylen; i++)
+		e = lpm->group[(LPM_DATA(e) << 8) | key[i]];
+
+	if (!(e & LPM_VALID))
+		return false;
+
+	*tag = LPM_DATA(e);
+	return true;
+}
+
+
+#endif /* PFQ_LANG_LPM_H */
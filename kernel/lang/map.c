@@ -0,0 +1,428 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <lang/module.h>
+#include <lang/qbuff.h>
+
+#include <pfq/map.h>
+#include <pfq/sketch.h>
+#include <pfq/printk.h>
+
+
+/* extract the key of the packet, as specified by kind */
+
+static bool
+map_key(struct pfq_map const *map, int kind, struct qbuff * buff, char *key)
+{
+	switch(kind)
+	{
+	case Q_MAP_KEY_SRC_ADDR:
+	case Q_MAP_KEY_DST_ADDR: {
+
+		size_t off = map->type == Q_MAP_LPM ? sizeof(uint32_t) : 0;
+		size_t len = map->key_size - off;
+
+		if (map->type == Q_MAP_LPM)
+			*(uint32_t *)key = (uint32_t)len * 8;
+
+		if (len == 4) {
+			struct iphdr _iph;
+			const struct iphdr *ip;
+
+			ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+			if (ip == NULL)
+				return false;
+
+			memcpy(key + off, kind == Q_MAP_KEY_SRC_ADDR ? &ip->saddr : &ip->daddr, 4);
+		}
+		else {
+			struct ipv6hdr _ip6h;
+			const struct ipv6hdr *ip6;
+
+			ip6 = qbuff_ip6_header_pointer(buff, 0, sizeof(_ip6h), &_ip6h);
+			if (ip6 == NULL)
+				return false;
+
+			memcpy(key + off, kind == Q_MAP_KEY_SRC_ADDR ? &ip6->saddr : &ip6->daddr, 16);
+		}
+		return true;
+	}
+
+	case Q_MAP_KEY_FLOW: {
+
+		struct pfq_map_flow_key *flow = (struct pfq_map_flow_key *)key;
+		struct iphdr _iph;
+		const struct iphdr *ip;
+
+		ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+		if (ip == NULL)
+			return false;
+
+		memset(flow, 0, sizeof(*flow));
+		flow->saddr = ip->saddr;
+		flow->daddr = ip->daddr;
+		flow->proto = ip->protocol;
+
+		if (ip->protocol == IPPROTO_TCP || ip->protocol == IPPROTO_UDP) {
+			struct udphdr _udp;
+			const struct udphdr *udp;
+
+			udp = qbuff_l4_header_pointer(buff, 0, sizeof(_udp), &_udp);
+			if (udp == NULL)
+				return false;
+
+			flow->sport = udp->source;
+			flow->dport = udp->dest;
+		}
+		return true;
+	}
+
+	case Q_MAP_KEY_MARK:
+		*(uint32_t *)key = get_mark(buff);
+		return true;
+
+	case Q_MAP_KEY_SRC_PORT:
+	case Q_MAP_KEY_DST_PORT: {
+
+		struct udphdr _udp;
+		const struct udphdr *udp;
+		struct iphdr _iph;
+		const struct iphdr *ip;
+
+		ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+		if (ip == NULL || (ip->protocol != IPPROTO_TCP && ip->protocol != IPPROTO_UDP))
+			return false;
+
+		udp = qbuff_l4_header_pointer(buff, 0, sizeof(_udp), &_udp);
+		if (udp == NULL)
+			return false;
+
+		*(__be16 *)key = kind == Q_MAP_KEY_SRC_PORT ? udp->source : udp->dest;
+		return true;
+	}
+	}
+
+	return false;
+}
+
+
+static void *
+map_lookup_buff(arguments_t args, struct qbuff * buff)
+{
+	struct pfq_map *map = GET_ARG_0(struct pfq_map *, args);
+	int kind = GET_ARG_1(int, args);
+	char key[Q_MAP_MAX_KEY_SIZE] __aligned(8);
+
+	if (!map_key(map, kind, buff, key))
+		return NULL;
+
+	return pfq_map_lookup(map, key);
+}
+
+
+static bool
+map_contains(arguments_t args, struct qbuff * buff)
+{
+	struct pfq_map *map = GET_ARG_0(struct pfq_map *, args);
+
+	if (map->type == Q_MAP_BLOOM) {
+		int kind = GET_ARG_1(int, args);
+		char key[Q_MAP_MAX_KEY_SIZE] __aligned(8);
+
+		return map_key(map, kind, buff, key) && pfq_map_bloom_test(map, key);
+	}
+
+	return map_lookup_buff(args, buff) != NULL;
+}
+
+
+static ActionQbuff
+map_filter(arguments_t args, struct qbuff * buff)
+{
+	if (map_contains(args, buff))
+		return Pass(buff);
+	return Drop(buff);
+}
+
+
+/* the value (up to 8 bytes) associated with the key of the packet (the estimate, for count-min sketches) */
+
+static uint64_t
+map_lookup(arguments_t args, struct qbuff * buff)
+{
+	struct pfq_map *map = GET_ARG_0(struct pfq_map *, args);
+	void *value;
+	uint64_t ret = 0;
+
+	if (pfq_map_is_sketch(map)) {
+		int kind = GET_ARG_1(int, args);
+		char key[Q_MAP_MAX_KEY_SIZE] __aligned(8);
+
+		if (!map_key(map, kind, buff, key))
+			return NOTHING;
+		return (uint64_t)JUST(pfq_sketch_estimate(map, key));
+	}
+
+	if (map->type == Q_MAP_BLOOM)
+		return map_contains(args, buff) ? (uint64_t)JUST(1) : NOTHING;
+
+	value = map_lookup_buff(args, buff);
+	if (value == NULL)
+		return NOTHING;
+
+	memcpy(&ret, value, min_t(size_t, map->value_size, sizeof(ret)));
+	return (uint64_t)JUST(ret);
+}
+
+
+/* steer by the (uint32_t) value associated with the key of the packet; drop the others */
+
+static ActionQbuff
+steering_by_map(arguments_t args, struct qbuff * buff)
+{
+	uint32_t *value = map_lookup_buff(args, buff);
+
+	if (value == NULL)
+		return Drop(buff);
+
+	return Steering(buff, READ_ONCE(*value));
+}
+
+
+/* count the packets (and the bytes) of each key: the value is { uint64_t packets[, bytes] } */
+
+static ActionQbuff
+map_update(arguments_t args, struct qbuff * buff)
+{
+	struct pfq_map *map = GET_ARG_0(struct pfq_map *, args);
+	int kind = GET_ARG_1(int, args);
+	char key[Q_MAP_MAX_KEY_SIZE] __aligned(8);
+	atomic64_t *value;
+
+	if (!map_key(map, kind, buff, key))
+		return Pass(buff);
+
+	if (pfq_map_is_sketch(map)) {
+		pfq_sketch_update(map, key);
+		return Pass(buff);
+	}
+
+	value = pfq_map_lookup(map, key);
+	if (value == NULL && map->type == Q_MAP_HASH) {
+
+		static const char zero[Q_MAP_MAX_VALUE_SIZE];
+
+		/* a concurrent insertion of the same key is fine */
+
+		pfq_map_update(map, key, zero, Q_MAP_NOEXIST, GFP_ATOMIC);
+		value = pfq_map_lookup(map, key);
+	}
+
+	if (value) {
+		atomic64_inc(&value[0]);
+		if (map->value_size >= 2 * sizeof(atomic64_t))
+			atomic64_add(qbuff_len(buff), &value[1]);
+	}
+
+	return Pass(buff);
+}
+
+
+/* the estimated packets of the key exceed the threshold (count-min sketches) */
+
+static bool
+is_heavy_hitter(arguments_t args, struct qbuff * buff)
+{
+	struct pfq_map *map = GET_ARG_0(struct pfq_map *, args);
+	int kind = GET_ARG_1(int, args);
+	uint64_t threshold = GET_ARG_2(uint64_t, args);
+	char key[Q_MAP_MAX_KEY_SIZE] __aligned(8);
+
+	if (!map_key(map, kind, buff, key))
+		return false;
+
+	return pfq_sketch_above(map, key, threshold);
+}
+
+
+/* maps keyed by the whole address/flow/port of the packet */
+
+static inline bool
+map_is_keyed(struct pfq_map const *map)
+{
+	return map->type == Q_MAP_HASH || map->type == Q_MAP_BLOOM || pfq_map_is_sketch(map);
+}
+
+
+static int map_init(arguments_t args)
+{
+	int id   = GET_ARG_0(int, args);
+	int kind = GET_ARG_1(int, args);
+	struct pfq_map *map;
+	bool ok;
+
+	map = pfq_map_get(id);
+	if (map == NULL) {
+		printk(KERN_INFO "[PFQ|init] map: invalid map id %d!\n", id);
+		return -EINVAL;
+	}
+
+	if (!pfq_map_access(map, INIT_OWNER(args))) {
+		printk(KERN_INFO "[PFQ|init] map %d: permission denied!\n", id);
+		pfq_map_put(map);
+		return -EACCES;
+	}
+
+	switch(kind)
+	{
+	case Q_MAP_KEY_SRC_ADDR:
+	case Q_MAP_KEY_DST_ADDR:
+		ok = map->type == Q_MAP_LPM ||
+		     (map_is_keyed(map) && (map->key_size == 4 || map->key_size == 16));
+		break;
+	case Q_MAP_KEY_FLOW:
+		ok = map_is_keyed(map) && map->key_size == sizeof(struct pfq_map_flow_key);
+		break;
+	case Q_MAP_KEY_MARK:
+		ok = map->type != Q_MAP_LPM && map->key_size == sizeof(uint32_t);
+		break;
+	case Q_MAP_KEY_SRC_PORT:
+	case Q_MAP_KEY_DST_PORT:
+		ok = map_is_keyed(map) && map->key_size == sizeof(__be16);
+		break;
+	default:
+		ok = false;
+	}
+
+	if (!ok) {
+		printk(KERN_INFO "[PFQ|init] map %d: key %d does not match the map (type=%d key_size=%zu)!\n",
+		       id, kind, map->type, map->key_size);
+		pfq_map_put(map);
+		return -EINVAL;
+	}
+
+	SET_ARG_0(args, map);
+
+	pr_devel("[PFQ|init] map %d@%p: key=%d\n", id, map, kind);
+	return 0;
+}
+
+
+static int map_steer_init(arguments_t args)
+{
+	int err = map_init(args);
+	struct pfq_map *map;
+
+	if (err < 0)
+		return err;
+
+	map = GET_ARG_0(struct pfq_map *, args);
+	if (pfq_map_is_sketch(map) || map->type == Q_MAP_BLOOM || map->value_size < sizeof(uint32_t)) {
+		printk(KERN_INFO "[PFQ|init] steer_by_map: map %d: value_size too small!\n", map->id);
+		pfq_map_put(map);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+
+/* the cardinality of a HyperLogLog merges all the registers of all the cpus: too expensive per packet */
+
+static int map_lookup_init(arguments_t args)
+{
+	int err = map_init(args);
+	struct pfq_map *map;
+
+	if (err < 0)
+		return err;
+
+	map = GET_ARG_0(struct pfq_map *, args);
+	if (map->type == Q_MAP_HLL) {
+		printk(KERN_INFO "[PFQ|init] map_lookup: map %d: HyperLogLog estimates are available to userspace only!\n", map->id);
+		pfq_map_put(map);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+
+static int map_update_init(arguments_t args)
+{
+	int err = map_init(args);
+	struct pfq_map *map;
+
+	if (err < 0)
+		return err;
+
+	map = GET_ARG_0(struct pfq_map *, args);
+	if (map->type == Q_MAP_LPM || map->value_size < sizeof(atomic64_t)) {
+		printk(KERN_INFO "[PFQ|init] map_update: map %d: counters require a hash/array/sketch map with 8 bytes values!\n", map->id);
+		pfq_map_put(map);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+
+static int map_sketch_init(arguments_t args)
+{
+	int err = map_init(args);
+	struct pfq_map *map;
+
+	if (err < 0)
+		return err;
+
+	map = GET_ARG_0(struct pfq_map *, args);
+	if (map->type != Q_MAP_COUNT_MIN) {
+		printk(KERN_INFO "[PFQ|init] is_heavy_hitter: map %d is not a count-min sketch!\n", map->id);
+		pfq_map_put(map);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+
+static int map_fini(arguments_t args)
+{
+	struct pfq_map *map = GET_ARG_0(struct pfq_map *, args);
+
+	pr_devel("[PFQ|init] map %d@%p released.\n", map->id, map);
+	pfq_map_put(map);
+	return 0;
+}
+
+
+struct pfq_lang_function_descr map_functions[] = {
+
+	{"map_contains",	"CInt -> CInt -> Qbuff -> Bool",		map_contains,		map_init,		map_fini},
+	{"map_filter",		"CInt -> CInt -> Qbuff -> Action Qbuff",	map_filter,		map_init,		map_fini},
+	{"map_lookup",		"CInt -> CInt -> Qbuff -> Word64",		map_lookup,		map_lookup_init,	map_fini},
+	{"map_update",		"CInt -> CInt -> Qbuff -> Action Qbuff",	map_update,		map_update_init,	map_fini},
+	{"steer_by_map",	"CInt -> CInt -> Qbuff -> Action Qbuff",	steering_by_map,	map_steer_init,		map_fini},
+	{"is_heavy_hitter",	"CInt -> CInt -> Word64 -> Qbuff -> Bool",	is_heavy_hitter,	map_sketch_init,	map_fini},
+	{ NULL }};
+
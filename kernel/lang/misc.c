@@ -25,6 +25,7 @@
 #include <lang/headers.h>
 #include <lang/misc.h>
 
+#include <pfq/group.h>
 #include <pfq/sparse.h>
 
 
@@ -108,7 +109,7 @@ log_ip4_packet(arguments_t args, struct qbuff * buff)
 		{
 		case IPPROTO_UDP: {
 			struct udphdr _udph; const struct udphdr *udp;
-			udp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(struct udphdr), &_udph);
+			udp = qbuff_l4_header_pointer(buff, 0, sizeof(struct udphdr), &_udph);
 			if (udp)
 			{
 				printk(KERN_INFO "[pfq-lang] IP4 %pI4.%d > %pI4.%d: UDP\n",
@@ -122,7 +123,7 @@ log_ip4_packet(arguments_t args, struct qbuff * buff)
 		} break;
 		case IPPROTO_TCP: {
 			struct tcphdr _tcph; const struct tcphdr *tcp;
-			tcp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(struct tcphdr), &_tcph);
+			tcp = qbuff_l4_header_pointer(buff, 0, sizeof(struct tcphdr), &_tcph);
 			if (tcp)
 			{
 				printk(KERN_INFO "[pfq-lang] IP4 %pI4.%d > %pI4.%d: TCP\n",
@@ -136,7 +137,7 @@ log_ip4_packet(arguments_t args, struct qbuff * buff)
 		} break;
 		case IPPROTO_ICMP: {
 			struct icmphdr _icmp; const struct icmphdr *icmp;
-			icmp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(struct icmphdr), &_icmp);
+			icmp = qbuff_l4_header_pointer(buff, 0, sizeof(struct icmphdr), &_icmp);
                         if (icmp)
 			{
 				printk(KERN_INFO "[pfq-lang] IP4 %pI4 > %pI4: ICMP type=%d (code=%d)\n",
@@ -191,15 +192,13 @@ trace(arguments_t args, struct qbuff * buff)
 					, buff->to_kernel
 					);
 
-		printk(KERN_INFO "[pfq-lang]     MONAD: state:%u fanout:{cl=%lx h1=%u h2=%u tp=%u} shift:%d ipoff:%d ipproto:%d ep_ctx:%d\n"
+		printk(KERN_INFO "[pfq-lang]     MONAD: state:%u fanout:{cl=%lx h1=%u h2=%u tp=%u} shift:%d ep_ctx:%d\n"
 					, mon->state
 					, mon->fanout.class_mask
 					, mon->fanout.hash
 					, mon->fanout.hash2
 					, mon->fanout.type
 					, mon->shift
-					, mon->ipoff
-					, mon->ipproto
 					, mon->ep_ctx
 					);
 
@@ -208,6 +207,14 @@ trace(arguments_t args, struct qbuff * buff)
 }
 
 
+static ActionQbuff
+recorder_trigger(arguments_t args, struct qbuff * buff)
+{
+	pfq_group_trigger_recorder(buff->monad->group);
+	return Pass(buff);
+}
+
+
 struct pfq_lang_function_descr misc_functions[] = {
 
         { "inc",	"CInt    -> Qbuff -> Action Qbuff",	inc_counter, NULL, NULL	},
@@ -220,6 +227,8 @@ struct pfq_lang_function_descr misc_functions[] = {
         { "log_packet", "Qbuff -> Action Qbuff",		log_packet , NULL, NULL },
         { "trace",	"Qbuff -> Action Qbuff",		trace	   , NULL, NULL },
 
+        { "recorder_trigger", "Qbuff -> Action Qbuff",		recorder_trigger, NULL, NULL },
+
         { NULL }};
 
 
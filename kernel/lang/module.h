@@ -28,8 +28,11 @@
 #include <lang/maybe.h>
 
 #include <pfq/sparse.h>
+#include <pfq/types.h>
 #include <pfq/kcompat.h>
 
+#include <lang/prof.h>
+
 #define ARGS_TYPE(a)		__builtin_choose_expr(__builtin_types_compatible_p(arguments_t, typeof(a)), a, (void)0)
 
 #define EVAL_FUNCTION(f,buff)    eval_function(f, buff)
@@ -156,13 +159,25 @@ struct pfq_lang_functional_node
 	fini_ptr_t	      fini;
 
 	bool		      initialized;
+
+	const char *	      symbol;
+	struct pfq_lang_prof __percpu *prof;		/* profiling counters */
+
+	pfq_id_t	      owner;			/* socket installing the computation */
 };
 
 
+/* the socket installing the computation, for the access checks of the init functions */
+
+#define INIT_OWNER(a)		(container_of(ARGS_TYPE(a), struct pfq_lang_functional_node, fun)->owner)
+
+
 struct pfq_lang_computation_tree
 {
 	size_t size;
 	struct pfq_lang_functional_node *entry_point;
+	struct pfq_lang_exec __rcu *exec;		/* flattened program (NULL: tree walking), replaced by optimize */
+	struct pfq_lang_prof __percpu *prof;		/* per-node profiling counters */
 	struct pfq_lang_functional_node node[];
 };
 
@@ -219,10 +234,17 @@ bool fwd_to_kernel(struct qbuff *buff)
 }
 
 
+extern ActionQbuff pfq_lang_prof_eval(function_t f, struct qbuff * buff);
+
+
 static inline ActionQbuff
 eval_function(function_t f, struct qbuff * buff)
 {
 	struct pfq_lang_functional *fun = f.fun;
+
+	if (pfq_lang_prof_enabled())
+		return pfq_lang_prof_eval(f, buff);
+
 	while (fun) {
 
                 fanout_t *a;
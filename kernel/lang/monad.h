@@ -74,9 +74,8 @@ struct pfq_lang_monad
         uint32_t		state;
         fanout_t		fanout;
         int			shift;
-	int			ipoff;
-        int			ipproto;
         int			ep_ctx;		/* endpoint context */
+        bool			prio;		/* class_high: to the high-priority Rx queue of the group sockets */
 };
 
 /* Fanout constructors */
@@ -0,0 +1,396 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <lang/module.h>
+#include <lang/qbuff.h>
+#include <lang/sample.h>
+
+#include <pfq/global.h>
+#include <pfq/sparse.h>
+#include <pfq/printk.h>
+
+#include <linux/version.h>
+#include <linux/percpu.h>
+#include <linux/math64.h>
+#include <linux/slab.h>
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,11,0)
+#include <linux/sched/clock.h>
+#else
+#include <linux/sched.h>
+#endif
+
+
+/*
+ * Token-bucket policers. Buckets are per-cpu (no shared cacheline is written
+ * in the fast path) and refilled from local_clock(): tokens are kept in 32.32
+ * fixed point, the rate in tokens per nanosecond.
+ *
+ * police_group splits the rate among the online cpus, with a burst of
+ * POLICE_GROUP_BURST_NS worth of traffic; police_flow keeps a direct-mapped
+ * table of flows per cpu (flows are pinned to a cpu by RSS/steering).
+ */
+
+#define POLICE_SHIFT		32
+#define POLICE_MAX_BURST	(1ULL << 30)
+#define POLICE_GROUP_BURST_NS	(100 * NSEC_PER_MSEC)
+#define POLICE_MIN_BYTE_BURST	65536
+#define POLICE_FLOW_ENTRIES	1024
+
+
+struct police_rate
+{
+	uint64_t rate;		/* tokens/ns, 32.32 (0: unlimited) */
+	uint64_t burst;		/* bucket size, 32.32 */
+	uint64_t fill;		/* ns to fill an empty bucket */
+};
+
+
+struct police_bucket
+{
+	uint64_t last;
+	uint64_t tokens;
+};
+
+
+struct police_group_state
+{
+	struct police_bucket pkt;
+	struct police_bucket byte;
+} ____cacheline_aligned;
+
+
+struct police_flow_entry
+{
+	uint32_t tag;		/* flow hash */
+	struct police_bucket bucket;
+};
+
+
+struct police_flow_table
+{
+	struct police_flow_entry entry[POLICE_FLOW_ENTRIES];
+};
+
+
+struct police_context
+{
+	struct police_rate pkt;
+	struct police_rate byte;
+	void __percpu *state;
+};
+
+
+static int
+police_rate_init(struct police_rate *r, uint64_t rate, uint64_t burst)
+{
+	if (rate == 0)
+		return 0;
+
+	if (burst == 0 || burst >= POLICE_MAX_BURST)
+		return -EINVAL;
+
+	r->rate  = div_u64(rate, NSEC_PER_SEC) << POLICE_SHIFT |
+		   div_u64((rate % NSEC_PER_SEC) << POLICE_SHIFT, NSEC_PER_SEC);
+	r->burst = burst << POLICE_SHIFT;
+	r->fill  = div64_u64(r->burst, r->rate) + 1;
+	return 0;
+}
+
+
+static inline void
+police_refill(struct police_rate const *r, struct police_bucket *b, uint64_t now)
+{
+	uint64_t elapsed = min_t(uint64_t, now - b->last, r->fill);
+
+	b->tokens = min_t(uint64_t, b->tokens + elapsed * r->rate, r->burst);
+	b->last = now;
+}
+
+
+static inline bool
+police_take(struct police_rate const *r, struct police_bucket *b, uint64_t cost, uint64_t now)
+{
+	police_refill(r, b, now);
+	if (b->tokens < (cost << POLICE_SHIFT))
+		return false;
+	b->tokens -= cost << POLICE_SHIFT;
+	return true;
+}
+
+
+static inline void
+police_account(struct qbuff * buff)
+{
+	local_inc(&get_group_stats(buff)->plcd);
+	sparse_inc(global->percpu_stats, plcd);
+}
+
+
+static bool
+police_group_conform(struct police_context const *ctx, struct qbuff * buff)
+{
+	struct police_group_state *s = this_cpu_ptr((struct police_group_state __percpu *)ctx->state);
+	uint64_t now = local_clock();
+
+	/* tokens are taken only if both buckets conform */
+
+	if (ctx->pkt.rate) {
+		police_refill(&ctx->pkt, &s->pkt, now);
+		if (s->pkt.tokens < (1ULL << POLICE_SHIFT))
+			return false;
+	}
+
+	if (ctx->byte.rate && !police_take(&ctx->byte, &s->byte, qbuff_len(buff), now))
+		return false;
+
+	if (ctx->pkt.rate)
+		s->pkt.tokens -= 1ULL << POLICE_SHIFT;
+	return true;
+}
+
+
+/* non IP packets are not policed: they do not belong to any flow */
+
+static bool
+police_flow_conform(struct police_context const *ctx, struct qbuff * buff)
+{
+	struct police_flow_table *t = this_cpu_ptr((struct police_flow_table __percpu *)ctx->state);
+	struct police_flow_entry *e;
+	uint32_t hash;
+
+	if (!sample_flow_hash(buff, false, &hash))
+		return true;
+
+	e = &t->entry[hash & (POLICE_FLOW_ENTRIES-1)];
+	if (e->tag != hash) {
+		e->tag = hash;
+		e->bucket.last = 0;
+		e->bucket.tokens = 0;
+	}
+
+	return police_take(&ctx->pkt, &e->bucket, 1, local_clock());
+}
+
+
+static ActionQbuff
+police_group(arguments_t args, struct qbuff * buff)
+{
+	if (police_group_conform(GET_ARG_0(struct police_context *, args), buff))
+		return Pass(buff);
+	police_account(buff);
+	return Drop(buff);
+}
+
+
+static ActionQbuff
+police_group_mark(arguments_t args, struct qbuff * buff)
+{
+	if (!police_group_conform(GET_ARG_0(struct police_context *, args), buff)) {
+		police_account(buff);
+		set_mark(buff, GET_ARG_2(uint32_t, args));
+	}
+	return Pass(buff);
+}
+
+
+static ActionQbuff
+police_group_class(arguments_t args, struct qbuff * buff)
+{
+	if (police_group_conform(GET_ARG_0(struct police_context *, args), buff))
+		return Pass(buff);
+	police_account(buff);
+	return Pass(class(buff, Q_CLASS(GET_ARG_2(int, args))));
+}
+
+
+static ActionQbuff
+police_flow(arguments_t args, struct qbuff * buff)
+{
+	if (police_flow_conform(GET_ARG_0(struct police_context *, args), buff))
+		return Pass(buff);
+	police_account(buff);
+	return Drop(buff);
+}
+
+
+static ActionQbuff
+police_flow_mark(arguments_t args, struct qbuff * buff)
+{
+	if (!police_flow_conform(GET_ARG_0(struct police_context *, args), buff)) {
+		police_account(buff);
+		set_mark(buff, GET_ARG_2(uint32_t, args));
+	}
+	return Pass(buff);
+}
+
+
+static ActionQbuff
+police_flow_class(arguments_t args, struct qbuff * buff)
+{
+	if (police_flow_conform(GET_ARG_0(struct police_context *, args), buff))
+		return Pass(buff);
+	police_account(buff);
+	return Pass(class(buff, Q_CLASS(GET_ARG_2(int, args))));
+}
+
+
+/* burst of a per-cpu group bucket: POLICE_GROUP_BURST_NS worth of tokens */
+
+static uint64_t
+police_group_burst(uint64_t rate, uint64_t min)
+{
+	uint64_t burst = div_u64(rate * POLICE_GROUP_BURST_NS, NSEC_PER_SEC);
+	return clamp_t(uint64_t, burst, min, POLICE_MAX_BURST - 1);
+}
+
+
+static int police_group_init(arguments_t args)
+{
+	uint64_t pps = GET_ARG_0(uint64_t, args);
+	uint64_t bps = GET_ARG_1(uint64_t, args);
+	struct police_context *ctx;
+	unsigned int cpus = num_online_cpus();
+	uint64_t pkt_rate, byte_rate;
+
+	if (pps == 0 && bps == 0) {
+		printk(KERN_INFO "[PFQ|init] police_group: no rate given!\n");
+		return -EINVAL;
+	}
+
+	ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+	if (ctx == NULL) {
+		printk(KERN_INFO "[PFQ|init] police_group: out of memory!\n");
+		return -ENOMEM;
+	}
+
+	pkt_rate  = pps ? max_t(uint64_t, div_u64(pps, cpus), 1) : 0;
+	byte_rate = bps ? max_t(uint64_t, div_u64(bps / 8, cpus), 1) : 0;
+
+	if (police_rate_init(&ctx->pkt, pkt_rate, police_group_burst(pkt_rate, 1)) < 0 ||
+	    police_rate_init(&ctx->byte, byte_rate, police_group_burst(byte_rate, POLICE_MIN_BYTE_BURST)) < 0) {
+		printk(KERN_INFO "[PFQ|init] police_group: rate out of range (%llu pps, %llu bps)!\n", pps, bps);
+		kfree(ctx);
+		return -EINVAL;
+	}
+
+	ctx->state = alloc_percpu(struct police_group_state);
+	if (ctx->state == NULL) {
+		printk(KERN_INFO "[PFQ|init] police_group: out of memory!\n");
+		kfree(ctx);
+		return -ENOMEM;
+	}
+
+	SET_ARG_0(args, ctx);
+
+	pr_devel("[PFQ|init] police_group: %llu pps, %llu bps (%u cpus)\n", pps, bps, cpus);
+	return 0;
+}
+
+
+static int police_flow_init(arguments_t args)
+{
+	uint64_t pps = GET_ARG_0(uint64_t, args);
+	uint64_t burst = GET_ARG_1(uint64_t, args);
+	struct police_context *ctx;
+
+	if (pps == 0) {
+		printk(KERN_INFO "[PFQ|init] police_flow: rate must be at least 1 pps!\n");
+		return -EINVAL;
+	}
+
+	ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+	if (ctx == NULL) {
+		printk(KERN_INFO "[PFQ|init] police_flow: out of memory!\n");
+		return -ENOMEM;
+	}
+
+	if (police_rate_init(&ctx->pkt, pps, burst) < 0) {
+		printk(KERN_INFO "[PFQ|init] police_flow: burst %llu out of range!\n", burst);
+		kfree(ctx);
+		return -EINVAL;
+	}
+
+	ctx->state = alloc_percpu(struct police_flow_table);
+	if (ctx->state == NULL) {
+		printk(KERN_INFO "[PFQ|init] police_flow: out of memory!\n");
+		kfree(ctx);
+		return -ENOMEM;
+	}
+
+	SET_ARG_0(args, ctx);
+
+	pr_devel("[PFQ|init] police_flow: %llu pps, burst %llu\n", pps, burst);
+	return 0;
+}
+
+
+static int police_class_check(arguments_t args)
+{
+	int c = GET_ARG_2(int, args);
+
+	if (c <= 0 || c >= (int)Q_CLASS_MAX) {
+		printk(KERN_INFO "[PFQ|init] police: class %d out of range!\n", c);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+
+static int police_group_class_init(arguments_t args)
+{
+	int err = police_class_check(args);
+	if (err < 0)
+		return err;
+	return police_group_init(args);
+}
+
+
+static int police_flow_class_init(arguments_t args)
+{
+	int err = police_class_check(args);
+	if (err < 0)
+		return err;
+	return police_flow_init(args);
+}
+
+
+static int police_fini(arguments_t args)
+{
+	struct police_context *ctx = GET_ARG_0(struct police_context *, args);
+
+	free_percpu(ctx->state);
+	kfree(ctx);
+	return 0;
+}
+
+
+struct pfq_lang_function_descr police_functions[] = {
+
+	{ "police_group",	"Word64 -> Word64 -> Qbuff -> Action Qbuff",		police_group,	    police_group_init,	     police_fini },
+	{ "police_group_mark",	"Word64 -> Word64 -> Word32 -> Qbuff -> Action Qbuff",	police_group_mark,  police_group_init,	     police_fini },
+	{ "police_group_class",	"Word64 -> Word64 -> CInt -> Qbuff -> Action Qbuff",	police_group_class, police_group_class_init, police_fini },
+	{ "police_flow",	"Word64 -> Word64 -> Qbuff -> Action Qbuff",		police_flow,	    police_flow_init,	     police_fini },
+	{ "police_flow_mark",	"Word64 -> Word64 -> Word32 -> Qbuff -> Action Qbuff",	police_flow_mark,   police_flow_init,	     police_fini },
+	{ "police_flow_class",	"Word64 -> Word64 -> CInt -> Qbuff -> Action Qbuff",	police_flow_class,  police_flow_class_init,  police_fini },
+	{ NULL }};
@@ -168,51 +168,36 @@ is_ip(struct qbuff * buff)
 static inline bool
 is_udp(struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
-
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-                return false;
+	int proto = qbuff_ip_protocol(buff);
 
-	if (ip->protocol != IPPROTO_UDP)
+	if (proto != IPPROTO_UDP)
                 return false;
 
-        return qbuff_header_available(buff, (int)qbuff_maclen(buff)  + (ip->ihl<<2), sizeof(struct udphdr));
+	return qbuff_l4_header_available(buff, sizeof(struct udphdr));
 }
 
 
 static inline bool
 is_tcp(struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
-
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-                return false;
+	int proto = qbuff_ip_protocol(buff);
 
-	if (ip->protocol != IPPROTO_TCP)
+	if (proto != IPPROTO_TCP)
                 return false;
 
-	return qbuff_header_available(buff, (int)qbuff_maclen(buff) + (ip->ihl<<2), sizeof(struct tcphdr));
+	return qbuff_l4_header_available(buff, sizeof(struct tcphdr));
 }
 
 
 static inline bool
 is_icmp(struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
-
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-                return false;
+	int proto = qbuff_ip_protocol(buff);
 
-	if (ip->protocol != IPPROTO_ICMP)
+	if (proto != IPPROTO_ICMP)
                 return false;
 
-	return qbuff_header_available(buff, (int)qbuff_maclen(buff) + (ip->ihl<<2), sizeof(struct icmphdr));
+	return qbuff_l4_header_available(buff, sizeof(struct icmphdr));
 }
 
 
@@ -222,7 +207,7 @@ has_addr(struct qbuff * buff, __be32 addr, __be32 mask)
 	struct iphdr _iph;
 	const struct iphdr *ip;
 
-        bool ctx = buff->monad->ep_ctx;
+        int ctx = buff->monad->ep_ctx;
 
 	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
 	if (ip == NULL)
@@ -263,18 +248,13 @@ has_dst_addr(struct qbuff * buff, __be32 addr, __be32 mask)
 static inline bool
 is_flow(struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
+	int proto = qbuff_ip_protocol(buff);
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-		return false;
-
-	if (ip->protocol != IPPROTO_UDP &&
-	    ip->protocol != IPPROTO_TCP)
+	if (proto != IPPROTO_UDP &&
+	    proto != IPPROTO_TCP)
                 return false;
 
-	return qbuff_header_available(buff, (int)qbuff_maclen(buff) + (ip->ihl<<2), ip->protocol == IPPROTO_UDP ?
+	return qbuff_l4_header_available(buff, proto == IPPROTO_UDP ?
 				    sizeof(struct udphdr) : sizeof(struct tcphdr));
 }
 
@@ -289,14 +269,7 @@ is_l3_proto(struct qbuff * buff, uint16_t type)
 static inline bool
 is_l4_proto(struct qbuff * buff, uint8_t protocol)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
-
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-		return false;
-
-        return ip->protocol == protocol;
+        return qbuff_ip_protocol(buff) == protocol;
 }
 
 
@@ -342,18 +315,11 @@ is_more_frag(struct qbuff * buff)
 static inline bool
 has_src_port(struct qbuff * buff, uint16_t port)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
-
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-		return false;
-
-	switch(ip->protocol)
+	switch(qbuff_ip_protocol(buff))
 	{
 	case IPPROTO_UDP: {
 		struct udphdr _udph; const struct udphdr *udp;
-		udp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(struct udphdr), &_udph);
+		udp = qbuff_l4_header_pointer(buff, 0, sizeof(struct udphdr), &_udph);
 		if (udp == NULL)
 			return false;
 
@@ -361,7 +327,7 @@ has_src_port(struct qbuff * buff, uint16_t port)
 	}
 	case IPPROTO_TCP: {
 		struct tcphdr _tcph; const struct tcphdr *tcp;
-		tcp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(struct tcphdr), &_tcph);
+		tcp = qbuff_l4_header_pointer(buff, 0, sizeof(struct tcphdr), &_tcph);
 		if (tcp == NULL)
 			return false;
 
@@ -375,18 +341,11 @@ has_src_port(struct qbuff * buff, uint16_t port)
 static inline bool
 has_dst_port(struct qbuff * buff, uint16_t port)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
-
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-		return false;
-
-	switch(ip->protocol)
+	switch(qbuff_ip_protocol(buff))
 	{
 	case IPPROTO_UDP: {
 		struct udphdr _udph; const struct udphdr *udp;
-		udp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(struct udphdr), &_udph);
+		udp = qbuff_l4_header_pointer(buff, 0, sizeof(struct udphdr), &_udph);
 		if (udp == NULL)
 			return false;
 
@@ -394,7 +353,7 @@ has_dst_port(struct qbuff * buff, uint16_t port)
 	}
 	case IPPROTO_TCP: {
 		struct tcphdr _tcph; const struct tcphdr *tcp;
-		tcp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(struct tcphdr), &_tcph);
+		tcp = qbuff_l4_header_pointer(buff, 0, sizeof(struct tcphdr), &_tcph);
 		if (tcp == NULL)
 			return false;
 
@@ -409,7 +368,7 @@ has_dst_port(struct qbuff * buff, uint16_t port)
 static inline bool
 has_port(struct qbuff * buff, uint16_t port)
 {
-        bool ctx = buff->monad->ep_ctx;
+        int ctx = buff->monad->ep_ctx;
 
 	return (has_src_port(buff, port) && (ctx & EPOINT_SRC)) ||
 	       (has_dst_port(buff, port) && (ctx & EPOINT_DST));
@@ -433,7 +392,7 @@ static inline bool
 is_broadcast(struct qbuff * buff)
 {
 	struct ethhdr *eth = qbuff_eth_hdr(buff);
-        bool ctx = buff->monad->ep_ctx;
+        int ctx = buff->monad->ep_ctx;
 
 	return (is_broadcast_ether_addr(eth->h_dest)   && (ctx & EPOINT_DST)) ||
 	       (is_broadcast_ether_addr(eth->h_source) && (ctx & EPOINT_SRC));
@@ -443,7 +402,7 @@ static inline bool
 is_multicast(struct qbuff * buff)
 {
 	struct ethhdr *eth = qbuff_eth_hdr(buff);
-        bool ctx = buff->monad->ep_ctx;
+        int ctx = buff->monad->ep_ctx;
 
 	return (is_multicast_ether_addr(eth->h_dest) && (ctx & EPOINT_DST)) ||
 	       (is_multicast_ether_addr(eth->h_source) && (ctx & EPOINT_SRC));
@@ -455,7 +414,7 @@ is_ip_broadcast(struct qbuff * buff)
 {
 	struct iphdr _iph;
 	const struct iphdr *ip;
-        bool ctx = buff->monad->ep_ctx;
+        int ctx = buff->monad->ep_ctx;
 
 	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
 	if (ip == NULL)
@@ -471,7 +430,7 @@ is_ip_multicast(struct qbuff * buff)
 {
 	struct iphdr _iph;
 	const struct iphdr *ip;
-        bool ctx = buff->monad->ep_ctx;
+        int ctx = buff->monad->ep_ctx;
 
 	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
 	if (ip == NULL)
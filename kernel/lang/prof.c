@@ -0,0 +1,173 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+
+#include <lang/module.h>
+#include <lang/monad.h>
+#include <lang/prof.h>
+
+#include <pfq/sparse.h>
+
+#include <linux/pf_q.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/timex.h>
+
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,3,0))
+DEFINE_STATIC_KEY_FALSE(pfq_lang_prof_key);
+#else
+struct static_key pfq_lang_prof_key = STATIC_KEY_INIT_FALSE;
+#endif
+
+EXPORT_SYMBOL(pfq_lang_prof_key);
+
+
+static DEFINE_MUTEX(prof_lock);
+
+static bool prof_ready;		/* the key is toggled only when the module is live */
+static bool prof_value;
+static bool prof_enabled;
+
+
+static void
+prof_apply(bool value)
+{
+	if (value == prof_enabled)
+		return;
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,3,0))
+	if (value)
+		static_branch_enable(&pfq_lang_prof_key);
+	else
+		static_branch_disable(&pfq_lang_prof_key);
+#else
+	if (value)
+		static_key_slow_inc(&pfq_lang_prof_key);
+	else
+		static_key_slow_dec(&pfq_lang_prof_key);
+#endif
+	prof_enabled = value;
+
+	printk(KERN_INFO "[PFQ] pfq-lang profiling %s.\n", value ? "enabled" : "disabled");
+}
+
+
+void
+pfq_lang_prof_set(bool value)
+{
+	mutex_lock(&prof_lock);
+	prof_value = value;
+	if (prof_ready)
+		prof_apply(value);
+	mutex_unlock(&prof_lock);
+}
+
+
+void
+pfq_lang_prof_init(void)
+{
+	mutex_lock(&prof_lock);
+	prof_ready = true;
+	prof_apply(prof_value);
+	mutex_unlock(&prof_lock);
+}
+
+
+void
+pfq_lang_prof_fini(void)
+{
+	mutex_lock(&prof_lock);
+	prof_apply(false);
+	prof_ready = false;
+	mutex_unlock(&prof_lock);
+}
+
+
+/* kleisli composition with per-node counters (the slow path of eval_function) */
+
+ActionQbuff
+pfq_lang_prof_eval(function_t f, struct qbuff * buff)
+{
+	struct pfq_lang_functional *fun = f.fun;
+
+	while (fun) {
+
+		struct pfq_lang_functional_node *node = container_of(fun, struct pfq_lang_functional_node, fun);
+		struct pfq_lang_prof *prof = this_cpu_ptr(node->prof);
+		bool sample = (local_read(&prof->invoke) % Q_LANG_PROF_SAMPLE) == 0;
+		cycles_t start = 0;
+
+		local_inc(&prof->invoke);
+
+		if (sample)
+			start = get_cycles();
+
+		buff = ((function_ptr_t)fun->run)(fun, buff).qbuff;
+
+		if (sample) {
+			local_add((long)(get_cycles() - start), &prof->cycles);
+			local_inc(&prof->samples);
+		}
+
+		if (buff == NULL || is_drop(buff->monad->fanout)) {
+			local_inc(&prof->drop);
+			return Pass(buff);
+		}
+
+		local_inc(&prof->pass);
+		fun = fun->next;
+	}
+
+	return Pass(buff);
+}
+
+EXPORT_SYMBOL(pfq_lang_prof_eval);
+
+
+size_t
+pfq_lang_prof_read(struct pfq_lang_computation_tree const *comp, struct pfq_lang_node_stats *stats, size_t size)
+{
+	size_t n;
+
+	for(n = 0; n < min(size, comp->size); n++)
+	{
+		struct pfq_lang_functional_node const *node = &comp->node[n];
+		struct pfq_lang_node_stats *s = &stats[n];
+
+		memset(s, 0, sizeof(*s));
+
+		if (node->symbol)
+			strncpy(s->symbol, node->symbol, Q_LANG_PROF_SYMB_LEN-1);
+
+		s->next = node->fun.next ? container_of(node->fun.next, struct pfq_lang_functional_node, fun) - comp->node : -1;
+
+		s->invoke  = (unsigned long)sparse_read(node->prof, invoke);
+		s->pass    = (unsigned long)sparse_read(node->prof, pass);
+		s->drop    = (unsigned long)sparse_read(node->prof, drop);
+		s->cycles  = (unsigned long)sparse_read(node->prof, cycles);
+		s->samples = (unsigned long)sparse_read(node->prof, samples);
+	}
+
+	return comp->size;
+}
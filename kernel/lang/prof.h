@@ -0,0 +1,70 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+
+#ifndef PFQ_LANG_PROF_H
+#define PFQ_LANG_PROF_H
+
+#include <linux/version.h>
+#include <linux/jump_label.h>
+#include <asm/local.h>
+
+/* one every Q_LANG_PROF_SAMPLE invocations is timed with get_cycles() */
+
+#define Q_LANG_PROF_SAMPLE		64
+
+
+/* per-cpu profiling counters of a function (node) of a computation */
+
+struct pfq_lang_prof
+{
+	local_t		invoke;
+	local_t		pass;
+	local_t		drop;
+	local_t		cycles;
+	local_t		samples;
+};
+
+
+/* profiling is compiled in, but patched out of the fast path while disabled */
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,3,0))
+DECLARE_STATIC_KEY_FALSE(pfq_lang_prof_key);
+#define pfq_lang_prof_enabled()		static_branch_unlikely(&pfq_lang_prof_key)
+#else
+extern struct static_key pfq_lang_prof_key;
+#define pfq_lang_prof_enabled()		static_key_false(&pfq_lang_prof_key)
+#endif
+
+
+struct pfq_lang_computation_tree;
+struct pfq_lang_node_stats;
+
+extern void pfq_lang_prof_init(void);
+extern void pfq_lang_prof_fini(void);
+extern void pfq_lang_prof_set(bool value);
+
+extern size_t pfq_lang_prof_read(struct pfq_lang_computation_tree const *comp,
+				 struct pfq_lang_node_stats *stats, size_t size);
+
+#endif /* PFQ_LANG_PROF_H */
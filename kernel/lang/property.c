@@ -106,20 +106,13 @@ ip_frag(arguments_t args, struct qbuff * buff)
 static uint64_t
 tcp_source(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
-
 	struct tcphdr _tcp;
 	const struct tcphdr *tcp;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-		return NOTHING;
-
-	if (ip->protocol != IPPROTO_TCP)
+	if (qbuff_ip_protocol(buff) != IPPROTO_TCP)
 		return NOTHING;
 
-	tcp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_tcp), &_tcp);
+	tcp = qbuff_l4_header_pointer(buff, 0, sizeof(_tcp), &_tcp);
 	if (tcp == NULL)
 		return NOTHING;
 
@@ -130,20 +123,13 @@ tcp_source(arguments_t args, struct qbuff * buff)
 static uint64_t
 tcp_dest(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
-
 	struct tcphdr _tcp;
 	const struct tcphdr *tcp;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-		return NOTHING;
-
-	if (ip->protocol != IPPROTO_TCP)
+	if (qbuff_ip_protocol(buff) != IPPROTO_TCP)
 		return NOTHING;
 
-	tcp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_tcp), &_tcp);
+	tcp = qbuff_l4_header_pointer(buff, 0, sizeof(_tcp), &_tcp);
 	if (tcp == NULL)
 		return NOTHING;
 
@@ -153,20 +139,13 @@ tcp_dest(arguments_t args, struct qbuff * buff)
 static uint64_t
 tcp_hdrlen_(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
-
 	struct tcphdr _tcp;
 	const struct tcphdr *tcp;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-		return NOTHING;
-
-	if (ip->protocol != IPPROTO_TCP)
+	if (qbuff_ip_protocol(buff) != IPPROTO_TCP)
 		return NOTHING;
 
-	tcp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_tcp), &_tcp);
+	tcp = qbuff_l4_header_pointer(buff, 0, sizeof(_tcp), &_tcp);
 	if (tcp == NULL)
 		return NOTHING;
 
@@ -180,20 +159,13 @@ tcp_hdrlen_(arguments_t args, struct qbuff * buff)
 static uint64_t
 udp_source(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
-
 	struct udphdr _udp;
 	const struct udphdr *udp;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-		return NOTHING;
-
-	if (ip->protocol != IPPROTO_UDP)
+	if (qbuff_ip_protocol(buff) != IPPROTO_UDP)
 		return NOTHING;
 
-	udp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_udp), &_udp);
+	udp = qbuff_l4_header_pointer(buff, 0, sizeof(_udp), &_udp);
 	if (udp == NULL)
 		return NOTHING;
 
@@ -204,20 +176,13 @@ udp_source(arguments_t args, struct qbuff * buff)
 static uint64_t
 udp_dest(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
-
 	struct udphdr _udp;
 	const struct udphdr *udp;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-		return NOTHING;
-
-	if (ip->protocol != IPPROTO_UDP)
+	if (qbuff_ip_protocol(buff) != IPPROTO_UDP)
 		return NOTHING;
 
-	udp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_udp), &_udp);
+	udp = qbuff_l4_header_pointer(buff, 0, sizeof(_udp), &_udp);
 	if (udp == NULL)
 		return NOTHING;
 
@@ -227,20 +192,13 @@ udp_dest(arguments_t args, struct qbuff * buff)
 static uint64_t
 udp_len(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
-
 	struct udphdr _udp;
 	const struct udphdr *udp;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-		return NOTHING;
-
-	if (ip->protocol != IPPROTO_UDP)
+	if (qbuff_ip_protocol(buff) != IPPROTO_UDP)
 		return NOTHING;
 
-	udp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_udp), &_udp);
+	udp = qbuff_l4_header_pointer(buff, 0, sizeof(_udp), &_udp);
 	if (udp == NULL)
 		return NOTHING;
 
@@ -251,20 +209,13 @@ udp_len(arguments_t args, struct qbuff * buff)
 static uint64_t
 icmp_type(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
-
 	struct icmphdr _icmp;
 	const struct icmphdr *icmp;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-		return NOTHING;
-
-	if (ip->protocol != IPPROTO_ICMP)
+	if (qbuff_ip_protocol(buff) != IPPROTO_ICMP)
 		return NOTHING;
 
-	icmp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_icmp), &_icmp);
+	icmp = qbuff_l4_header_pointer(buff, 0, sizeof(_icmp), &_icmp);
 	if (icmp == NULL)
 		return NOTHING;
 
@@ -275,20 +226,13 @@ icmp_type(arguments_t args, struct qbuff * buff)
 static uint64_t
 icmp_code(arguments_t args, struct qbuff * buff)
 {
-	struct iphdr _iph;
-	const struct iphdr *ip;
-
 	struct icmphdr _icmp;
 	const struct icmphdr *icmp;
 
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-		return NOTHING;
-
-	if (ip->protocol != IPPROTO_ICMP)
+	if (qbuff_ip_protocol(buff) != IPPROTO_ICMP)
 		return NOTHING;
 
-	icmp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_icmp), &_icmp);
+	icmp = qbuff_l4_header_pointer(buff, 0, sizeof(_icmp), &_icmp);
 	if (icmp == NULL)
 		return NOTHING;
 
@@ -29,131 +29,457 @@
 
 #include <pfq/nethdr.h>
 
+#include <linux/if_vlan.h>
+#include <linux/if_tunnel.h>
+
+
+#define Q_GTP_C_PORT		2123
+#define Q_GTP_U_PORT		2152
+#define Q_VXLAN_PORT		4789
+
+#define Q_MPLS_MAX_LABELS	8
+#define Q_GTP_MAX_EXT_HDR	4
+
+
+/* IP version of the header at offset (MPLS and GTP do not carry the payload type) */
+
+static inline int
+ip_proto_at(struct qbuff const *buff, int offset)
+{
+	uint8_t _v;
+	const uint8_t *v;
+
+	v = qbuff_header_pointer(buff, offset, sizeof(_v), &_v);
+	if (v == NULL)
+		return IPPROTO_NONE;
+
+	switch(*v >> 4)
+	{
+	case 4: return IPPROTO_IP;
+	case 6: return IPPROTO_IPV6;
+	}
+
+	return IPPROTO_NONE;
+}
+
+
+/* MPLS label stack: offset of the payload and bottom label */
+
+static inline int
+mpls_offset(struct qbuff const *buff, int offset, int *proto, uint32_t *label)
+{
+	int n;
+
+	for(n = 0; n < Q_MPLS_MAX_LABELS; n++, offset += 4)
+	{
+		__be32 _lse;
+		const __be32 *lse;
+
+		lse = qbuff_header_pointer(buff, offset, sizeof(_lse), &_lse);
+		if (lse == NULL)
+			break;
+
+		*label = be32_to_cpu(*lse) >> 12;
+
+		if (be32_to_cpu(*lse) & 0x100) {	/* bottom of stack */
+			*proto = ip_proto_at(buff, offset + 4);
+			return offset + 4;
+		}
+	}
+
+	*proto = IPPROTO_NONE;
+	return -1;
+}
+
+
+/* Ethernet frame in a tunnel (VXLAN, GRE TEB) */
+
+static inline int
+eth_offset(struct qbuff const *buff, int offset, int *proto)
+{
+	__be16 _type;
+	const __be16 *type;
+	int n;
+
+	type = qbuff_header_pointer(buff, offset + 12, sizeof(_type), &_type);
+	if (type == NULL)
+		goto none;
+
+	offset += ETH_HLEN;
+
+	for(n = 0; n < 2 && (*type == __constant_htons(ETH_P_8021Q) ||
+			     *type == __constant_htons(ETH_P_8021AD)); n++)
+	{
+		type = qbuff_header_pointer(buff, offset + 2, sizeof(_type), &_type);
+		if (type == NULL)
+			goto none;
+		offset += VLAN_HLEN;
+	}
+
+	if (*type == __constant_htons(ETH_P_IP)) {
+		*proto = IPPROTO_IP;
+		return offset;
+	}
+	if (*type == __constant_htons(ETH_P_IPV6)) {
+		*proto = IPPROTO_IPV6;
+		return offset;
+	}
+none:
+	*proto = IPPROTO_NONE;
+	return -1;
+}
+
+
+static inline int
+gre_offset(struct qbuff const *buff, int offset, int *proto, uint32_t *key)
+{
+	__be16 _gre[2];
+	const __be16 *gre;
+	int len = 4;
+
+	gre = qbuff_header_pointer(buff, offset, sizeof(_gre), _gre);
+	if (gre == NULL || (gre[0] & GRE_VERSION))
+		goto none;
+
+	if (gre[0] & GRE_CSUM)
+		len += 4;
+
+	if (gre[0] & GRE_KEY) {
+		__be32 _k;
+		const __be32 *k = qbuff_header_pointer(buff, offset + len, sizeof(_k), &_k);
+		if (k == NULL)
+			goto none;
+		*key = be32_to_cpu(*k);
+		len += 4;
+	}
+
+	if (gre[0] & GRE_SEQ)
+		len += 4;
+
+	switch(gre[1])
+	{
+	case __constant_htons(ETH_P_IP): {
+		*proto = IPPROTO_IP;
+		return offset + len;
+	}
+	case __constant_htons(ETH_P_IPV6): {
+		*proto = IPPROTO_IPV6;
+		return offset + len;
+	}
+	case __constant_htons(ETH_P_TEB):
+		return eth_offset(buff, offset + len, proto);
+	case __constant_htons(ETH_P_MPLS_UC):
+		return mpls_offset(buff, offset + len, proto, key);
+	}
+none:
+	*proto = IPPROTO_NONE;
+	return -1;
+}
+
+
+/* GTP-U: G-PDU (version 1, message type 255) carrying an IP packet */
+
+static inline int
+gtp_u_offset(struct qbuff const *buff, int offset, int *proto, uint32_t *teid)
+{
+	uint8_t _h[8];
+	const uint8_t *h;
+	int len = 8, n;
+
+	h = qbuff_header_pointer(buff, offset, 8, _h);
+	if (h == NULL || (h[0] & 0xf0) != 0x30 || h[1] != 0xff)
+		goto none;
+
+	*teid = be32_to_cpu(*(__be32 const *)(h + 4));
+
+	if (h[0] & 0x07) {	/* E, S, PN: sequence number, N-PDU and next extension type */
+		uint8_t _next;
+		const uint8_t *next;
+
+		next = qbuff_header_pointer(buff, offset + 11, 1, &_next);
+		if (next == NULL)
+			goto none;
+
+		len = 12;
+
+		for(n = 0; (h[0] & 0x04) && *next && n < Q_GTP_MAX_EXT_HDR; n++)
+		{
+			uint8_t _elen;
+			const uint8_t *elen;
+
+			elen = qbuff_header_pointer(buff, offset + len, 1, &_elen);
+			if (elen == NULL || *elen == 0)
+				goto none;
+
+			len += *elen * 4;
+
+			next = qbuff_header_pointer(buff, offset + len - 1, 1, &_next);
+			if (next == NULL)
+				goto none;
+		}
+	}
+
+	*proto = ip_proto_at(buff, offset + len);
+	return offset + len;
+none:
+	*proto = IPPROTO_NONE;
+	return -1;
+}
+
 
 static inline int
-next_ip_offset(struct qbuff const *buff, int offset, int tproto, int *proto)
+udp_tunnel_offset(struct qbuff const *buff, int offset, int *proto, uint8_t *tunnel, uint32_t *id)
 {
-	(void)buff;
+	struct udphdr _udp;
+	const struct udphdr *udp;
+
+	udp = qbuff_header_pointer(buff, offset, sizeof(_udp), &_udp);
+	if (udp == NULL)
+		goto none;
+
+	switch(udp->dest)
+	{
+	case __constant_htons(Q_GTP_U_PORT): {
+		*tunnel = Q_TUNNEL_GTP;
+		return gtp_u_offset(buff, offset + sizeof(_udp), proto, id);
+	}
+	case __constant_htons(Q_VXLAN_PORT): {
+		__be32 _vx[2];
+		const __be32 *vx;
+
+		vx = qbuff_header_pointer(buff, offset + sizeof(_udp), sizeof(_vx), _vx);
+		if (vx == NULL || !(vx[0] & __constant_htonl(0x08000000)))
+			goto none;
+
+		*tunnel = Q_TUNNEL_VXLAN;
+		*id = be32_to_cpu(vx[1]) >> 8;
+		return eth_offset(buff, offset + sizeof(_udp) + sizeof(_vx), proto);
+	}
+	}
+none:
+	*proto = IPPROTO_NONE;
+	return -1;
+}
+
+
+/* tunnels: offset and protocol of the next IP level, IPPROTO_NONE if any */
+
+static inline int
+next_ip_offset(struct qbuff const *buff, int offset, int tproto, int *proto, uint8_t *tunnel, uint32_t *id)
+{
+	*id = 0;
 
 	switch(tproto)
 	{
 	case IPPROTO_IPIP: {
+		*tunnel = Q_TUNNEL_IP;
 		*proto = IPPROTO_IP;
 		return offset;
 	}
 	case IPPROTO_IPV6: {
+		*tunnel = Q_TUNNEL_IP;
 		*proto = IPPROTO_IPV6;
 		return offset;
 	}
+	case IPPROTO_GRE: {
+		*tunnel = Q_TUNNEL_GRE;
+		return gre_offset(buff, offset, proto, id);
+	}
+	case IPPROTO_UDP:
+		return udp_tunnel_offset(buff, offset, proto, tunnel, id);
 	}
 
+	*proto = IPPROTO_NONE;
 	return -1;
 }
 
 
-static inline int
-qbuff_next_ip_offset(struct qbuff *buff, int offset, int *proto)
+/* parse the packet once: VLAN stack, MPLS and IP levels (the results are cached in the qbuff) */
+
+static inline void
+qbuff_parse_headers(struct qbuff *buff)
 {
-	switch(*proto)
+	struct qbuff_headers *hdr = &buff->hdr;
+	__be16 type = qbuff_eth_hdr(buff)->h_proto;
+	int proto, offset = (int)qbuff_maclen(buff);
+	uint8_t tunnel = Q_TUNNEL_NONE;
+	uint32_t tunnel_id = 0;
+
+	hdr->levels = 0;
+	hdr->vlan_num = 0;
+
+	/* in-band VLAN tags (802.1Q and QinQ) */
+
+	if (type == __constant_htons(ETH_P_8021Q) || type == __constant_htons(ETH_P_8021AD))
 	{
-	case IPPROTO_NONE: {
+		offset = ETH_HLEN;
 
-		if (qbuff_eth_hdr(buff)->h_proto == __constant_htons(ETH_P_IP))
+		while (type == __constant_htons(ETH_P_8021Q) || type == __constant_htons(ETH_P_8021AD))
 		{
-			*proto = IPPROTO_IP;
-			return (int)qbuff_maclen(buff);
+			struct vlan_hdr _vh;
+			const struct vlan_hdr *vh;
+
+			vh = qbuff_header_pointer(buff, offset, sizeof(_vh), &_vh);
+			if (vh == NULL)
+				break;
+
+			type = vh->h_vlan_encapsulated_proto;
+			offset += VLAN_HLEN;
+			hdr->vlan_num++;
 		}
+	}
 
-		if (qbuff_eth_hdr(buff)->h_proto == __constant_htons(ETH_P_IPV6))
-		{
-			*proto = IPPROTO_IPV6;
-			return (int)qbuff_maclen(buff);
+	hdr->l3proto = type;
+
+	if (type == __constant_htons(ETH_P_MPLS_UC) || type == __constant_htons(ETH_P_MPLS_MC)) {
+		tunnel = Q_TUNNEL_MPLS;
+		offset = mpls_offset(buff, offset, &proto, &tunnel_id);
+	}
+	else
+		proto = type == __constant_htons(ETH_P_IP)   ? IPPROTO_IP   :
+			type == __constant_htons(ETH_P_IPV6) ? IPPROTO_IPV6 : IPPROTO_NONE;
+
+	/* IP levels */
+
+	while (proto != IPPROTO_NONE && hdr->levels < Q_QBUFF_MAX_IP_LEVEL)
+	{
+		struct qbuff_ip_level *level = &hdr->ip[hdr->levels];
+		bool fragment = false;
+
+		if (proto == IPPROTO_IP) {
+
+			struct iphdr _iph;
+			const struct iphdr *ip;
+
+			ip = qbuff_header_pointer(buff, offset, sizeof(_iph), &_iph);
+			if (ip == NULL)
+				break;
+
+			level->l4proto = ip->protocol;
+			level->l4off   = (int16_t)(offset + (ip->ihl<<2));
+
+			fragment = (ip->frag_off & __constant_htons(IP_OFFSET)) != 0;
 		}
+		else {
+			struct ipv6hdr _ip6h;
+			const struct ipv6hdr *ip6;
 
-		return -1;
+			ip6 = qbuff_header_pointer(buff, offset, sizeof(_ip6h), &_ip6h);
+			if (ip6 == NULL)
+				break;
 
-	} break;
-	case IPPROTO_IP: {
+			level->l4proto = ip6->nexthdr;
+			level->l4off   = (int16_t)(offset + sizeof(struct ipv6hdr));
+		}
 
-		struct iphdr _iph;
-		const struct iphdr *ip;
+		level->off	 = (int16_t)offset;
+		level->proto	 = (uint8_t)proto;
+		level->tunnel	 = tunnel;
+		level->tunnel_id = tunnel_id;
+		hdr->levels++;
 
-		ip = qbuff_header_pointer(buff, offset, sizeof(_iph), &_iph);
-		if (ip == NULL)
-			return -1;
+		/* no tunnel header in the non-first fragments */
 
-                return next_ip_offset(buff, offset + (ip->ihl<<2), ip->protocol, proto);
+		if (fragment)
+			break;
 
-	} break;
+		offset = next_ip_offset(buff, level->l4off, level->l4proto, &proto, &tunnel, &tunnel_id);
 	}
+}
 
-	return -1;
+
+/* the IP level selected by the monad (shift) */
+
+static inline struct qbuff_ip_level const *
+qbuff_ip_level(struct qbuff *buff)
+{
+	int shift = buff->monad->shift;
+
+	if (unlikely(buff->hdr.levels < 0))
+		qbuff_parse_headers(buff);
+
+	if (shift < 0 || shift >= buff->hdr.levels)
+		return NULL;
+
+	return &buff->hdr.ip[shift];
+}
+
+
+/* the IP level tunneled in the one selected by the monad, if any */
+
+static inline struct qbuff_ip_level const *
+qbuff_ip_inner_level(struct qbuff *buff)
+{
+	struct qbuff_ip_level const *level = qbuff_ip_level(buff);
+
+	if (level == NULL || buff->monad->shift + 1 >= buff->hdr.levels)
+		return NULL;
+
+	return level + 1;
 }
 
 
 static inline const void *
 qbuff_generic_ip_header_pointer(struct qbuff * buff, int ip_proto, int offset, int len, void *buffer)
 {
-	int ipoff = buff->monad->ipoff;
+	struct qbuff_ip_level const *level = qbuff_ip_level(buff);
 
-	if (unlikely(ipoff < 0))
+	if (level == NULL || level->proto != ip_proto)
 		return NULL;
 
-	if (buff->monad->ipproto == IPPROTO_NONE)
-	{
-		int n = 0;
-		do
-		{
-			ipoff = qbuff_next_ip_offset(buff, ipoff, &buff->monad->ipproto);
-			if (ipoff < 0) {
-				buff->monad->ipproto = IPPROTO_NONE;
-				buff->monad->ipoff = -1;
-				return NULL;
-			}
-		}
-		while (n++ < buff->monad->shift);
+	return qbuff_header_pointer(buff, level->off + offset, len, buffer);
+}
 
-		buff->monad->ipoff = ipoff;
-	}
+#define qbuff_ip_header_pointer(buff, offset, len, buffer)  qbuff_generic_ip_header_pointer(buff, IPPROTO_IP, offset, len, buffer)
+#define qbuff_ip6_header_pointer(buff, offset, len, buffer) qbuff_generic_ip_header_pointer(buff, IPPROTO_IPV6, offset, len, buffer)
+
+
+/* transport header of the IPv4 level selected by the monad */
+
+static inline const void *
+qbuff_l4_header_pointer(struct qbuff * buff, int offset, int len, void *buffer)
+{
+	struct qbuff_ip_level const *level = qbuff_ip_level(buff);
 
-	if (buff->monad->ipproto != ip_proto)
+	if (level == NULL || level->proto != IPPROTO_IP)
 		return NULL;
 
-	return qbuff_header_pointer(buff, buff->monad->ipoff + offset, len, buffer);
+	return qbuff_header_pointer(buff, level->l4off + offset, len, buffer);
 }
 
-#define qbuff_ip_header_pointer(buff, offset, len, buffer)  qbuff_generic_ip_header_pointer(buff, IPPROTO_IP, offset, len, buffer)
+
+static inline bool
+qbuff_l4_header_available(struct qbuff * buff, int len)
+{
+	struct qbuff_ip_level const *level = qbuff_ip_level(buff);
+
+	if (level == NULL)
+		return false;
+
+	return (int)qbuff_len(buff) - level->l4off >= len;
+}
 
 
 static inline int
 qbuff_ip_version(struct qbuff * buff)
 {
-	if (unlikely(buff->monad->ipoff < 0))
-		return 0;
+	struct qbuff_ip_level const *level = qbuff_ip_level(buff);
 
-	if (buff->monad->ipproto == IPPROTO_NONE)
-	{
-		qbuff_ip_header_pointer(buff, 0, 0, NULL);
-	}
+	if (level == NULL)
+		return 0;
 
-	return buff->monad->ipproto == IPPROTO_IP   ? 4 :
-	       buff->monad->ipproto == IPPROTO_IPV6 ? 6 : 0;
+	return level->proto == IPPROTO_IP   ? 4 :
+	       level->proto == IPPROTO_IPV6 ? 6 : 0;
 }
 
 
 static inline int
 qbuff_ip_protocol(struct qbuff * buff)
 {
-	switch(qbuff_ip_version(buff))
-	{
-	case 4: {
-		struct iphdr _iph;
-		const struct iphdr *ip;
-		ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-		if (ip)
-			return ip->protocol;
-	} break;
-	}
+	struct qbuff_ip_level const *level = qbuff_ip_level(buff);
+
+	if (level && level->proto == IPPROTO_IP)
+		return level->l4proto;
 
 	return IPPROTO_NONE;
 }
@@ -0,0 +1,212 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <lang/module.h>
+#include <lang/qbuff.h>
+#include <lang/sample.h>
+
+#include <pfq/global.h>
+
+#include <linux/jhash.h>
+
+
+/*
+ * Deterministic sampling: keep the packet when the keyed hash falls in the
+ * first 1/rate of the hash space. The key (module parameter sample_seed) is
+ * the same on every cpu and group, so that the decision is consistent.
+ */
+
+static inline bool
+sample_keep(uint32_t hash, uint32_t rate)
+{
+	return (((uint64_t)hash * rate) >> 32) == 0;
+}
+
+
+static inline uint32_t
+sample_addr_hash(const __be32 *addr, int proto)
+{
+	if (proto == IPPROTO_IP)
+		return (__force uint32_t)addr[0];
+	return jhash2((__force const u32 *)addr, 4, 0);
+}
+
+
+/* hash of the 5-tuple; symmetric: the same for both directions */
+
+bool
+sample_flow_hash(struct qbuff * buff, bool symmetric, uint32_t *hash)
+{
+	struct qbuff_ip_level const *level = qbuff_ip_level(buff);
+	uint32_t src, dst, ports = 0;
+
+	if (level == NULL)
+		return false;
+
+	if (level->proto == IPPROTO_IP) {
+		struct iphdr _iph;
+		const struct iphdr *ip;
+
+		ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+		if (ip == NULL)
+			return false;
+
+		src = sample_addr_hash(&ip->saddr, IPPROTO_IP);
+		dst = sample_addr_hash(&ip->daddr, IPPROTO_IP);
+	}
+	else {
+		struct ipv6hdr _ip6h;
+		const struct ipv6hdr *ip6;
+
+		ip6 = qbuff_ip6_header_pointer(buff, 0, sizeof(_ip6h), &_ip6h);
+		if (ip6 == NULL)
+			return false;
+
+		src = sample_addr_hash(ip6->saddr.s6_addr32, IPPROTO_IPV6);
+		dst = sample_addr_hash(ip6->daddr.s6_addr32, IPPROTO_IPV6);
+	}
+
+	if (level->l4proto == IPPROTO_TCP || level->l4proto == IPPROTO_UDP ||
+	    level->l4proto == IPPROTO_SCTP) {
+		__be16 _pp[2];
+		const __be16 *pp;
+
+		pp = qbuff_header_pointer(buff, level->l4off, sizeof(_pp), _pp);
+		if (pp) {
+			uint16_t sport = (__force uint16_t)pp[0], dport = (__force uint16_t)pp[1];
+
+			if (symmetric && (src > dst || (src == dst && sport > dport)))
+				swap(sport, dport);
+
+			ports = (uint32_t)sport << 16 | dport;
+		}
+	}
+
+	if (symmetric && src > dst)
+		swap(src, dst);
+
+	*hash = jhash_3words(src, dst, ports ^ level->l4proto, global->sample_seed);
+	return true;
+}
+
+
+/*
+ * Hash of the fields that do not change along the path (trajectory sampling):
+ * the same packet is kept by every observation point.
+ */
+
+static uint32_t
+sample_packet_hash(struct qbuff * buff)
+{
+	struct qbuff_ip_level const *level = qbuff_ip_level(buff);
+	uint32_t _l4[2], l4 = 0;
+	const uint32_t *p;
+
+	if (level == NULL)
+		return jhash_1word(buff->counter, global->sample_seed);
+
+	/* ports and sequence number (TCP), ports, length and checksum (UDP) */
+
+	p = qbuff_header_pointer(buff, level->l4off, sizeof(_l4), _l4);
+	if (p)
+		l4 = p[0] ^ p[1];
+
+	if (level->proto == IPPROTO_IP) {
+		struct iphdr _iph;
+		const struct iphdr *ip;
+
+		ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+		if (ip == NULL)
+			return 0;
+
+		return jhash_3words((__force u32)ip->saddr ^ (__force u32)ip->daddr,
+				    (uint32_t)(__force u16)ip->id << 16 ^ (__force u16)ip->tot_len,
+				    l4, global->sample_seed);
+	}
+	else {
+		struct ipv6hdr _ip6h;
+		const struct ipv6hdr *ip6;
+
+		ip6 = qbuff_ip6_header_pointer(buff, 0, sizeof(_ip6h), &_ip6h);
+		if (ip6 == NULL)
+			return 0;
+
+		return jhash_3words(sample_addr_hash(ip6->saddr.s6_addr32, IPPROTO_IPV6) ^
+				    sample_addr_hash(ip6->daddr.s6_addr32, IPPROTO_IPV6),
+				    (__force u16)ip6->payload_len, l4, global->sample_seed);
+	}
+}
+
+
+static ActionQbuff
+sample_flow(arguments_t args, struct qbuff * buff)
+{
+	uint32_t rate = GET_ARG_0(uint32_t, args), hash;
+
+	if (sample_flow_hash(buff, false, &hash) && sample_keep(hash, rate))
+		return Pass(buff);
+	return Drop(buff);
+}
+
+
+static ActionQbuff
+sample_flow_sym(arguments_t args, struct qbuff * buff)
+{
+	uint32_t rate = GET_ARG_0(uint32_t, args), hash;
+
+	if (sample_flow_hash(buff, true, &hash) && sample_keep(hash, rate))
+		return Pass(buff);
+	return Drop(buff);
+}
+
+
+static ActionQbuff
+sample_packet(arguments_t args, struct qbuff * buff)
+{
+	uint32_t rate = GET_ARG_0(uint32_t, args);
+
+	if (sample_keep(sample_packet_hash(buff), rate))
+		return Pass(buff);
+	return Drop(buff);
+}
+
+
+static int sample_init(arguments_t args)
+{
+	uint32_t rate = GET_ARG_0(uint32_t, args);
+
+	if (rate == 0) {
+		printk(KERN_INFO "[PFQ|init] sample: rate must be at least 1 (1 packet/flow out of rate)!\n");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+
+struct pfq_lang_function_descr sample_functions[] = {
+
+	{ "sample_flow",	"Word32 -> Qbuff -> Action Qbuff",	sample_flow,	 sample_init, NULL },
+	{ "sample_flow_sym",	"Word32 -> Qbuff -> Action Qbuff",	sample_flow_sym, sample_init, NULL },
+	{ "sample_packet",	"Word32 -> Qbuff -> Action Qbuff",	sample_packet,	 sample_init, NULL },
+	{ NULL }};
@@ -275,6 +275,7 @@ static struct
 	{.symb = "Word32",  .size = sizeof(uint32_t)},
 	{.symb = "Word64",  .size = sizeof(uint64_t)},
 	{.symb = "CIDR",    .size = sizeof(struct CIDR)},
+	{.symb = "CIDR6",   .size = sizeof(struct CIDR6)},
 	{.symb = "String",  .size = 0},
 	{.symb = "Action",  .size = 0},
 	{.symb = "Qbuff",  .size = 0}
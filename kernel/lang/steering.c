@@ -22,11 +22,15 @@
  ****************************************************************/
 
 #include <lang/module.h>
+#include <lang/steering.h>
 #include <lang/types.h>
 #include <lang/qbuff.h>
 
 #include <pfq/bitops.h>
+#include <pfq/frag.h>
+#include <pfq/global.h>
 #include <pfq/kcompat.h>
+#include <pfq/percpu.h>
 #include <pfq/printk.h>
 #include <pfq/qbuff.h>
 #include <pfq/vlan.h>
@@ -69,7 +73,7 @@ steering_key(arguments_t args, struct qbuff * buff)
 		    	return Drop(buff);
 		}
 
-		udp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_udp), &_udp);
+		udp = qbuff_l4_header_pointer(buff, 0, sizeof(_udp), &_udp);
 		if (udp == NULL)
 			return Drop(buff);  /* broken */
 
@@ -212,14 +216,6 @@ steering_rrobin(arguments_t args, struct qbuff * buff)
 
 
 
-static ActionQbuff
-steering_rss(arguments_t args, struct qbuff * buff)
-{
-	uint32_t hash = qbuff_get_rss_hash(buff);
-	return Steering(buff, hash);
-}
-
-
 static ActionQbuff
 steering_to(arguments_t args, struct qbuff * buff)
 {
@@ -307,6 +303,74 @@ steering_link(arguments_t args, struct qbuff * buff)
 }
 
 
+/*
+ * Like steer_flow, with IPv4 fragments: the first fragment records its flow
+ * hash in a per-cpu table, the others take it from there (they have no
+ * transport header). Fragments seen before the first one are steered
+ * by the fallback.
+ */
+
+static ActionQbuff
+steering_flow_frag(arguments_t args, struct qbuff * buff)
+{
+	int fallback = GET_ARG_0(int, args);
+	struct pfq_frag_table *tab;
+
+	struct iphdr _iph;
+	const struct iphdr *ip;
+
+	struct udphdr _udp;
+	const struct udphdr *udp;
+	uint32_t hash;
+
+	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	if (ip == NULL)
+		return Drop(buff);
+
+	if (ip->protocol != IPPROTO_UDP &&
+	    ip->protocol != IPPROTO_TCP) {
+		return Steering(buff, (__force uint32_t)ip->saddr ^ (__force uint32_t)ip->daddr);
+	}
+
+	if (!pfq_ip_is_fragment(ip) || pfq_ip_is_first_fragment(ip)) {
+
+		udp = qbuff_l4_header_pointer(buff, 0, sizeof(_udp), &_udp);
+		if (udp == NULL)
+			return Drop(buff);  /* broken */
+
+		hash = (__force uint32_t)(ip->saddr ^ ip->daddr ^ (__force __be32)udp->source ^ (__force __be32)udp->dest);
+
+		if (pfq_ip_is_fragment(ip))
+			pfq_frag_insert(this_cpu_ptr(global->percpu_data)->frag, ip, hash);
+
+		return Steering(buff, hash);
+	}
+
+	tab = this_cpu_ptr(global->percpu_data)->frag;
+	if (pfq_frag_lookup(tab, ip, &hash))
+		return Steering(buff, hash);
+
+	if (fallback == Q_FRAG_FALLBACK_DROP)
+		return Drop(buff);
+
+	return Steering(buff, (__force uint32_t)ip->saddr ^ (__force uint32_t)ip->daddr);
+}
+
+
+static int steering_flow_frag_init(arguments_t args)
+{
+	int fallback = GET_ARG_0(int, args);
+
+	if (fallback != Q_FRAG_FALLBACK_ADDR &&
+	    fallback != Q_FRAG_FALLBACK_DROP) {
+		printk(KERN_INFO "[PFQ|init] steer_flow_frag: unknown fallback %d!\n", fallback);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+
 static int steering_local_link_init(arguments_t args)
 {
 	char *mac = GET_ARG(char *, args);
@@ -502,34 +566,6 @@ steering_local_net(arguments_t args, struct qbuff * buff)
 }
 
 
-static ActionQbuff
-steering_flow(arguments_t args, struct qbuff * buff)
-{
-	struct iphdr _iph;
-	const struct iphdr *ip;
-
-	struct udphdr _udp;
-	const struct udphdr *udp;
-	__be32 hash;
-
-	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
-	if (ip == NULL)
-		return Drop(buff);
-
-	if (ip->protocol != IPPROTO_UDP &&
-	    ip->protocol != IPPROTO_TCP) {
-		return Steering(buff, (__force uint32_t)ip->saddr ^ (__force uint32_t)ip->daddr);
-	}
-
-	udp = qbuff_ip_header_pointer(buff, (ip->ihl<<2), sizeof(_udp), &_udp);
-	if (udp == NULL)
-		return Drop(buff);  /* broken */
-
-	hash = ip->saddr ^ ip->daddr ^ (__force __be32)udp->source ^ (__force __be32)udp->dest;
-	return Steering(buff, (__force uint32_t)hash);
-}
-
-
 struct pfq_lang_function_descr steering_functions[] = {
 
 	{ "steer_rrobin","Qbuff -> Action Qbuff", steering_rrobin  , NULL, NULL },
@@ -541,6 +577,7 @@ struct pfq_lang_function_descr steering_functions[] = {
 
 	{ "steer_p2p",   "Qbuff -> Action Qbuff", steering_p2p     , NULL, NULL },
 	{ "steer_flow",  "Qbuff -> Action Qbuff", steering_flow    , NULL, NULL },
+	{ "steer_flow_frag", "CInt -> Qbuff -> Action Qbuff", steering_flow_frag, steering_flow_frag_init, NULL },
 	{ "steer_to",    "CInt   -> Qbuff -> Action Qbuff", steering_to , NULL, NULL },
 
 	{ "steer_field", "Word32 -> Word32 -> Qbuff -> Action Qbuff", steering_field , NULL, NULL},
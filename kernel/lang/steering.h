@@ -0,0 +1,69 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#ifndef PFQ_LANG_STEERING_H
+#define PFQ_LANG_STEERING_H
+
+#include <lang/module.h>
+#include <lang/qbuff.h>
+
+#include <pfq/qbuff.h>
+
+
+static inline ActionQbuff
+steering_rss(arguments_t args, struct qbuff * buff)
+{
+	uint32_t hash = qbuff_get_rss_hash(buff);
+	return Steering(buff, hash);
+}
+
+
+static inline ActionQbuff
+steering_flow(arguments_t args, struct qbuff * buff)
+{
+	struct iphdr _iph;
+	const struct iphdr *ip;
+
+	struct udphdr _udp;
+	const struct udphdr *udp;
+	__be32 hash;
+
+	ip = qbuff_ip_header_pointer(buff, 0, sizeof(_iph), &_iph);
+	if (ip == NULL)
+		return Drop(buff);
+
+	if (ip->protocol != IPPROTO_UDP &&
+	    ip->protocol != IPPROTO_TCP) {
+		return Steering(buff, (__force uint32_t)ip->saddr ^ (__force uint32_t)ip->daddr);
+	}
+
+	udp = qbuff_l4_header_pointer(buff, 0, sizeof(_udp), &_udp);
+	if (udp == NULL)
+		return Drop(buff);  /* broken */
+
+	hash = ip->saddr ^ ip->daddr ^ (__force __be32)udp->source ^ (__force __be32)udp->dest;
+	return Steering(buff, (__force uint32_t)hash);
+}
+
+
+#endif /* PFQ_LANG_STEERING_H */
@@ -33,6 +33,13 @@
 
 extern struct pfq_lang_function_descr  filter_functions[];
 extern struct pfq_lang_function_descr  bloom_functions[];
+extern struct pfq_lang_function_descr  lpm_functions[];
+extern struct pfq_lang_function_descr  map_functions[];
+extern struct pfq_lang_function_descr  aho_functions[];
+extern struct pfq_lang_function_descr  sample_functions[];
+extern struct pfq_lang_function_descr  police_functions[];
+extern struct pfq_lang_function_descr  tunnel_functions[];
+extern struct pfq_lang_function_descr  flow_functions[];
 extern struct pfq_lang_function_descr  vlan_functions[];
 extern struct pfq_lang_function_descr  forward_functions[];
 extern struct pfq_lang_function_descr  steering_functions[];
@@ -221,6 +228,13 @@ pfq_lang_symtable_init(void)
         pfq_lang_symtable_register_functions(NULL, &global->functions, forward_functions);
         pfq_lang_symtable_register_functions(NULL, &global->functions, steering_functions);
         pfq_lang_symtable_register_functions(NULL, &global->functions, bloom_functions);
+        pfq_lang_symtable_register_functions(NULL, &global->functions, lpm_functions);
+        pfq_lang_symtable_register_functions(NULL, &global->functions, map_functions);
+        pfq_lang_symtable_register_functions(NULL, &global->functions, aho_functions);
+        pfq_lang_symtable_register_functions(NULL, &global->functions, sample_functions);
+        pfq_lang_symtable_register_functions(NULL, &global->functions, police_functions);
+        pfq_lang_symtable_register_functions(NULL, &global->functions, tunnel_functions);
+        pfq_lang_symtable_register_functions(NULL, &global->functions, flow_functions);
         pfq_lang_symtable_register_functions(NULL, &global->functions, control_functions);
         pfq_lang_symtable_register_functions(NULL, &global->functions, vlan_functions);
         pfq_lang_symtable_register_functions(NULL, &global->functions, misc_functions);
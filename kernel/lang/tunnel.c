@@ -0,0 +1,306 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <lang/module.h>
+#include <lang/qbuff.h>
+
+#include <pfq/printk.h>
+
+#include <linux/inetdevice.h>
+
+
+/*
+ * Tunnels: GTP (GTP-C and GTP-U), VXLAN, GRE and MPLS. The tunneled IP levels
+ * are found by the header parser (lang/qbuff.h); the functions here test the
+ * level selected by the monad and steer by the innermost one.
+ */
+
+static bool
+tunnel_udp_ports(struct qbuff * buff, __be16 *sport, __be16 *dport)
+{
+	struct qbuff_ip_level const *level = qbuff_ip_level(buff);
+	__be16 _pp[2];
+	const __be16 *pp;
+
+	if (level == NULL || level->l4proto != IPPROTO_UDP)
+		return false;
+
+	pp = qbuff_header_pointer(buff, level->l4off, sizeof(_pp), _pp);
+	if (pp == NULL)
+		return false;
+
+	*sport = pp[0];
+	*dport = pp[1];
+	return true;
+}
+
+
+static inline bool
+tunnel_udp_port(struct qbuff * buff, __be16 port)
+{
+	__be16 sport, dport;
+	return tunnel_udp_ports(buff, &sport, &dport) && (sport == port || dport == port);
+}
+
+
+static bool
+is_gtp_cp(struct qbuff * buff)
+{
+	return tunnel_udp_port(buff, __constant_htons(Q_GTP_C_PORT));
+}
+
+
+static bool
+is_gtp_up(struct qbuff * buff)
+{
+	return tunnel_udp_port(buff, __constant_htons(Q_GTP_U_PORT));
+}
+
+
+static bool
+is_gtp(struct qbuff * buff)
+{
+	__be16 sport, dport;
+
+	if (!tunnel_udp_ports(buff, &sport, &dport))
+		return false;
+
+	return sport == __constant_htons(Q_GTP_C_PORT) || dport == __constant_htons(Q_GTP_C_PORT) ||
+	       sport == __constant_htons(Q_GTP_U_PORT) || dport == __constant_htons(Q_GTP_U_PORT);
+}
+
+
+static bool
+is_vxlan(struct qbuff * buff)
+{
+	struct qbuff_ip_level const *inner = qbuff_ip_inner_level(buff);
+	return inner && inner->tunnel == Q_TUNNEL_VXLAN;
+}
+
+
+static bool
+is_gre(struct qbuff * buff)
+{
+	struct qbuff_ip_level const *level = qbuff_ip_level(buff);
+	return level && level->l4proto == IPPROTO_GRE;
+}
+
+
+/* MPLS labelled: in the frame (below the first IP level) or in a tunnel */
+
+static bool
+is_mpls(struct qbuff * buff)
+{
+	struct qbuff_ip_level const *inner = qbuff_ip_inner_level(buff);
+
+	if (inner && inner->tunnel == Q_TUNNEL_MPLS)
+		return true;
+
+	return buff->monad->shift == 0 &&
+	       (buff->hdr.l3proto == __constant_htons(ETH_P_MPLS_UC) ||
+		buff->hdr.l3proto == __constant_htons(ETH_P_MPLS_MC));
+}
+
+
+static bool pred_is_gtp    (arguments_t args, struct qbuff * buff) { return is_gtp(buff); }
+static bool pred_is_gtp_cp (arguments_t args, struct qbuff * buff) { return is_gtp_cp(buff); }
+static bool pred_is_gtp_up (arguments_t args, struct qbuff * buff) { return is_gtp_up(buff); }
+static bool pred_is_vxlan  (arguments_t args, struct qbuff * buff) { return is_vxlan(buff); }
+static bool pred_is_gre    (arguments_t args, struct qbuff * buff) { return is_gre(buff); }
+static bool pred_is_mpls   (arguments_t args, struct qbuff * buff) { return is_mpls(buff); }
+
+
+static ActionQbuff filter_gtp    (arguments_t args, struct qbuff * buff) { return is_gtp(buff)    ? Pass(buff) : Drop(buff); }
+static ActionQbuff filter_gtp_cp (arguments_t args, struct qbuff * buff) { return is_gtp_cp(buff) ? Pass(buff) : Drop(buff); }
+static ActionQbuff filter_gtp_up (arguments_t args, struct qbuff * buff) { return is_gtp_up(buff) ? Pass(buff) : Drop(buff); }
+static ActionQbuff filter_vxlan  (arguments_t args, struct qbuff * buff) { return is_vxlan(buff)  ? Pass(buff) : Drop(buff); }
+static ActionQbuff filter_gre    (arguments_t args, struct qbuff * buff) { return is_gre(buff)    ? Pass(buff) : Drop(buff); }
+static ActionQbuff filter_mpls   (arguments_t args, struct qbuff * buff) { return is_mpls(buff)   ? Pass(buff) : Drop(buff); }
+
+
+/* symmetric hash of the flow of the given level (as steer_flow) */
+
+static bool
+tunnel_flow_hash(struct qbuff * buff, struct qbuff_ip_level const *level, uint32_t *hash)
+{
+	uint32_t h;
+
+	if (level->proto == IPPROTO_IP) {
+		struct iphdr _iph;
+		const struct iphdr *ip;
+
+		ip = qbuff_header_pointer(buff, level->off, sizeof(_iph), &_iph);
+		if (ip == NULL)
+			return false;
+
+		h = (__force uint32_t)(ip->saddr ^ ip->daddr);
+
+		if (ip->frag_off & __constant_htons(IP_MF | IP_OFFSET)) {
+			*hash = h;
+			return true;
+		}
+	}
+	else {
+		struct ipv6hdr _ip6h;
+		const struct ipv6hdr *ip6;
+		int n;
+
+		ip6 = qbuff_header_pointer(buff, level->off, sizeof(_ip6h), &_ip6h);
+		if (ip6 == NULL)
+			return false;
+
+		for(h = 0, n = 0; n < 4; n++)
+			h ^= (__force uint32_t)(ip6->saddr.s6_addr32[n] ^ ip6->daddr.s6_addr32[n]);
+	}
+
+	if (level->l4proto == IPPROTO_TCP || level->l4proto == IPPROTO_UDP) {
+		__be32 _ports;
+		const __be32 *ports;
+
+		ports = qbuff_header_pointer(buff, level->l4off, sizeof(_ports), &_ports);
+		if (ports == NULL)
+			return false;
+
+		h ^= (__force uint32_t)*ports;
+	}
+
+	*hash = h;
+	return true;
+}
+
+
+/* steer by the flow of the innermost IP level (GTP-U, VXLAN, GRE, MPLS, IPIP) */
+
+static ActionQbuff
+steering_inner(arguments_t args, struct qbuff * buff)
+{
+	uint32_t hash;
+
+	if (qbuff_ip_level(buff) == NULL ||
+	    !tunnel_flow_hash(buff, &buff->hdr.ip[buff->hdr.levels - 1], &hash))
+		return Drop(buff);
+
+	return Steering(buff, hash);
+}
+
+
+/* steer GTP-U by tunnel endpoint id (uplink and downlink have distinct TEIDs) */
+
+static ActionQbuff
+steering_teid(arguments_t args, struct qbuff * buff)
+{
+	struct qbuff_ip_level const *inner = qbuff_ip_inner_level(buff);
+
+	if (inner == NULL || inner->tunnel != Q_TUNNEL_GTP)
+		return Drop(buff);
+
+	return Steering(buff, inner->tunnel_id);
+}
+
+
+/*
+ * Per-user steering of GTP: user-plane packets are steered by the address of
+ * the user (the inner address that belongs to the given network), control-plane
+ * packets are broadcasted to all the sockets.
+ */
+
+static ActionQbuff
+steering_gtp_usr(arguments_t args, struct qbuff * buff)
+{
+	__be32 addr = GET_ARG_0(__be32, args);
+	__be32 mask = GET_ARG_1(__be32, args);
+
+	struct qbuff_ip_level const *inner;
+	struct iphdr _iph;
+	const struct iphdr *ip;
+
+	if (is_gtp_cp(buff))
+		return Broadcast(buff);
+
+	inner = qbuff_ip_inner_level(buff);
+	if (inner == NULL || inner->tunnel != Q_TUNNEL_GTP)
+		return Drop(buff);
+
+	if (inner->proto != IPPROTO_IP) {
+		uint32_t hash;
+		if (!tunnel_flow_hash(buff, inner, &hash))
+			return Drop(buff);
+		return Steering(buff, hash);
+	}
+
+	ip = qbuff_header_pointer(buff, inner->off, sizeof(_iph), &_iph);
+	if (ip == NULL)
+		return Drop(buff);
+
+	if ((ip->saddr & mask) == addr)
+		return Steering(buff, (__force uint32_t)ip->saddr);
+
+	if ((ip->daddr & mask) == addr)
+		return Steering(buff, (__force uint32_t)ip->daddr);
+
+	return Drop(buff);
+}
+
+
+static int steering_gtp_usr_init(arguments_t args)
+{
+	__be32 addr = GET_ARG_0(__be32, args);
+	int prefix  = GET_ARG_1(int, args);
+	__be32 mask;
+
+	if (prefix < 0 || prefix > 32) {
+		printk(KERN_INFO "[PFQ|init] steer_gtp_usr: invalid prefix /%d!\n", prefix);
+		return -EINVAL;
+	}
+
+	mask = inet_make_mask(prefix);
+
+	SET_ARG_0(args, addr & mask);
+	SET_ARG_1(args, mask);
+
+	pr_devel("[PFQ|init] steer_gtp_usr: addr=%pI4 mask=%pI4\n", &addr, &mask);
+	return 0;
+}
+
+
+struct pfq_lang_function_descr tunnel_functions[] = {
+
+	{ "is_gtp",		"Qbuff -> Bool",		pred_is_gtp,	NULL, NULL },
+	{ "is_gtp_cp",		"Qbuff -> Bool",		pred_is_gtp_cp, NULL, NULL },
+	{ "is_gtp_up",		"Qbuff -> Bool",		pred_is_gtp_up, NULL, NULL },
+	{ "is_vxlan",		"Qbuff -> Bool",		pred_is_vxlan,	NULL, NULL },
+	{ "is_gre",		"Qbuff -> Bool",		pred_is_gre,	NULL, NULL },
+	{ "is_mpls",		"Qbuff -> Bool",		pred_is_mpls,	NULL, NULL },
+
+	{ "gtp",		"Qbuff -> Action Qbuff",	filter_gtp,	NULL, NULL },
+	{ "gtp_cp",		"Qbuff -> Action Qbuff",	filter_gtp_cp,	NULL, NULL },
+	{ "gtp_up",		"Qbuff -> Action Qbuff",	filter_gtp_up,	NULL, NULL },
+	{ "vxlan",		"Qbuff -> Action Qbuff",	filter_vxlan,	NULL, NULL },
+	{ "gre",		"Qbuff -> Action Qbuff",	filter_gre,	NULL, NULL },
+	{ "mpls",		"Qbuff -> Action Qbuff",	filter_mpls,	NULL, NULL },
+
+	{ "steer_inner",	"Qbuff -> Action Qbuff",	steering_inner, NULL, NULL },
+	{ "steer_teid",		"Qbuff -> Action Qbuff",	steering_teid,	NULL, NULL },
+	{ "steer_gtp_usr",	"Word32 -> CInt -> Qbuff -> Action Qbuff", steering_gtp_usr, steering_gtp_usr_init, NULL },
+
+	{ NULL }};
@@ -27,6 +27,8 @@
 
 #include <pfq/kcompat.h>
 
+#include <linux/in6.h>
+
 
 /* CIDR notation */
 
@@ -36,6 +38,12 @@ struct CIDR
 	int	prefix;
 };
 
+struct CIDR6
+{
+	struct in6_addr addr;
+	int	prefix;
+};
+
 struct CIDR_
 {
 	__be32	addr;
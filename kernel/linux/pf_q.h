@@ -131,11 +131,32 @@ typedef uint8_t  pfq_qver_t;
 #define Q_SO_GET_GROUP_STATS		31
 #define Q_SO_GET_GROUP_COUNTERS		32
 #define Q_SO_GET_WEIGHT			33
+#define Q_SO_GET_GROUP_PROFILE		34      /* per-function profiling counters */
+#define Q_SO_MAP_CREATE			35      /* create a shared map (the id is returned) */
+#define Q_SO_MAP_LOOKUP			36
+#define Q_SO_MAP_GET_NEXT_KEY		37
 
 #define Q_SO_TX_BIND			40
 #define Q_SO_TX_UNBIND			41
 #define Q_SO_TX_QUEUE_XMIT	        42
 
+#define Q_SO_GROUP_EBPF			50      /* eBPF program (compiled pfq-lang computation) */
+#define Q_SO_GROUP_OPTIMIZE		51      /* reorder the filters of the computation (profiling counters) */
+#define Q_SO_MAP_UPDATE			52
+#define Q_SO_MAP_DELETE			53
+#define Q_SO_MAP_DESTROY		54
+#define Q_SO_GROUP_BALANCE		55      /* load-aware balancing of the steered packets */
+#define Q_SO_SET_SPILL			56      /* overflow socket id (-1 to disable) */
+#define Q_SO_GET_SPILL			57
+#define Q_SO_SET_RX_HP_SLOTS		58      /* high-priority Rx queue (0 to disable) */
+#define Q_SO_GET_RX_HP_SLOTS		59
+#define Q_SO_SET_FLOW_SLOTS		60      /* flow record queue (0 to disable) */
+#define Q_SO_GET_FLOW_SLOTS		61
+#define Q_SO_SET_RECORDER_SLOTS		62      /* flight recorder (0 to disable) */
+#define Q_SO_GET_RECORDER_SLOTS		63
+#define Q_SO_GROUP_RECORDER		64      /* attach/detach the recorder of the socket to a group */
+#define Q_SO_GROUP_RECORDER_TRIGGER	65      /* freeze the recorder of a group */
+
 /* general placeholders */
 
 #define Q_ANY_DEVICE			-1
@@ -204,6 +225,12 @@ typedef uint8_t  pfq_qver_t;
 #define	Q_KEY_ICMP_CODE			(1ULL << 12)
 
 
+/* fragment-aware steering: fragments received before the first one */
+
+#define Q_FRAG_FALLBACK_ADDR		0	/* steered by source and destination address */
+#define Q_FRAG_FALLBACK_DROP		1	/* dropped */
+
+
 /* PFQ socket queue */
 
 struct pfq_shared_rx_queue
@@ -213,9 +240,25 @@ struct pfq_shared_rx_queue
         unsigned int            size;       /* queue size in bytes */
         unsigned int            slot_size;  /* sizeof(pfq_pkthdr) + caplen  */
 
+	/* multi-consumer claim of the Rx queue (user space only, see pfq_claim) */
+
+	struct
+	{
+		unsigned long		head;	    /* claimed slots << 32 | length of the queue */
+		unsigned long		done;	    /* slots released */
+		unsigned long		ver;	    /* version of the queue being claimed */
+
+	} mc ____pfq_cacheline_aligned;
+
 } ____pfq_cacheline_aligned;
 
 
+#define PFQ_SHARED_QUEUE_MC_POS(head)		((head) >> 32)
+#define PFQ_SHARED_QUEUE_MC_LEN(head)		((head) & 0xffffffffUL)
+#define PFQ_SHARED_QUEUE_MC_HEAD(pos, len)	(((unsigned long)(pos) << 32) | (unsigned long)(len))
+#define PFQ_SHARED_QUEUE_MC_SWAP		(~0UL)	/* a consumer is swapping the queue */
+
+
 
 struct pfq_shared_tx_queue
 {
@@ -239,11 +282,36 @@ struct pfq_shared_tx_queue
 } ____pfq_cacheline_aligned;
 
 
+/* flight recorder: a circular buffer of Rx slots continuously overwritten,
+ * frozen by a trigger. The slot of the n-th packet is n % len, committed with
+ * info.commit = n + 1 (Q_RECORDER_SLOT_BUSY while the slot is being written). */
+
+#define Q_RECORDER_ARMED		0
+#define Q_RECORDER_TRIGGERED		1	/* recording the post-trigger window */
+#define Q_RECORDER_FROZEN		2
+
+#define Q_RECORDER_SLOT_BUSY		(~0U)
+
+struct pfq_shared_recorder
+{
+        unsigned long		head;	    /* packets recorded (atomic) */
+        unsigned long		stop;	    /* head at which the recorder freezes (~0UL if armed) */
+        unsigned int		state;	    /* Q_RECORDER_xxx */
+        unsigned int		post;	    /* post-trigger window, in packets */
+        unsigned int		len;	    /* buffer length in slots */
+        unsigned int		slot_size;  /* sizeof(pfq_pkthdr) + caplen */
+
+} ____pfq_cacheline_aligned;
+
+
 struct pfq_shared_queue
 {
         struct pfq_shared_rx_queue rx;
         struct pfq_shared_tx_queue tx;
         struct pfq_shared_tx_queue tx_async[Q_MAX_TX_QUEUES];
+        struct pfq_shared_rx_queue rx_hp;	/* high-priority Rx queue (after the Tx queues) */
+        struct pfq_shared_rx_queue flow;	/* flow record queue (after the high-priority queue) */
+        struct pfq_shared_recorder recorder;	/* flight recorder (after the flow record queue) */
 };
 
 
@@ -429,6 +497,170 @@ struct pfq_so_fprog
 };
 
 
+/* pfq_so_group_balance: load-aware balancing of the steered packets. A socket is
+ * congested when the fill level of its Rx queue goes above the high watermark, until it
+ * falls below the low one (percentage of the queue length, 0 for the default).
+ */
+
+#define Q_BALANCE_NONE			0	/* hash and weight only (default) */
+#define Q_BALANCE_FLOW			1	/* new flows are diverted from congested sockets */
+#define Q_BALANCE_PACKET		2	/* packets are diverted from congested sockets (stateless groups) */
+
+#define Q_BALANCE_DEF_HIGH		75
+#define Q_BALANCE_DEF_LOW		25
+
+struct pfq_so_group_balance
+{
+        int gid;
+        int policy;
+        unsigned int high;
+        unsigned int low;
+};
+
+
+/* pfq_so_group_recorder: the flight recorder of the socket records the packets
+ * of the group (post < 0 to detach). Attaching re-arms the recorder; once triggered,
+ * it records 'post' more packets and then freezes.
+ */
+
+struct pfq_so_group_recorder
+{
+        int gid;
+        int post;
+};
+
+
+/* pfq_so_ebpf: per-group eBPF program (fd < 0 to detach) */
+
+struct pfq_so_ebpf
+{
+        int gid;
+        int fd;
+};
+
+
+/* pfq_lang_node_stats: profiling counters of a function of the group computation
+ * (collected when the pfq module is loaded with lang_profile=1)
+ */
+
+#define Q_LANG_PROF_SYMB_LEN		32
+
+struct pfq_lang_node_stats
+{
+	char			symbol[Q_LANG_PROF_SYMB_LEN];
+	ptrdiff_t		next;		/* kleisli composition (-1 if none) */
+
+	unsigned long int	invoke;		/* number of invocations */
+	unsigned long int	pass;		/* packets passed on */
+	unsigned long int	drop;		/* packets dropped */
+	unsigned long int	cycles;		/* cycles of the sampled invocations (nested functions included) */
+	unsigned long int	samples;	/* number of sampled invocations */
+};
+
+
+/* pfq_so_group_profile: size is the capacity of stats (in), the number of functions (out) */
+
+struct pfq_so_group_profile
+{
+	int gid;
+	size_t size;
+	struct pfq_lang_node_stats __user *stats;
+};
+
+
+/* shared maps: created by a socket, updated from userspace and accessed by pfq-lang functions */
+
+#define Q_MAP_HASH			0
+#define Q_MAP_ARRAY			1	/* key: uint32_t index */
+#define Q_MAP_LPM			2	/* key: struct pfq_map_lpm_key */
+#define Q_MAP_COUNT_MIN			3	/* heavy hitters sketch (see below) */
+#define Q_MAP_HLL			4	/* HyperLogLog distinct counter (see below) */
+#define Q_MAP_BLOOM			5	/* set membership (see below) */
+
+/* sketches are updated by map_update (value_size must be 8):
+ *
+ * Q_MAP_COUNT_MIN: max_entries counters per row. Lookup returns the estimated
+ *                  number of packets of the key (uint64_t), get_next_key walks
+ *                  the top talkers.
+ * Q_MAP_HLL:       max_entries registers (16..65536). Lookup (any key) returns
+ *                  the estimated number of distinct keys (uint64_t).
+ *
+ * Deleting any key resets the sketch.
+ *
+ * Q_MAP_BLOOM:     blocked bloom filter sized for max_entries keys and the target
+ *                  false positive rate fpr (parts per million, 0 = 1%); it grows
+ *                  as more keys are added. value_size must be 0: update adds the
+ *                  key, lookup succeeds if the key is (probably) in the set.
+ *                  Deleting any key clears the filter.
+ */
+
+#define Q_MAP_MAX_KEY_SIZE		32
+#define Q_MAP_MAX_VALUE_SIZE		256
+#define Q_MAP_MAX_ENTRIES		(1 << 24)
+
+/* update flags */
+
+#define Q_MAP_ANY			0	/* create or update */
+#define Q_MAP_NOEXIST			1	/* create only */
+#define Q_MAP_EXIST			2	/* update only */
+
+/* pfq-lang map functions: key of the packet */
+
+#define Q_MAP_KEY_SRC_ADDR		0	/* IPv4 (4 bytes) or IPv6 (16 bytes) source address */
+#define Q_MAP_KEY_DST_ADDR		1	/* IPv4 (4 bytes) or IPv6 (16 bytes) destination address */
+#define Q_MAP_KEY_FLOW			2	/* struct pfq_map_flow_key */
+#define Q_MAP_KEY_MARK			3	/* uint32_t */
+#define Q_MAP_KEY_SRC_PORT		4	/* __be16 TCP/UDP source port */
+#define Q_MAP_KEY_DST_PORT		5	/* __be16 TCP/UDP destination port */
+
+struct pfq_map_lpm_key
+{
+	uint32_t	prefix;
+	uint8_t		addr[];		/* 4 bytes (IPv4) or 16 bytes (IPv6) */
+};
+
+struct pfq_map_flow_key
+{
+	__be32		saddr;
+	__be32		daddr;
+	__be16		sport;
+	__be16		dport;
+	uint8_t		proto;
+	uint8_t		pad[3];
+};
+
+
+/* pfq_so_map: Q_SO_MAP_CREATE (id is returned) */
+
+struct pfq_so_map
+{
+	int		id;
+	int		type;
+	unsigned int	key_size;
+	unsigned int	value_size;
+	unsigned int	max_entries;
+	unsigned int	fpr;		/* Q_MAP_BLOOM: false positive rate (parts per million) */
+};
+
+
+/* pfq_so_map_elem: lookup/update/delete/get_next_key (key == NULL for the first key) */
+
+struct pfq_so_map_elem
+{
+	int		id;
+	int		flags;
+	const void __user *key;
+	void __user	*value;		/* next key, for Q_SO_MAP_GET_NEXT_KEY */
+};
+
+
+/* return value of an eBPF computation */
+
+#define Q_EBPF_DROP			0x00000000
+#define Q_EBPF_PASS			0x00000001
+#define Q_EBPF_STEER			0x80000000	/* steering: the lower 31 bits are the hash */
+
+
 /* pfq statistics for socket and groups */
 
 struct pfq_stats
@@ -443,9 +675,46 @@ struct pfq_stats
 
         unsigned long int frwd;		/* forwarded to devices */
         unsigned long int kern;		/* passed to kernel */
+
+        unsigned long int plcd;		/* exceeding the rate of a policer */
+        unsigned long int dvrt;		/* diverted from a congested socket */
+        unsigned long int spll;		/* spilled to the overflow socket (Rx queue full) */
+        unsigned long int hrcv;		/* received by the high-priority queue */
+        unsigned long int hlst;		/* lost by the high-priority queue */
+        unsigned long int chnd;		/* chained to other groups (to_group) */
+        unsigned long int loop;		/* chaining stopped by the loop protection */
+        unsigned long int fexp;		/* flow records exported */
+        unsigned long int flst;		/* flow records lost (flow queue full) */
 };
 
 
+/* flow records (flow_export): a pfq_pkthdr precedes each record in the flow queue */
+
+#define Q_FLOW_END_IDLE			1	/* idle timeout */
+#define Q_FLOW_END_ACTIVE		2	/* active timeout */
+#define Q_FLOW_END_OF_FLOW		3	/* TCP FIN or RST */
+#define Q_FLOW_END_EVICTED		5	/* lack of resources (table full) */
+
+struct pfq_flow_record
+{
+        uint8_t  saddr[16];		/* IPv4 addresses in the first 4 bytes */
+        uint8_t  daddr[16];
+        uint16_t sport;			/* network byte order */
+        uint16_t dport;
+        uint8_t  proto;			/* L4 protocol */
+        uint8_t  ipver;			/* 4 or 6 */
+        uint8_t  tcp_flags;		/* OR of the TCP flags of the flow */
+        uint8_t  reason;		/* Q_FLOW_END_xxx (IPFIX flowEndReason) */
+        int32_t  ifindex;		/* ingress interface */
+        uint64_t packets;
+        uint64_t bytes;
+        uint64_t first;			/* ns since the epoch */
+        uint64_t last;
+};
+
+#define PFQ_FLOW_SLOT_SIZE		PFQ_SHARED_QUEUE_SLOT_SIZE(sizeof(struct pfq_flow_record))
+
+
 /* pfq counters for groups */
 
 struct pfq_counters
@@ -43,6 +43,7 @@
 #include <linux/vmalloc.h>
 #include <linux/percpu.h>
 #include <linux/bug.h>
+#include <linux/rcupdate.h>
 
 #include <net/sock.h>
 #ifdef CONFIG_INET
@@ -51,6 +52,7 @@
 
 #include <linux/pf_q.h>
 
+#include <lang/prof.h>
 #include <lang/symtable.h>
 
 #include <pfq/global.h>
@@ -68,6 +70,7 @@
 #include <pfq/proc.h>
 #include <pfq/sockopt.h>
 #include <pfq/bpf.h>
+#include <pfq/map.h>
 #include <pfq/memory.h>
 #include <pfq/thread.h>
 #include <pfq/vlan.h>
@@ -116,12 +119,19 @@ pfq_release(struct socket *sock)
 	pr_devel("[PFQ|%d] disabling socket...\n", so->id);
 	pfq_sock_disable(so);
 
+	/* destroy the maps created by the socket (still alive for the computations using them) */
+
+	pr_devel("[PFQ|%d] releasing maps...\n", so->id);
+	pfq_map_release_all(so->id);
+
 	/* release the socket id */
 
 	pr_devel("[PFQ|%d] releasing id...\n", so->id);
-	msleep(Q_GRACE_PERIOD);
 	pfq_sock_release_id(so->id);
 
+	/* wait for the Rx path to drop any reference to this socket */
+	synchronize_rcu();
+
 #if 0
 	/* reset the GC at the last socket closed */
         if (pfq_sock_counter() == 0) {
@@ -161,6 +171,12 @@ pfq_poll(struct file *file, struct socket *sock, poll_table * wait)
         if (pfq_mpsc_queue_len(so) > 0)
                 mask |= POLLIN | POLLRDNORM;
 
+        if (pfq_mpsc_hp_queue_len(so) > 0)
+                mask |= POLLIN | POLLPRI;
+
+        if (pfq_mpsc_flow_queue_len(so) > 0)
+                mask |= POLLIN | POLLRDNORM;
+
         return mask;
 }
 
@@ -478,6 +494,9 @@ static int __init pfq_init_module(void)
 	/* register pfq-lang default functions */
 	pfq_lang_symtable_init();
 
+	/* enable pfq-lang profiling (if requested) */
+	pfq_lang_prof_init();
+
 	/* register netdev notifier */
         register_netdevice_notifier(&pfq_netdev_notifier_block);
 
@@ -512,6 +531,8 @@ static int __init pfq_init_module(void)
         printk(KERN_INFO "[PFQ] capt_batch_len  : %d\n", global->capt_batch_len);
         printk(KERN_INFO "[PFQ] xmit_batch_len  : %d\n", global->xmit_batch_len);
         printk(KERN_INFO "[PFQ] vlan_untag      : %d\n", global->vlan_untag);
+        printk(KERN_INFO "[PFQ] lang_batch      : %d\n", global->lang_batch);
+        printk(KERN_INFO "[PFQ] lang_profile    : %d\n", global->lang_profile);
         printk(KERN_INFO "[PFQ] skb_tx_pool_size: %d\n", global->skb_tx_pool_size);
         printk(KERN_INFO "[PFQ] skb_rx_pool_size: %d\n", global->skb_rx_pool_size);
         printk(KERN_INFO "[PFQ] skb_size        : %zu\n", sizeof(struct sk_buff));
@@ -548,6 +569,9 @@ static void __exit pfq_exit_module(void)
 	/* stop the timer */
 	pfq_timer_fini();
 
+	/* disable pfq-lang profiling */
+	pfq_lang_prof_fini();
+
 	/* unregister proc */
 	pfq_proc_destruct();
 
@@ -568,10 +592,10 @@ static void __exit pfq_exit_module(void)
         proto_unregister(&pfq_proto);
 
         /* disable direct capture */
-        pfq_devmap_toggle_reset();
+        pfq_devmap_free();
 
-        /* wait grace period */
-        msleep(Q_GRACE_PERIOD);
+        /* wait for the readers of devmap, groups and sockets */
+        synchronize_rcu();
 
         /* free per CPU data */
         total += pfq_percpu_destruct();
@@ -0,0 +1,179 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#ifndef PFQ_BALANCE_H
+#define PFQ_BALANCE_H
+
+#include <pfq/bitops.h>
+#include <pfq/global.h>
+#include <pfq/group.h>
+#include <pfq/sock.h>
+
+#include <linux/jhash.h>
+#include <linux/jiffies.h>
+
+
+/*
+ * Load-aware balancing (Q_SO_GROUP_BALANCE): the socket selected by the hash
+ * of the steering function is replaced with the least loaded one when its Rx
+ * queue is congested. With Q_BALANCE_FLOW the choice is recorded in a per-cpu
+ * table, so that established flows stay on their socket until it congests.
+ */
+
+#define PFQ_BALANCE_TABLE_SIZE	1024		/* power of 2 */
+#define PFQ_BALANCE_TIMEOUT	(10*HZ)		/* flows idle for longer are new ones */
+
+
+struct pfq_balance_entry
+{
+	uint32_t	hash;			/* steering hash */
+	uint8_t		gid;
+	uint8_t		id;			/* socket of the flow */
+	uint8_t		used;
+	uint32_t	stamp;			/* jiffies */
+};
+
+
+struct pfq_balance_table
+{
+	struct pfq_balance_entry entry[PFQ_BALANCE_TABLE_SIZE];
+};
+
+
+/* fill level of the Rx queue (percentage) and congestion state, with hysteresis */
+
+static inline bool
+pfq_sock_rx_congested(struct pfq_sock *so, struct pfq_group const *group, unsigned int *fill)
+{
+	struct pfq_shared_rx_queue *rx_queue = pfq_sock_rx_shared_queue(so);
+	bool congested = READ_ONCE(so->rx_congested);
+	size_t len;
+
+	if (unlikely(rx_queue == NULL || so->rx_queue_len == 0)) {
+		*fill = 0;
+		return false;
+	}
+
+	len = min_t(size_t, PFQ_SHARED_QUEUE_LEN(READ_ONCE(rx_queue->shinfo)), so->rx_queue_len);
+	*fill = (unsigned int)(len * 100 / so->rx_queue_len);
+
+	if (congested ? *fill < group->balance_low : *fill > group->balance_high) {
+		congested = !congested;
+		WRITE_ONCE(so->rx_congested, congested);
+	}
+
+	return congested;
+}
+
+
+static inline bool
+pfq_balance_congested(struct pfq_group const *group, unsigned long sbit)
+{
+	struct pfq_sock *so = pfq_sock_get_by_id((__force pfq_id_t)pfq_ctz(sbit));
+	unsigned int fill;
+
+	return so && pfq_sock_rx_congested(so, group, &fill);
+}
+
+
+/* the least loaded socket among the eligible ones that are not congested (sbit if any) */
+
+static inline unsigned long
+pfq_balance_least_loaded(struct pfq_group const *group, unsigned long elig_mask, unsigned long sbit)
+{
+	unsigned long bit, best = sbit;
+	unsigned int fill, best_fill = UINT_MAX;
+
+	pfq_bitwise_foreach(elig_mask, bit,
+	{
+		struct pfq_sock *so = pfq_sock_get_by_id((__force pfq_id_t)pfq_ctz(bit));
+
+		if (so && !pfq_sock_rx_congested(so, group, &fill) && fill < best_fill) {
+			best = bit;
+			best_fill = fill;
+		}
+	});
+
+	return best;
+}
+
+
+static inline void
+pfq_balance_account(struct pfq_group *group, int cpu)
+{
+	__sparse_inc(group->stats, dvrt, cpu);
+	__sparse_inc(global->percpu_stats, dvrt, cpu);
+}
+
+
+/* the socket (bit) that receives the packet steered to sbit by the given hash */
+
+static inline unsigned long
+pfq_balance(struct pfq_group *group, uint32_t hash, unsigned long sbit, unsigned long elig_mask, int cpu)
+{
+	struct pfq_balance_table *tab = per_cpu_ptr(global->percpu_data, cpu)->balance;
+	uint8_t gid = (uint8_t)(group - global->groups);
+	struct pfq_balance_entry *e;
+	unsigned long bit;
+
+	if (group->balance == Q_BALANCE_PACKET) {
+
+		if (!pfq_balance_congested(group, sbit))
+			return sbit;
+
+		bit = pfq_balance_least_loaded(group, elig_mask, sbit);
+		if (bit != sbit)
+			pfq_balance_account(group, cpu);
+		return bit;
+	}
+
+	/* Q_BALANCE_FLOW: established flows keep their socket, while not congested */
+
+	e = &tab->entry[jhash_2words(hash, gid, 0) & (PFQ_BALANCE_TABLE_SIZE-1)];
+
+	if (e->used && e->hash == hash && e->gid == gid &&
+	    (uint32_t)jiffies - e->stamp <= PFQ_BALANCE_TIMEOUT &&
+	    (elig_mask & (1UL << e->id))) {
+
+		if (!pfq_balance_congested(group, 1UL << e->id)) {
+			e->stamp = (uint32_t)jiffies;
+			return 1UL << e->id;
+		}
+
+		sbit = 1UL << e->id;
+	}
+
+	bit = pfq_balance_congested(group, sbit) ? pfq_balance_least_loaded(group, elig_mask, sbit) : sbit;
+	if (bit != sbit)
+		pfq_balance_account(group, cpu);
+
+	e->hash  = hash;
+	e->gid	 = gid;
+	e->id	 = (uint8_t)pfq_ctz(bit);
+	e->used  = 1;
+	e->stamp = (uint32_t)jiffies;
+	return bit;
+}
+
+
+#endif /* PFQ_BALANCE_H */
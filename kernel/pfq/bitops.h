@@ -24,6 +24,9 @@
 #ifndef PFQ_BITOPS_H
 #define PFQ_BITOPS_H
 
+#include <linux/bitops.h>
+#include <linux/types.h>
+
 static inline
 int __128bit_popcount(unsigned __int128 x)
 {
@@ -61,4 +64,27 @@ int __128bit_ctz(unsigned __int128 x)
 }
 
 
+/* log2 of x >= 1 (16 bits fixed point) */
+
+static inline
+u64 pfq_log2_q16(u64 x)
+{
+	int n = fls64(x) - 17, i;
+	u64 y = (u64)n << 16;
+
+	x >>= n;
+
+	for(i = 15; i >= 0; i--)
+	{
+		x = (x * x) >> 16;
+		if (x >= (2ULL << 16)) {
+			x >>= 1;
+			y |= 1ULL << i;
+		}
+	}
+
+	return y;
+}
+
+
 #endif /* PFQ_BITOPS_H */
@@ -0,0 +1,202 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <pfq/bloom.h>
+#include <pfq/bitops.h>
+#include <pfq/global.h>
+#include <pfq/map.h>
+#include <pfq/printk.h>
+
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/rcupdate.h>
+#include <linux/vmalloc.h>
+
+
+struct pfq_bloom *
+pfq_bloom_create(u32 nblocks, u32 k, u32 capacity)
+{
+	struct pfq_bloom *bf;
+
+	if (nblocks == 0 || k == 0 || k > Q_BLOOM_MAX_K)
+		return NULL;
+
+	bf = vzalloc(sizeof(*bf) + (size_t)nblocks * sizeof(bf->block[0]));
+	if (bf == NULL)
+		return NULL;
+
+	bf->nblocks  = nblocks;
+	bf->k        = k;
+	bf->capacity = capacity;
+	return bf;
+}
+
+
+/*
+ * Size the filter for capacity keys and false positive rate 2^-log2p
+ * (log2p in 16 bits fixed point): m/n = log2p/ln2 bits per key, plus 1/8
+ * to compensate for the uneven load of the blocks; k = log2p.
+ */
+
+struct pfq_bloom *
+pfq_bloom_create_fpr(u32 capacity, u64 log2p)
+{
+	u64 bits = ((((u64)capacity * log2p) >> 16) * 94548) >> 16;	/* no u64 overflow (1/ln2 = 94548/2^16) */
+	u32 k = (u32)clamp_t(u64, (log2p + (1 << 15)) >> 16, 1, Q_BLOOM_MAX_K);
+
+	bits += bits >> 3;
+
+	return pfq_bloom_create((u32)max_t(u64, DIV_ROUND_UP(bits, Q_BLOOM_BLOCK_BITS), 1), k, capacity);
+}
+
+
+void
+pfq_bloom_destroy(struct pfq_bloom *bf)
+{
+	vfree(bf);
+}
+
+
+/*
+ * Q_MAP_BLOOM maps grow by layers (scalable bloom filter): when the last layer
+ * is full, a new one is added with twice the capacity and half the false
+ * positive rate, so that the overall rate stays within the target.
+ */
+
+static struct pfq_bloom *
+map_bloom_layer(struct pfq_map *map, int layer)
+{
+	return pfq_bloom_create_fpr((u32)map->max_entries << layer, map->bloom_log2p + ((u64)(layer + 1) << 16));
+}
+
+
+int
+pfq_map_bloom_alloc(struct pfq_map *map, unsigned int fpr)
+{
+	if (fpr == 0)
+		fpr = Q_BLOOM_DEFAULT_FPR;
+
+	if (fpr >= 1000000 || map->max_entries > (UINT_MAX >> Q_BLOOM_MAX_LAYERS))
+		return -EINVAL;
+
+	map->bloom_log2p = pfq_log2_q16(div_u64(1000000ULL << 16, fpr));
+
+	map->bloom[0] = map_bloom_layer(map, 0);
+	if (map->bloom[0] == NULL)
+		return -ENOMEM;
+
+	map->bloom_layers = 1;
+
+	pr_devel("[PFQ] bloom map: capacity=%zu fpr=%u ppm blocks=%u k=%u\n",
+		 map->max_entries, fpr, map->bloom[0]->nblocks, map->bloom[0]->k);
+	return 0;
+}
+
+
+void
+pfq_map_bloom_free(struct pfq_map *map)
+{
+	int n;
+
+	for(n = 0; n < map->bloom_layers; n++)
+		pfq_bloom_destroy(map->bloom[n]);
+
+	map->bloom_layers = 0;
+}
+
+
+int
+pfq_map_bloom_add(struct pfq_map *map, const void *key)
+{
+	u32 hash = pfq_bloom_hash(key, map->key_size, map->seed);
+	struct pfq_bloom *bf;
+	int n;
+
+	mutex_lock(&global->maps_lock);
+
+	n = map->bloom_layers;
+	bf = map->bloom[n-1];
+
+	if (bf->count >= bf->capacity && n < Q_BLOOM_MAX_LAYERS) {
+
+		bf = map_bloom_layer(map, n);
+		if (bf == NULL) {
+			mutex_unlock(&global->maps_lock);
+			return -ENOMEM;
+		}
+
+		map->bloom[n] = bf;
+		smp_wmb();
+		WRITE_ONCE(map->bloom_layers, n + 1);
+		n++;
+	}
+
+	pfq_bloom_add(bf, hash, (u32)n - 1);
+	atomic_inc(&map->count);
+
+	mutex_unlock(&global->maps_lock);
+	return 0;
+}
+
+
+void
+pfq_map_bloom_clear(struct pfq_map *map)
+{
+	int n, layers;
+
+	mutex_lock(&global->maps_lock);
+
+	layers = map->bloom_layers;
+	WRITE_ONCE(map->bloom_layers, 1);
+
+	synchronize_rcu();
+
+	for(n = 1; n < layers; n++) {
+		pfq_bloom_destroy(map->bloom[n]);
+		map->bloom[n] = NULL;
+	}
+
+	memset(map->bloom[0]->block, 0, (size_t)map->bloom[0]->nblocks * sizeof(map->bloom[0]->block[0]));
+	map->bloom[0]->count = 0;
+	atomic_set(&map->count, 0);
+
+	mutex_unlock(&global->maps_lock);
+}
+
+
+bool
+pfq_map_bloom_test(struct pfq_map *map, const void *key)
+{
+	u32 hash = pfq_bloom_hash(key, map->key_size, map->seed);
+	int n, layers = READ_ONCE(map->bloom_layers);
+
+	smp_rmb();
+
+	for(n = 0; n < layers; n++)
+	{
+		if (pfq_bloom_test(READ_ONCE(map->bloom[n]), hash, (u32)n))
+			return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,138 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#ifndef PFQ_BLOOM_H
+#define PFQ_BLOOM_H
+
+#include <linux/jhash.h>
+#include <linux/hash.h>
+#include <linux/string.h>
+#include <linux/types.h>
+#include <linux/cache.h>
+#include <linux/compiler.h>
+
+
+#define Q_BLOOM_BLOCK_WORDS		8	/* 512 bits: all the probes of a key hit one cache line */
+#define Q_BLOOM_BLOCK_BITS		(Q_BLOOM_BLOCK_WORDS * 64)
+#define Q_BLOOM_MAX_K			16
+#define Q_BLOOM_LANG_MAX_K		4	/* bloom* functions of pfq-lang */
+#define Q_BLOOM_MAX_LAYERS		4	/* growth of Q_MAP_BLOOM maps: up to 15 x max_entries keys */
+#define Q_BLOOM_DEFAULT_FPR		10000	/* parts per million */
+
+
+/* blocked bloom filter */
+
+struct pfq_bloom
+{
+	u32	nblocks;
+	u32	k;
+	u32	capacity;		/* keys within the target false positive rate */
+	u32	count;
+	u64	block[][Q_BLOOM_BLOCK_WORDS] ____cacheline_aligned;
+};
+
+
+/* 4-byte keys (IPv4 addresses, marks) take a multiplicative hash, cheaper
+ * than jhash on the Rx path: the block and the probes are mixed again below */
+
+static inline u32
+pfq_bloom_hash(const void *key, size_t len, u32 seed)
+{
+	if (len == sizeof(u32)) {
+		u32 k;
+		memcpy(&k, key, sizeof(k));
+		return hash_32(k ^ seed, 32);
+	}
+
+	return jhash(key, (u32)len, seed);
+}
+
+
+/* the layer salt makes the filters of a growing set independent */
+
+static inline u64 *
+pfq_bloom_block(struct pfq_bloom const *bf, u32 hash, u32 salt, u32 *probe)
+{
+	u32 x = hash ^ (salt * 0x9e3779b1);
+	u32 y = (x ^ (x >> 16)) * 0x85ebca6b;
+
+	*probe = y ^ (y >> 13);
+	return (u64 *)bf->block[((u64)x * bf->nblocks) >> 32];
+}
+
+
+static inline bool
+pfq_bloom_test(struct pfq_bloom const *bf, u32 hash, u32 salt)
+{
+	u32 probe, a, b, n;
+	u64 *blk = pfq_bloom_block(bf, hash, salt, &probe);
+
+	a = probe % Q_BLOOM_BLOCK_BITS;
+	b = (probe / Q_BLOOM_BLOCK_BITS) | 1;
+
+	for(n = 0; n < bf->k; n++, a += b)
+	{
+		u32 bit = a % Q_BLOOM_BLOCK_BITS;
+		if (!(READ_ONCE(blk[bit >> 6]) & (1ULL << (bit & 63))))
+			return false;
+	}
+
+	return true;
+}
+
+
+static inline void
+pfq_bloom_add(struct pfq_bloom *bf, u32 hash, u32 salt)
+{
+	u32 probe, a, b, n;
+	u64 *blk = pfq_bloom_block(bf, hash, salt, &probe);
+
+	a = probe % Q_BLOOM_BLOCK_BITS;
+	b = (probe / Q_BLOOM_BLOCK_BITS) | 1;
+
+	for(n = 0; n < bf->k; n++, a += b)
+	{
+		u32 bit = a % Q_BLOOM_BLOCK_BITS;
+		blk[bit >> 6] |= 1ULL << (bit & 63);
+	}
+
+	bf->count++;
+}
+
+
+struct pfq_map;
+
+extern struct pfq_bloom * pfq_bloom_create(u32 nblocks, u32 k, u32 capacity);
+extern struct pfq_bloom * pfq_bloom_create_fpr(u32 capacity, u64 log2p);
+extern void pfq_bloom_destroy(struct pfq_bloom *bf);
+
+/* Q_MAP_BLOOM maps: writers run in process context */
+
+extern int  pfq_map_bloom_alloc(struct pfq_map *map, unsigned int fpr);
+extern void pfq_map_bloom_free(struct pfq_map *map);
+extern int  pfq_map_bloom_add(struct pfq_map *map, const void *key);
+extern void pfq_map_bloom_clear(struct pfq_map *map);
+extern bool pfq_map_bloom_test(struct pfq_map *map, const void *key);	/* under rcu_read_lock */
+
+
+#endif /* PFQ_BLOOM_H */
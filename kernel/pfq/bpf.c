@@ -26,6 +26,8 @@
 #include <linux/version.h>
 #include <linux/module.h>
 #include <linux/filter.h>
+#include <linux/bpf.h>
+#include <linux/err.h>
 #include <linux/slab.h>
 #include <linux/uaccess.h>
 #include <net/sock.h>
@@ -82,3 +84,30 @@ pfq_free_sk_filter(struct sk_filter *filter)
 }
 
 
+/* eBPF programs (socket filter type) loaded by user-space via bpf(2) */
+
+struct bpf_prog *
+pfq_get_ebpf_prog(int fd)
+{
+#ifdef PFQ_USE_EBPF
+	struct bpf_prog *prog = bpf_prog_get_type(fd, BPF_PROG_TYPE_SOCKET_FILTER);
+	if (IS_ERR(prog)) {
+		pr_devel("[PFQ] eBPF: bpf_prog_get_type error: (%ld)!\n", PTR_ERR(prog));
+		return prog;
+	}
+
+        pr_devel("[PFQ] eBPF: new prog (len %u, jited %d)\n", prog->len, prog->jited);
+	return prog;
+#else
+	return ERR_PTR(-EOPNOTSUPP);
+#endif
+}
+
+
+void
+pfq_put_ebpf_prog(struct bpf_prog *prog)
+{
+#ifdef PFQ_USE_EBPF
+	bpf_prog_put(prog);
+#endif
+}
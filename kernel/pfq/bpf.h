@@ -26,8 +26,18 @@
 #define PFQ_BPF_H
 
 #include <linux/filter.h>
+#include <linux/version.h>
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4,8,0))
+#define PFQ_USE_EBPF
+#endif
+
+struct bpf_prog;
 
 extern struct sk_filter * pfq_alloc_sk_filter(struct sock_fprog *fprog);
 extern void pfq_free_sk_filter(struct sk_filter *filter);
 
+extern struct bpf_prog * pfq_get_ebpf_prog(int fd);
+extern void pfq_put_ebpf_prog(struct bpf_prog *prog);
+
 #endif /* PFQ_BPF_H */
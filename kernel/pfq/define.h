@@ -32,21 +32,23 @@
 
 #define Q_BUFF_LOG_LEN			16
 #define Q_BUFF_QUEUE_LEN		512
+#define Q_QBUFF_MAX_IP_LEVEL		4
+#define Q_MAX_GROUP_CHAIN		8		/* hops of the group chaining (to_group) */
 
 #define Q_MAX_STEERING_MASK	        512
 
-#define Q_MAX_DEVICE			4096
-#define Q_MAX_DEVICE_MASK		(Q_MAX_DEVICE-1)
+#define Q_DEVMAP_HASH_BITS		8
+#define Q_DEVMAP_HASH_SIZE		(1 << Q_DEVMAP_HASH_BITS)
+#define Q_DEVMAP_HASH_MASK		(Q_DEVMAP_HASH_SIZE-1)
 #define Q_MAX_QUEUE			256
 #define Q_MAX_QUEUE_MASK		(Q_MAX_QUEUE-1)
 
 #define Q_MAX_TX_SKB_COPY		256
 
-#define Q_GRACE_PERIOD			200 /* msec */
-
 #define Q_FUN_SYMB_LEN			256
 #define Q_FUN_SIGN_LEN			1024
 #define Q_FUN_MAX_ENTRIES		1024
+#define Q_FUN_MAX_ARRAY_LEN		(1 << 20)
 
 #define Q_MAX_CPU			256
 #define Q_MAX_CPU_MASK			(Q_MAX_CPU-1)
@@ -54,7 +56,12 @@
 #define Q_GROUP_PERSIST_MEM		64
 #define Q_GROUP_PERSIST_DATA		1024
 
+#define Q_MAX_MAPS			64
+
 #define Q_MAX_SOCKQUEUE_LEN		262144
+#define Q_MAX_SOCKQUEUE_HP_LEN		4096		/* high-priority Rx queue */
+#define Q_MAX_SOCKQUEUE_FLOW_LEN	65536		/* flow record queue */
+#define Q_MAX_RECORDER_LEN		1048576		/* flight recorder */
 
 #define Q_INVALID_ID			(__force pfq_id_t)-1
 
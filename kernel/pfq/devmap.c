@@ -28,70 +28,350 @@
 #include <pfq/printk.h>
 #include <pfq/thread.h>
 
+#include <linux/slab.h>
 
-void pfq_devmap_toggle_update(void)
+
+static inline struct pfq_devmap_entry_tail *
+pfq_devmap_entry_tail(struct pfq_devmap_entry *e)
+{
+	return (struct pfq_devmap_entry_tail *)&e->group_mask[2 * e->nqueue];
+}
+
+
+static void
+pfq_devmap_entry_free_rcu(struct rcu_head *rcu)
+{
+	kfree(container_of(rcu, struct pfq_devmap_entry_tail, rcu)->entry);
+}
+
+
+static void
+pfq_devmap_entry_release(struct pfq_devmap_entry *e)
+{
+	struct pfq_devmap_entry_tail *tail = pfq_devmap_entry_tail(e);
+
+	tail->entry = e;
+	call_rcu(&tail->rcu, pfq_devmap_entry_free_rcu);
+}
+
+
+static struct pfq_devmap_entry *
+pfq_devmap_entry_clone(struct pfq_devmap_entry const *old, int ifindex, int nqueue)
+{
+	struct pfq_devmap_entry *e;
+	int q;
+
+	e = kmalloc(sizeof(struct pfq_devmap_entry) + 2 * nqueue * sizeof(unsigned long) +
+		    sizeof(struct pfq_devmap_entry_tail), GFP_KERNEL);
+	if (!e)
+		return NULL;
+
+	e->ifindex	  = ifindex;
+	e->nqueue	  = nqueue;
+	e->any_queue	  = old ? old->any_queue : 0;
+	e->any_queue_excl = old ? old->any_queue_excl : 0;
+
+	for(q = 0; q < nqueue; ++q) {
+		e->group_mask[q] = pfq_devmap_entry_groups(old, q);
+		e->group_mask[nqueue + q] = pfq_devmap_entry_excluded(old, q);
+	}
+
+	return e;
+}
+
+
+static bool
+pfq_devmap_entry_empty(struct pfq_devmap_entry const *e)
+{
+	int q;
+	if (e->any_queue || e->any_queue_excl)
+		return false;
+	for(q = 0; q < 2 * e->nqueue; ++q)
+		if (e->group_mask[q])
+			return false;
+	return true;
+}
+
+
+/* whether the bit is set for the queue (any of them with Q_ANY_QUEUE), in the
+ * masks of the bound groups or of the excluded ones */
+
+static bool
+pfq_devmap_entry_test(struct pfq_devmap_entry const *e, int queue, unsigned long bit, bool excl)
 {
-    int i,j;
-    for(i=0; i < Q_MAX_DEVICE; ++i)
-    {
-        unsigned long val = 0;
-        for(j=0; j < Q_MAX_QUEUE; ++j)
-        {
-            val |= (unsigned long)atomic_long_read(&global->devmap[i][j]);
-        }
-
-        atomic_set(&global->devmap_toggle[i], val ? 1 : 0);
-    }
+	int q;
+
+	if (!e)
+		return false;
+
+	if (queue != Q_ANY_QUEUE)
+		return (excl ? pfq_devmap_entry_excluded(e, queue) : pfq_devmap_entry_groups(e, queue)) & bit;
+
+	if ((excl ? e->any_queue_excl : e->any_queue) & bit)
+		return true;
+
+	for(q = 0; q < e->nqueue; ++q)
+		if (e->group_mask[excl ? e->nqueue + q : q] & bit)
+			return true;
+
+	return false;
+}
+
+
+/* update the masks of a (device,queue) slot: a Q_ANY_DEVICE group (any) unbound
+ * from the slot is excluded from it, until it is bound again */
+
+static bool
+pfq_devmap_mask_update(unsigned long *mask, unsigned long *excl, int action, unsigned long bit, unsigned long any)
+{
+	unsigned long m = *mask, x = *excl;
+
+	switch(action)
+	{
+	case Q_DEVMAP_SET:	*mask = m | bit; *excl = x & ~bit; break;
+	case Q_DEVMAP_RESET:	*mask = m & ~bit; *excl = x | (any & bit); break;
+	case Q_DEVMAP_INCLUDE:	*excl = x & ~bit; break;
+	}
+
+	return *mask != m || *excl != x;
+}
+
+
+/* build the updated copy of an entry (NULL when no group is left); any is the
+ * Q_ANY_DEVICE entry (NULL when updating the latter).
+ * Returns the number of (device,queue) slots changed, or -ENOMEM.
+ */
+
+static int
+pfq_devmap_entry_update(struct pfq_devmap_entry *old, struct pfq_devmap_entry const *any, int ifindex,
+			int action, int queue, unsigned long bit, struct pfq_devmap_entry **ret)
+{
+	struct pfq_devmap_entry *e;
+	int nqueue, q, n = 0;
+
+	*ret = old;
+
+	if (!old && (action == Q_DEVMAP_INCLUDE ||
+		    (action == Q_DEVMAP_RESET && !pfq_devmap_entry_test(any, queue, bit, false))))
+		return 0;
+
+	nqueue = old ? old->nqueue : 0;
+	if (queue != Q_ANY_QUEUE && queue >= nqueue)
+		nqueue = queue + 1;
+
+	e = pfq_devmap_entry_clone(old, ifindex, nqueue);
+	if (!e)
+		return -ENOMEM;
+
+	for(q = 0; q < nqueue; ++q)
+	{
+		if (queue != Q_ANY_QUEUE && queue != q)
+			continue;
+
+		if (pfq_devmap_mask_update(&e->group_mask[q], &e->group_mask[nqueue + q],
+					   action, bit, pfq_devmap_entry_groups(any, q)))
+			n++;
+	}
+
+	if (queue == Q_ANY_QUEUE &&
+	    pfq_devmap_mask_update(&e->any_queue, &e->any_queue_excl, action, bit, any ? any->any_queue : 0))
+		n += Q_MAX_QUEUE - nqueue;
+
+	if (n == 0) {
+		kfree(e);
+		return 0;
+	}
+
+	if (pfq_devmap_entry_empty(e)) {
+		kfree(e);
+		e = NULL;
+	}
+
+	*ret = e;
+	return n;
+}
+
+
+/* clear the bit from every mask of the entry in place, without allocating
+ * (the release of a group cannot fail). Returns the number of masks changed.
+ */
+
+static int
+pfq_devmap_entry_clear(struct pfq_devmap_entry *e, unsigned long bit)
+{
+	int q, n = 0;
+
+	for(q = 0; q < 2 * e->nqueue; ++q)
+	{
+		if (e->group_mask[q] & bit) {
+			WRITE_ONCE(e->group_mask[q], e->group_mask[q] & ~bit);
+			n++;
+		}
+	}
+
+	if (e->any_queue & bit) {
+		WRITE_ONCE(e->any_queue, e->any_queue & ~bit);
+		n++;
+	}
+
+	if (e->any_queue_excl & bit) {
+		WRITE_ONCE(e->any_queue_excl, e->any_queue_excl & ~bit);
+		n++;
+	}
+
+	return n;
+}
+
+
+static void
+pfq_devmap_entry_publish(struct pfq_devmap_entry *old, struct pfq_devmap_entry *e)
+{
+	if (old == e)
+		return;
+
+	if (old && e)
+		hlist_replace_rcu(&old->node, &e->node);
+	else if (e)
+		hlist_add_head_rcu(&e->node, &global->devmap[e->ifindex & Q_DEVMAP_HASH_MASK]);
+	else
+		hlist_del_rcu(&old->node);
+
+	if (old)
+		pfq_devmap_entry_release(old);
+}
+
+
+static int
+pfq_devmap_update_any_device(int action, int queue, unsigned long bit)
+{
+	struct pfq_devmap_entry *any, *old, *e;
+	struct hlist_node *tmp;
+	int n = 0, rc, i;
+
+	any = rcu_dereference_protected(global->devmap_any, lockdep_is_held(&global->devmap_lock));
+
+	/* reset of all the queues (release of the group): cleared in place */
+
+	if (action == Q_DEVMAP_RESET && queue == Q_ANY_QUEUE)
+	{
+		for(i = 0; i < Q_DEVMAP_HASH_SIZE; ++i)
+		{
+			hlist_for_each_entry_safe(old, tmp, &global->devmap[i], node)
+			{
+				n += pfq_devmap_entry_clear(old, bit);
+				if (pfq_devmap_entry_empty(old))
+					pfq_devmap_entry_publish(old, NULL);
+			}
+		}
+
+		if (any) {
+			n += pfq_devmap_entry_clear(any, bit);
+			if (pfq_devmap_entry_empty(any)) {
+				RCU_INIT_POINTER(global->devmap_any, NULL);
+				pfq_devmap_entry_release(any);
+			}
+		}
+
+		return n;
+	}
+
+	/* reset removes the gid from every device bound explicitly, set drops
+	 * the exclusions of the gid from the devices */
+
+	for(i = 0; i < Q_DEVMAP_HASH_SIZE; ++i)
+	{
+		hlist_for_each_entry_safe(old, tmp, &global->devmap[i], node)
+		{
+			if (action == Q_DEVMAP_SET && !pfq_devmap_entry_test(old, queue, bit, true))
+				continue;
+
+			rc = pfq_devmap_entry_update(old, NULL, old->ifindex,
+						     action == Q_DEVMAP_SET ? Q_DEVMAP_INCLUDE : action, queue, bit, &e);
+			if (rc < 0)
+				return rc;
+			pfq_devmap_entry_publish(old, e);
+			n += rc;
+		}
+	}
+
+	rc = pfq_devmap_entry_update(any, NULL, Q_ANY_DEVICE, action, queue, bit, &e);
+	if (rc < 0)
+		return rc;
+
+	if (any != e) {
+		rcu_assign_pointer(global->devmap_any, e);
+		if (any)
+			pfq_devmap_entry_release(any);
+	}
+
+	return n + rc;
 }
 
 
 int pfq_devmap_update(int action, int index, int queue, pfq_gid_t gid)
 {
-    int n = 0, i,q;
-
-    if (unlikely((__force int)gid >= Q_MAX_GID ||
-		 (__force int)gid < 0)) {
-        pr_devel("[PF_Q] devmap_update: bad gid (%u)\n",gid);
-        return 0;
-    }
-
-    mutex_lock(&global->devmap_lock);
-
-    for(i=0; i < Q_MAX_DEVICE; ++i)
-    {
-        for(q=0; q < Q_MAX_QUEUE; ++q)
-        {
-            long tmp;
-
-            if (!pfq_devmap_equal(i, q, index, queue))
-                continue;
-
-            /* map_set... */
-            if (action == Q_DEVMAP_SET) {
-
-                tmp = atomic_long_read(&global->devmap[i][q]);
-                tmp |= 1L << (__force int)gid;
-                atomic_long_set(&global->devmap[i][q], tmp);
-                n++;
-                continue;
-            }
-
-            /* map_reset */
-            tmp = atomic_long_read(&global->devmap[i][q]);
-            if (tmp & (1L << (__force int)gid)) {
-                tmp &= ~(1L << (__force int)gid);
-                atomic_long_set(&global->devmap[i][q], tmp);
-                n++;
-                continue;
-            }
-        }
-    }
-
-    /* update capture toggle filter... */
-
-    pfq_devmap_toggle_update();
-
-    mutex_unlock(&global->devmap_lock);
-    return n;
+	struct pfq_devmap_entry *old, *e;
+	unsigned long bit;
+	int n;
+
+	if (unlikely((__force int)gid >= Q_MAX_GID ||
+		     (__force int)gid < 0)) {
+		pr_devel("[PF_Q] devmap_update: bad gid (%u)\n",gid);
+		return 0;
+	}
+
+	if (unlikely((index < 0 && index != Q_ANY_DEVICE) ||
+		     (queue != Q_ANY_QUEUE && (queue < 0 || queue >= Q_MAX_QUEUE)))) {
+		pr_devel("[PF_Q] devmap_update: bad device/queue (%d:%d)\n", index, queue);
+		return -EINVAL;
+	}
+
+	bit = 1UL << (__force int)gid;
+
+	mutex_lock(&global->devmap_lock);
+
+	if (index == Q_ANY_DEVICE) {
+		n = pfq_devmap_update_any_device(action, queue, bit);
+	}
+	else {
+		/* a Q_ANY_DEVICE group unbound from the device is excluded from it */
+
+		old = pfq_devmap_lookup_rcu(index);
+		n = pfq_devmap_entry_update(old, rcu_dereference_protected(global->devmap_any, lockdep_is_held(&global->devmap_lock)),
+					    index, action, queue, bit, &e);
+		if (n >= 0)
+			pfq_devmap_entry_publish(old, e);
+	}
+
+	mutex_unlock(&global->devmap_lock);
+	return n;
 }
 
+
+void pfq_devmap_free(void)
+{
+	struct pfq_devmap_entry *e;
+	struct hlist_node *tmp;
+	int i;
+
+	mutex_lock(&global->devmap_lock);
+
+	for(i = 0; i < Q_DEVMAP_HASH_SIZE; ++i)
+	{
+		hlist_for_each_entry_safe(e, tmp, &global->devmap[i], node)
+		{
+			hlist_del_rcu(&e->node);
+			pfq_devmap_entry_release(e);
+		}
+	}
+
+	e = rcu_dereference_protected(global->devmap_any, lockdep_is_held(&global->devmap_lock));
+	RCU_INIT_POINTER(global->devmap_any, NULL);
+	if (e)
+		pfq_devmap_entry_release(e);
+
+	mutex_unlock(&global->devmap_lock);
+
+	/* the release callbacks must run before the module is unloaded */
+	rcu_barrier();
+}
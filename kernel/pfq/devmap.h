@@ -30,12 +30,45 @@
 #include <pfq/define.h>
 #include <pfq/kcompat.h>
 
+#include <linux/rculist.h>
+#include <linux/rcupdate.h>
+
 
 /* pfq devmap */
 
 enum
 {      Q_DEVMAP_RESET,
-       Q_DEVMAP_SET
+       Q_DEVMAP_SET,
+       Q_DEVMAP_INCLUDE		/* internal: drop the exclusion of a Q_ANY_DEVICE group */
+};
+
+
+/* per-device entry: replaced with RCU (copy-on-write); bits are only cleared
+ * in place (each mask is read as a whole word).
+ *
+ * group_mask[q] holds the groups bound to queue q, group_mask[nqueue + q] the
+ * Q_ANY_DEVICE groups unbound from queue q of this device; queues >= nqueue
+ * share the any_queue/any_queue_excl masks.
+ *
+ * The masks follow the key, so that a lookup touches the first cache line
+ * only; the rcu_head, used on release, is placed after group_mask[2*nqueue].
+ */
+
+struct pfq_devmap_entry
+{
+	struct hlist_node	node;
+	int			ifindex;
+	int			nqueue;
+	unsigned long		any_queue;
+	unsigned long		any_queue_excl;
+	unsigned long		group_mask[];
+};
+
+
+struct pfq_devmap_entry_tail
+{
+	struct rcu_head		 rcu;
+	struct pfq_devmap_entry *entry;
 };
 
 
@@ -43,42 +76,75 @@ enum
 */
 
 extern int  pfq_devmap_update(int action, int index, int queue, pfq_gid_t gid);
+extern void pfq_devmap_free(void);
 
 
 static inline
-int pfq_devmap_equal(int i1, int q1, int i2, int q2)
+unsigned long pfq_devmap_entry_groups(struct pfq_devmap_entry const *e, int queue)
 {
-        return  (i1 == i2 && q1 == q2) ||
-                (i1 == i2 && q2 == -1) ||
-                (i2 == -1 && q1 == q2) ||
-                (i2 == -1 && q2 == -1);
+	if (!e)
+		return 0;
+	return (unsigned int)queue < (unsigned int)e->nqueue ? READ_ONCE(e->group_mask[queue]) : READ_ONCE(e->any_queue);
 }
 
 
 static inline
-unsigned long pfq_devmap_get_groups(int dev, int queue)
+unsigned long pfq_devmap_entry_excluded(struct pfq_devmap_entry const *e, int queue)
 {
-        return (long unsigned)atomic_long_read(&global->devmap[dev & Q_MAX_DEVICE_MASK][queue & Q_MAX_QUEUE_MASK]);
+	if (!e)
+		return 0;
+	return (unsigned int)queue < (unsigned int)e->nqueue ? READ_ONCE(e->group_mask[e->nqueue + queue]) : READ_ONCE(e->any_queue_excl);
 }
 
 
-extern void pfq_devmap_toggle_update(void);
+/* to be called under rcu_read_lock or devmap_lock
+*/
+
+static inline
+struct pfq_devmap_entry *pfq_devmap_lookup_rcu(int dev)
+{
+	struct pfq_devmap_entry *e;
+
+	pfq_hlist_for_each_entry_rcu(e, &global->devmap[dev & Q_DEVMAP_HASH_MASK], node,
+				     lockdep_is_held(&global->devmap_lock))
+	{
+		if (e->ifindex == dev)
+			return e;
+	}
+	return NULL;
+}
+
 
 static inline
-int pfq_devmap_toggle_get(int index)
+unsigned long pfq_devmap_get_groups(int dev, int queue)
 {
-        return atomic_read(&global->devmap_toggle[index & Q_MAX_DEVICE_MASK]);
+	struct pfq_devmap_entry *e;
+	unsigned long ret;
+
+	rcu_read_lock();
+	e = pfq_devmap_lookup_rcu(dev);
+	ret = pfq_devmap_entry_groups(e, queue) |
+	      (pfq_devmap_entry_groups(rcu_dereference(global->devmap_any), queue) & ~pfq_devmap_entry_excluded(e, queue));
+	rcu_read_unlock();
+
+	return ret;
 }
 
 
+/* empty entries are never published: the toggle is the presence of the entry */
+
 static inline
-void pfq_devmap_toggle_reset(void)
+int pfq_devmap_toggle_get(int index)
 {
-        int n;
-        for(n = 0; n < Q_MAX_DEVICE; n++)
-        {
-                atomic_set(&global->devmap_toggle[n],0);
-        }
+	int ret;
+
+	rcu_read_lock();
+	ret = rcu_access_pointer(global->devmap_any) != NULL ||
+	      pfq_devmap_lookup_rcu(index) != NULL;
+	rcu_read_unlock();
+
+	return ret;
 }
 
+
 #endif /* PFQ_DEVMAP_H */
@@ -23,11 +23,13 @@
 
 #include <pfq/bitops.h>
 #include <pfq/endpoint.h>
+#include <pfq/global.h>
 #include <pfq/io.h>
 #include <pfq/kcompat.h>
 #include <pfq/netdev.h>
 #include <pfq/printk.h>
 #include <pfq/queue.h>
+#include <pfq/sock.h>
 #include <pfq/sparse.h>
 #include <pfq/qbuff.h>
 
@@ -76,11 +78,90 @@ pfq_add_dev_to_endpoints( struct net_device *dev
 }
 
 
+/* retry once on the overflow socket the packets that did not fit the Rx queue */
+
+static
+size_t spill_to_user_qbuffs( struct pfq_sock *so
+			   , struct pfq_qbuff_queue *buffs
+			   , unsigned __int128 mask
+			   , size_t cpy
+			   , size_t len
+			   , int cpu)
+{
+	int spill_id = READ_ONCE(so->spill_id);
+	struct pfq_sock *spill;
+	size_t n, spilled = 0;
+
+	if (spill_id >= 0) {
+
+		spill = pfq_sock_get_by_id((__force pfq_id_t)spill_id);
+		if (spill && spill != so && pfq_sock_rx_shared_queue(spill) != NULL) {
+
+			/* the queue is filled in mask order: skip the packets already copied */
+
+			for(n = 0; n < cpy; n++)
+				mask &= mask - 1;
+
+			spilled = pfq_sk_queue_recv(spill, buffs, mask, (int)(len - cpy));
+
+			__sparse_add(so->stats, spll, spilled, cpu);
+			__sparse_add(spill->stats, recv, spilled, cpu);
+			__sparse_add(global->percpu_stats, spll, spilled, cpu);
+		}
+	}
+
+	if (len > cpy + spilled)
+		__sparse_add(so->stats, lost, len - cpy - spilled, cpu);
+
+	return spilled;
+}
+
+
+/* packets classified as high priority go to the high-priority Rx queue;
+ * the mask of the remaining ones is returned */
+
 static inline
-size_t copy_to_user_qbuffs( struct pfq_sock *so
-			  , struct pfq_qbuff_queue *buffs
-			  , unsigned __int128 mask
-			  , int cpu)
+unsigned __int128 copy_to_user_hp_qbuffs( struct pfq_sock *so
+					, struct pfq_qbuff_queue *buffs
+					, unsigned __int128 mask
+					, size_t *copied
+					, int cpu)
+{
+	unsigned __int128 hp_mask = 0, tmp = mask;
+	unsigned long bit = 1UL << (__force int)so->id;
+	struct qbuff *buff;
+	size_t n, len, cpy;
+
+	for_each_qbuff_with_mask(tmp, buffs, buff, n)
+	{
+		if (buff->prio_mask & bit)
+			hp_mask |= ((unsigned __int128)1) << n;
+	}
+
+	if (hp_mask == 0)
+		return mask;
+
+	len = pfq_popcount(hp_mask);
+	cpy = pfq_sk_queue_recv_hp(so, buffs, hp_mask, (int)len);
+	*copied = cpy;
+
+	__sparse_add(so->stats, hrcv, cpy, cpu);
+	__sparse_add(global->percpu_stats, hrcv, cpy, cpu);
+
+	if (unlikely(len > cpy)) {
+		__sparse_add(so->stats, hlst, len - cpy, cpu);
+		__sparse_add(global->percpu_stats, hlst, len - cpy, cpu);
+	}
+
+	return mask & ~hp_mask;
+}
+
+
+static inline
+size_t copy_to_user_qbuffs_bulk( struct pfq_sock *so
+			       , struct pfq_qbuff_queue *buffs
+			       , unsigned __int128 mask
+			       , int cpu)
 {
         size_t cpy, len = pfq_popcount(mask);
 
@@ -91,8 +172,8 @@ size_t copy_to_user_qbuffs( struct pfq_sock *so
 		smp_rmb();
 
                 cpy = pfq_sk_queue_recv(so, buffs, mask, (int)len);
-		if (len > cpy)
-			__sparse_add(so->stats, lost, len - cpy, cpu);
+		if (unlikely(len > cpy))
+			cpy += spill_to_user_qbuffs(so, buffs, mask, cpy, len, cpu);
 
 		return cpy;
         }
@@ -103,6 +184,28 @@ size_t copy_to_user_qbuffs( struct pfq_sock *so
 }
 
 
+static inline
+size_t copy_to_user_qbuffs( struct pfq_sock *so
+			  , struct pfq_qbuff_queue *buffs
+			  , unsigned __int128 mask
+			  , int cpu)
+{
+	if (unlikely(so->rx_hp_queue_len) && pfq_sock_rx_hp_shared_queue(so) != NULL) {
+
+		unsigned __int128 bulk;
+		size_t hp = 0;
+
+		smp_rmb();
+
+		bulk = copy_to_user_hp_qbuffs(so, buffs, mask, &hp, cpu);
+
+		return bulk ? hp + copy_to_user_qbuffs_bulk(so, buffs, bulk, cpu) : hp;
+	}
+
+	return copy_to_user_qbuffs_bulk(so, buffs, mask, cpu);
+}
+
+
 static inline
 size_t copy_to_dev_qbuffs( struct pfq_sock *so
 			 , struct pfq_qbuff_queue *buffs
@@ -0,0 +1,117 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#ifndef PFQ_FRAG_H
+#define PFQ_FRAG_H
+
+#include <linux/jhash.h>
+#include <linux/jiffies.h>
+#include <linux/types.h>
+#include <linux/ip.h>
+
+
+/*
+ * Per-cpu table of the IPv4 datagrams being fragmented: it maps
+ * (src, dst, id, proto) to the flow hash of the first fragment, so that the
+ * following fragments (without transport header) are steered alike.
+ * Direct-mapped: a colliding datagram replaces the entry.
+ */
+
+#define PFQ_FRAG_TABLE_SIZE	512		/* power of 2 */
+#define PFQ_FRAG_TIMEOUT	(HZ)		/* fragments of a datagram are close in time */
+
+
+struct pfq_frag_entry
+{
+	__be32		saddr;
+	__be32		daddr;
+	__be16		id;
+	uint8_t		proto;
+	uint8_t		used;
+	uint32_t	hash;
+	uint32_t	stamp;			/* jiffies */
+};
+
+
+struct pfq_frag_table
+{
+	struct pfq_frag_entry entry[PFQ_FRAG_TABLE_SIZE];
+};
+
+
+static inline bool
+pfq_ip_is_fragment(struct iphdr const *ip)
+{
+	return (ip->frag_off & htons(IP_MF | IP_OFFSET)) != 0;
+}
+
+
+static inline bool
+pfq_ip_is_first_fragment(struct iphdr const *ip)
+{
+	return (ip->frag_off & htons(IP_OFFSET)) == 0;
+}
+
+
+static inline struct pfq_frag_entry *
+pfq_frag_slot(struct pfq_frag_table *tab, struct iphdr const *ip)
+{
+	uint32_t h = jhash_3words((__force u32)ip->saddr, (__force u32)ip->daddr,
+				  (uint32_t)(__force u16)ip->id << 8 | ip->protocol, 0);
+
+	return &tab->entry[h & (PFQ_FRAG_TABLE_SIZE-1)];
+}
+
+
+static inline void
+pfq_frag_insert(struct pfq_frag_table *tab, struct iphdr const *ip, uint32_t hash)
+{
+	struct pfq_frag_entry *e = pfq_frag_slot(tab, ip);
+
+	e->saddr = ip->saddr;
+	e->daddr = ip->daddr;
+	e->id	 = ip->id;
+	e->proto = ip->protocol;
+	e->used  = 1;
+	e->hash  = hash;
+	e->stamp = (uint32_t)jiffies;
+}
+
+
+static inline bool
+pfq_frag_lookup(struct pfq_frag_table *tab, struct iphdr const *ip, uint32_t *hash)
+{
+	struct pfq_frag_entry const *e = pfq_frag_slot(tab, ip);
+
+	if (!e->used ||
+	    e->saddr != ip->saddr || e->daddr != ip->daddr ||
+	    e->id != ip->id || e->proto != ip->protocol ||
+	    (uint32_t)jiffies - e->stamp > PFQ_FRAG_TIMEOUT)
+		return false;
+
+	*hash = e->hash;
+	return true;
+}
+
+
+#endif /* PFQ_FRAG_H */
@@ -34,6 +34,9 @@ struct pfq_global_data default_global =
 	.capt_batch_len		= 1,
 
 	.vlan_untag		= 0,
+	.lang_batch		= 0,
+	.lang_profile		= 0,
+	.sample_seed		= 0,
 
 	.skb_tx_pool_size	= 1024,
 	.skb_rx_pool_size	= 1024,
@@ -46,14 +49,17 @@ struct pfq_global_data default_global =
 	.socket_count		= {0},
      // .socket_lock		= {{0}},
 
-	.devmap			= {{{0}}},
-	.devmap_toggle		= {{0}},
+	.devmap			= {{0}},
+	.devmap_any		= NULL,
      // .devmap_lock		= {{0}},
 
 	.pool_enabled		= {0},
 	.groups			= {{}},
      // .groups_lock		= {{0}},
 
+	.maps			= {0},
+     // .maps_lock		= {{0}},
+
 	.percpu_stats		= NULL,
 	.percpu_memory		= NULL,
 	.percpu_data		= NULL,
@@ -84,6 +90,7 @@ pfq_global_init(void)
 			mutex_init(&data->socket_lock);
 			mutex_init(&data->devmap_lock);
 			mutex_init(&data->groups_lock);
+			mutex_init(&data->maps_lock);
 			init_rwsem(&data->symtable_sem);
 		}
 	}
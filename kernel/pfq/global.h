@@ -36,6 +36,9 @@ struct pfq_memory_stats __percpu;
 struct pfq_percpu_data  __percpu;
 struct pfq_percpu_pool  __percpu;
 
+struct pfq_devmap_entry;
+struct pfq_map;
+
 
 struct pfq_global_data
 {
@@ -49,6 +52,9 @@ struct pfq_global_data
 	int skb_rx_pool_size;
 
 	int vlan_untag;
+	int lang_batch;
+	int lang_profile;
+	unsigned int sample_seed;
 
 	int tx_cpu[Q_MAX_CPU];
 	int tx_cpu_nr;
@@ -58,8 +64,8 @@ struct pfq_global_data
 	atomic_t        socket_count;
 	struct mutex	socket_lock;
 
-	atomic_long_t   devmap [Q_MAX_DEVICE][Q_MAX_QUEUE];
-	atomic_t        devmap_toggle [Q_MAX_DEVICE];
+	struct hlist_head devmap [Q_DEVMAP_HASH_SIZE];
+	struct pfq_devmap_entry __rcu * devmap_any;
 	struct mutex	devmap_lock;
 
 	atomic_t	pool_enabled;
@@ -67,6 +73,9 @@ struct pfq_global_data
 	struct pfq_group groups[Q_MAX_GID];
 	struct mutex	 groups_lock;
 
+	struct pfq_map * maps[Q_MAX_MAPS];
+	struct mutex	 maps_lock;
+
 	struct pfq_kernel_stats	__percpu   * percpu_stats;
 	struct pfq_memory_stats	__percpu   * percpu_memory;
 	struct pfq_percpu_data		__percpu   * percpu_data;
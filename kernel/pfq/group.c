@@ -23,6 +23,7 @@
  ****************************************************************/
 
 #include <lang/engine.h>
+#include <lang/exec.h>
 
 #include <pfq/atomic.h>
 #include <pfq/bitops.h>
@@ -32,8 +33,18 @@
 #include <pfq/group.h>
 #include <pfq/kcompat.h>
 #include <pfq/percpu.h>
+#include <pfq/sock.h>
 #include <pfq/thread.h>
 
+#include <linux/rcupdate.h>
+
+
+/* the programs of the groups are replaced under the groups_lock, and retired with RCU */
+
+#define pfq_group_replace(ptr, val) \
+	rcu_replace_pointer(ptr, val, lockdep_is_held(&global->groups_lock))
+
+
 void
 pfq_group_lock(void)
 {
@@ -161,6 +172,35 @@ pfq_group_access(pfq_gid_t gid, pfq_id_t id)
 }
 
 
+/* to_group: the computation of the group 'src' may chain packets to the group gid
+ * (fast path: the policy of gid is checked against the installer of the computation) */
+
+bool
+pfq_group_chain_access(pfq_gid_t gid, struct pfq_group const *src)
+{
+	struct pfq_group *group;
+
+	group = pfq_group_get(gid);
+	if (group == NULL || !READ_ONCE(group->enabled))
+		return false;
+
+	switch(READ_ONCE(group->policy))
+	{
+	case Q_POLICY_GROUP_PRIVATE:
+		return READ_ONCE(group->owner) == READ_ONCE(src->prog_owner);
+
+	case Q_POLICY_GROUP_RESTRICTED:
+		return READ_ONCE(group->pid) == READ_ONCE(src->prog_tgid);
+
+	case Q_POLICY_GROUP_SHARED:
+	case Q_POLICY_GROUP_UNDEFINED:
+		return true;
+	}
+
+	return false;
+}
+
+
 static void
 __pfq_group_init(struct pfq_group *group, pfq_gid_t gid)
 {
@@ -175,15 +215,25 @@ __pfq_group_init(struct pfq_group *group, pfq_gid_t gid)
                 atomic_long_set(&group->sock_id[i], 0);
         }
 
-        atomic_long_set(&group->bp_filter,0L);
-        atomic_long_set(&group->comp,     0L);
-        atomic_long_set(&group->comp_ctx, 0L);
+        RCU_INIT_POINTER(group->bp_filter, NULL);
+        RCU_INIT_POINTER(group->comp,      NULL);
+        RCU_INIT_POINTER(group->comp_ctx,  NULL);
+        RCU_INIT_POINTER(group->ebpf,      NULL);
+
+	group->prog_owner = Q_INVALID_ID;
+	group->prog_tgid  = 0;
 
 	pfq_group_stats_reset(group->stats);
 	pfq_group_counters_reset(group->counters);
 
 	group->vlan_filt = false;
 
+	group->balance	    = Q_BALANCE_NONE;
+	group->balance_high = Q_BALANCE_DEF_HIGH;
+	group->balance_low  = Q_BALANCE_DEF_LOW;
+
+	group->recorder_id  = -1;
+
 	for(i = 0; i < 4096; i++) {
 		group->vid_filters[i] = 0;
 	}
@@ -198,10 +248,11 @@ __pfq_group_free(struct pfq_group *group, pfq_gid_t gid)
 {
         struct sk_filter *filter;
         struct pfq_lang_computation_tree *old_comp;
+        struct bpf_prog *old_ebpf;
         void *old_ctx;
         size_t i;
 
-        /* remove this gid from devmap matrix */
+        /* remove this gid from devmap */
 
         pfq_devmap_update(Q_DEVMAP_RESET, Q_ANY_DEVICE, Q_ANY_QUEUE, gid);
 
@@ -211,11 +262,14 @@ __pfq_group_free(struct pfq_group *group, pfq_gid_t gid)
         group->owner  = Q_INVALID_ID;
         group->policy = Q_POLICY_GROUP_UNDEFINED;
 
-        filter   = (struct sk_filter *)atomic_long_xchg(&group->bp_filter, 0L);
-        old_comp = (struct pfq_lang_computation_tree *)atomic_long_xchg(&group->comp, 0L);
-        old_ctx  = (void *)atomic_long_xchg(&group->comp_ctx, 0L);
+        filter   = pfq_group_replace(group->bp_filter, (struct sk_filter *)NULL);
+        old_comp = pfq_group_replace(group->comp, (struct pfq_lang_computation_tree *)NULL);
+        old_ctx  = pfq_group_replace(group->comp_ctx, (void *)NULL);
+        old_ebpf = pfq_group_replace(group->ebpf, (struct bpf_prog *)NULL);
 
-        msleep(Q_GRACE_PERIOD);   /* sleeping is possible here: user-context */
+	WRITE_ONCE(group->recorder_id, -1);
+
+        synchronize_rcu();   /* wait for the readers of the old computation/filter */
 
 	/* finalize old computation */
 
@@ -223,12 +277,15 @@ __pfq_group_free(struct pfq_group *group, pfq_gid_t gid)
 		pfq_lang_computation_destruct(old_comp);
 	}
 
-	kfree(old_comp);
-	kfree(old_ctx);
+	pfq_lang_computation_free(old_comp);
+	pfq_lang_context_free(old_ctx);
 
 	if (filter)
 		pfq_free_sk_filter(filter);
 
+	if (old_ebpf)
+		pfq_put_ebpf_prog(old_ebpf);
+
         group->vlan_filt = false;
 	for(i = 0; i < 4096; i++) {
 		group->vid_filters[i] = 0;
@@ -308,6 +365,9 @@ __pfq_group_leave(pfq_gid_t gid, pfq_id_t id)
                 atomic_long_set(&group->sock_id[i], tmp);
         }
 
+	if (group->recorder_id == (__force int)id)
+		WRITE_ONCE(group->recorder_id, -1);
+
 	if (group->enabled && __pfq_group_is_empty(gid))
 		__pfq_group_free(group, gid);
 
@@ -346,17 +406,43 @@ pfq_group_set_filter(pfq_gid_t gid, struct sk_filter *filter)
                 return;
         }
 
-        old_filter = (void *)atomic_long_xchg(&group->bp_filter, (long)filter);
-
-        msleep(Q_GRACE_PERIOD);
+        mutex_lock(&global->groups_lock);
+        old_filter = pfq_group_replace(group->bp_filter, filter);
+        mutex_unlock(&global->groups_lock);
 
-	if (old_filter)
+	if (old_filter) {
+		synchronize_rcu();
 		pfq_free_sk_filter(old_filter);
+	}
+}
+
+
+void
+pfq_group_set_ebpf(pfq_gid_t gid, struct bpf_prog *prog)
+{
+        struct pfq_group * group;
+        struct bpf_prog * old_prog;
+
+	group = pfq_group_get(gid);
+        if (group == NULL) {
+		if (prog)
+			pfq_put_ebpf_prog(prog);
+                return;
+        }
+
+        mutex_lock(&global->groups_lock);
+        old_prog = pfq_group_replace(group->ebpf, prog);
+        mutex_unlock(&global->groups_lock);
+
+	if (old_prog) {
+		synchronize_rcu();
+		pfq_put_ebpf_prog(old_prog);
+	}
 }
 
 
 int
-pfq_group_set_prog(pfq_gid_t gid, struct pfq_lang_computation_tree *comp, void *ctx)
+pfq_group_set_prog(pfq_gid_t gid, struct pfq_lang_computation_tree *comp, void *ctx, pfq_id_t owner)
 {
         struct pfq_group * group;
         struct pfq_lang_computation_tree *old_comp;
@@ -368,10 +454,16 @@ pfq_group_set_prog(pfq_gid_t gid, struct pfq_lang_computation_tree *comp, void *
 
         mutex_lock(&global->groups_lock);
 
-        old_comp = (struct pfq_lang_computation_tree *)atomic_long_xchg(&group->comp, (long)comp);
-        old_ctx  = (void *)atomic_long_xchg(&group->comp_ctx, (long)ctx);
+	WRITE_ONCE(group->prog_owner, owner);
+	WRITE_ONCE(group->prog_tgid,  pfq_get_tgid());
+
+        old_comp = pfq_group_replace(group->comp, comp);
+        old_ctx  = pfq_group_replace(group->comp_ctx, ctx);
 
-        msleep(Q_GRACE_PERIOD);   /* sleeping is possible here: user-context */
+        /* the new computation is live: wait for the readers of the old one */
+
+        if (old_comp || old_ctx)
+		synchronize_rcu();
 
 	/* call fini on old computation */
 
@@ -380,14 +472,110 @@ pfq_group_set_prog(pfq_gid_t gid, struct pfq_lang_computation_tree *comp, void *
 
         /* free the old computation/context */
 
-        kfree(old_comp);
-        kfree(old_ctx);
+        pfq_lang_computation_free(old_comp);
+        pfq_lang_context_free(old_ctx);
 
         mutex_unlock(&global->groups_lock);
         return 0;
 }
 
 
+int
+pfq_group_optimize_prog(pfq_gid_t gid)
+{
+        struct pfq_lang_computation_tree *comp;
+        struct pfq_group * group;
+        int rc = -ENOENT;
+
+	group = pfq_group_get(gid);
+        if (group == NULL)
+                return -EINVAL;
+
+        /* the computation cannot be replaced or released while the lock is held */
+
+        mutex_lock(&global->groups_lock);
+
+        comp = rcu_dereference_protected(group->comp, lockdep_is_held(&global->groups_lock));
+        if (comp)
+		rc = pfq_lang_exec_optimize(comp);
+
+        mutex_unlock(&global->groups_lock);
+        return rc;
+}
+
+
+int
+pfq_group_set_balance(pfq_gid_t gid, int policy, unsigned int high, unsigned int low)
+{
+        struct pfq_group * group;
+
+	group = pfq_group_get(gid);
+        if (group == NULL)
+                return -EINVAL;
+
+	if (policy != Q_BALANCE_NONE &&
+	    policy != Q_BALANCE_FLOW &&
+	    policy != Q_BALANCE_PACKET)
+		return -EINVAL;
+
+	high = high ? high : Q_BALANCE_DEF_HIGH;
+	low  = low  ? low  : Q_BALANCE_DEF_LOW;
+
+	if (high > 100 || low >= high)
+		return -EINVAL;
+
+        mutex_lock(&global->groups_lock);
+
+	WRITE_ONCE(group->balance_high, high);
+	WRITE_ONCE(group->balance_low,  low);
+	WRITE_ONCE(group->balance,	policy);
+
+        mutex_unlock(&global->groups_lock);
+	return 0;
+}
+
+
+int
+pfq_group_set_recorder(pfq_gid_t gid, pfq_id_t id, bool enable)
+{
+        struct pfq_group * group;
+
+	group = pfq_group_get(gid);
+        if (group == NULL)
+                return -EINVAL;
+
+        mutex_lock(&global->groups_lock);
+
+	if (enable)
+		WRITE_ONCE(group->recorder_id, (__force int)id);
+	else if (group->recorder_id == (__force int)id)
+		WRITE_ONCE(group->recorder_id, -1);
+
+        mutex_unlock(&global->groups_lock);
+	return 0;
+}
+
+
+/* trigger the flight recorder of the group (rcu read lock held) */
+
+int
+pfq_group_trigger_recorder(struct pfq_group *group)
+{
+	int id = READ_ONCE(group->recorder_id);
+	struct pfq_sock *so;
+
+	if (id < 0)
+		return -ENODEV;
+
+	so = pfq_sock_get_by_id((__force pfq_id_t)id);
+	if (so == NULL)
+		return -ENODEV;
+
+	pfq_sock_recorder_trigger(so);
+	return 0;
+}
+
+
 int
 pfq_group_join(pfq_gid_t gid, pfq_id_t id, unsigned long class_mask, int policy)
 {
@@ -35,6 +35,7 @@
 
 typedef struct pfq_kernel_stats pfq_group_stats_t;
 struct pfq_group_counters;
+struct pfq_lang_computation_tree;
 
 struct pfq_group
 {
@@ -46,14 +47,24 @@ struct pfq_group
         atomic_long_t sock_id[Q_CLASS_MAX];		/* list of (bitwise) socket ids that joined this group, for each different class:
         						   Q_CLASS_DEFAULT, Q_CLASS_USER_PLANE, Q_CLASS_CONTROL_PLANE etc... */
 
-        atomic_long_t bp_filter;			/* struct sk_filter pointer */
+        struct sk_filter __rcu *bp_filter;		/* socket filter */
+
+        struct pfq_lang_computation_tree __rcu *comp;	/* new functional program */
+        void __rcu *comp_ctx;                           /* storage context (new functional program) */
+        struct bpf_prog __rcu *ebpf;                    /* compiled computation (takes precedence over comp) */
 
-        atomic_long_t comp;                             /* struct pfq_lang_computation_tree *  (new functional program) */
-        atomic_long_t comp_ctx;                         /* void *: storage context (new functional program) */
+	pfq_id_t prog_owner;				/* socket that installed the computation */
+	int	 prog_tgid;				/* and its process id/tgid (to_group access) */
 
 	pfq_group_stats_t __percpu *stats;
 	struct pfq_group_counters __percpu *counters;
 
+        int    balance;					/* load-aware balancing policy (Q_BALANCE_xxx) */
+        unsigned int balance_high;			/* Rx queue watermarks, percentage */
+        unsigned int balance_low;
+
+        int    recorder_id;				/* socket id of the flight recorder (-1 if none) */
+
         bool   enabled;
         bool   vlan_filt;                               /* enable/disable vlan filtering */
         char   vid_filters[4096];                       /* vlan filters */
@@ -66,7 +77,11 @@ struct pfq_lang_computation_tree;
 extern int  pfq_group_join_free(pfq_id_t id, unsigned long class_mask, int policy);
 extern int  pfq_group_join(pfq_gid_t gid, pfq_id_t id, unsigned long class_mask, int policy);
 extern int  pfq_group_leave(pfq_gid_t gid, pfq_id_t id);
-extern int  pfq_group_set_prog(pfq_gid_t gid, struct pfq_lang_computation_tree *prog, void *ctx);
+extern int  pfq_group_set_prog(pfq_gid_t gid, struct pfq_lang_computation_tree *prog, void *ctx, pfq_id_t owner);
+extern int  pfq_group_optimize_prog(pfq_gid_t gid);
+extern int  pfq_group_set_balance(pfq_gid_t gid, int policy, unsigned int high, unsigned int low);
+extern int  pfq_group_set_recorder(pfq_gid_t gid, pfq_id_t id, bool enable);
+extern int  pfq_group_trigger_recorder(struct pfq_group *group);
 extern void pfq_group_leave_all(pfq_id_t id);
 
 extern unsigned long pfq_group_get_groups(pfq_id_t id);
@@ -74,6 +89,7 @@ extern unsigned long pfq_group_get_all_sock_mask(pfq_gid_t gid);
 
 extern int  pfq_group_get_context(pfq_gid_t gid, int level, int size, void __user *context);
 extern void pfq_group_set_filter(pfq_gid_t gid, struct sk_filter *filter);
+extern void pfq_group_set_ebpf(pfq_gid_t gid, struct bpf_prog *prog);
 
 extern struct pfq_group * pfq_group_get(pfq_gid_t gid);
 
@@ -84,6 +100,7 @@ extern void pfq_group_set_vlan_filter(pfq_gid_t gid, bool value, int vid);
 
 extern bool pfq_group_policy_access(pfq_gid_t gid, pfq_id_t id, int policy);
 extern bool pfq_group_access(pfq_gid_t gid, pfq_id_t id);
+extern bool pfq_group_chain_access(pfq_gid_t gid, struct pfq_group const *src);
 
 extern void pfq_group_lock(void);
 extern void pfq_group_unlock(void);
@@ -28,9 +28,14 @@
 #include <net/inet_common.h>
 #endif
 
+#include <linux/math64.h>
+
 #include <lang/engine.h>
+#include <lang/exec.h>
+#include <lang/flow.h>
 #include <lang/symtable.h>
 
+#include <pfq/balance.h>
 #include <pfq/bitops.h>
 #include <pfq/devmap.h>
 #include <pfq/global.h>
@@ -720,6 +725,332 @@ unsigned int pfq_fold(unsigned int a, unsigned int b)
 }
 
 
+static inline void
+pfq_lang_monad_init(struct pfq_lang_monad *monad, struct pfq_group *group)
+{
+	monad->fanout.class_mask = Q_CLASS_DEFAULT;
+	monad->fanout.type = fanout_copy;
+	monad->group = group;
+	monad->state = 0;
+	monad->shift = 0;
+	monad->ep_ctx = EPOINT_SRC | EPOINT_DST;
+	monad->prio = false;
+}
+
+
+static inline void
+pfq_ebpf_run(struct qbuff *buff, struct bpf_prog *ebpf)
+{
+	uint32_t ret = qbuff_run_ebpf(buff, ebpf);
+
+	if (ret == Q_EBPF_DROP)
+		buff->monad->fanout.type = fanout_drop;
+	else if (ret & Q_EBPF_STEER) {
+		buff->monad->fanout.type = fanout_steer;
+		buff->monad->fanout.hash = ret & ~Q_EBPF_STEER;
+	}
+}
+
+
+/* forward the qbuff to the sockets of the group, according to the fanout of the computation */
+
+static inline void
+pfq_group_fanout(struct qbuff *buff, struct pfq_group *this_group, int cpu)
+{
+	fanout_t const *fanout = &buff->monad->fanout;
+	unsigned long cbit, elig_mask = 0, fwd_mask = 0;
+
+	/* skip this packet? */
+
+	if (is_drop(*fanout)) {
+		__sparse_inc(this_group->stats, drop, cpu);
+		return;
+	}
+
+	/* compute the eligible mask of sockets enabled to receive this packet... */
+
+	pfq_bitwise_foreach(fanout->class_mask, cbit,
+	{
+		int class = (int)pfq_ctz(cbit);
+		elig_mask |= (unsigned long)atomic_long_read(&this_group->sock_id[class]);
+	});
+
+
+	if (is_steering(*fanout)) { /* single or double */
+
+		unsigned long steer_mask[Q_MAX_STEERING_MASK], bit;
+		unsigned int sbit, steer_mask_numb = 0;
+
+		/* compute the load balancing mask list */
+
+		pfq_bitwise_foreach(elig_mask, sbit,
+		{
+			pfq_id_t id = (__force pfq_id_t)pfq_ctz(sbit);
+			struct pfq_sock * so = pfq_sock_get_by_id(id);
+
+			int i, end = so ? so->weight : 1;
+			for(i = 0; i < end; ++i)
+				steer_mask[steer_mask_numb++] = sbit;
+		});
+
+		bit = steer_mask[pfq_fold(hash_int(fanout->hash), (unsigned int)steer_mask_numb)];
+		if (unlikely(this_group->balance != Q_BALANCE_NONE))
+			bit = pfq_balance(this_group, fanout->hash, bit, elig_mask, cpu);
+
+		fwd_mask |= bit;
+
+		if (is_double_steering(*fanout)) {
+			bit = steer_mask[pfq_fold(hash_int(fanout->hash2), (unsigned int)steer_mask_numb)];
+			if (unlikely(this_group->balance != Q_BALANCE_NONE))
+				bit = pfq_balance(this_group, fanout->hash2, bit, elig_mask, cpu);
+
+			fwd_mask |= bit;
+		}
+
+	}
+	else {  /* broadcast */
+
+		fwd_mask = elig_mask;
+	}
+
+	buff->fwd_mask |= fwd_mask;
+
+	/* the priority is per group: only the sockets of this group get the packet as high priority */
+
+	if (unlikely(buff->monad->prio))
+		buff->prio_mask |= fwd_mask;
+}
+
+
+/* copy the packets to the flight recorder of the group, if any */
+
+static inline void
+pfq_group_record(struct pfq_group *this_group, struct qbuff *buffs, unsigned __int128 mask)
+{
+	int id = READ_ONCE(this_group->recorder_id);
+	struct pfq_sock *so;
+
+	if (likely(id < 0))
+		return;
+
+	so = pfq_sock_get_by_id((__force pfq_id_t)id);
+	if (so)
+		pfq_sk_queue_record(so, buffs, mask);
+}
+
+
+/*
+ * Batch evaluation: each group processes the whole capture batch. Filters and
+ * pfq-lang instructions run over the selection mask of the packets of the group,
+ * packets are then forwarded exactly as in the per-packet mode.
+ */
+
+/* drop the groups chained by the computation of this_group (to_group) the installer
+ * of the computation has no access to (the policy of the target may have changed) */
+
+static inline void
+pfq_group_chain_check(struct qbuff *buff, struct pfq_group const *this_group, unsigned long chain_mask)
+{
+	unsigned long bit, req = buff->chain_mask & ~chain_mask;
+
+	if (likely(req == 0))
+		return;
+
+	pfq_bitwise_foreach(req, bit,
+	{
+		if (!pfq_group_chain_access((__force pfq_gid_t)pfq_ctz(bit), this_group))
+			buff->chain_mask &= ~bit;
+	});
+}
+
+
+/* the groups a packet is chained to (to_group), not evaluated yet */
+
+static inline unsigned long
+pfq_group_chain_next(struct qbuff *buff, unsigned long visited, int cpu)
+{
+	unsigned long next = buff->chain_mask & ~visited;
+
+	if (unlikely(buff->chain_mask & visited))
+		__sparse_inc(global->percpu_stats, loop, cpu);
+
+	if (unlikely(next))
+		__sparse_inc(global->percpu_stats, chnd, cpu);
+
+	buff->chain_mask = 0;
+	return next;
+}
+
+
+static void
+pfq_receive_batch(struct pfq_percpu_data *data, int cpu)
+{
+	struct pfq_qbuff_queue *queue = PFQ_QBUFF_QUEUE(data->qbuff_queue);
+	struct pfq_lang_batch *batch = data->batch;
+	unsigned long all_groups, bit;
+	struct qbuff *buff;
+	unsigned int n;
+	int hop;
+
+	for(n = 0; n < queue->len; n++)
+		batch->visited[n] = 0;
+
+	rcu_read_lock();
+
+	/* groups chained by to_group are evaluated in the next hop: each group
+	 * evaluates a packet at most once, up to Q_MAX_GROUP_CHAIN hops */
+
+	for(hop = 0; ; hop++)
+	{
+		all_groups = 0;
+		for(n = 0; n < queue->len; n++)
+			all_groups |= batch->group_mask[n];
+
+		if (likely(all_groups == 0))
+			break;
+
+		if (unlikely(hop == Q_MAX_GROUP_CHAIN)) {
+			for(n = 0; n < queue->len; n++)
+				if (batch->group_mask[n])
+					__sparse_inc(global->percpu_stats, loop, cpu);
+			break;
+		}
+
+		pfq_bitwise_foreach(all_groups, bit,
+		{
+			pfq_gid_t gid = (__force pfq_gid_t)pfq_ctz(bit);
+			struct pfq_group * this_group = pfq_group_get(gid);
+			struct pfq_lang_computation_tree *prg;
+			struct pfq_lang_exec const *exec;
+			struct bpf_prog *ebpf;
+			unsigned __int128 mask = 0, sel, pass;
+			size_t to_kernel = 0, num_fwd = 0, num_chnd = 0;
+
+			if (unlikely(!this_group))
+				continue;
+
+			/* select the packets of this group */
+
+			for(n = 0; n < queue->len; n++)
+			{
+				if (batch->group_mask[n] & bit)
+					mask |= (unsigned __int128)1 << n;
+			}
+
+			__sparse_add(this_group->stats, recv, pfq_popcount(mask), cpu);
+
+			/* flight recorder */
+
+			pfq_group_record(this_group, queue->queue, mask);
+
+			/* bp and vlan filters */
+
+			if (rcu_access_pointer(this_group->bp_filter)) {
+				sel = mask;
+				for_each_qbuff_with_mask(sel, queue, buff, n)
+				{
+					if (!qbuff_run_bp_filter(buff, this_group)) {
+						mask ^= (unsigned __int128)1 << n;
+						__sparse_inc(this_group->stats, drop, cpu);
+					}
+				}
+			}
+
+			if (pfq_group_vlan_filters_enabled(gid)) {
+				sel = mask;
+				for_each_qbuff_with_mask(sel, queue, buff, n)
+				{
+					if (!qbuff_run_vlan_filter(buff, (pfq_gid_t)gid)) {
+						mask ^= (unsigned __int128)1 << n;
+						__sparse_inc(this_group->stats, drop, cpu);
+					}
+				}
+			}
+
+			/* process pfq-lang */
+
+			prg  = rcu_dereference(this_group->comp);
+			ebpf = rcu_dereference(this_group->ebpf);
+
+			if (!prg && !ebpf) {
+				unsigned long sock_mask = (unsigned long)atomic_long_read(&this_group->sock_id[0]);
+				sel = mask;
+				for_each_qbuff_with_mask(sel, queue, buff, n)
+					buff->fwd_mask |= sock_mask;
+				continue;
+			}
+
+			sel = mask;
+			for_each_qbuff_with_mask(sel, queue, buff, n)
+			{
+				pfq_lang_monad_init(buff->monad, this_group);
+				batch->fwd_dev_num[n] = buff->fwd_dev_num;
+				batch->to_kernel[n] = buff->to_kernel;
+				batch->chain_mask[n] = buff->chain_mask;
+			}
+
+			/* run the compiled eBPF program, the flattened or the functional program */
+
+			if (ebpf) {
+				sel = mask;
+				for_each_qbuff_with_mask(sel, queue, buff, n)
+					pfq_ebpf_run(buff, ebpf);
+				pass = mask;
+			}
+			else if ((exec = rcu_dereference(prg->exec)) && !pfq_lang_prof_enabled()) {
+				pass = pfq_lang_exec_run_batch(queue, mask, exec, batch->pending);
+			}
+			else {
+				pass = 0;
+				sel = mask;
+				for_each_qbuff_with_mask(sel, queue, buff, n)
+				{
+					if (pfq_lang_run(buff, prg).qbuff)
+						pass |= (unsigned __int128)1 << n;
+				}
+			}
+
+			__sparse_add(this_group->stats, drop, pfq_popcount(mask ^ pass), cpu);
+
+			/* update stats and forward the packets to the sockets of the group */
+
+			sel = pass;
+			for_each_qbuff_with_mask(sel, queue, buff, n)
+			{
+				num_fwd   += buff->fwd_dev_num - batch->fwd_dev_num[n];
+				to_kernel += buff->to_kernel - batch->to_kernel[n];
+			}
+
+			sel = mask;
+			for_each_qbuff_with_mask(sel, queue, buff, n)
+			{
+				pfq_group_chain_check(buff, this_group, batch->chain_mask[n]);
+				num_chnd += buff->chain_mask != batch->chain_mask[n];
+			}
+
+			__sparse_add(this_group->stats, frwd, num_fwd, cpu);
+			__sparse_add(this_group->stats, kern, to_kernel, cpu);
+			__sparse_add(this_group->stats, chnd, num_chnd, cpu);
+
+			sel = pass;
+			for_each_qbuff_with_mask(sel, queue, buff, n)
+				pfq_group_fanout(buff, this_group, cpu);
+		});
+
+		/* the groups of the next hop */
+
+		for(n = 0; n < queue->len; n++)
+		{
+			buff = PFQ_QBUFF_QUEUE_AT(queue, n);
+			batch->visited[n] |= batch->group_mask[n];
+			batch->group_mask[n] = pfq_group_chain_next(buff, batch->visited[n], cpu);
+		}
+	}
+
+	rcu_read_unlock();
+}
+
+
 int
 pfq_receive(struct napi_struct *napi, struct sk_buff * skb)
 {
@@ -747,9 +1078,10 @@ pfq_receive(struct napi_struct *napi, struct sk_buff * skb)
 	if (likely(skb)) /* ensure this is not the timer heartbeat */
 	{
 		struct pfq_lang_monad monad;
-		unsigned long group_mask;
+		unsigned long group_mask, visited;
 		struct qbuff *buff;
 		ktime_t current_rx;
+		int hop;
 
 		/* if required, timestamp the packet now */
 		if (ktime_to_ns(skb->tstamp) == 0)
@@ -770,13 +1102,19 @@ pfq_receive(struct napi_struct *napi, struct sk_buff * skb)
 
 		skb_push(skb, skb->mac_len);
 
+		/* the evaluation mode (lang_batch) can be changed at run-time: it is
+		 * taken at the beginning of the queue, for all of its packets */
+
+		if (data->qbuff_queue->len == 0)
+			data->lang_batch = READ_ONCE(global->lang_batch);
+
 		/* initialize the qbuff */
 
 		buff = &data->qbuff_queue->queue[data->qbuff_queue->len];
 
 		qbuff_init( buff
 			  , skb
-			  , &monad
+			  , data->lang_batch ? &data->batch->monad[data->qbuff_queue->len] : &monad
 			  , data->counter++);
 
 		/* get the eligible groups */
@@ -785,119 +1123,109 @@ pfq_receive(struct napi_struct *napi, struct sk_buff * skb)
 						  , qbuff_get_rx_queue(buff));
 
 
-		/* process all groups for this qbuff */
+		/* batch evaluation: groups are processed when the batch is complete */
 
-		pfq_bitwise_foreach(group_mask, bit,
-		{
-			pfq_gid_t gid = (__force pfq_gid_t)pfq_ctz(bit);
-			struct pfq_group * this_group = pfq_group_get(gid);
-			struct pfq_lang_computation_tree *prg;
-
-			if (unlikely(!this_group))
-				continue;
+		if (data->lang_batch) {
+			data->batch->group_mask[data->qbuff_queue->len] = group_mask;
+			data->qbuff_queue->len++;
+			current_rx = qbuff_get_ktime(buff);
+			goto flush;
+		}
 
-			/* increment counter for this group */
+		/* process all groups for this qbuff: group state is retired with RCU */
 
-			__sparse_inc(this_group->stats, recv, cpu);
+		rcu_read_lock();
 
-			/* check if bp filter is enabled */
+		for(hop = 0, visited = 0; group_mask; hop++) {
 
-			if (atomic_long_read(&this_group->bp_filter)) {
-				if (!qbuff_run_bp_filter(buff, this_group)) {
-					__sparse_inc(this_group->stats, drop, cpu);
-					continue;
-				}
+			if (unlikely(hop == Q_MAX_GROUP_CHAIN)) {
+				__sparse_inc(global->percpu_stats, loop, cpu);
+				break;
 			}
 
-			/* check vlan filter */
+			pfq_bitwise_foreach(group_mask, bit,
+			{
+				pfq_gid_t gid = (__force pfq_gid_t)pfq_ctz(bit);
+				struct pfq_group * this_group = pfq_group_get(gid);
+				struct pfq_lang_computation_tree *prg;
+				struct bpf_prog *ebpf;
 
-			if (pfq_group_vlan_filters_enabled(gid)) {
-				if (!qbuff_run_vlan_filter(buff, (pfq_gid_t)gid)) {
-					__sparse_inc(this_group->stats, drop, cpu);
+				if (unlikely(!this_group))
 					continue;
-				}
-			}
-
-			/* process pfq-lang */
 
-			prg = (struct pfq_lang_computation_tree *)atomic_long_read(&this_group->comp);
-			if (prg) {
-				unsigned long cbit, elig_mask = 0;
-				size_t to_kernel = buff->to_kernel;
-				size_t num_fwd = buff->fwd_dev_num;
+				/* increment counter for this group */
 
-			 	/* setup monad for this computation */
+				__sparse_inc(this_group->stats, recv, cpu);
 
-			 	monad.fanout.class_mask = Q_CLASS_DEFAULT;
-			 	monad.fanout.type = fanout_copy;
-			 	monad.group = this_group;
-			 	monad.state = 0;
-			 	monad.shift = 0;
-			 	monad.ipoff = 0;
-			 	monad.ipproto = IPPROTO_NONE;
-			 	monad.ep_ctx = EPOINT_SRC | EPOINT_DST;
+				/* flight recorder */
 
-			 	/* run the functional program */
+				pfq_group_record(this_group, buff, 1);
 
-			 	if (!pfq_lang_run(buff, prg).qbuff) {
-			 		__sparse_inc(this_group->stats, drop, cpu);
-			 		continue;
-			 	}
+				/* check if bp filter is enabled */
 
-			 	/* update stats */
+				if (rcu_access_pointer(this_group->bp_filter)) {
+					if (!qbuff_run_bp_filter(buff, this_group)) {
+						__sparse_inc(this_group->stats, drop, cpu);
+						continue;
+					}
+				}
 
-                                 __sparse_add(this_group->stats, frwd, buff->fwd_dev_num - num_fwd, cpu);
-                                 __sparse_add(this_group->stats, kern, buff->to_kernel - to_kernel, cpu);
+				/* check vlan filter */
 
-			 	/* skip this packet? */
+				if (pfq_group_vlan_filters_enabled(gid)) {
+					if (!qbuff_run_vlan_filter(buff, (pfq_gid_t)gid)) {
+						__sparse_inc(this_group->stats, drop, cpu);
+						continue;
+					}
+				}
 
-			 	if (is_drop(monad.fanout)) {
-			 		__sparse_inc(this_group->stats, drop, cpu);
-			 		continue;
-			 	}
+				/* process pfq-lang */
 
-			 	/* compute the eligible mask of sockets enabled to receive this packet... */
+				prg  = rcu_dereference(this_group->comp);
+				ebpf = rcu_dereference(this_group->ebpf);
 
-			 	pfq_bitwise_foreach(monad.fanout.class_mask, cbit,
-			 	{
-			 		int class = (int)pfq_ctz(cbit);
-			 		elig_mask |= (unsigned long)atomic_long_read(&this_group->sock_id[class]);
-			 	});
+				if (prg || ebpf) {
+					size_t to_kernel = buff->to_kernel;
+					size_t num_fwd = buff->fwd_dev_num;
+					unsigned long chain_mask = buff->chain_mask;
 
+				 	/* setup monad for this computation */
 
-			 	if (is_steering(monad.fanout)) { /* single or double */
+					pfq_lang_monad_init(&monad, this_group);
 
-			 		unsigned long steer_mask[Q_MAX_STEERING_MASK];
-			 		unsigned int sbit, steer_mask_numb = 0;
+				 	/* run the compiled eBPF program (JIT) or the functional program */
 
-					/* compute the load balancing mask list */
+					if (ebpf)
+						pfq_ebpf_run(buff, ebpf);
+				 	else if (!pfq_lang_run(buff, prg).qbuff) {
+				 		__sparse_inc(this_group->stats, drop, cpu);
+				 		continue;
+				 	}
 
-			 		pfq_bitwise_foreach(elig_mask, sbit,
-			 		{
-			 			pfq_id_t id = (__force pfq_id_t)pfq_ctz(sbit);
-			 			struct pfq_sock * so = pfq_sock_get_by_id(id);
+				 	/* update stats */
 
-						int i, end = so ? so->weight : 1;
-						for(i = 0; i < end; ++i)
-							steer_mask[steer_mask_numb++] = sbit;
-			 		});
+	                                 __sparse_add(this_group->stats, frwd, buff->fwd_dev_num - num_fwd, cpu);
+	                                 __sparse_add(this_group->stats, kern, buff->to_kernel - to_kernel, cpu);
 
-					buff->fwd_mask |= steer_mask[pfq_fold(hash_int(monad.fanout.hash), (unsigned int)steer_mask_numb)];
+					pfq_group_chain_check(buff, this_group, chain_mask);
+					if (buff->chain_mask != chain_mask)
+						__sparse_inc(this_group->stats, chnd, cpu);
 
-					if (is_double_steering(monad.fanout))
-						buff->fwd_mask |= steer_mask[pfq_fold(hash_int(monad.fanout.hash2), (unsigned int)steer_mask_numb)];
+					pfq_group_fanout(buff, this_group, cpu);
 
-			 	}
-			 	else {  /* broadcast */
+				} else {
+					buff->fwd_mask |= (unsigned long)atomic_long_read(&this_group->sock_id[0]);
+				}
+			}
+			);
 
-			 		buff->fwd_mask |= elig_mask;
-			 	}
+			/* groups chained by to_group are evaluated in the next hop */
 
-			} else {
-				buff->fwd_mask |= (unsigned long)atomic_long_read(&this_group->sock_id[0]);
-			}
+			visited |= group_mask;
+			group_mask = pfq_group_chain_next(buff, visited, cpu);
 		}
-		);
+
+		rcu_read_unlock();
 
 		/* get the current timestamp */
 
@@ -913,7 +1241,9 @@ pfq_receive(struct napi_struct *napi, struct sk_buff * skb)
 			qbuff_free(buff, &pool->rx);
 		}
 
-		/* transmit the queue or wait for the next packet? */
+	flush:
+		/* transmit the queue or wait for the next packet?
+		 * (batched packets are released by pfq_receive_run) */
 
 		if (data->qbuff_queue->len < (size_t)global->capt_batch_len &&
 		     ktime_to_ns(ktime_sub(current_rx, data->last_rx)) < 1000000) {
@@ -923,6 +1253,10 @@ pfq_receive(struct napi_struct *napi, struct sk_buff * skb)
 		data->last_rx = current_rx;
 	}
 	else {
+		/* timer heartbeat: expire the idle flows (flow_export) */
+
+		pfq_lang_flow_expire(cpu);
+
 		if (data->qbuff_queue->len == 0)
 			return 0;
 	}
@@ -931,6 +1265,9 @@ pfq_receive(struct napi_struct *napi, struct sk_buff * skb)
 
 	__sparse_add(global->percpu_stats, recv, data->qbuff_queue->len, cpu);
 
+	if (data->lang_batch)
+		pfq_receive_batch(data, cpu);
+
 	return pfq_receive_run( data
 			      , pool
 			      , cpu);
@@ -972,7 +1309,9 @@ int pfq_receive_run( struct pfq_percpu_data *data
 		})
 	}
 
-        /* forward packets to endpoints */
+        /* forward packets to endpoints (sockets and shared queues are retired with RCU) */
+
+	rcu_read_lock();
 
 	pfq_bitwise_foreach(all_fwd_mask, bit,
 	{
@@ -984,6 +1323,8 @@ int pfq_receive_run( struct pfq_percpu_data *data
 		}
 	});
 
+	rcu_read_unlock();
+
 	/* forward packets to device */
 
 	pfq_get_lazy_endpoints(PFQ_QBUFF_QUEUE(data->qbuff_queue), &endpoints);
@@ -1037,12 +1378,15 @@ int pfq_copy_bits(const struct sk_buff *skb, int offset, void *to, int len)
 }
 
 
-size_t pfq_sk_queue_recv(struct pfq_sock *so,
-			 struct pfq_qbuff_queue *buffs,
-			 unsigned __int128 mask,
-			 int burst_len)
+static size_t
+__pfq_sk_queue_recv(struct pfq_sock *so,
+		    struct pfq_shared_rx_queue *rx_queue,
+		    char *rx_mem,
+		    size_t rx_queue_len,
+		    struct pfq_qbuff_queue *buffs,
+		    unsigned __int128 mask,
+		    int burst_len)
 {
-	struct pfq_shared_rx_queue *rx_queue = pfq_sock_rx_shared_queue(so);
 	struct pfq_pkthdr *hdr;
 	struct qbuff *buff;
 	unsigned long data;
@@ -1050,16 +1394,14 @@ size_t pfq_sk_queue_recv(struct pfq_sock *so,
 	pfq_qver_t qver;
 	int qlen;
 
-	if (unlikely(rx_queue == NULL))
+	if (unlikely(rx_queue == NULL || rx_mem == NULL))
 		return 0;
 
 	data = __atomic_fetch_add(&rx_queue->shinfo, burst_len, __ATOMIC_RELAXED);
 	qlen = PFQ_SHARED_QUEUE_LEN(data);
 	qver = PFQ_SHARED_QUEUE_VER(data);
 
-	hdr  = (struct pfq_pkthdr *) pfq_mpsc_slot_ptr(so, qver, qlen);
-	if (unlikely(hdr == NULL))
-		return 0;
+	hdr  = (struct pfq_pkthdr *)(rx_mem + (rx_queue_len * (qver & 1) + (size_t)qlen) * so->rx_slot_size);
 
 	for_each_qbuff_with_mask(mask, buffs, buff, n)
 	{
@@ -1076,7 +1418,7 @@ size_t pfq_sk_queue_recv(struct pfq_sock *so,
 		prefetch_w0(hdr);
 		prefetch_w0((char *)hdr + 64);
 
-		if (unlikely(slot_index >= so->rx_queue_len)) {
+		if (unlikely(slot_index >= rx_queue_len)) {
 #ifdef PFQ_USE_POLL
 			if (waitqueue_active(&so->waitqueue)) {
 				wake_up_interruptible(&so->waitqueue);
@@ -1140,3 +1482,176 @@ size_t pfq_sk_queue_recv(struct pfq_sock *so,
 	return copied;
 }
 
+
+size_t pfq_sk_queue_recv(struct pfq_sock *so,
+			 struct pfq_qbuff_queue *buffs,
+			 unsigned __int128 mask,
+			 int burst_len)
+{
+	return __pfq_sk_queue_recv(so, pfq_sock_rx_shared_queue(so), pfq_sock_rx_queue_mem(so),
+				   so->rx_queue_len, buffs, mask, burst_len);
+}
+
+
+size_t pfq_sk_queue_recv_hp(struct pfq_sock *so,
+			    struct pfq_qbuff_queue *buffs,
+			    unsigned __int128 mask,
+			    int burst_len)
+{
+	size_t copied = __pfq_sk_queue_recv(so, pfq_sock_rx_hp_shared_queue(so), pfq_sock_rx_hp_queue_mem(so),
+					    so->rx_hp_queue_len, buffs, mask, burst_len);
+#ifdef PFQ_USE_POLL
+	/* high-priority packets wake up the consumer at once */
+
+	if (copied && waitqueue_active(&so->waitqueue))
+		wake_up_interruptible(&so->waitqueue);
+#endif
+	return copied;
+}
+
+
+/* append a flow record to the flow queue of the socket (false if full) */
+
+bool pfq_sk_queue_flow(struct pfq_sock *so, struct pfq_flow_record const *rec)
+{
+	struct pfq_shared_rx_queue *flow_queue = pfq_sock_flow_shared_queue(so);
+	char *flow_mem = pfq_sock_flow_queue_mem(so);
+	struct pfq_pkthdr *hdr;
+	unsigned long data;
+	pfq_qver_t qver;
+	size_t qlen;
+
+	if (unlikely(flow_queue == NULL || flow_mem == NULL))
+		return false;
+
+	data = __atomic_fetch_add(&flow_queue->shinfo, 1, __ATOMIC_RELAXED);
+	qlen = PFQ_SHARED_QUEUE_LEN(data);
+	qver = PFQ_SHARED_QUEUE_VER(data);
+
+	if (unlikely(qlen >= so->flow_queue_len)) {
+#ifdef PFQ_USE_POLL
+		if (waitqueue_active(&so->waitqueue))
+			wake_up_interruptible(&so->waitqueue);
+#endif
+		return false;
+	}
+
+	hdr = (struct pfq_pkthdr *)(flow_mem + (so->flow_queue_len * (qver & 1) + qlen) * PFQ_FLOW_SLOT_SIZE);
+
+	memcpy(hdr + 1, rec, sizeof(*rec));
+
+	/* the timestamp is the end of the flow */
+
+	hdr->tstamp.tv.sec  = (uint32_t)div_u64_rem(rec->last, NSEC_PER_SEC, &hdr->tstamp.tv.nsec);
+
+	hdr->caplen = (uint16_t)sizeof(*rec);
+	hdr->len = (uint16_t)sizeof(*rec);
+
+	hdr->info.data.mark = 0;
+	hdr->info.ifindex = rec->ifindex;
+	hdr->info.vlan.tci = 0;
+	hdr->info.queue = 0;
+
+	/* commit the slot (release semantic) */
+
+	__atomic_store_n(&hdr->info.commit, qver, __ATOMIC_RELEASE);
+
+#ifdef PFQ_USE_POLL
+	if ((qlen & 31) == 0 &&
+	    waitqueue_active(&so->waitqueue)) {
+		wake_up_interruptible(&so->waitqueue);
+	}
+#endif
+	return true;
+}
+
+
+/* copy the packet to the slot of the flight recorder reserved with index:
+ * the slot is claimed by a single writer, the ones lagging behind a full
+ * round of the buffer do not overwrite it */
+
+static void
+pfq_sk_record_slot(struct pfq_sock *so, char *rec_mem, unsigned long index, struct qbuff *buff)
+{
+	struct sk_buff *skb = QBUFF_SKB(buff);
+	struct pfq_pkthdr *hdr;
+	uint32_t commit;
+	size_t bytes;
+
+	hdr = (struct pfq_pkthdr *)(rec_mem + (index % so->recorder_len) * so->rx_slot_size);
+
+	commit = __atomic_load_n(&hdr->info.commit, __ATOMIC_RELAXED);
+
+	if (unlikely(commit == Q_RECORDER_SLOT_BUSY || (int32_t)(commit - (uint32_t)(index + 1)) > 0))
+		return;
+
+	if (unlikely(!__atomic_compare_exchange_n(&hdr->info.commit, &commit, Q_RECORDER_SLOT_BUSY,
+						  false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)))
+		return;
+
+	/* the slot is invalid while it is being written */
+
+	smp_wmb();
+
+	bytes = min_t(size_t, skb->len, so->rx_len);
+
+	/* on failure, hand the slot back to the next lap with its previous commit */
+
+	if (unlikely(pfq_copy_bits(skb, 0, hdr + 1, bytes) != 0)) {
+		__atomic_store_n(&hdr->info.commit, commit, __ATOMIC_RELEASE);
+		return;
+	}
+
+	if (likely(so->tstamp != 0)) {
+		struct timespec ts;
+		skb_get_timestampns(skb, &ts);
+		hdr->tstamp.tv.sec  = (uint32_t)ts.tv_sec;
+		hdr->tstamp.tv.nsec = (uint32_t)ts.tv_nsec;
+	}
+
+	hdr->caplen = (uint16_t)bytes;
+	hdr->len = (uint16_t)skb->len;
+
+	hdr->info.data.mark = skb->mark;
+	hdr->info.ifindex = skb->dev->ifindex;
+	hdr->info.vlan.tci = skb->vlan_tci & ~VLAN_TAG_PRESENT;
+	hdr->info.queue	= skb_rx_queue_recorded(skb) ? (uint16_t)skb_get_rx_queue(skb) : 0;
+
+	/* commit the slot with its index (release semantic) */
+
+	__atomic_store_n(&hdr->info.commit, (uint32_t)(index + 1), __ATOMIC_RELEASE);
+}
+
+
+/* copy the packets (buffs[n] for each bit n of the mask) to the flight recorder
+ * of the socket: the slots are reserved at once, the buffer is overwritten
+ * circularly until the head reaches the stop index */
+
+void pfq_sk_queue_record(struct pfq_sock *so, struct qbuff *buffs, unsigned __int128 mask)
+{
+	struct pfq_shared_recorder *rec = pfq_sock_recorder(so);
+	char *rec_mem = pfq_sock_recorder_mem(so);
+	unsigned long index, stop;
+	unsigned int n;
+
+	if (unlikely(rec == NULL || rec_mem == NULL || mask == 0))
+		return;
+
+	if (__atomic_load_n(&rec->state, __ATOMIC_RELAXED) == Q_RECORDER_FROZEN)
+		return;
+
+	index = __atomic_fetch_add(&rec->head, pfq_popcount(mask), __ATOMIC_RELAXED);
+	stop  = __atomic_load_n(&rec->stop, __ATOMIC_ACQUIRE);
+
+	for(; mask; mask &= mask - 1, index++)
+	{
+		n = pfq_ctz(mask);
+
+		if (unlikely(index >= stop)) {
+			__atomic_store_n(&rec->state, Q_RECORDER_FROZEN, __ATOMIC_RELEASE);
+			return;
+		}
+
+		pfq_sk_record_slot(so, rec_mem, index, &buffs[n]);
+	}
+}
@@ -72,6 +72,21 @@ extern size_t pfq_sk_queue_recv( struct pfq_sock *so
 			       , int burst_len
 			       );
 
+extern size_t pfq_sk_queue_recv_hp( struct pfq_sock *so
+				  , struct pfq_qbuff_queue *buffs
+				  , unsigned __int128 buffs_mask
+				  , int burst_len
+				  );
+
+extern bool pfq_sk_queue_flow( struct pfq_sock *so
+			     , struct pfq_flow_record const *rec
+			     );
+
+extern void pfq_sk_queue_record( struct pfq_sock *so
+			       , struct qbuff *buffs
+			       , unsigned __int128 mask
+			       );
+
 
 struct pfq_xmit_context
 {
@@ -28,6 +28,7 @@
 #include <linux/netdevice.h>
 #include <linux/slab.h>
 #include <linux/inetdevice.h>
+#include <linux/rcupdate.h>
 
 #if (LINUX_VERSION_CODE <= KERNEL_VERSION(3,14,0))
 static inline bool netif_xmit_frozen_or_drv_stopped(const struct netdev_queue *queue)
@@ -56,4 +57,25 @@ netdev_notifier_info_to_dev(void *data)
 #endif
 
 
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(5,5,0))
+#define rcu_replace_pointer(rcu_ptr, ptr, c)				\
+({									\
+	typeof(ptr) __tmp = rcu_dereference_protected((rcu_ptr), (c));	\
+	rcu_assign_pointer((rcu_ptr), (ptr));				\
+	__tmp;								\
+})
+#endif
+
+
+/* lockdep condition of the RCU list walk (>= 5.4) */
+
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(5,4,0))
+#define pfq_hlist_for_each_entry_rcu(pos, head, member, c)		\
+	hlist_for_each_entry_rcu(pos, head, member)
+#else
+#define pfq_hlist_for_each_entry_rcu(pos, head, member, c)		\
+	hlist_for_each_entry_rcu(pos, head, member, c)
+#endif
+
+
 #endif /* PFQ_KCOMPACT_H */
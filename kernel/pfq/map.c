@@ -0,0 +1,587 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <pfq/global.h>
+#include <pfq/group.h>
+#include <pfq/map.h>
+#include <pfq/printk.h>
+#include <pfq/sketch.h>
+
+#include <linux/jhash.h>
+#include <linux/random.h>
+#include <linux/vmalloc.h>
+
+
+struct pfq_map_elem
+{
+	struct hlist_node	node;
+	struct rcu_head		rcu;
+	u32			hash;
+	char			data[] __aligned(8);	/* key, value (8 bytes aligned) */
+};
+
+
+static inline void *
+map_elem_value(struct pfq_map const *map, struct pfq_map_elem *e)
+{
+	return e->data + ALIGN(map->key_size, 8);
+}
+
+
+static inline u32
+map_hash(struct pfq_map const *map, const void *key)
+{
+	return jhash(key, (u32)map->key_size, map->seed);
+}
+
+
+static struct pfq_map_elem *
+map_hash_find(struct pfq_map *map, const void *key, u32 hash)
+{
+	struct pfq_map_elem *e;
+
+	hlist_for_each_entry_rcu(e, &map->buckets[hash & map->mask], node)
+	{
+		if (e->hash == hash && !memcmp(e->data, key, map->key_size))
+			return e;
+	}
+
+	return NULL;
+}
+
+
+/* Q_MAP_LPM: the prefix of the key is cleared beyond its length */
+
+static int
+map_lpm_key(struct pfq_map const *map, const void *key, struct pfq_map_lpm_key *out)
+{
+	struct pfq_map_lpm_key const *k = key;
+	unsigned int len = (unsigned int)(map->key_size - sizeof(uint32_t));
+	unsigned int n;
+
+	if (k->prefix > len * 8)
+		return -EINVAL;
+
+	out->prefix = k->prefix;
+	for(n = 0; n < len; n++)
+	{
+		unsigned int bits = k->prefix > n * 8 ? min(k->prefix - n * 8, 8U) : 0;
+		out->addr[n] = k->addr[n] & (uint8_t)(0xff00 >> bits);
+	}
+
+	return 0;
+}
+
+
+static void *
+map_lpm_lookup(struct pfq_map *map, const void *key)
+{
+	struct pfq_map_lpm_key const *k = key;
+	union {
+		struct pfq_map_lpm_key lpm;
+		char data[Q_MAP_MAX_KEY_SIZE];
+	} tmp;
+	int w;
+
+	/* try the prefix lengths in use, the longest first */
+
+	for(w = BITS_TO_LONGS(Q_MAP_LPM_MAX_PREFIX+1) - 1; w >= 0; w--)
+	{
+		unsigned long word = READ_ONCE(map->prefix_map[w]);
+
+		while (word)
+		{
+			unsigned int prefix = (unsigned int)(w * BITS_PER_LONG + __fls(word));
+			struct pfq_map_elem *e;
+
+			word &= ~(1UL << __fls(word));
+
+			if (prefix > k->prefix)
+				continue;
+
+			tmp.lpm.prefix = prefix;
+			memcpy(tmp.lpm.addr, k->addr, map->key_size - sizeof(uint32_t));
+			map_lpm_key(map, &tmp.lpm, &tmp.lpm);
+
+			e = map_hash_find(map, &tmp.lpm, map_hash(map, &tmp.lpm));
+			if (e)
+				return map_elem_value(map, e);
+		}
+	}
+
+	return NULL;
+}
+
+
+void *
+pfq_map_lookup(struct pfq_map *map, const void *key)
+{
+	struct pfq_map_elem *e;
+
+	switch(map->type)
+	{
+	case Q_MAP_ARRAY: {
+		uint32_t index = *(uint32_t const *)key;
+		if (index >= map->max_entries)
+			return NULL;
+		return map->array + index * pfq_map_value_stride(map);
+	}
+	case Q_MAP_LPM:
+		return map_lpm_lookup(map, key);
+	case Q_MAP_COUNT_MIN:
+	case Q_MAP_HLL:
+	case Q_MAP_BLOOM:
+		return NULL;
+	}
+
+	e = map_hash_find(map, key, map_hash(map, key));
+	return e ? map_elem_value(map, e) : NULL;
+}
+
+
+int
+pfq_map_update(struct pfq_map *map, const void *key, const void *value, int flags, gfp_t gfp)
+{
+	union {
+		struct pfq_map_lpm_key lpm;
+		char data[Q_MAP_MAX_KEY_SIZE];
+	} tmp;
+	struct pfq_map_elem *old, *e;
+	u32 hash;
+
+	if (pfq_map_is_sketch(map))
+		return -EINVAL;
+
+	if (map->type == Q_MAP_BLOOM)
+		return pfq_map_bloom_add(map, key);
+
+	if (map->type == Q_MAP_ARRAY) {
+
+		uint32_t index = *(uint32_t const *)key;
+
+		if (index >= map->max_entries)
+			return -E2BIG;
+		if (flags == Q_MAP_NOEXIST)
+			return -EEXIST;
+
+		/* note: values larger than a word are not updated atomically */
+
+		spin_lock_bh(&map->lock);
+		memcpy(map->array + index * pfq_map_value_stride(map), value, map->value_size);
+		spin_unlock_bh(&map->lock);
+		return 0;
+	}
+
+	if (map->type == Q_MAP_LPM) {
+		if (map_lpm_key(map, key, &tmp.lpm) < 0)
+			return -EINVAL;
+		key = &tmp.lpm;
+	}
+
+	hash = map_hash(map, key);
+
+	e = kmalloc(sizeof(*e) + ALIGN(map->key_size, 8) + map->value_size, gfp);
+	if (e == NULL)
+		return -ENOMEM;
+
+	e->hash = hash;
+	memcpy(e->data, key, map->key_size);
+	memcpy(map_elem_value(map, e), value, map->value_size);
+
+	spin_lock_bh(&map->lock);
+
+	old = map_hash_find(map, key, hash);
+
+	if ((old && flags == Q_MAP_NOEXIST) || (!old && flags == Q_MAP_EXIST)) {
+		spin_unlock_bh(&map->lock);
+		kfree(e);
+		return old ? -EEXIST : -ENOENT;
+	}
+
+	if (old) {
+		hlist_replace_rcu(&old->node, &e->node);
+		spin_unlock_bh(&map->lock);
+		kfree_rcu(old, rcu);
+		return 0;
+	}
+
+	if (atomic_read(&map->count) >= (int)map->max_entries) {
+		spin_unlock_bh(&map->lock);
+		kfree(e);
+		return -E2BIG;
+	}
+
+	if (map->type == Q_MAP_LPM && map->prefix_count[tmp.lpm.prefix]++ == 0)
+		set_bit(tmp.lpm.prefix, map->prefix_map);
+
+	hlist_add_head_rcu(&e->node, &map->buckets[hash & map->mask]);
+	atomic_inc(&map->count);
+
+	spin_unlock_bh(&map->lock);
+	return 0;
+}
+
+
+int
+pfq_map_delete(struct pfq_map *map, const void *key)
+{
+	union {
+		struct pfq_map_lpm_key lpm;
+		char data[Q_MAP_MAX_KEY_SIZE];
+	} tmp;
+	struct pfq_map_elem *e;
+
+	if (pfq_map_is_sketch(map)) {
+		spin_lock_bh(&map->lock);
+		pfq_sketch_reset(map);
+		spin_unlock_bh(&map->lock);
+		return 0;
+	}
+
+	if (map->type == Q_MAP_BLOOM) {
+		pfq_map_bloom_clear(map);
+		return 0;
+	}
+
+	if (map->type == Q_MAP_ARRAY) {
+
+		uint32_t index = *(uint32_t const *)key;
+
+		if (index >= map->max_entries)
+			return -E2BIG;
+
+		spin_lock_bh(&map->lock);
+		memset(map->array + index * pfq_map_value_stride(map), 0, map->value_size);
+		spin_unlock_bh(&map->lock);
+		return 0;
+	}
+
+	if (map->type == Q_MAP_LPM) {
+		if (map_lpm_key(map, key, &tmp.lpm) < 0)
+			return -EINVAL;
+		key = &tmp.lpm;
+	}
+
+	spin_lock_bh(&map->lock);
+
+	e = map_hash_find(map, key, map_hash(map, key));
+	if (e == NULL) {
+		spin_unlock_bh(&map->lock);
+		return -ENOENT;
+	}
+
+	hlist_del_rcu(&e->node);
+	atomic_dec(&map->count);
+
+	if (map->type == Q_MAP_LPM && --map->prefix_count[tmp.lpm.prefix] == 0)
+		clear_bit(tmp.lpm.prefix, map->prefix_map);
+
+	spin_unlock_bh(&map->lock);
+
+	kfree_rcu(e, rcu);
+	return 0;
+}
+
+
+/* walk the map: the key following the given one (NULL for the first key) */
+
+int
+pfq_map_get_next_key(struct pfq_map *map, const void *key, void *next)
+{
+	struct pfq_map_elem *e = NULL;
+	u32 bucket = 0;
+
+	if (pfq_map_is_sketch(map))
+		return pfq_sketch_next_key(map, key, next);
+
+	if (map->type == Q_MAP_BLOOM)
+		return -EINVAL;
+
+	if (map->type == Q_MAP_ARRAY) {
+
+		uint32_t index = key ? *(uint32_t const *)key + 1 : 0;
+
+		if (index >= map->max_entries)
+			return -ENOENT;
+
+		*(uint32_t *)next = index;
+		return 0;
+	}
+
+	rcu_read_lock();
+
+	if (key) {
+		u32 hash = map_hash(map, key);
+		struct pfq_map_elem *cur = map_hash_find(map, key, hash);
+
+		/* a missing key restarts the walk from the first one */
+
+		if (cur) {
+			e = hlist_entry_safe(rcu_dereference_raw(hlist_next_rcu(&cur->node)),
+					     struct pfq_map_elem, node);
+			bucket = (hash & map->mask) + 1;
+		}
+	}
+
+	for(; e == NULL && bucket <= map->mask; bucket++)
+	{
+		e = hlist_entry_safe(rcu_dereference_raw(hlist_first_rcu(&map->buckets[bucket])),
+				     struct pfq_map_elem, node);
+	}
+
+	if (e)
+		memcpy(next, e->data, map->key_size);
+
+	rcu_read_unlock();
+	return e ? 0 : -ENOENT;
+}
+
+
+/* copy the value of the key (the estimate, for sketches; nothing, for bloom filters) */
+
+int
+pfq_map_read(struct pfq_map *map, const void *key, void *value)
+{
+	void *ptr;
+
+	if (pfq_map_is_sketch(map)) {
+		*(u64 *)value = pfq_sketch_estimate(map, key);
+		return 0;
+	}
+
+	/* the layers of a bloom filter are released after a grace period (clear) */
+
+	if (map->type == Q_MAP_BLOOM) {
+		bool found;
+
+		rcu_read_lock();
+		found = pfq_map_bloom_test(map, key);
+		rcu_read_unlock();
+
+		return found ? 0 : -ENOENT;
+	}
+
+	rcu_read_lock();
+	ptr = pfq_map_lookup(map, key);
+	if (ptr)
+		memcpy(value, ptr, map->value_size);
+	rcu_read_unlock();
+
+	return ptr ? 0 : -ENOENT;
+}
+
+
+static void
+map_free(struct pfq_map *map)
+{
+	struct pfq_map_elem *e;
+	struct hlist_node *tmp;
+	u32 n;
+
+	if (map->buckets) {
+		for(n = 0; n <= map->mask; n++)
+		{
+			hlist_for_each_entry_safe(e, tmp, &map->buckets[n], node)
+			{
+				hlist_del(&e->node);
+				kfree(e);
+			}
+		}
+	}
+
+	pfq_sketch_free(map);
+	pfq_map_bloom_free(map);
+	vfree(map->buckets);
+	vfree(map->array);
+	kfree(map);
+}
+
+
+int
+pfq_map_create(pfq_id_t owner, int type, size_t key_size, size_t value_size, size_t max_entries, unsigned int fpr)
+{
+	struct pfq_map *map;
+	int n;
+
+	switch(type)
+	{
+	case Q_MAP_HASH:  if (key_size == 0) return -EINVAL; break;
+	case Q_MAP_ARRAY: if (key_size != sizeof(uint32_t)) return -EINVAL; break;
+	case Q_MAP_LPM:	  if (key_size != sizeof(uint32_t) + 4 &&
+			      key_size != sizeof(uint32_t) + 16) return -EINVAL; break;
+	case Q_MAP_COUNT_MIN:
+	case Q_MAP_HLL:	  if (key_size == 0) return -EINVAL; break;
+	case Q_MAP_BLOOM: if (key_size == 0 || value_size != 0) return -EINVAL; break;
+	default:
+		return -EINVAL;
+	}
+
+	if (key_size > Q_MAP_MAX_KEY_SIZE || (value_size == 0 && type != Q_MAP_BLOOM) || value_size > Q_MAP_MAX_VALUE_SIZE ||
+	    max_entries == 0 || max_entries > Q_MAP_MAX_ENTRIES)
+		return -EINVAL;
+
+	map = kzalloc(sizeof(*map), GFP_KERNEL);
+	if (map == NULL)
+		return -ENOMEM;
+
+	map->type	 = type;
+	map->owner	 = owner;
+	map->key_size	 = key_size;
+	map->value_size	 = value_size;
+	map->max_entries = max_entries;
+
+	atomic_set(&map->refcnt, 1);
+	atomic_set(&map->count, 0);
+	spin_lock_init(&map->lock);
+	get_random_bytes(&map->seed, sizeof(map->seed));
+
+	if (type == Q_MAP_ARRAY) {
+		map->array = vzalloc(max_entries * pfq_map_value_stride(map));
+		if (map->array == NULL)
+			goto nomem;
+	}
+	else if (pfq_map_is_sketch(map) || type == Q_MAP_BLOOM) {
+		int err = type == Q_MAP_BLOOM ? pfq_map_bloom_alloc(map, fpr) : pfq_sketch_alloc(map);
+		if (err < 0) {
+			map_free(map);
+			return err;
+		}
+	}
+	else {
+		map->mask = (u32)roundup_pow_of_two(max_entries) - 1;
+		map->buckets = vzalloc((map->mask + 1) * sizeof(struct hlist_head));
+		if (map->buckets == NULL)
+			goto nomem;
+	}
+
+	mutex_lock(&global->maps_lock);
+
+	for(n = 0; n < Q_MAX_MAPS; n++)
+	{
+		if (global->maps[n] == NULL) {
+			map->id = n;
+			global->maps[n] = map;
+			break;
+		}
+	}
+
+	mutex_unlock(&global->maps_lock);
+
+	if (n == Q_MAX_MAPS) {
+		map_free(map);
+		return -ENOSPC;
+	}
+
+	pr_devel("[PFQ|%d] map %d created: type=%d key_size=%zu value_size=%zu max_entries=%zu\n",
+		 owner, n, type, key_size, value_size, max_entries);
+	return n;
+
+nomem:
+	map_free(map);
+	return -ENOMEM;
+}
+
+
+/* take a reference to the map (e.g. by the init of a pfq-lang function) */
+
+struct pfq_map *
+pfq_map_get(int mid)
+{
+	struct pfq_map *map = NULL;
+
+	if (mid < 0 || mid >= Q_MAX_MAPS)
+		return NULL;
+
+	mutex_lock(&global->maps_lock);
+	map = global->maps[mid];
+	if (map)
+		atomic_inc(&map->refcnt);
+	mutex_unlock(&global->maps_lock);
+
+	return map;
+}
+
+
+void
+pfq_map_put(struct pfq_map *map)
+{
+	if (map == NULL || !atomic_dec_and_test(&map->refcnt))
+		return;
+
+	/* wait for the Rx path to drop any reference to the map */
+
+	synchronize_rcu();
+
+	pr_devel("[PFQ] map %d freed.\n", map->id);
+	map_free(map);
+}
+
+
+int
+pfq_map_destroy(pfq_id_t id, int mid)
+{
+	struct pfq_map *map;
+
+	if (mid < 0 || mid >= Q_MAX_MAPS)
+		return -EINVAL;
+
+	mutex_lock(&global->maps_lock);
+
+	map = global->maps[mid];
+	if (map == NULL || map->owner != id) {
+		mutex_unlock(&global->maps_lock);
+		return map ? -EACCES : -EINVAL;
+	}
+
+	global->maps[mid] = NULL;
+	mutex_unlock(&global->maps_lock);
+
+	/* computations still using the map keep it alive */
+
+	pfq_map_put(map);
+	return 0;
+}
+
+
+/* a map is accessible to the socket that created it, and to the sockets
+ * sharing a group with it */
+
+bool
+pfq_map_access(struct pfq_map const *map, pfq_id_t id)
+{
+	return map->owner == id ||
+	       (pfq_group_get_groups(map->owner) & pfq_group_get_groups(id)) != 0;
+}
+
+
+void
+pfq_map_release_all(pfq_id_t id)
+{
+	int n;
+
+	for(n = 0; n < Q_MAX_MAPS; n++)
+	{
+		if (global->maps[n] && global->maps[n]->owner == id)
+			pfq_map_destroy(id, n);
+	}
+}
@@ -0,0 +1,105 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#ifndef PFQ_MAP_H
+#define PFQ_MAP_H
+
+#include <pfq/bloom.h>
+#include <pfq/define.h>
+#include <pfq/kcompat.h>
+#include <pfq/types.h>
+
+#include <linux/pf_q.h>
+#include <linux/rculist.h>
+#include <linux/spinlock.h>
+
+
+#define Q_MAP_LPM_MAX_PREFIX		128
+
+
+/* shared map: hash tables (Q_MAP_HASH, Q_MAP_LPM), array (Q_MAP_ARRAY), sketches or bloom filters */
+
+struct pfq_map
+{
+	int		id;
+	int		type;
+	pfq_id_t	owner;				/* creator socket (the map is destroyed when it is closed) */
+
+	size_t		key_size;
+	size_t		value_size;
+	size_t		max_entries;
+
+	atomic_t	refcnt;				/* the table of maps and the computations that use it */
+	atomic_t	count;				/* number of elements */
+	spinlock_t	lock;				/* serializes the writers */
+
+	u32		seed;
+	u32		mask;				/* number of buckets - 1 */
+	struct hlist_head *buckets;
+
+	char		*array;				/* Q_MAP_ARRAY values */
+
+	char		*sketch;			/* Q_MAP_COUNT_MIN, Q_MAP_HLL: one sketch per cpu */
+	size_t		sketch_size;
+
+	struct pfq_bloom *bloom[Q_BLOOM_MAX_LAYERS];	/* Q_MAP_BLOOM layers */
+	int		bloom_layers;
+	u64		bloom_log2p;			/* log2(1/fpr) of the first layer (16 bits fixed point) */
+
+	unsigned long	prefix_map[BITS_TO_LONGS(Q_MAP_LPM_MAX_PREFIX+1)];	/* Q_MAP_LPM: prefix lengths in use */
+	unsigned int	prefix_count[Q_MAP_LPM_MAX_PREFIX+1];
+};
+
+
+static inline bool
+pfq_map_is_sketch(struct pfq_map const *map)
+{
+	return map->type == Q_MAP_COUNT_MIN || map->type == Q_MAP_HLL;
+}
+
+
+static inline size_t
+pfq_map_value_stride(struct pfq_map const *map)
+{
+	return ALIGN(map->value_size, 8);
+}
+
+
+extern int  pfq_map_create(pfq_id_t owner, int type, size_t key_size, size_t value_size, size_t max_entries, unsigned int fpr);
+extern int  pfq_map_destroy(pfq_id_t id, int mid);
+extern bool pfq_map_access(struct pfq_map const *map, pfq_id_t id);
+extern void pfq_map_release_all(pfq_id_t owner);
+
+extern struct pfq_map * pfq_map_get(int mid);
+extern void pfq_map_put(struct pfq_map *map);
+
+/* lookup and update can be called from the Rx path (under rcu_read_lock) */
+
+extern void * pfq_map_lookup(struct pfq_map *map, const void *key);
+extern int    pfq_map_update(struct pfq_map *map, const void *key, const void *value, int flags, gfp_t gfp);
+extern int    pfq_map_delete(struct pfq_map *map, const void *key);
+extern int    pfq_map_get_next_key(struct pfq_map *map, const void *key, void *next);
+extern int    pfq_map_read(struct pfq_map *map, const void *key, void *value);
+
+
+#endif /* PFQ_MAP_H */
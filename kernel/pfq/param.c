@@ -21,6 +21,8 @@
  *
  ****************************************************************/
 
+#include <lang/prof.h>
+
 #include <pfq/global.h>
 #include <pfq/define.h>
 
@@ -30,6 +32,24 @@
 extern struct pfq_global_data default_global;
 
 
+static int
+param_set_lang_profile(const char *val, const struct kernel_param *kp)
+{
+	int rc = param_set_int(val, kp);
+	if (rc == 0)
+		pfq_lang_prof_set(*(int *)kp->arg != 0);
+	return rc;
+}
+
+
+static const struct kernel_param_ops param_ops_lang_profile =
+{
+	.set = param_set_lang_profile,
+	.get = param_get_int,
+};
+
+
+
 module_param_named(max_slot_size,	 default_global.max_slot_size,		int, 0644);
 module_param_named(max_pool_size,	 default_global.max_pool_size,		int, 0644);
 
@@ -38,6 +58,9 @@ module_param_named(xmit_batch_len,	 default_global.xmit_batch_len,		int, 0644);
 module_param_named(skb_tx_pool_size,	 default_global.skb_tx_pool_size,	int, 0644);
 module_param_named(skb_rx_pool_size,	 default_global.skb_rx_pool_size,	int, 0644);
 module_param_named(vlan_untag,		 default_global.vlan_untag,		int, 0644);
+module_param_named(lang_batch,		 default_global.lang_batch,		int, 0644);
+module_param_cb(lang_profile,		 &param_ops_lang_profile, &default_global.lang_profile,	0644);
+module_param_named(sample_seed,	 default_global.sample_seed,		uint, 0644);
 module_param_named(tx_retry,		 default_global.tx_retry,		int, 0644);
 
 module_param_array_named(tx_cpu,	 default_global.tx_cpu,	  int, &default_global.tx_cpu_nr, 0644);
@@ -47,6 +70,9 @@ MODULE_PARM_DESC(max_pool_size,		" Maximum socket buffer pool size (default=2048
 MODULE_PARM_DESC(capt_batch_len,	" Capture batch queue length");
 MODULE_PARM_DESC(xmit_batch_len,	" Transmit batch queue length");
 MODULE_PARM_DESC(vlan_untag,		" Enable vlan untagging (default=0)");
+MODULE_PARM_DESC(lang_batch,		" Evaluate pfq-lang computations over the capture batch (default=0)");
+MODULE_PARM_DESC(lang_profile,		" Collect per-function counters of pfq-lang computations (default=0)");
+MODULE_PARM_DESC(sample_seed,		" Key of the hash of the pfq-lang sampling functions (default=0)");
 
 #ifdef PFQ_USE_SKB_POOL
 MODULE_PARM_DESC(skb_tx_pool_size,	" Socket buffer Tx pool size (default=1024)");
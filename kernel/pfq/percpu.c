@@ -25,9 +25,12 @@
 #include <pfq/qbuff.h>
 #include <pfq/percpu.h>
 #include <pfq/qbuff.h>
+#include <pfq/balance.h>
 #include <pfq/memory.h>
 #include <pfq/define.h>
 
+#include <lang/exec.h>
+
 int pfq_percpu_alloc(void)
 {
 	global->percpu_data = alloc_percpu(struct pfq_percpu_data);
@@ -73,6 +76,9 @@ void pfq_percpu_free(void)
 
 		struct pfq_percpu_data *data = per_cpu_ptr(global->percpu_data, cpu);
 		pfq_free_pages(data->qbuff_queue, sizeof(struct pfq_qbuff_long_queue));
+		pfq_free_pages(data->batch, sizeof(struct pfq_lang_batch));
+		pfq_free_pages(data->frag, sizeof(struct pfq_frag_table));
+		pfq_free_pages(data->balance, sizeof(struct pfq_balance_table));
 	}
 
 	free_percpu(global->percpu_stats);
@@ -105,6 +111,22 @@ int pfq_percpu_init(void)
 
 		data->qbuff_queue->len = 0;
 
+		data->batch = pfq_malloc_pages(sizeof(struct pfq_lang_batch), GFP_KERNEL);
+		if (!data->batch)
+			return -ENOMEM;
+
+		data->frag = pfq_malloc_pages(sizeof(struct pfq_frag_table), GFP_KERNEL);
+		if (!data->frag)
+			return -ENOMEM;
+
+		memset(data->frag, 0, sizeof(struct pfq_frag_table));
+
+		data->balance = pfq_malloc_pages(sizeof(struct pfq_balance_table), GFP_KERNEL);
+		if (!data->balance)
+			return -ENOMEM;
+
+		memset(data->balance, 0, sizeof(struct pfq_balance_table));
+
 		preempt_enable();
 	}
 
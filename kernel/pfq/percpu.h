@@ -26,6 +26,7 @@
 
 
 #include <pfq/define.h>
+#include <pfq/frag.h>
 #include <pfq/global.h>
 #include <pfq/kcompat.h>
 #include <pfq/pool.h>
@@ -55,13 +56,20 @@ int  pfq_percpu_alloc(void);
 void pfq_percpu_free(void);
 
 
+struct pfq_lang_batch;
+struct pfq_balance_table;
+
 struct pfq_percpu_data
 {
 	struct pfq_qbuff_long_queue  *qbuff_queue;
+	struct pfq_lang_batch	     *batch;		/* batch evaluation of pfq-lang */
+	struct pfq_frag_table	     *frag;		/* fragment-aware steering */
+	struct pfq_balance_table     *balance;		/* load-aware balancing (flows) */
 
 	ktime_t			last_rx;
 	struct timer_list	timer;
 	uint32_t		counter;
+	int			lang_batch;		/* evaluation mode of the queued packets */
 
 } ____pfq_cacheline_aligned;
 
@@ -97,7 +97,7 @@ static int pfq_proc_lang(struct seq_file *m, void *v)
 		if (!this_group->policy)
 			continue;
 
-		comp = (struct pfq_lang_computation_tree *)atomic_long_read(&this_group->comp);
+		comp = rcu_dereference_protected(this_group->comp, lockdep_is_held(&global->groups_lock));
 
 		seq_printf(m, "group=%zu ", n);
 		seq_printf_computation_tree(m, comp);
@@ -111,7 +111,7 @@ static int pfq_proc_sockets(struct seq_file *m, void *v)
 {
 	size_t n;
 
-	seq_printf(m, "socket: recv      lost      drop      sent      disc.     failed    forward   kernel\n");
+	seq_printf(m, "socket: recv      lost      drop      sent      disc.     failed    forward   kernel    spilled   hp recv   hp lost   flows     flow lost spill\n");
 
 	mutex_lock(&global->socket_lock);
 
@@ -125,7 +125,7 @@ static int pfq_proc_sockets(struct seq_file *m, void *v)
 
 		pfq_kernel_stats_read(so->stats, &stats);
 
-		seq_printf(m, "%6zu: %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu\n", n,
+		seq_printf(m, "%6zu: %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %d\n", n,
 			   stats.recv,
 			   stats.lost,
 			   stats.drop,
@@ -133,7 +133,13 @@ static int pfq_proc_sockets(struct seq_file *m, void *v)
 			   stats.disc,
 			   stats.fail,
 			   stats.frwd,
-			   stats.kern);
+			   stats.kern,
+			   stats.spll,
+			   stats.hrcv,
+			   stats.hlst,
+			   stats.fexp,
+			   stats.flst,
+			   READ_ONCE(so->spill_id));
         }
 
 	mutex_unlock(&global->socket_lock);
@@ -145,7 +151,7 @@ static int pfq_proc_groups(struct seq_file *m, void *v)
 {
 	size_t n;
 
-	seq_printf(m, " group: recv      lost      drop      sent      disc.     failed    forward   kernel    pol pid   def.    uplane   cplane    ctrl\n");
+	seq_printf(m, " group: recv      lost      drop      sent      disc.     failed    forward   kernel    policed   diverted  chained   loop      pol pid   def.    uplane   cplane    ctrl\n");
 
 	pfq_group_lock();
 
@@ -157,7 +163,7 @@ static int pfq_proc_groups(struct seq_file *m, void *v)
 		if (!this_group->enabled)
 			continue;
 
-		seq_printf(m, "%6zu: %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu", n,
+		seq_printf(m, "%6zu: %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu %-9lu", n,
 			   sparse_read(this_group->stats, recv),
 			   sparse_read(this_group->stats, lost),
 			   sparse_read(this_group->stats, drop),
@@ -167,7 +173,11 @@ static int pfq_proc_groups(struct seq_file *m, void *v)
 			   sparse_read(this_group->stats, fail),
 
 			   sparse_read(this_group->stats, frwd),
-			   sparse_read(this_group->stats, kern));
+			   sparse_read(this_group->stats, kern),
+			   sparse_read(this_group->stats, plcd),
+			   sparse_read(this_group->stats, dvrt),
+			   sparse_read(this_group->stats, chnd),
+			   sparse_read(this_group->stats, loop));
 
 		seq_printf(m, "%3d %3d ", this_group->policy, this_group->pid);
 
@@ -196,6 +206,20 @@ static int pfq_proc_stats(struct seq_file *m, void *v)
 	seq_printf(m, "FORWARD:\n");
 	seq_printf(m, "  forwarded : %ld\n", sparse_read(global->percpu_stats, frwd));
 	seq_printf(m, "  kernel    : %ld\n", sparse_read(global->percpu_stats, kern));
+	seq_printf(m, "POLICE:\n");
+	seq_printf(m, "  policed   : %ld\n", sparse_read(global->percpu_stats, plcd));
+	seq_printf(m, "BALANCE:\n");
+	seq_printf(m, "  diverted  : %ld\n", sparse_read(global->percpu_stats, dvrt));
+	seq_printf(m, "  spilled   : %ld\n", sparse_read(global->percpu_stats, spll));
+	seq_printf(m, "CHAIN:\n");
+	seq_printf(m, "  chained   : %ld\n", sparse_read(global->percpu_stats, chnd));
+	seq_printf(m, "  loop      : %ld\n", sparse_read(global->percpu_stats, loop));
+	seq_printf(m, "PRIORITY:\n");
+	seq_printf(m, "  hp recv   : %ld\n", sparse_read(global->percpu_stats, hrcv));
+	seq_printf(m, "  hp lost   : %ld\n", sparse_read(global->percpu_stats, hlst));
+	seq_printf(m, "FLOWS:\n");
+	seq_printf(m, "  exported  : %ld\n", sparse_read(global->percpu_stats, fexp));
+	seq_printf(m, "  lost      : %ld\n", sparse_read(global->percpu_stats, flst));
 	return 0;
 }
 
@@ -23,6 +23,7 @@
 #ifndef PFQ_QBUFF_H
 #define PFQ_QBUFF_H
 
+#include <pfq/bpf.h>
 #include <pfq/global.h>
 #include <pfq/vlan.h>
 #include <pfq/types.h>
@@ -32,10 +33,43 @@
 #include <linux/version.h>
 #include <linux/skbuff.h>
 #include <linux/ip.h>
+#include <linux/pf_q.h>
 
 struct pfq_lang_monad;
 
 
+/* parsed headers, shared by all the groups and functions: the IP levels
+ * (outer header first, then the tunneled ones) follow the VLAN stack.
+ */
+
+#define Q_TUNNEL_NONE		0
+#define Q_TUNNEL_IP		1		/* IPIP, 6in4, IPv6 */
+#define Q_TUNNEL_GRE		2
+#define Q_TUNNEL_GTP		3		/* GTP-U (G-PDU) */
+#define Q_TUNNEL_VXLAN		4
+#define Q_TUNNEL_MPLS		5
+
+
+struct qbuff_ip_level
+{
+	int16_t			off;		/* offset of the IP header */
+	int16_t			l4off;		/* offset of the transport header */
+	uint8_t			proto;		/* IPPROTO_IP or IPPROTO_IPV6 */
+	uint8_t			l4proto;	/* transport protocol */
+	uint8_t			tunnel;		/* encapsulation of this level (Q_TUNNEL_xxx) */
+	uint32_t		tunnel_id;	/* GRE key, TEID, VNI or MPLS label (bottom of stack) */
+};
+
+
+struct qbuff_headers
+{
+	int8_t			levels;		/* number of IP levels (-1: not parsed yet) */
+	uint8_t			vlan_num;	/* number of in-band VLAN tags */
+	__be16			l3proto;	/* ethertype after the VLAN stack */
+	struct qbuff_ip_level	ip[Q_QBUFF_MAX_IP_LEVEL];
+};
+
+
 struct qbuff
 {
 	void		       *addr;				/* struct sk_buff * */
@@ -45,6 +79,9 @@ struct qbuff
         unsigned long		fwd_mask;			/* fwd to sockets */
         uint32_t		counter;			/* unique id */
         bool			to_kernel;			/* fwd to kernel */
+        unsigned long		prio_mask;			/* sockets receiving it in the high-priority Rx queue */
+        unsigned long		chain_mask;			/* fwd to groups (to_group) */
+	struct qbuff_headers	hdr;				/* parsed headers cache */
 };
 
 
@@ -61,6 +98,9 @@ qbuff_init( struct qbuff *buff
 	buff->counter = id;
 	buff->fwd_mask = 0;
 	buff->to_kernel = false;
+	buff->prio_mask = 0;
+	buff->chain_mask = 0;
+	buff->hdr.levels = -1;
 }
 
 
@@ -285,7 +325,7 @@ qbuff_get_rx_queue(struct qbuff const *buff)
 static inline bool
 qbuff_run_bp_filter(struct qbuff *buff, struct pfq_group *this_group)
 {
-	struct sk_filter *bpf = (struct sk_filter *)atomic_long_read(&this_group->bp_filter);
+	struct sk_filter *bpf = rcu_dereference(this_group->bp_filter);
 
 	if (!bpf) return true;
 
@@ -299,6 +339,17 @@ qbuff_run_bp_filter(struct qbuff *buff, struct pfq_group *this_group)
 
 }
 
+static inline uint32_t
+qbuff_run_ebpf(struct qbuff *buff, struct bpf_prog *prog)
+{
+#ifdef PFQ_USE_EBPF
+	return bpf_prog_run_save_cb(prog, QBUFF_SKB(buff));
+#else
+	return Q_EBPF_PASS;
+#endif
+}
+
+
 static inline bool
 qbuff_run_vlan_filter(struct qbuff const *buff, pfq_gid_t gid)
 {
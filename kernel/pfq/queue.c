@@ -56,6 +56,10 @@ pfq_shared_queue_enable(struct pfq_sock *so, unsigned long user_addr, size_t use
 		mapped_queue->rx.size      = (unsigned int)pfq_mpsc_queue_mem(so)/2;
 		mapped_queue->rx.slot_size = (unsigned int)so->rx_slot_size;
 
+		mapped_queue->rx.mc.head   = 0;
+		mapped_queue->rx.mc.done   = 0;
+		mapped_queue->rx.mc.ver    = 0;
+
 		/* reset Rx slots */
 
 		for(i = 0; i < 2; i++)
@@ -90,7 +94,68 @@ pfq_shared_queue_enable(struct pfq_sock *so, unsigned long user_addr, size_t use
 			mapped_queue->tx_async[n].cons.off   = 0;
 		}
 
-		/* commit queues */
+		/* initialize the high-priority Rx queue */
+
+		mapped_queue->rx_hp.shinfo    = 0;
+		mapped_queue->rx_hp.len       = (unsigned int)so->rx_hp_queue_len;
+		mapped_queue->rx_hp.size      = (unsigned int)pfq_mpsc_hp_queue_mem(so)/2;
+		mapped_queue->rx_hp.slot_size = (unsigned int)so->rx_slot_size;
+
+		mapped_queue->rx_hp.mc.head   = 0;
+		mapped_queue->rx_hp.mc.done   = 0;
+		mapped_queue->rx_hp.mc.ver    = 0;
+
+		for(i = 0; i < 2 && so->rx_hp_queue_len; i++)
+		{
+			char * raw = so->shmem.addr + sizeof(struct pfq_shared_queue) + pfq_mpsc_queue_mem(so)
+					+ pfq_spsc_queue_mem(so) * (1 + Q_MAX_TX_QUEUES) + i * mapped_queue->rx_hp.size;
+			char * end = raw + mapped_queue->rx_hp.size;
+			const int rst = !i;
+			for(;raw < end; raw += mapped_queue->rx_hp.slot_size)
+				((struct pfq_pkthdr *)raw)->info.commit = (uint16_t)rst;
+		}
+
+		/* initialize the flow record queue */
+
+		mapped_queue->flow.shinfo    = 0;
+		mapped_queue->flow.len       = (unsigned int)so->flow_queue_len;
+		mapped_queue->flow.size      = (unsigned int)pfq_mpsc_flow_queue_mem(so)/2;
+		mapped_queue->flow.slot_size = (unsigned int)PFQ_FLOW_SLOT_SIZE;
+
+		mapped_queue->flow.mc.head   = 0;
+		mapped_queue->flow.mc.done   = 0;
+		mapped_queue->flow.mc.ver    = 0;
+
+		for(i = 0; i < 2 && so->flow_queue_len; i++)
+		{
+			char * raw = so->shmem.addr + sizeof(struct pfq_shared_queue) + pfq_mpsc_queue_mem(so)
+					+ pfq_spsc_queue_mem(so) * (1 + Q_MAX_TX_QUEUES) + pfq_mpsc_hp_queue_mem(so)
+					+ i * mapped_queue->flow.size;
+			char * end = raw + mapped_queue->flow.size;
+			const int rst = !i;
+			for(;raw < end; raw += mapped_queue->flow.slot_size)
+				((struct pfq_pkthdr *)raw)->info.commit = (uint16_t)rst;
+		}
+
+		/* initialize the flight recorder (armed) */
+
+		mapped_queue->recorder.head      = 0;
+		mapped_queue->recorder.stop      = ~0UL;
+		mapped_queue->recorder.state     = Q_RECORDER_ARMED;
+		mapped_queue->recorder.post      = 0;
+		mapped_queue->recorder.len       = (unsigned int)so->recorder_len;
+		mapped_queue->recorder.slot_size = (unsigned int)so->rx_slot_size;
+
+		if (so->recorder_len)
+		{
+			char * raw = so->shmem.addr + sizeof(struct pfq_shared_queue) + pfq_mpsc_queue_mem(so)
+					+ pfq_spsc_queue_mem(so) * (1 + Q_MAX_TX_QUEUES) + pfq_mpsc_hp_queue_mem(so)
+					+ pfq_mpsc_flow_queue_mem(so);
+			char * end = raw + pfq_recorder_mem(so);
+			for(;raw < end; raw += so->rx_slot_size)
+				((struct pfq_pkthdr *)raw)->info.commit = 0;
+		}
+
 
 		smp_wmb();
 
@@ -46,6 +46,21 @@ static inline size_t pfq_spsc_queue_mem(struct pfq_sock *so)
         return so->tx_queue_len * so->tx_slot_size * 2;
 }
 
+static inline size_t pfq_mpsc_hp_queue_mem(struct pfq_sock *so)
+{
+        return so->rx_hp_queue_len * so->rx_slot_size * 2;
+}
+
+static inline size_t pfq_mpsc_flow_queue_mem(struct pfq_sock *so)
+{
+        return so->flow_queue_len * PFQ_FLOW_SLOT_SIZE * 2;
+}
+
+static inline size_t pfq_recorder_mem(struct pfq_sock *so)
+{
+        return so->recorder_len * so->rx_slot_size;
+}
+
 
 static inline
 size_t pfq_mpsc_queue_len(struct pfq_sock *p)
@@ -96,6 +111,68 @@ void *pfq_sock_tx_queue_mem(struct pfq_sock *so, int index)
 }
 
 
+static inline
+void *pfq_sock_rx_hp_queue_mem(struct pfq_sock *so)
+{
+	struct pfq_shared_queue *sq = pfq_sock_shared_queue(so);
+	if (unlikely(sq == NULL || so->rx_hp_queue_len == 0))
+		return NULL;
+
+	return (void *)sq + sizeof(struct pfq_shared_queue)
+			  + pfq_mpsc_queue_mem(so)
+			  + pfq_spsc_queue_mem(so) * (1 + Q_MAX_TX_QUEUES);
+}
+
+
+static inline
+size_t pfq_mpsc_hp_queue_len(struct pfq_sock *p)
+{
+	struct pfq_shared_rx_queue *q = pfq_sock_rx_hp_shared_queue(p);
+	if (!q)
+		return 0;
+        return PFQ_SHARED_QUEUE_LEN(__atomic_load_n(&q->shinfo, __ATOMIC_RELAXED));
+}
+
+
+static inline
+void *pfq_sock_flow_queue_mem(struct pfq_sock *so)
+{
+	struct pfq_shared_queue *sq = pfq_sock_shared_queue(so);
+	if (unlikely(sq == NULL || so->flow_queue_len == 0))
+		return NULL;
+
+	return (void *)sq + sizeof(struct pfq_shared_queue)
+			  + pfq_mpsc_queue_mem(so)
+			  + pfq_spsc_queue_mem(so) * (1 + Q_MAX_TX_QUEUES)
+			  + pfq_mpsc_hp_queue_mem(so);
+}
+
+
+static inline
+void *pfq_sock_recorder_mem(struct pfq_sock *so)
+{
+	struct pfq_shared_queue *sq = pfq_sock_shared_queue(so);
+	if (unlikely(sq == NULL || so->recorder_len == 0))
+		return NULL;
+
+	return (void *)sq + sizeof(struct pfq_shared_queue)
+			  + pfq_mpsc_queue_mem(so)
+			  + pfq_spsc_queue_mem(so) * (1 + Q_MAX_TX_QUEUES)
+			  + pfq_mpsc_hp_queue_mem(so)
+			  + pfq_mpsc_flow_queue_mem(so);
+}
+
+
+static inline
+size_t pfq_mpsc_flow_queue_len(struct pfq_sock *p)
+{
+	struct pfq_shared_rx_queue *q = pfq_sock_flow_shared_queue(p);
+	if (!q)
+		return 0;
+        return PFQ_SHARED_QUEUE_LEN(__atomic_load_n(&q->shinfo, __ATOMIC_RELAXED));
+}
+
+
 static inline
 char *pfq_mpsc_slot_ptr(struct pfq_sock *so, size_t qindex, size_t slot)
 {
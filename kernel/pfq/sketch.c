@@ -0,0 +1,291 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#include <pfq/sketch.h>
+#include <pfq/printk.h>
+#include <pfq/bitops.h>
+
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/vmalloc.h>
+
+
+/*
+ * Sketches are updated by the Rx path of each cpu without locks;
+ * readers merge the per-cpu copies (and may see a Space-Saving entry
+ * while it is being replaced).
+ */
+
+static inline u32
+cms_hash(struct pfq_map const *map, const void *key, int row)
+{
+	return jhash(key, (u32)map->key_size, map->seed + (u32)row);
+}
+
+
+static inline u64
+hll_hash(struct pfq_map const *map, const void *key)
+{
+	return (u64)jhash(key, (u32)map->key_size, map->seed) << 32 |
+		    jhash(key, (u32)map->key_size, ~map->seed);
+}
+
+
+int
+pfq_sketch_alloc(struct pfq_map *map)
+{
+	size_t size;
+
+	if (map->value_size != sizeof(u64) || map->max_entries < 16)
+		return -EINVAL;
+
+	map->max_entries = roundup_pow_of_two(map->max_entries);
+
+	if (map->type == Q_MAP_HLL) {
+		if (map->max_entries > 65536)
+			return -EINVAL;
+		size = map->max_entries;
+	}
+	else
+		size = sizeof(struct pfq_sketch_cms) + Q_SKETCH_CMS_DEPTH * map->max_entries * sizeof(u64);
+
+	map->sketch_size = ALIGN(size, L1_CACHE_BYTES);
+	map->sketch = vzalloc(map->sketch_size * nr_cpu_ids);
+	if (map->sketch == NULL)
+		return -ENOMEM;
+
+	return 0;
+}
+
+
+void
+pfq_sketch_free(struct pfq_map *map)
+{
+	vfree(map->sketch);
+	map->sketch = NULL;
+}
+
+
+void
+pfq_sketch_reset(struct pfq_map *map)
+{
+	memset(map->sketch, 0, map->sketch_size * nr_cpu_ids);
+}
+
+
+/* Count-Min update of the counters, Space-Saving update of the top talkers */
+
+static void
+cms_update(struct pfq_map *map, struct pfq_sketch_cms *cms, const void *key)
+{
+	struct pfq_sketch_topk *min = &cms->topk[0];
+	u32 hash = 0;
+	int n;
+
+	for(n = 0; n < Q_SKETCH_CMS_DEPTH; n++)
+	{
+		u32 h = cms_hash(map, key, n);
+		if (n == 0)
+			hash = h;
+		cms->counter[n * map->max_entries + (h & (map->max_entries - 1))]++;
+	}
+
+	for(n = 0; n < Q_SKETCH_TOPK; n++)
+	{
+		struct pfq_sketch_topk *e = &cms->topk[n];
+
+		if (e->count && e->hash == hash && !memcmp(e->key, key, map->key_size)) {
+			e->count++;
+			return;
+		}
+
+		if (e->count < min->count)
+			min = e;
+	}
+
+	/* the key replaces the least frequent one, inheriting its count as error */
+
+	min->error = min->count;
+	min->count++;
+	min->hash  = hash;
+	memcpy(min->key, key, map->key_size);
+}
+
+
+static void
+hll_update(struct pfq_map *map, u8 *reg, const void *key)
+{
+	unsigned int p = ilog2(map->max_entries);
+	u64 h = hll_hash(map, key);
+	u64 w = (h << p) | (1ULL << (p - 1));
+	u8 rank = (u8)(64 - fls64(w) + 1);
+	u32 index = (u32)(h >> (64 - p));
+
+	if (reg[index] < rank)
+		reg[index] = rank;
+}
+
+
+void
+pfq_sketch_update(struct pfq_map *map, const void *key)
+{
+	void *sketch = pfq_sketch_cpu(map, smp_processor_id());
+
+	if (map->type == Q_MAP_HLL)
+		hll_update(map, sketch, key);
+	else
+		cms_update(map, sketch, key);
+}
+
+
+static u64
+hll_estimate(struct pfq_map *map)
+{
+	u64 m = map->max_entries, sum = 0, alpha, e;
+	unsigned int zeros = 0;
+	size_t n;
+	int cpu;
+
+	for(n = 0; n < m; n++)
+	{
+		u8 r = 0;
+
+		for_each_possible_cpu(cpu)
+		{
+			u8 *reg = pfq_sketch_cpu(map, cpu);
+			r = max(r, READ_ONCE(reg[n]));
+		}
+
+		if (r == 0)
+			zeros++;
+		if (r < 32)
+			sum += 1ULL << (32 - r);
+	}
+
+	/* alpha_m (16 bits fixed point) */
+
+	alpha = m == 16 ? 44106 :
+		m == 32 ? 45679 :
+		m == 64 ? 46465 : div64_u64(47271 * m * 1000, m * 1000 + 1079);
+
+	e = div64_u64(alpha * m * m, max(sum >> 16, 1ULL));
+
+	/* small range correction (linear counting): m * ln(m/zeros) */
+
+	if (e <= 5 * m / 2 && zeros)
+		e = (m * 45426 * pfq_log2_q16(div64_u64(m << 16, zeros))) >> 32;
+
+	return e;
+}
+
+
+static u64
+cms_row(struct pfq_map *map, u32 index, u64 threshold)
+{
+	u64 sum = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+	{
+		struct pfq_sketch_cms *cms = pfq_sketch_cpu(map, cpu);
+		sum += READ_ONCE(cms->counter[index]);
+		if (sum >= threshold)
+			break;
+	}
+
+	return sum;
+}
+
+
+static u64
+cms_estimate(struct pfq_map *map, const void *key, u64 threshold)
+{
+	u64 est = ~0ULL;
+	int n;
+
+	for(n = 0; n < Q_SKETCH_CMS_DEPTH; n++)
+	{
+		u32 index = n * map->max_entries + (cms_hash(map, key, n) & (map->max_entries - 1));
+		est = min(est, cms_row(map, index, threshold));
+		if (est < threshold)
+			break;
+	}
+
+	return est;
+}
+
+
+u64
+pfq_sketch_estimate(struct pfq_map *map, const void *key)
+{
+	if (map->type == Q_MAP_HLL)
+		return hll_estimate(map);
+
+	return cms_estimate(map, key, ~0ULL);
+}
+
+
+/* is_heavy_hitter (count-min sketches only): the rows are summed until the threshold is reached */
+
+bool
+pfq_sketch_above(struct pfq_map *map, const void *key, u64 threshold)
+{
+	return cms_estimate(map, key, threshold) >= threshold;
+}
+
+
+/* walk the top talkers of all the cpus, in key order */
+
+int
+pfq_sketch_next_key(struct pfq_map *map, const void *key, void *next)
+{
+	const char *best = NULL;
+	int cpu, n;
+
+	if (map->type != Q_MAP_COUNT_MIN)
+		return -ENOENT;
+
+	for_each_possible_cpu(cpu)
+	{
+		struct pfq_sketch_cms *cms = pfq_sketch_cpu(map, cpu);
+
+		for(n = 0; n < Q_SKETCH_TOPK; n++)
+		{
+			const char *k = cms->topk[n].key;
+
+			if (READ_ONCE(cms->topk[n].count) == 0)
+				continue;
+			if (key && memcmp(k, key, map->key_size) <= 0)
+				continue;
+			if (best == NULL || memcmp(k, best, map->key_size) < 0)
+				best = k;
+		}
+	}
+
+	if (best == NULL)
+		return -ENOENT;
+
+	memcpy(next, best, map->key_size);
+	return 0;
+}
@@ -0,0 +1,71 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#ifndef PFQ_SKETCH_H
+#define PFQ_SKETCH_H
+
+#include <pfq/map.h>
+
+
+#define Q_SKETCH_CMS_DEPTH		4	/* Count-Min rows */
+#define Q_SKETCH_TOPK			32	/* Space-Saving entries (per cpu) */
+
+
+/* Space-Saving entry: count overestimates the key by at most error */
+
+struct pfq_sketch_topk
+{
+	u32		hash;
+	u64		count;
+	u64		error;
+	char		key[Q_MAP_MAX_KEY_SIZE];
+};
+
+
+/* per-cpu Count-Min sketch */
+
+struct pfq_sketch_cms
+{
+	struct pfq_sketch_topk	topk[Q_SKETCH_TOPK];
+	u64			counter[];	/* Q_SKETCH_CMS_DEPTH rows of max_entries counters */
+};
+
+
+static inline void *
+pfq_sketch_cpu(struct pfq_map *map, int cpu)
+{
+	return map->sketch + (size_t)cpu * map->sketch_size;
+}
+
+
+extern int  pfq_sketch_alloc(struct pfq_map *map);
+extern void pfq_sketch_free(struct pfq_map *map);
+extern void pfq_sketch_reset(struct pfq_map *map);
+
+extern void pfq_sketch_update(struct pfq_map *map, const void *key);
+extern u64  pfq_sketch_estimate(struct pfq_map *map, const void *key);
+extern bool pfq_sketch_above(struct pfq_map *map, const void *key, u64 threshold);
+extern int  pfq_sketch_next_key(struct pfq_map *map, const void *key, void *next);
+
+
+#endif /* PFQ_SKETCH_H */
@@ -32,6 +32,7 @@
 #include <pfq/thread.h>
 
 #include <linux/pf_q.h>
+#include <linux/rcupdate.h>
 
 void
 pfq_sock_init_once(void)
@@ -111,6 +112,8 @@ pfq_sock_get_by_id(pfq_id_t id)
 
 void pfq_sock_release_id(pfq_id_t id)
 {
+	int n;
+
         if ((__force int)id >= Q_MAX_ID ||
 	    (__force int)id < 0) {
                 pr_devel("[PFQ] pfq_release_sock_by_id: bad id=%d!\n", id);
@@ -119,9 +122,18 @@ void pfq_sock_release_id(pfq_id_t id)
 
         atomic_long_set(global->socket_ptr + (__force int)id, 0);
 
+	/* sockets spilling to this one must not reach a later owner of the id */
+
+	for(n = 0; n < Q_MAX_ID; n++)
+	{
+		struct pfq_sock *so = (struct pfq_sock *)atomic_long_read(&global->socket_ptr[n]);
+		if (so && READ_ONCE(so->spill_id) == (__force int)id)
+			WRITE_ONCE(so->spill_id, -1);
+	}
+
         if (atomic_dec_return(&global->socket_count) == 0) {
 		pr_devel("[PFQ] calling sock_fini_once...\n");
-		msleep(Q_GRACE_PERIOD);
+		synchronize_rcu();
 		pfq_sock_fini_once();
 	}
 }
@@ -149,6 +161,15 @@ int pfq_sock_init(struct pfq_sock *so, pfq_id_t id, size_t caplen, size_t xmitle
 		local_set(&stat->fail, 0);
 		local_set(&stat->frwd, 0);
 		local_set(&stat->kern, 0);
+		local_set(&stat->plcd, 0);
+		local_set(&stat->dvrt, 0);
+		local_set(&stat->spll, 0);
+		local_set(&stat->hrcv, 0);
+		local_set(&stat->hlst, 0);
+		local_set(&stat->chnd, 0);
+		local_set(&stat->loop, 0);
+		local_set(&stat->fexp, 0);
+		local_set(&stat->flst, 0);
 	}
 
 	/* setup id */
@@ -164,6 +185,8 @@ int pfq_sock_init(struct pfq_sock *so, pfq_id_t id, size_t caplen, size_t xmitle
 	/* default weight */
 
 	so->weight = 1;
+	so->rx_congested = false;
+	so->spill_id = -1;
 
         so->shmem.addr = NULL;
         so->shmem.size = 0;
@@ -187,6 +210,10 @@ int pfq_sock_init(struct pfq_sock *so, pfq_id_t id, size_t caplen, size_t xmitle
         so->rx_len = caplen;
         so->rx_queue_len = 0;
         so->rx_slot_size  = PFQ_SHARED_QUEUE_SLOT_SIZE(caplen);
+        so->rx_hp_queue_len = 0;
+        so->flow_queue_len = 0;
+        so->recorder_len = 0;
+        so->recorder_post = 0;
 
 	/* Tx queues setup */
 
@@ -290,7 +317,7 @@ pfq_sock_disable(struct pfq_sock *so)
 	pr_devel("[PFQ|%d] leaving all groups...\n", so->id);
 	pfq_group_leave_all(so->id);
 
-	msleep(Q_GRACE_PERIOD);
+	synchronize_rcu();
 
 	if (atomic_long_read(&so->shmem_addr)) {
 
@@ -299,12 +326,10 @@ pfq_sock_disable(struct pfq_sock *so)
 		pr_devel("[PFQ|%d] unbinding Tx threads...\n", so->id);
 		pfq_sock_tx_unbind(so);
 
-		msleep(Q_GRACE_PERIOD);
-
 		pr_devel("[PFQ|%d] disabling shared queue...\n", so->id);
 		atomic_long_set(&so->shmem_addr, 0);
 
-		msleep(Q_GRACE_PERIOD);
+		synchronize_rcu();
 
 		pr_devel("[PFQ|%d] unmapping shared queue...\n", so->id);
 		pfq_shared_queue_unmap(so);
@@ -318,3 +343,48 @@ pfq_sock_disable(struct pfq_sock *so)
 
 
 
+
+
+/* flight recorder: arm the recorder with the given post-trigger window */
+
+void
+pfq_sock_recorder_arm(struct pfq_sock *so, unsigned int post)
+{
+	struct pfq_shared_recorder *rec = pfq_sock_recorder(so);
+	if (rec == NULL)
+		return;
+
+	so->recorder_post = post;
+	rec->post = post;
+
+	__atomic_store_n(&rec->stop, ~0UL, __ATOMIC_RELEASE);
+	__atomic_store_n(&rec->state, Q_RECORDER_ARMED, __ATOMIC_RELEASE);
+
+	pr_devel("[PFQ|%d] recorder armed (post=%u)\n", so->id, post);
+}
+
+
+/* flight recorder: freeze the recorder after the post-trigger window (the first trigger wins) */
+
+void
+pfq_sock_recorder_trigger(struct pfq_sock *so)
+{
+	struct pfq_shared_recorder *rec = pfq_sock_recorder(so);
+	unsigned int state = Q_RECORDER_ARMED;
+	unsigned int post;
+
+	if (rec == NULL)
+		return;
+
+	if (!__atomic_compare_exchange_n(&rec->state, &state, Q_RECORDER_TRIGGERED,
+					 false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+		return;
+
+	post = READ_ONCE(so->recorder_post);
+
+	__atomic_store_n(&rec->stop, __atomic_load_n(&rec->head, __ATOMIC_RELAXED) + post, __ATOMIC_RELEASE);
+	if (post == 0)
+		__atomic_store_n(&rec->state, Q_RECORDER_FROZEN, __ATOMIC_RELEASE);
+
+	pr_devel("[PFQ|%d] recorder triggered (post=%u)\n", so->id, post);
+}
@@ -74,12 +74,18 @@ struct pfq_sock
         int			egress_queue;
 	int			weight;
 	int			tstamp;
+	bool			rx_congested;	/* load-aware balancing (hysteresis) */
+	int			spill_id;	/* overflow socket, when the Rx queue is full (-1 = none) */
 
 	size_t			rx_len;
 	size_t			tx_len;
 
 	size_t			rx_queue_len;
 	size_t			rx_slot_size;
+	size_t			rx_hp_queue_len;	/* high-priority Rx queue (same slot size) */
+	size_t			flow_queue_len;		/* flow record queue (PFQ_FLOW_SLOT_SIZE slots) */
+	size_t			recorder_len;		/* flight recorder (Rx slot size) */
+	unsigned int		recorder_post;		/* post-trigger window of the recorder */
 
 	size_t			tx_queue_len;
 	size_t			tx_slot_size;
@@ -141,6 +147,39 @@ pfq_sock_rx_shared_queue(struct pfq_sock *so)
 }
 
 
+static inline
+struct pfq_shared_rx_queue *
+pfq_sock_rx_hp_shared_queue(struct pfq_sock *so)
+{
+	struct pfq_shared_queue *sq = pfq_sock_shared_queue(so);
+	if (unlikely(sq == NULL || so->rx_hp_queue_len == 0))
+		return NULL;
+	return &sq->rx_hp;
+}
+
+
+static inline
+struct pfq_shared_rx_queue *
+pfq_sock_flow_shared_queue(struct pfq_sock *so)
+{
+	struct pfq_shared_queue *sq = pfq_sock_shared_queue(so);
+	if (unlikely(sq == NULL || so->flow_queue_len == 0))
+		return NULL;
+	return &sq->flow;
+}
+
+
+static inline
+struct pfq_shared_recorder *
+pfq_sock_recorder(struct pfq_sock *so)
+{
+	struct pfq_shared_queue *sq = pfq_sock_shared_queue(so);
+	if (unlikely(sq == NULL || so->recorder_len == 0))
+		return NULL;
+	return &sq->recorder;
+}
+
+
 static inline
 struct pfq_shared_tx_queue *
 pfq_sock_tx_shared_queue(struct pfq_sock *so, int index)
@@ -170,5 +209,8 @@ extern int	pfq_sock_tx_unbind(struct pfq_sock *so);
 extern int	pfq_sock_enable(struct pfq_sock *so, struct pfq_so_enable *mem);
 extern int	pfq_sock_disable(struct pfq_sock *so);
 
+extern void	pfq_sock_recorder_arm(struct pfq_sock *so, unsigned int post);
+extern void	pfq_sock_recorder_trigger(struct pfq_sock *so);
+
 
 #endif /* PFQ_SOCK_H */
@@ -22,6 +22,8 @@
  ****************************************************************/
 
 #include <lang/engine.h>
+#include <lang/exec.h>
+#include <lang/prof.h>
 #include <lang/symtable.h>
 
 #include <pfq/bpf.h>
@@ -30,6 +32,7 @@
 #include <pfq/global.h>
 #include <pfq/group.h>
 #include <pfq/io.h>
+#include <pfq/map.h>
 #include <pfq/memory.h>
 #include <pfq/netdev.h>
 #include <pfq/percpu.h>
@@ -199,6 +202,30 @@ int pfq_getsockopt(struct socket *sock,
                         return -EFAULT;
         } break;
 
+        case Q_SO_GET_RX_HP_SLOTS:
+        {
+                if (len != sizeof(so->rx_hp_queue_len))
+                        return -EINVAL;
+                if (copy_to_user(optval, &so->rx_hp_queue_len, sizeof(so->rx_hp_queue_len)))
+                        return -EFAULT;
+        } break;
+
+        case Q_SO_GET_FLOW_SLOTS:
+        {
+                if (len != sizeof(so->flow_queue_len))
+                        return -EINVAL;
+                if (copy_to_user(optval, &so->flow_queue_len, sizeof(so->flow_queue_len)))
+                        return -EFAULT;
+        } break;
+
+        case Q_SO_GET_RECORDER_SLOTS:
+        {
+                if (len != sizeof(so->recorder_len))
+                        return -EINVAL;
+                if (copy_to_user(optval, &so->recorder_len, sizeof(so->recorder_len)))
+                        return -EFAULT;
+        } break;
+
         case Q_SO_GET_TX_SLOTS:
         {
                 if (len != sizeof(so->tx_queue_len))
@@ -293,6 +320,141 @@ int pfq_getsockopt(struct socket *sock,
                         return -EFAULT;
         } break;
 
+        case Q_SO_GET_GROUP_PROFILE:
+        {
+                struct pfq_lang_computation_tree *comp;
+                struct pfq_lang_node_stats *stats;
+                struct pfq_so_group_profile prof;
+                struct pfq_group *group;
+                size_t capacity;
+                pfq_gid_t gid;
+
+                if (len != sizeof(prof))
+                        return -EINVAL;
+
+                if (copy_from_user(&prof, optval, sizeof(prof)))
+                        return -EFAULT;
+
+                gid = (__force pfq_gid_t)prof.gid;
+
+                group = pfq_group_get(gid);
+                if (group == NULL) {
+                        printk(KERN_INFO "[PFQ|%d] group error: invalid group id %d!\n", so->id, gid);
+                        return -EFAULT;
+                }
+
+                if (!pfq_group_access(gid, so->id)) {
+                        printk(KERN_INFO "[PFQ|%d] group profile error: gid=%d permission denied!\n",
+                               so->id, gid);
+                        return -EACCES;
+                }
+
+                /* the capacity is bounded by the size of the current computation */
+
+                rcu_read_lock();
+                comp = rcu_dereference(group->comp);
+                capacity = prof.stats && comp ? min_t(size_t, prof.size, comp->size) : 0;
+                rcu_read_unlock();
+
+                stats = kmalloc_array(capacity, sizeof(struct pfq_lang_node_stats), GFP_KERNEL | __GFP_NOWARN);
+                if (stats == NULL)
+                        return -ENOMEM;
+
+		/* the computation is released after a grace period */
+
+                rcu_read_lock();
+                comp = rcu_dereference(group->comp);
+                prof.size = comp ? pfq_lang_prof_read(comp, stats, capacity) : 0;
+                rcu_read_unlock();
+
+                if (copy_to_user(prof.stats, stats, min(capacity, prof.size) * sizeof(struct pfq_lang_node_stats)) ||
+                    copy_to_user(optval, &prof, sizeof(prof))) {
+                        kfree(stats);
+                        return -EFAULT;
+                }
+
+                kfree(stats);
+        } break;
+
+        case Q_SO_MAP_CREATE:
+        {
+                struct pfq_so_map m;
+
+                if (len != sizeof(m))
+                        return -EINVAL;
+
+                if (copy_from_user(&m, optval, sizeof(m)))
+                        return -EFAULT;
+
+                m.id = pfq_map_create(so->id, m.type, m.key_size, m.value_size, m.max_entries, m.fpr);
+                if (m.id < 0) {
+                        printk(KERN_INFO "[PFQ|%d] map create error: type=%d key_size=%u value_size=%u max_entries=%u (%d)!\n",
+                               so->id, m.type, m.key_size, m.value_size, m.max_entries, m.id);
+                        return m.id;
+                }
+
+                if (copy_to_user(optval, &m, sizeof(m))) {
+                        pfq_map_destroy(so->id, m.id);
+                        return -EFAULT;
+                }
+        } break;
+
+        case Q_SO_MAP_LOOKUP:
+        case Q_SO_MAP_GET_NEXT_KEY:
+        {
+                char key[Q_MAP_MAX_KEY_SIZE], data[Q_MAP_MAX_VALUE_SIZE];
+                struct pfq_so_map_elem elem;
+                struct pfq_map *map;
+                size_t size;
+                int err = 0;
+
+                if (len != sizeof(elem))
+                        return -EINVAL;
+
+                if (copy_from_user(&elem, optval, sizeof(elem)))
+                        return -EFAULT;
+
+                map = pfq_map_get(elem.id);
+                if (map == NULL) {
+                        printk(KERN_INFO "[PFQ|%d] map error: invalid map id %d!\n", so->id, elem.id);
+                        return -EINVAL;
+                }
+
+                if (!pfq_map_access(map, so->id)) {
+                        printk(KERN_INFO "[PFQ|%d] map %d: permission denied!\n", so->id, elem.id);
+                        pfq_map_put(map);
+                        return -EACCES;
+                }
+
+                if (elem.key && copy_from_user(key, elem.key, map->key_size)) {
+                        pfq_map_put(map);
+                        return -EFAULT;
+                }
+
+                if (optname == Q_SO_MAP_LOOKUP) {
+
+                        if (elem.key == NULL) {
+                                pfq_map_put(map);
+                                return -EINVAL;
+                        }
+
+                        size = map->value_size;
+                        err = pfq_map_read(map, key, data);
+                }
+                else {
+                        size = map->key_size;
+                        err = pfq_map_get_next_key(map, elem.key ? key : NULL, data);
+                }
+
+                pfq_map_put(map);
+
+                if (err < 0)
+                        return err;
+
+                if (copy_to_user(elem.value, data, size))
+                        return -EFAULT;
+        } break;
+
         case Q_SO_GET_WEIGHT:
         {
                 if (len != sizeof(so->weight))
@@ -302,6 +464,17 @@ int pfq_getsockopt(struct socket *sock,
                         return -EFAULT;
         } break;
 
+        case Q_SO_GET_SPILL:
+        {
+		int spill_id = READ_ONCE(so->spill_id);
+
+                if (len != sizeof(spill_id))
+                        return -EINVAL;
+
+                if (copy_to_user(optval, &spill_id, sizeof(spill_id)))
+                        return -EFAULT;
+        } break;
+
         default:
                 return -EFAULT;
         }
@@ -359,6 +532,7 @@ int pfq_setsockopt(struct socket *sock,
         {
                 struct pfq_so_binding bind;
 		pfq_gid_t gid;
+                int err;
 
                 if (optlen != sizeof(bind))
                         return -EINVAL;
@@ -385,7 +559,12 @@ int pfq_setsockopt(struct socket *sock,
                         return -EACCES;
                 }
 
-                pfq_devmap_update(Q_DEVMAP_SET, bind.ifindex, bind.qindex, gid);
+                err = pfq_devmap_update(Q_DEVMAP_SET, bind.ifindex, bind.qindex, gid);
+                if (err < 0) {
+                        printk(KERN_INFO "[PFQ|%d] group id=%d bind error: device ifindex=%d qindex=%d (%d)!\n",
+                               so->id, bind.gid, bind.ifindex, bind.qindex, err);
+                        return err;
+                }
 
                 pr_devel("[PFQ|%d] group id=%d bind: device ifindex=%d qindex=%d\n",
 					so->id, bind.gid, bind.ifindex, bind.qindex);
@@ -396,6 +575,7 @@ int pfq_setsockopt(struct socket *sock,
         {
                 struct pfq_so_binding bind;
 		pfq_gid_t gid;
+                int err;
 
                 if (optlen != sizeof(bind))
                         return -EINVAL;
@@ -417,7 +597,12 @@ int pfq_setsockopt(struct socket *sock,
 		}
 #endif
 
-                pfq_devmap_update(Q_DEVMAP_RESET, bind.ifindex, bind.qindex, gid);
+                err = pfq_devmap_update(Q_DEVMAP_RESET, bind.ifindex, bind.qindex, gid);
+                if (err < 0) {
+                        printk(KERN_INFO "[PFQ|%d] group id=%d unbind error: device ifindex=%d qindex=%d (%d)!\n",
+                               so->id, gid, bind.ifindex, bind.qindex, err);
+                        return err;
+                }
 
                 pr_devel("[PFQ|%d] group id=%d unbind: device ifindex=%d qindex=%d\n",
 					so->id, gid, bind.ifindex, bind.qindex);
@@ -521,6 +706,84 @@ int pfq_setsockopt(struct socket *sock,
                 pr_devel("[PFQ|%d] rx_queue: slots=%zu\n", so->id, so->rx_queue_len);
         } break;
 
+        case Q_SO_SET_RX_HP_SLOTS:
+        {
+                typeof(so->rx_hp_queue_len) slots;
+
+                if (optlen != sizeof(slots))
+                        return -EINVAL;
+
+                if (copy_from_user(&slots, optval, optlen))
+                        return -EFAULT;
+
+                if (slots > Q_MAX_SOCKQUEUE_HP_LEN) {
+                        printk(KERN_INFO "[PFQ|%d] invalid high-priority Rx slots=%zu (max %d)\n",
+                               so->id, slots, Q_MAX_SOCKQUEUE_HP_LEN);
+                        return -EPERM;
+                }
+
+                if (pfq_sock_shared_queue(so) != NULL) {
+                        printk(KERN_INFO "[PFQ|%d] high-priority Rx queue: socket already enabled!\n", so->id);
+                        return -EPERM;
+                }
+
+                so->rx_hp_queue_len = slots;
+
+                pr_devel("[PFQ|%d] rx_hp_queue: slots=%zu\n", so->id, so->rx_hp_queue_len);
+        } break;
+
+        case Q_SO_SET_FLOW_SLOTS:
+        {
+                typeof(so->flow_queue_len) slots;
+
+                if (optlen != sizeof(slots))
+                        return -EINVAL;
+
+                if (copy_from_user(&slots, optval, optlen))
+                        return -EFAULT;
+
+                if (slots > Q_MAX_SOCKQUEUE_FLOW_LEN) {
+                        printk(KERN_INFO "[PFQ|%d] invalid flow record slots=%zu (max %d)\n",
+                               so->id, slots, Q_MAX_SOCKQUEUE_FLOW_LEN);
+                        return -EPERM;
+                }
+
+                if (pfq_sock_shared_queue(so) != NULL) {
+                        printk(KERN_INFO "[PFQ|%d] flow record queue: socket already enabled!\n", so->id);
+                        return -EPERM;
+                }
+
+                so->flow_queue_len = slots;
+
+                pr_devel("[PFQ|%d] flow_queue: slots=%zu\n", so->id, so->flow_queue_len);
+        } break;
+
+        case Q_SO_SET_RECORDER_SLOTS:
+        {
+                typeof(so->recorder_len) slots;
+
+                if (optlen != sizeof(slots))
+                        return -EINVAL;
+
+                if (copy_from_user(&slots, optval, optlen))
+                        return -EFAULT;
+
+                if (slots > Q_MAX_RECORDER_LEN) {
+                        printk(KERN_INFO "[PFQ|%d] invalid recorder slots=%zu (max %d)\n",
+                               so->id, slots, Q_MAX_RECORDER_LEN);
+                        return -EPERM;
+                }
+
+                if (pfq_sock_shared_queue(so) != NULL) {
+                        printk(KERN_INFO "[PFQ|%d] recorder: socket already enabled!\n", so->id);
+                        return -EPERM;
+                }
+
+                so->recorder_len = slots;
+
+                pr_devel("[PFQ|%d] recorder: slots=%zu\n", so->id, so->recorder_len);
+        } break;
+
         case Q_SO_SET_TX_SLOTS:
         {
                 typeof (so->tx_queue_len) slots;
@@ -592,6 +855,37 @@ int pfq_setsockopt(struct socket *sock,
 
         } break;
 
+        case Q_SO_SET_SPILL:
+        {
+                int spill_id;
+
+                if (optlen != sizeof(spill_id))
+                        return -EINVAL;
+
+                if (copy_from_user(&spill_id, optval, optlen))
+                        return -EFAULT;
+
+		if (spill_id != -1 &&
+		    (spill_id == (__force int)so->id ||
+		     pfq_sock_get_by_id((__force pfq_id_t)spill_id) == NULL)) {
+                        printk(KERN_INFO "[PFQ|%d] spill socket %d: invalid id!\n", so->id, spill_id);
+                        return -EINVAL;
+		}
+
+		/* the spill socket must share a group with this one */
+
+		if (spill_id != -1 &&
+		    (pfq_group_get_groups(so->id) & pfq_group_get_groups((__force pfq_id_t)spill_id)) == 0) {
+                        printk(KERN_INFO "[PFQ|%d] spill socket %d: permission denied!\n", so->id, spill_id);
+                        return -EACCES;
+		}
+
+                WRITE_ONCE(so->spill_id, spill_id);
+
+                pr_devel("[PFQ|%d] spill socket set to %d.\n", so->id, spill_id);
+
+        } break;
+
         case Q_SO_GROUP_LEAVE:
         {
                 pfq_gid_t gid;
@@ -665,6 +959,232 @@ int pfq_setsockopt(struct socket *sock,
 
         } break;
 
+        case Q_SO_GROUP_EBPF:
+        {
+                struct pfq_so_ebpf ebpf;
+                struct bpf_prog *prog = NULL;
+		pfq_gid_t gid;
+
+                if (optlen != sizeof(ebpf))
+                        return -EINVAL;
+
+                if (copy_from_user(&ebpf, optval, optlen))
+                        return -EFAULT;
+
+		gid = (__force pfq_gid_t)ebpf.gid;
+
+		if (!pfq_group_has_joined(gid, so->id)) {
+                        printk(KERN_INFO "[PFQ|%d] ebpf: gid=%d not joined!\n", so->id, ebpf.gid);
+			return -EACCES;
+		}
+
+                if (ebpf.fd >= 0) {
+
+                        prog = pfq_get_ebpf_prog(ebpf.fd);
+                        if (IS_ERR(prog)) {
+                                printk(KERN_INFO "[PFQ|%d] ebpf error: fd=%d for gid=%d (%ld)\n",
+                                       so->id, ebpf.fd, ebpf.gid, PTR_ERR(prog));
+                                return (int)PTR_ERR(prog);
+                        }
+                }
+
+                pfq_group_set_ebpf(gid, prog);
+
+                pr_devel("[PFQ|%d] ebpf: gid=%d %s\n", so->id, ebpf.gid, prog ? "program attached" : "program detached");
+
+        } break;
+
+        case Q_SO_GROUP_OPTIMIZE:
+        {
+                pfq_gid_t gid;
+                int value, err;
+
+                if (optlen != sizeof(value))
+                        return -EINVAL;
+
+                if (copy_from_user(&value, optval, optlen))
+                        return -EFAULT;
+
+		gid = (__force pfq_gid_t)value;
+
+                if (!pfq_group_access(gid, so->id)) {
+                        printk(KERN_INFO "[PFQ|%d] optimize error: gid=%d permission denied!\n", so->id, value);
+                        return -EACCES;
+                }
+
+                err = pfq_group_optimize_prog(gid);
+                if (err < 0) {
+                        printk(KERN_INFO "[PFQ|%d] optimize error: gid=%d (%d)!\n", so->id, value, err);
+                        return err;
+                }
+
+                pr_devel("[PFQ|%d] optimize: gid=%d computation recompiled.\n", so->id, value);
+
+        } break;
+
+        case Q_SO_GROUP_BALANCE:
+        {
+                struct pfq_so_group_balance b;
+                pfq_gid_t gid;
+                int err;
+
+                if (optlen != sizeof(b))
+                        return -EINVAL;
+
+                if (copy_from_user(&b, optval, optlen))
+                        return -EFAULT;
+
+		gid = (__force pfq_gid_t)b.gid;
+
+                if (!pfq_group_access(gid, so->id)) {
+                        printk(KERN_INFO "[PFQ|%d] balance error: gid=%d permission denied!\n", so->id, b.gid);
+                        return -EACCES;
+                }
+
+                err = pfq_group_set_balance(gid, b.policy, b.high, b.low);
+                if (err < 0) {
+                        printk(KERN_INFO "[PFQ|%d] balance error: gid=%d policy=%d watermarks=%u/%u!\n",
+			       so->id, b.gid, b.policy, b.high, b.low);
+                        return err;
+                }
+
+                pr_devel("[PFQ|%d] balance: gid=%d policy=%d\n", so->id, b.gid, b.policy);
+
+        } break;
+
+        case Q_SO_GROUP_RECORDER:
+        {
+                struct pfq_so_group_recorder r;
+                pfq_gid_t gid;
+                int err;
+
+                if (optlen != sizeof(r))
+                        return -EINVAL;
+
+                if (copy_from_user(&r, optval, optlen))
+                        return -EFAULT;
+
+		gid = (__force pfq_gid_t)r.gid;
+
+                if (!pfq_group_access(gid, so->id)) {
+                        printk(KERN_INFO "[PFQ|%d] recorder error: gid=%d permission denied!\n", so->id, r.gid);
+                        return -EACCES;
+                }
+
+                if (r.post >= 0) {
+                        if (pfq_sock_recorder(so) == NULL) {
+                                printk(KERN_INFO "[PFQ|%d] recorder error: socket not enabled or no recorder slots!\n", so->id);
+                                return -EPERM;
+                        }
+                        pfq_sock_recorder_arm(so, (unsigned int)r.post);
+                }
+
+                err = pfq_group_set_recorder(gid, so->id, r.post >= 0);
+                if (err < 0) {
+                        printk(KERN_INFO "[PFQ|%d] recorder error: gid=%d!\n", so->id, r.gid);
+                        return err;
+                }
+
+                pr_devel("[PFQ|%d] recorder: gid=%d post=%d\n", so->id, r.gid, r.post);
+
+        } break;
+
+        case Q_SO_GROUP_RECORDER_TRIGGER:
+        {
+                struct pfq_group *group;
+                pfq_gid_t gid;
+                int err;
+
+                if (optlen != sizeof(gid))
+                        return -EINVAL;
+
+                if (copy_from_user(&gid, optval, optlen))
+                        return -EFAULT;
+
+                if (!pfq_group_access(gid, so->id)) {
+                        printk(KERN_INFO "[PFQ|%d] recorder trigger error: gid=%d permission denied!\n", so->id, gid);
+                        return -EACCES;
+                }
+
+                group = pfq_group_get(gid);
+                if (group == NULL)
+                        return -EINVAL;
+
+                rcu_read_lock();
+                err = pfq_group_trigger_recorder(group);
+                rcu_read_unlock();
+
+                if (err < 0) {
+                        printk(KERN_INFO "[PFQ|%d] recorder trigger error: gid=%d has no recorder!\n", so->id, gid);
+                        return err;
+                }
+
+                pr_devel("[PFQ|%d] recorder trigger: gid=%d\n", so->id, gid);
+
+        } break;
+
+        case Q_SO_MAP_UPDATE:
+        case Q_SO_MAP_DELETE:
+        {
+                char key[Q_MAP_MAX_KEY_SIZE], value[Q_MAP_MAX_VALUE_SIZE];
+                struct pfq_so_map_elem elem;
+                struct pfq_map *map;
+                int err;
+
+                if (optlen != sizeof(elem))
+                        return -EINVAL;
+
+                if (copy_from_user(&elem, optval, optlen))
+                        return -EFAULT;
+
+                map = pfq_map_get(elem.id);
+                if (map == NULL) {
+                        printk(KERN_INFO "[PFQ|%d] map error: invalid map id %d!\n", so->id, elem.id);
+                        return -EINVAL;
+                }
+
+                if (!pfq_map_access(map, so->id)) {
+                        printk(KERN_INFO "[PFQ|%d] map %d: permission denied!\n", so->id, elem.id);
+                        pfq_map_put(map);
+                        return -EACCES;
+                }
+
+                if (copy_from_user(key, elem.key, map->key_size) ||
+                    (optname == Q_SO_MAP_UPDATE && copy_from_user(value, elem.value, map->value_size))) {
+                        pfq_map_put(map);
+                        return -EFAULT;
+                }
+
+                err = optname == Q_SO_MAP_UPDATE ? pfq_map_update(map, key, value, elem.flags, GFP_KERNEL)
+                                                 : pfq_map_delete(map, key);
+                pfq_map_put(map);
+
+                if (err < 0) {
+                        pr_devel("[PFQ|%d] map %d: %s error (%d)!\n", so->id, elem.id,
+                                 optname == Q_SO_MAP_UPDATE ? "update" : "delete", err);
+                        return err;
+                }
+        } break;
+
+        case Q_SO_MAP_DESTROY:
+        {
+                int id, err;
+
+                if (optlen != sizeof(id))
+                        return -EINVAL;
+
+                if (copy_from_user(&id, optval, optlen))
+                        return -EFAULT;
+
+                err = pfq_map_destroy(so->id, id);
+                if (err < 0) {
+                        printk(KERN_INFO "[PFQ|%d] map destroy error: id=%d (%d)!\n", so->id, id, err);
+                        return err;
+                }
+
+                pr_devel("[PFQ|%d] map %d destroyed.\n", so->id, id);
+        } break;
+
         case Q_SO_GROUP_VLAN_FILT_TOGGLE:
         {
                 struct pfq_so_vlan_toggle vlan;
@@ -913,17 +1433,25 @@ int pfq_setsockopt(struct socket *sock,
 
 		/* run init functions */
 
-		if (pfq_lang_computation_init(comp) < 0) {
+		if (pfq_lang_computation_init(comp, so->id) < 0) {
                         printk(KERN_INFO "[PFQ|%d] computation: initialization aborted!", so->id);
                         pfq_lang_computation_destruct(comp);
                         err = -EPERM;
                         goto error;
 		}
 
+		/* flatten the computation (on failure the tree walking engine is used) */
+
+		pfq_lang_exec_compile(comp, false);
+#ifdef PFQ_LANG_BENCH
+		pfq_lang_exec_bench(comp);
+#endif
+
                 /* enable functional program */
 
-                if (pfq_group_set_prog(gid, comp, context) < 0) {
+                if (pfq_group_set_prog(gid, comp, context, so->id) < 0) {
                         printk(KERN_INFO "[PFQ|%d] computation: set program error!\n", so->id);
+                        pfq_lang_computation_destruct(comp);
                         err = -EPERM;
                         goto error;
                 }
@@ -931,8 +1459,8 @@ int pfq_setsockopt(struct socket *sock,
 		kfree(descr);
                 return 0;
 
-	error:  kfree(comp);
-		kfree(context);
+	error:  pfq_lang_computation_free(comp);
+		pfq_lang_context_free(context);
 		kfree(descr);
 		return err;
 
@@ -37,6 +37,16 @@ void pfq_kernel_stats_read(struct pfq_kernel_stats __percpu *kstats, struct pfq_
 
 	stats->frwd = (long unsigned)sparse_read(kstats, frwd);
 	stats->kern = (long unsigned)sparse_read(kstats, kern);
+
+	stats->plcd = (long unsigned)sparse_read(kstats, plcd);
+	stats->dvrt = (long unsigned)sparse_read(kstats, dvrt);
+	stats->spll = (long unsigned)sparse_read(kstats, spll);
+	stats->hrcv = (long unsigned)sparse_read(kstats, hrcv);
+	stats->hlst = (long unsigned)sparse_read(kstats, hlst);
+	stats->chnd = (long unsigned)sparse_read(kstats, chnd);
+	stats->loop = (long unsigned)sparse_read(kstats, loop);
+	stats->fexp = (long unsigned)sparse_read(kstats, fexp);
+	stats->flst = (long unsigned)sparse_read(kstats, flst);
 }
 
 
@@ -55,6 +65,15 @@ void pfq_kernel_stats_reset(struct pfq_kernel_stats __percpu *stats)
 		local_set(&stat->fail, 0);
 		local_set(&stat->frwd, 0);
 		local_set(&stat->kern, 0);
+		local_set(&stat->plcd, 0);
+		local_set(&stat->dvrt, 0);
+		local_set(&stat->spll, 0);
+		local_set(&stat->hrcv, 0);
+		local_set(&stat->hlst, 0);
+		local_set(&stat->chnd, 0);
+		local_set(&stat->loop, 0);
+		local_set(&stat->fexp, 0);
+		local_set(&stat->flst, 0);
 	}
 }
 
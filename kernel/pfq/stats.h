@@ -42,6 +42,15 @@ struct pfq_kernel_stats
         local_t fail;		/* Tx failed due to hardware congestion */
         local_t frwd;		/* forwarded to devices */
         local_t kern;		/* passed to kernel */
+        local_t plcd;		/* exceeding the rate of a policer */
+        local_t dvrt;		/* diverted from a congested socket */
+        local_t spll;		/* spilled to the overflow socket (Rx queue full) */
+        local_t hrcv;		/* received by the high-priority queue */
+        local_t hlst;		/* lost by the high-priority queue */
+        local_t chnd;		/* chained to other groups (to_group) */
+        local_t loop;		/* chaining stopped by the loop protection */
+        local_t fexp;		/* flow records exported */
+        local_t flst;		/* flow records lost (flow queue full) */
 };
 
 
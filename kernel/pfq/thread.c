@@ -33,6 +33,7 @@
 #include <linux/kthread.h>
 #include <linux/mutex.h>
 #include <linux/jiffies.h>
+#include <linux/delay.h>
 
 
 static DEFINE_MUTEX(pfq_thread_tx_pool_lock);
@@ -45,7 +46,8 @@ static struct pfq_thread_tx_data pfq_thread_tx_pool[Q_MAX_CPU] =
 		.cpu    = -1,
 		.task	= NULL,
 		.sock   = {NULL, NULL, NULL, NULL},
-		.sock_queue = {{-1}, {-1}, {-1}, {-1}}
+		.sock_queue = {{-1}, {-1}, {-1}, {-1}},
+		.seq	= {0}
 	}
 };
 
@@ -64,6 +66,20 @@ pfq_thread_ping(const char *type, struct pfq_thread_data const *data)
 
 
 
+/* wait until the Tx thread has started a new pass over its queues:
+ * a bounded wait that replaces the fixed grace period.
+ */
+
+static void
+pfq_tx_thread_quiesce(struct pfq_thread_tx_data *data)
+{
+	int seq = atomic_read(&data->seq);
+
+	while (data->task && (atomic_read(&data->seq) - seq) < 2)
+		usleep_range(10, 50);
+}
+
+
 static int
 pfq_tx_thread(void *_data)
 {
@@ -88,6 +104,11 @@ pfq_tx_thread(void *_data)
 		bool reg = false;
 		int total_sent = 0, n;
 
+		/* a full pass started here never sees the sockets unbound before */
+
+		atomic_inc(&data->seq);
+		smp_mb__after_atomic();
+
 		for(n = 0; n < Q_MAX_TX_QUEUES; n++)
 		{
 			struct pfq_sock *sock;
@@ -186,8 +207,8 @@ pfq_unbind_tx_thread(struct pfq_sock *sock)
 			{
 				if (data->sock[i] == sock) {
 					atomic_set(&data->sock_queue[i], -1);
-					smp_wmb();
-					msleep(Q_GRACE_PERIOD);
+					smp_mb();
+					pfq_tx_thread_quiesce(data);
 					data->sock[i] = NULL;
 				}
 			}
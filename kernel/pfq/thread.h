@@ -61,6 +61,7 @@ struct pfq_thread_tx_data
 
 	struct pfq_sock *	sock[Q_MAX_TX_QUEUES];
 	atomic_t		sock_queue[Q_MAX_TX_QUEUES];
+	atomic_t		seq;		/* loop counter: quiescent state for unbind */
 
 } ____pfq_cacheline_aligned;
 
@@ -560,6 +560,18 @@ namespace pfq { namespace lang {
 
         auto steer_flow = function("steer_flow");
 
+        //! Dispatch the packet across the sockets, keeping IPv4 fragments with their flow
+        /*!
+         * Like \c steer_flow; the fragments following the first one (without the transport
+         * header) take the flow hash of the first fragment, recorded in a per-cpu table.
+         * The fragments received before the first one are handled by \c fallback:
+         * Q_FRAG_FALLBACK_ADDR (steered by addresses) or Q_FRAG_FALLBACK_DROP. Example:
+         *
+         * steer_flow_frag (Q_FRAG_FALLBACK_ADDR)
+         */
+
+        auto steer_flow_frag = [] (int fallback) { return function("steer_flow_frag", fallback); };
+
         //! Dispatch the packet across the sockets
         /*!
          * Dispatch with a randomized algorithm that guarantees
@@ -636,6 +648,140 @@ namespace pfq { namespace lang {
                                 return function("steer_field_symmetric", offset1, offset2, bytes);
                            };
 
+        //
+        // deterministic sampling:
+        //
+
+        //! Keep 1 flow (TCP/UDP/SCTP 5-tuple) out of \c rate; drop the others.
+        /*!
+         * The decision is a keyed hash of the flow (module parameter sample_seed),
+         * consistent across cpus, groups and restarts. Example:
+         *
+         * sample_flow (100) >> steer_flow
+         */
+
+        auto sample_flow     = [] (uint32_t rate) { return function("sample_flow", rate); };
+
+        //! Like \c sample_flow, keeps or drops both the directions of a flow.  \see sample_flow
+
+        auto sample_flow_sym = [] (uint32_t rate) { return function("sample_flow_sym", rate); };
+
+        //! Keep 1 packet out of \c rate; drop the others.
+        /*!
+         * The decision is a keyed hash of the fields that do not change along the path
+         * (addresses, IP id and length, start of the transport header), so that the same
+         * packets are kept at every capture point.
+         */
+
+        auto sample_packet   = [] (uint32_t rate) { return function("sample_packet", rate); };
+
+        //
+        // tunnels:
+        //
+
+        //! Evaluate to \c true if the Qbuff carries a VXLAN tunnel.
+
+        auto is_vxlan    = predicate("is_vxlan");
+
+        //! Evaluate to \c true if the Qbuff carries a GRE tunnel.
+
+        auto is_gre      = predicate("is_gre");
+
+        //! Evaluate to \c true if the Qbuff is MPLS labelled (in the frame or in a tunnel).
+
+        auto is_mpls     = predicate("is_mpls");
+
+        //! Evaluate to \c Pass Qbuff if it carries a VXLAN tunnel, \c Drop it otherwise.
+
+        auto vxlan       = function("vxlan");
+
+        //! Evaluate to \c Pass Qbuff if it carries a GRE tunnel, \c Drop it otherwise.
+
+        auto gre         = function("gre");
+
+        //! Evaluate to \c Pass Qbuff if it is MPLS labelled, \c Drop it otherwise.
+
+        auto mpls        = function("mpls");
+
+        //! Dispatch the packet across the sockets by the flow of the innermost IP header.
+        /*!
+         * Tunnels (GTP-U, VXLAN, GRE, MPLS, IPIP) are decapsulated; the hash is symmetric
+         * in the addresses and ports, as for \c steer_flow. Example:
+         *
+         * when (is_vxlan, steer_inner)
+         */
+
+        auto steer_inner = function("steer_inner");
+
+        //! Dispatch GTP-U packets across the sockets by tunnel endpoint id (TEID); drop the others.
+
+        auto steer_teid  = function("steer_teid");
+
+        //
+        // policing:
+        //
+
+        //! Token-bucket policer of the traffic of the group: drop the packets that exceed
+        //! \c pps packets/sec or \c bps bits/sec (0 for no limit).
+        /*!
+         * The rate is split among the online cpus (one bucket per cpu, burst of 100 ms).
+         * The policed packets are accounted in the \c plcd counter of the group. Example:
+         *
+         * police_group (1000000, 0) >> steer_flow
+         */
+
+        auto police_group       = [] (uint64_t pps, uint64_t bps) { return function("police_group", pps, bps); };
+
+        //! Like \c police_group, but the exceeding packets are marked with \c value and passed.  \see police_group
+
+        auto police_group_mark  = [] (uint64_t pps, uint64_t bps, uint32_t value) {
+                                    return function("police_group_mark", pps, bps, value);
+                                };
+
+        //! Like \c police_group, but the exceeding packets are passed to the class \c value.  \see police_group
+
+        auto police_group_class = [] (uint64_t pps, uint64_t bps, int value) {
+                                    return function("police_group_class", pps, bps, value);
+                                };
+
+        //! Per-flow token-bucket policer: drop the packets of a flow exceeding \c pps packets/sec,
+        //! with a burst of \c burst packets.
+        /*!
+         * Flows (5-tuple) are kept in a per-cpu hash table; non IP packets are not policed. Example:
+         *
+         * steer_flow >> police_flow (1000, 64)
+         */
+
+        auto police_flow        = [] (uint64_t pps, uint64_t burst) { return function("police_flow", pps, burst); };
+
+        //! Like \c police_flow, but the exceeding packets are marked with \c value and passed.  \see police_flow
+
+        auto police_flow_mark   = [] (uint64_t pps, uint64_t burst, uint32_t value) {
+                                    return function("police_flow_mark", pps, burst, value);
+                                };
+
+        //! Like \c police_flow, but the exceeding packets are passed to the class \c value.  \see police_flow
+
+        auto police_flow_class  = [] (uint64_t pps, uint64_t burst, int value) {
+                                    return function("police_flow_class", pps, burst, value);
+                                };
+
+        //
+        // flow export:
+        //
+
+        //! Account the packet to its flow (5-tuple) and evaluates to \c Pass.
+        /*!
+         * Flows are kept in per-cpu tables and exported as pfq_flow_record to the
+         * flow queue of the sockets of the group (see socket::flow_slots) when idle
+         * for \c idle msec, after \c active msec, at TCP FIN/RST or when evicted.
+         * Example:
+         *
+         * flow_export (15000, 60000) >> drop
+         */
+
+        auto flow_export        = [] (uint32_t idle, uint32_t active) { return function("flow_export", idle, active); };
+
         //
         // default filters:
         //
@@ -724,6 +870,27 @@ namespace pfq { namespace lang {
 
         auto detour = function("detour");
 
+        //! Deliver the packet to the high-priority Rx queue of the sockets (if enabled). The computation evaluates to \c Pass.
+        /*!
+         * Example:
+         *
+         * when (is_l3_proto(0x0806) | has_port(179), class_high) >> steer_flow
+         */
+
+        auto class_high     = function("class_high");
+
+        //! Chain the packet to the computation of the given group and evaluates to \c Pass.
+        /*!
+         * The packet is evaluated by the group gid in the next hop, without copies.
+         * Each group evaluates a packet at most once (loop protection).
+         *
+         * Example:
+         *
+         * when (is_tcp, to_group(1)) >> steer_flow
+         */
+
+        auto to_group = [] (int gid) { return function("to_group", gid); };
+
         //! Broadcast the packet to all the sockets that have joined the group.
 
         auto broadcast      = function("broadcast");
@@ -764,6 +931,19 @@ namespace pfq { namespace lang {
 
         auto log_packet     = function("log_packet");
 
+        //! Trigger the flight recorder of the group and pass the packet.
+        /*!
+         * The recorder freezes after its post-trigger window (see socket::group_recorder).
+         * Only the first trigger counts, until the recorder is re-armed.
+         *
+         * Example:
+         *
+         * when (is_icmp, recorder_trigger) >> kernel
+         *
+         */
+
+        auto recorder_trigger = function("recorder_trigger");
+
         //! Forward the packet to the given device.
         /*!
          * This function is lazy, in that the action is logged and performed
@@ -1232,6 +1412,300 @@ namespace pfq { namespace lang {
             return std::pow(1 - std::pow(1 - 1.0/m, n * bloomK), bloomK);
         }
 
+        //
+        // longest prefix match (large IPv4/IPv6 network lists):
+        //
+
+        //! Predicate that evaluates to \c true when the source or the destination address
+        // of the packet belongs to one of the given networks.
+        /*!
+         * The first \c vector argument specifies the list of networks.
+         * The second \c vector argument specifies the tag of each network (the longest
+         * matching prefix wins); when empty, networks are tagged with their position
+         * in the list, starting from 1.
+         * Example:
+         *
+         * when (lpm ({"10.0.0.0/8", "10.1.0.0/16"}, {}), log_packet ) >> kernel
+         *
+         */
+
+        auto lpm        = [] (std::vector<CIDR> const &nets, std::vector<uint32_t> const &tags) {
+                                return predicate("lpm", nets, tags);
+                          };
+
+        //! Similarly to \c lpm, evaluates to \c true when the source address
+        //! of the packet belongs to one of the networks.  \see lpm
+
+        auto lpm_src    = [] (std::vector<CIDR> const &nets, std::vector<uint32_t> const &tags) {
+                                return predicate("lpm_src", nets, tags);
+                          };
+
+        //! Similarly to \c lpm, evaluates to \c true when the destination address
+        //! of the packet belongs to one of the networks.  \see lpm
+
+        auto lpm_dst    = [] (std::vector<CIDR> const &nets, std::vector<uint32_t> const &tags) {
+                                return predicate("lpm_dst", nets, tags);
+                          };
+
+        //! Monadic counterpart of \c lpm function.  \see lpm
+
+        auto lpm_filter      = [] (std::vector<CIDR> const &nets, std::vector<uint32_t> const &tags) {
+                                    return function("lpm_filter", nets, tags);
+                                };
+
+        //! Monadic counterpart of \c lpm_src function.  \see lpm_src
+
+        auto lpm_src_filter  = [] (std::vector<CIDR> const &nets, std::vector<uint32_t> const &tags) {
+                                    return function("lpm_src_filter", nets, tags);
+                                };
+
+        //! Monadic counterpart of \c lpm_dst function.  \see lpm_dst
+
+        auto lpm_dst_filter  = [] (std::vector<CIDR> const &nets, std::vector<uint32_t> const &tags) {
+                                    return function("lpm_dst_filter", nets, tags);
+                                };
+
+        //! Evaluate to the tag of the network the source address belongs to.  \see lpm
+
+        auto lpm_src_tag     = [] (std::vector<CIDR> const &nets, std::vector<uint32_t> const &tags) {
+                                    return property("lpm_src_tag", nets, tags);
+                                };
+
+        //! Evaluate to the tag of the network the destination address belongs to.  \see lpm
+
+        auto lpm_dst_tag     = [] (std::vector<CIDR> const &nets, std::vector<uint32_t> const &tags) {
+                                    return property("lpm_dst_tag", nets, tags);
+                                };
+
+        //! Mark the packet with the tag of the network the source address belongs to.
+        //! Packets that do not match pass unmarked.  \see lpm
+
+        auto lpm_src_mark    = [] (std::vector<CIDR> const &nets, std::vector<uint32_t> const &tags) {
+                                    return function("lpm_src_mark", nets, tags);
+                                };
+
+        //! Mark the packet with the tag of the network the destination address belongs to.
+        //! Packets that do not match pass unmarked.  \see lpm
+
+        auto lpm_dst_mark    = [] (std::vector<CIDR> const &nets, std::vector<uint32_t> const &tags) {
+                                    return function("lpm_dst_mark", nets, tags);
+                                };
+
+        //! Dispatch the packet across the sockets by the tag of the network of both the
+        //! source and the destination address. Packets that do not match are dropped.
+        /*!
+         * Example:
+         *
+         * steer_lpm ({"10.0.0.0/16", "10.1.0.0/16"}, {0, 1})
+         */
+
+        auto steer_lpm       = [] (std::vector<CIDR> const &nets, std::vector<uint32_t> const &tags) {
+                                    return function("steer_lpm", nets, tags);
+                                };
+
+        //! Dispatch the packet by the tag of the network of the source address.  \see steer_lpm
+
+        auto steer_lpm_src   = [] (std::vector<CIDR> const &nets, std::vector<uint32_t> const &tags) {
+                                    return function("steer_lpm_src", nets, tags);
+                                };
+
+        //! Dispatch the packet by the tag of the network of the destination address.  \see steer_lpm
+
+        auto steer_lpm_dst   = [] (std::vector<CIDR> const &nets, std::vector<uint32_t> const &tags) {
+                                    return function("steer_lpm_dst", nets, tags);
+                                };
+
+        //! IPv6 counterpart of \c lpm.  \see lpm
+
+        auto lpm6       = [] (std::vector<CIDR6> const &nets, std::vector<uint32_t> const &tags) {
+                                return predicate("lpm6", nets, tags);
+                          };
+
+        //! IPv6 counterpart of \c lpm_src.  \see lpm_src
+
+        auto lpm6_src   = [] (std::vector<CIDR6> const &nets, std::vector<uint32_t> const &tags) {
+                                return predicate("lpm6_src", nets, tags);
+                          };
+
+        //! IPv6 counterpart of \c lpm_dst.  \see lpm_dst
+
+        auto lpm6_dst   = [] (std::vector<CIDR6> const &nets, std::vector<uint32_t> const &tags) {
+                                return predicate("lpm6_dst", nets, tags);
+                          };
+
+        //! IPv6 counterpart of \c lpm_filter.  \see lpm_filter
+
+        auto lpm6_filter     = [] (std::vector<CIDR6> const &nets, std::vector<uint32_t> const &tags) {
+                                    return function("lpm6_filter", nets, tags);
+                                };
+
+        //! IPv6 counterpart of \c lpm_src_filter.  \see lpm_src_filter
+
+        auto lpm6_src_filter = [] (std::vector<CIDR6> const &nets, std::vector<uint32_t> const &tags) {
+                                    return function("lpm6_src_filter", nets, tags);
+                                };
+
+        //! IPv6 counterpart of \c lpm_dst_filter.  \see lpm_dst_filter
+
+        auto lpm6_dst_filter = [] (std::vector<CIDR6> const &nets, std::vector<uint32_t> const &tags) {
+                                    return function("lpm6_dst_filter", nets, tags);
+                                };
+
+        //! IPv6 counterpart of \c lpm_src_tag.  \see lpm_src_tag
+
+        auto lpm6_src_tag    = [] (std::vector<CIDR6> const &nets, std::vector<uint32_t> const &tags) {
+                                    return property("lpm6_src_tag", nets, tags);
+                                };
+
+        //! IPv6 counterpart of \c lpm_dst_tag.  \see lpm_dst_tag
+
+        auto lpm6_dst_tag    = [] (std::vector<CIDR6> const &nets, std::vector<uint32_t> const &tags) {
+                                    return property("lpm6_dst_tag", nets, tags);
+                                };
+
+        //! IPv6 counterpart of \c lpm_src_mark.  \see lpm_src_mark
+
+        auto lpm6_src_mark   = [] (std::vector<CIDR6> const &nets, std::vector<uint32_t> const &tags) {
+                                    return function("lpm6_src_mark", nets, tags);
+                                };
+
+        //! IPv6 counterpart of \c lpm_dst_mark.  \see lpm_dst_mark
+
+        auto lpm6_dst_mark   = [] (std::vector<CIDR6> const &nets, std::vector<uint32_t> const &tags) {
+                                    return function("lpm6_dst_mark", nets, tags);
+                                };
+
+        //! IPv6 counterpart of \c steer_lpm.  \see steer_lpm
+
+        auto steer_lpm6      = [] (std::vector<CIDR6> const &nets, std::vector<uint32_t> const &tags) {
+                                    return function("steer_lpm6", nets, tags);
+                                };
+
+        //! IPv6 counterpart of \c steer_lpm_src.  \see steer_lpm_src
+
+        auto steer_lpm6_src  = [] (std::vector<CIDR6> const &nets, std::vector<uint32_t> const &tags) {
+                                    return function("steer_lpm6_src", nets, tags);
+                                };
+
+        //! IPv6 counterpart of \c steer_lpm_dst.  \see steer_lpm_dst
+
+        auto steer_lpm6_dst  = [] (std::vector<CIDR6> const &nets, std::vector<uint32_t> const &tags) {
+                                    return function("steer_lpm6_dst", nets, tags);
+                                };
+
+        //
+        // payload matching (Aho-Corasick):
+        //
+
+        //! Predicate that evaluates to \c true when the payload contains one of the patterns.
+        /*!
+         * Patterns are arbitrary byte strings. The window starts \c offset bytes after
+         * the transport header (TCP/UDP) and spans \c depth bytes (0: up to the end of
+         * the packet). Example:
+         *
+         * when (payload_match ({"GET /admin", "\x90\x90\x90\x90"}, 0, 128), kernel)
+         */
+
+        auto payload_match  = [] (std::vector<std::string> const &pats, int offset, int depth) {
+                                    return predicate("payload_match", fmap(details::escape_pattern, pats), offset, depth);
+                                };
+
+        //! Monadic counterpart of \c payload_match function.  \see payload_match
+
+        auto payload_filter = [] (std::vector<std::string> const &pats, int offset, int depth) {
+                                    return function("payload_filter", fmap(details::escape_pattern, pats), offset, depth);
+                                };
+
+        //! Evaluate to the id of the pattern found in the payload (its position in the list, from 1).  \see payload_match
+
+        auto payload_id     = [] (std::vector<std::string> const &pats, int offset, int depth) {
+                                    return property("payload_id", fmap(details::escape_pattern, pats), offset, depth);
+                                };
+
+        //! Mark the packet with the id of the pattern found in the payload.  \see payload_id
+
+        auto payload_mark   = [] (std::vector<std::string> const &pats, int offset, int depth) {
+                                    return function("payload_mark", fmap(details::escape_pattern, pats), offset, depth);
+                                };
+
+        //! Set the state of the packet to the id of the pattern found in the payload.  \see payload_id
+
+        auto payload_state  = [] (std::vector<std::string> const &pats, int offset, int depth) {
+                                    return function("payload_state", fmap(details::escape_pattern, pats), offset, depth);
+                                };
+
+        //! Dispatch the packet across the sockets by the id of the pattern found in the payload.
+        //! Packets that do not match are dropped.  \see payload_id
+
+        auto steer_payload  = [] (std::vector<std::string> const &pats, int offset, int depth) {
+                                    return function("steer_payload", fmap(details::escape_pattern, pats), offset, depth);
+                                };
+
+        //
+        // shared maps (created and updated from userspace, see socket::map_create):
+        //
+
+        //! Predicate that evaluates to \c true when the key of the packet is in the map
+        //! (or, for bloom filter maps, probably in the set).
+        /*!
+         * The first argument is the map id, the second one specifies the key of the
+         * packet: Q_MAP_KEY_SRC_ADDR, Q_MAP_KEY_DST_ADDR, Q_MAP_KEY_FLOW, Q_MAP_KEY_MARK,
+         * Q_MAP_KEY_SRC_PORT or Q_MAP_KEY_DST_PORT.
+         * Example:
+         *
+         * when (map_contains (blocklist, Q_MAP_KEY_SRC_ADDR), drop) >> kernel
+         *
+         */
+
+        auto map_contains = [] (int id, int key) {
+                                return predicate("map_contains", id, key);
+                            };
+
+        //! Monadic counterpart of \c map_contains function.  \see map_contains
+
+        auto map_filter   = [] (int id, int key) {
+                                return function("map_filter", id, key);
+                            };
+
+        //! Evaluate to the value (up to 8 bytes) associated with the key of the packet.
+        //! For count-min sketches, evaluate to the estimated packets of the key (HyperLogLog maps are
+        //! rejected: their cardinality is available to userspace lookups only).  \see map_contains
+
+        auto map_lookup   = [] (int id, int key) {
+                                return property("map_lookup", id, key);
+                            };
+
+        //! Count the packets (and the bytes) of each key of the map.
+        /*!
+         * The value of the map is { uint64_t packets; uint64_t bytes; } (or packets only,
+         * for 8 bytes values). Missing keys are inserted in hash maps. Sketch maps
+         * (Q_MAP_COUNT_MIN, Q_MAP_HLL) account the key of the packet. Example:
+         *
+         * map_update (counters, Q_MAP_KEY_FLOW) >> steer_flow
+         */
+
+        auto map_update   = [] (int id, int key) {
+                                return function("map_update", id, key);
+                            };
+
+        //! Dispatch the packet across the sockets by the (uint32_t) value associated with its key.
+        //! Packets whose key is not in the map are dropped.  \see map_contains
+
+        auto steer_by_map = [] (int id, int key) {
+                                return function("steer_by_map", id, key);
+                            };
+
+        //! Predicate that evaluates to \c true when the estimated packets of the key exceed the threshold.
+        /*!
+         * The map must be a Q_MAP_COUNT_MIN sketch, updated by \c map_update. Example:
+         *
+         * map_update (talkers, Q_MAP_KEY_SRC_ADDR) >> when (is_heavy_hitter (talkers, Q_MAP_KEY_SRC_ADDR, 100000), kernel)
+         */
+
+        auto is_heavy_hitter = [] (int id, int key, uint64_t threshold) {
+                                return predicate("is_heavy_hitter", id, key, threshold);
+                            };
+
     }
 
 } // namespace lang
@@ -0,0 +1,558 @@
+/***************************************************************
+ *
+ * (C) 2011-16 Nicola Bonelli <nicola@pfq.io>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * The full GNU General Public License is included in this distribution in
+ * the file called "COPYING".
+ *
+ ****************************************************************/
+
+#pragma once
+
+#include <pfq/lang/lang.hpp>
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+
+#include <linux/bpf.h>
+#include <linux/pf_q.h>
+#include <linux/if_ether.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace pfq { namespace lang { namespace ebpf {
+
+    /*! \file ebpf.hpp
+     *  \brief This header contains the eBPF backend of pfq-lang.
+     *
+     * A computation is translated into an eBPF socket filter that returns the fanout:
+     * Q_EBPF_DROP, Q_EBPF_PASS or Q_EBPF_STEER | hash. Only a subset of pfq-lang has an
+     * eBPF lowering (filters, IPv4 predicates and combinators, when/unless/conditional,
+     * drop, steer_rss, steer_flow, src and dst); computations that use other functions
+     * are not compiled and must be run by the in-kernel interpreter.
+     *
+     * As the in-kernel parser, the program skips up to two 802.1Q/802.1ad tags in-band.
+     */
+
+    //
+    // registers: R6 = context (required by LD_ABS/LD_IND), R7 = offset of the IP
+    //            (or transport) header, R8 = hash, R9 = steering flag.
+    // stack:     [R10-8] = offset of the IP header.
+    //
+
+    class compiler
+    {
+    public:
+
+        compiler(std::vector<FunctionDescr> const &descr)
+        : descr_(descr)
+        , code_()
+        , labels_()
+        , fixup_()
+        , ctx_(ep_src | ep_dst)
+        {}
+
+        std::vector<bpf_insn>
+        operator()()
+        {
+            auto drop = label();
+            auto pass = label();
+
+            emit(alu64_reg(BPF_MOV, BPF_REG_6, BPF_REG_1));
+            emit(alu64_imm(BPF_MOV, BPF_REG_8, 0));
+            emit(alu64_imm(BPF_MOV, BPF_REG_9, 0));
+
+            l3_offset();
+
+            if (!descr_.empty())
+                chain(0, drop);
+
+            emit_jmp_imm(BPF_JEQ, BPF_REG_9, 0, pass);
+
+            emit(alu32_reg(BPF_MOV, BPF_REG_0, BPF_REG_8));
+            emit(alu32_imm(BPF_AND, BPF_REG_0, static_cast<int32_t>(~Q_EBPF_STEER)));
+            emit(alu32_imm(BPF_OR,  BPF_REG_0, static_cast<int32_t>(Q_EBPF_STEER)));
+            emit(exit_insn());
+
+            bind(pass);
+            emit(alu64_imm(BPF_MOV, BPF_REG_0, Q_EBPF_PASS));
+            emit(exit_insn());
+
+            bind(drop);
+            emit(alu64_imm(BPF_MOV, BPF_REG_0, Q_EBPF_DROP));
+            emit(exit_insn());
+
+            return link();
+        }
+
+    private:
+
+        static constexpr int ep_src = 1;        // endpoint context (EPOINT_SRC, EPOINT_DST)
+        static constexpr int ep_dst = 2;
+
+        static constexpr int32_t vlan_hlen = 4;
+        static constexpr int16_t l3_slot = -8;
+
+        // offset of the IP header, after the VLAN tags (if any)
+        //
+
+        void l3_offset()
+        {
+            auto done = label();
+
+            emit(alu64_imm(BPF_MOV, BPF_REG_7, ETH_HLEN));
+
+            for(int n = 0; n < 2; n++)
+            {
+                auto tag = label();
+                ld_ind(BPF_H, -2);
+                emit_jmp_imm(BPF_JEQ, BPF_REG_0, 0x8100, tag);          // 802.1Q
+                emit_jmp_imm(BPF_JNE, BPF_REG_0, 0x88a8, done);         // 802.1ad
+                bind(tag);
+                emit(alu64_imm(BPF_ADD, BPF_REG_7, vlan_hlen));
+            }
+
+            bind(done);
+            emit(stx_mem(BPF_DW, BPF_REG_10, BPF_REG_7, l3_slot));
+        }
+
+        // resolve the labels and remove the unreachable instructions (rejected by the verifier)
+        //
+
+        std::vector<bpf_insn>
+        link() const
+        {
+            std::vector<std::ptrdiff_t> target(code_.size(), -1);
+            std::vector<std::ptrdiff_t> index(code_.size(), -1);
+            std::vector<size_t> stack{0};
+            std::vector<bpf_insn> ret;
+
+            for(auto const &f : fixup_)
+                target[f.first] = labels_[f.second];
+
+            while (!stack.empty())
+            {
+                auto i = stack.back(); stack.pop_back();
+                if (i >= code_.size() || index[i] == 0)
+                    continue;
+
+                index[i] = 0;
+
+                auto op = BPF_OP(code_[i].code);
+                if (BPF_CLASS(code_[i].code) == BPF_JMP && op == BPF_EXIT)
+                    continue;
+                if (target[i] >= 0)
+                    stack.push_back(static_cast<size_t>(target[i]));
+                if (!(BPF_CLASS(code_[i].code) == BPF_JMP && op == BPF_JA))
+                    stack.push_back(i+1);
+            }
+
+            for(size_t i = 0; i < code_.size(); i++)
+            {
+                if (index[i] == 0) {
+                    index[i] = static_cast<std::ptrdiff_t>(ret.size());
+                    ret.push_back(code_[i]);
+                }
+            }
+
+            for(size_t i = 0; i < code_.size(); i++)
+            {
+                if (index[i] >= 0 && target[i] >= 0)
+                    ret[index[i]].off = static_cast<int16_t>(index[target[i]] - index[i] - 1);
+            }
+
+            return ret;
+        }
+
+        // functions: fall through on Pass, jump to drop otherwise.
+        //
+
+        void chain(std::ptrdiff_t n, size_t drop)
+        {
+            // as in the kernel, a link out of range terminates the chain
+            for(; n >= 0 && n < static_cast<std::ptrdiff_t>(descr_.size()); n = descr_[n].link)
+                action(descr_[n], drop);
+        }
+
+        void action(FunctionDescr const &f, size_t drop)
+        {
+            auto const &s = f.symbol;
+
+            if (s == "unit")
+                return;
+
+            if (s == "ip" || s == "udp" || s == "tcp" || s == "icmp" || s == "flow") {
+                builtin_predicate(s == "flow" ? "is_flow" : "is_" + s, drop);
+                return;
+            }
+
+            if (s == "drop") {
+                emit_ja(drop);
+                return;
+            }
+
+            if (s == "steer_rss") {
+                emit(ldx_mem(BPF_W, BPF_REG_8, BPF_REG_6, offsetof(__sk_buff, hash)));
+                emit(alu64_imm(BPF_MOV, BPF_REG_9, 1));
+                return;
+            }
+
+            if (s == "steer_flow") {
+                auto l3 = label();
+                is_ip(drop);
+                ld_ind(BPF_W, 12);
+                emit(alu64_reg(BPF_MOV, BPF_REG_8, BPF_REG_0));
+                ld_ind(BPF_W, 16);
+                emit(alu64_reg(BPF_XOR, BPF_REG_8, BPF_REG_0));
+                ld_ind(BPF_B, 9);
+                auto l4 = label();
+                emit_jmp_imm(BPF_JEQ, BPF_REG_0, IPPROTO_TCP, l4);
+                emit_jmp_imm(BPF_JNE, BPF_REG_0, IPPROTO_UDP, l3);
+                bind(l4);
+                transport_header();
+                ld_ind(BPF_W, 0);
+                emit(alu64_reg(BPF_XOR, BPF_REG_8, BPF_REG_0));
+                bind(l3);
+                emit(alu64_imm(BPF_MOV, BPF_REG_9, 1));
+                return;
+            }
+
+            if (s == "src" || s == "dst") {
+                auto ctx = ctx_;
+                ctx_ = s == "src" ? ep_src : ep_dst;
+                chain(fun_arg(f, 0), drop);
+                ctx_ = ctx;
+                return;
+            }
+
+            if (s == "when" || s == "unless") {
+                auto skip = label();
+                if (s == "when") {
+                    condition(fun_arg(f, 0), skip);
+                }
+                else {
+                    auto run = label();
+                    condition(fun_arg(f, 0), run);
+                    emit_ja(skip);
+                    bind(run);
+                }
+                chain(fun_arg(f, 1), drop);
+                bind(skip);
+                return;
+            }
+
+            if (s == "conditional") {
+                auto other = label();
+                auto end   = label();
+                condition(fun_arg(f, 0), other);
+                chain(fun_arg(f, 1), drop);
+                emit_ja(end);
+                bind(other);
+                chain(fun_arg(f, 2), drop);
+                bind(end);
+                return;
+            }
+
+            throw std::runtime_error("pfq::lang::ebpf: " + s + ": no eBPF lowering");
+        }
+
+        // predicates: fall through when true, jump to 'no' otherwise.
+        //
+
+        void condition(std::ptrdiff_t n, size_t no)
+        {
+            auto const &p = descr_.at(n);
+            auto const &s = p.symbol;
+
+            if (s == "not") {
+                auto yes = label();
+                condition(fun_arg(p, 0), yes);
+                emit_ja(no);
+                bind(yes);
+                return;
+            }
+
+            if (s == "and") {
+                condition(fun_arg(p, 0), no);
+                condition(fun_arg(p, 1), no);
+                return;
+            }
+
+            if (s == "or") {
+                auto second = label();
+                auto yes    = label();
+                condition(fun_arg(p, 0), second);
+                emit_ja(yes);
+                bind(second);
+                condition(fun_arg(p, 1), no);
+                bind(yes);
+                return;
+            }
+
+            if (s == "has_port" || s == "is_port" ||
+                s == "has_addr") {
+                auto second = label();
+                auto yes    = label();
+                auto dst    = (s == "has_addr" ? "has_dst_addr" : "has_dst_port");
+                auto src    = (s == "has_addr" ? "has_src_addr" : "has_src_port");
+
+                // the endpoint context (src/dst) selects the fields to check
+
+                if (!(ctx_ & ep_dst)) {
+                    field(src, p, no);
+                    return;
+                }
+                if (!(ctx_ & ep_src)) {
+                    field(dst, p, no);
+                    return;
+                }
+
+                field(src, p, second);
+                emit_ja(yes);
+                bind(second);
+                field(dst, p, no);
+                bind(yes);
+                return;
+            }
+
+            if (s == "has_src_port" || s == "is_src_port" ||
+                s == "has_dst_port" || s == "is_dst_port" ||
+                s == "has_src_addr" || s == "has_dst_addr") {
+                field(s.substr(0,3) == "is_" ? "has_" + s.substr(3) : s, p, no);
+                return;
+            }
+
+            builtin_predicate(s, no);
+        }
+
+        void builtin_predicate(std::string const &s, size_t no)
+        {
+            if (s == "is_ip") {
+                is_ip(no);
+                return;
+            }
+
+            if (s == "is_udp" || s == "is_tcp" || s == "is_icmp") {
+                is_ip(no);
+                ld_ind(BPF_B, 9);
+                emit_jmp_imm(BPF_JNE, BPF_REG_0, s == "is_udp" ? IPPROTO_UDP :
+                                                 s == "is_tcp" ? IPPROTO_TCP : IPPROTO_ICMP, no);
+                return;
+            }
+
+            if (s == "is_flow") {
+                is_flow(no);
+                return;
+            }
+
+            throw std::runtime_error("pfq::lang::ebpf: " + s + ": no eBPF lowering");
+        }
+
+        void field(std::string const &s, FunctionDescr const &p, size_t no)
+        {
+            if (s == "has_src_port" || s == "has_dst_port") {
+                auto port = *reinterpret_cast<uint16_t const *>(data_arg(p, 0));
+                is_flow(no);
+                transport_header();
+                ld_ind(BPF_H, s == "has_src_port" ? 0 : 2);
+                emit_jmp_imm(BPF_JNE, BPF_REG_0, port, no);
+                return;
+            }
+
+            auto cidr = *reinterpret_cast<CIDR const *>(data_arg(p, 0));
+            auto mask = cidr.prefix ? (0xffffffffu << (32 - cidr.prefix)) : 0u;
+            auto addr = ntohl(cidr.addr) & mask;
+
+            is_ip(no);
+            ld_ind(BPF_W, s == "has_src_addr" ? 12 : 16);
+            emit(alu32_imm(BPF_AND, BPF_REG_0, static_cast<int32_t>(mask)));
+            emit(alu32_imm(BPF_MOV, BPF_REG_1, static_cast<int32_t>(addr)));
+            emit_jmp_reg(BPF_JNE, BPF_REG_0, BPF_REG_1, no);
+        }
+
+        // R7 = offset of the IP header
+        //
+
+        void is_ip(size_t no)
+        {
+            emit(ldx_mem(BPF_DW, BPF_REG_7, BPF_REG_10, l3_slot));
+            ld_ind(BPF_H, -2);
+            emit_jmp_imm(BPF_JNE, BPF_REG_0, ETH_P_IP, no);
+        }
+
+        void is_flow(size_t no)
+        {
+            auto yes = label();
+            is_ip(no);
+            ld_ind(BPF_B, 9);
+            emit_jmp_imm(BPF_JEQ, BPF_REG_0, IPPROTO_TCP, yes);
+            emit_jmp_imm(BPF_JNE, BPF_REG_0, IPPROTO_UDP, no);
+            bind(yes);
+        }
+
+        // R7 (offset of the IP header) += IP header length
+        //
+
+        void transport_header()
+        {
+            ld_ind(BPF_B, 0);
+            emit(alu64_imm(BPF_AND, BPF_REG_0, 0xf));
+            emit(alu64_imm(BPF_LSH, BPF_REG_0, 2));
+            emit(alu64_reg(BPF_ADD, BPF_REG_7, BPF_REG_0));
+        }
+
+        // arguments...
+        //
+
+        std::ptrdiff_t fun_arg(FunctionDescr const &f, size_t i) const
+        {
+            auto const &a = f.arg.at(i);
+            if (a.ptr || a.size == 0)
+                throw std::runtime_error("pfq::lang::ebpf: " + f.symbol + ": bad argument");
+            return static_cast<std::ptrdiff_t>(a.size);
+        }
+
+        void const *data_arg(FunctionDescr const &f, size_t i) const
+        {
+            auto const &a = f.arg.at(i);
+            if (!a.ptr)
+                throw std::runtime_error("pfq::lang::ebpf: " + f.symbol + ": bad argument");
+            return a.ptr->forall_addr();
+        }
+
+        // labels...
+        //
+
+        size_t label()
+        {
+            labels_.push_back(-1);
+            return labels_.size()-1;
+        }
+
+        void bind(size_t l)
+        {
+            labels_[l] = static_cast<std::ptrdiff_t>(code_.size());
+        }
+
+        // instructions...
+        //
+
+        void emit(bpf_insn const &i)
+        {
+            if (code_.size() == BPF_MAXINSNS)
+                throw std::runtime_error("pfq::lang::ebpf: program too large");
+            code_.push_back(i);
+        }
+
+        static bpf_insn insn(uint8_t code, uint8_t dst, uint8_t src, int16_t off, int32_t imm)
+        {
+            bpf_insn i;
+            std::memset(&i, 0, sizeof(i));
+            i.code = code; i.dst_reg = dst & 0xf; i.src_reg = src & 0xf; i.off = off; i.imm = imm;
+            return i;
+        }
+
+        static bpf_insn alu64_imm(uint8_t op, uint8_t dst, int32_t imm) { return insn(BPF_ALU64 | op | BPF_K, dst, 0, 0, imm); }
+        static bpf_insn alu64_reg(uint8_t op, uint8_t dst, uint8_t src) { return insn(BPF_ALU64 | op | BPF_X, dst, src, 0, 0); }
+        static bpf_insn alu32_imm(uint8_t op, uint8_t dst, int32_t imm) { return insn(BPF_ALU | op | BPF_K, dst, 0, 0, imm); }
+        static bpf_insn alu32_reg(uint8_t op, uint8_t dst, uint8_t src) { return insn(BPF_ALU | op | BPF_X, dst, src, 0, 0); }
+        static bpf_insn ldx_mem(uint8_t size, uint8_t dst, uint8_t src, int16_t off) { return insn(BPF_LDX | size | BPF_MEM, dst, src, off, 0); }
+        static bpf_insn stx_mem(uint8_t size, uint8_t dst, uint8_t src, int16_t off) { return insn(BPF_STX | size | BPF_MEM, dst, src, off, 0); }
+        static bpf_insn exit_insn() { return insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0); }
+
+        void ld_ind(uint8_t size, int32_t off) { emit(insn(BPF_LD | size | BPF_IND, 0, BPF_REG_7, 0, off)); }
+
+        void emit_ja(size_t l)
+        {
+            fixup_.emplace_back(code_.size(), l);
+            emit(insn(BPF_JMP | BPF_JA, 0, 0, 0, 0));
+        }
+
+        void emit_jmp_imm(uint8_t op, uint8_t dst, int32_t imm, size_t l)
+        {
+            fixup_.emplace_back(code_.size(), l);
+            emit(insn(BPF_JMP | op | BPF_K, dst, 0, 0, imm));
+        }
+
+        void emit_jmp_reg(uint8_t op, uint8_t dst, uint8_t src, size_t l)
+        {
+            fixup_.emplace_back(code_.size(), l);
+            emit(insn(BPF_JMP | op | BPF_X, dst, src, 0, 0));
+        }
+
+        std::vector<FunctionDescr> const &descr_;
+        std::vector<bpf_insn> code_;
+        std::vector<std::ptrdiff_t> labels_;
+        std::vector<std::pair<size_t, size_t>> fixup_;
+        int ctx_;
+    };
+
+
+    //! Compile a pfq-lang computation into an eBPF program.
+    /*!
+     * Throw std::runtime_error if the computation has no eBPF lowering.
+     */
+
+    template <typename Comp>
+    inline std::vector<bpf_insn>
+    compile(Comp const &comp)
+    {
+        auto ser = pfq::lang::serialize(comp, 0).first;
+        return compiler(ser)();
+    }
+
+    //! Load an eBPF program with bpf(2).
+    /*!
+     * Return the file descriptor of the program, to be passed to the group.
+     */
+
+    inline int
+    load(std::vector<bpf_insn> const &prog, std::string *log = nullptr)
+    {
+        static char license[] = "GPL";
+        std::vector<char> buffer(log ? 65536 : 0);
+
+        union bpf_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+
+        attr.prog_type = BPF_PROG_TYPE_SOCKET_FILTER;
+        attr.insns     = reinterpret_cast<uint64_t>(prog.data());
+        attr.insn_cnt  = static_cast<uint32_t>(prog.size());
+        attr.license   = reinterpret_cast<uint64_t>(license);
+
+        if (log) {
+            attr.log_buf   = reinterpret_cast<uint64_t>(buffer.data());
+            attr.log_size  = static_cast<uint32_t>(buffer.size());
+            attr.log_level = 1;
+        }
+
+        int fd = static_cast<int>(::syscall(__NR_bpf, BPF_PROG_LOAD, &attr, sizeof(attr)));
+
+        if (log)
+            *log = buffer.data();
+
+        return fd;
+    }
+
+} // namespace ebpf
+} // namespace lang
+} // namespace pfq
@@ -126,6 +126,28 @@ namespace pfq { namespace lang
                 throw std::runtime_error("pfq::lang::inet_pton");
             return ret;
         }
+
+        //! Escape a payload pattern: backslashes and non printable bytes become \\xHH.
+
+        inline std::string
+        escape_pattern(const std::string &pat)
+        {
+            static const char hex[] = "0123456789abcdef";
+            std::string ret;
+
+            for(auto c : pat)
+            {
+                auto b = static_cast<unsigned char>(c);
+                if (b == '\\' || b < 0x20 || b > 0x7e) {
+                    ret += "\\x";
+                    ret += hex[b >> 4];
+                    ret += hex[b & 15];
+                }
+                else
+                    ret += c;
+            }
+            return ret;
+        }
     }
 
 
@@ -35,6 +35,7 @@
 #include <pfq/util.hpp>
 #include <pfq/queue.hpp>
 #include <pfq/lang/lang.hpp>
+#include <pfq/lang/ebpf.hpp>
 
 #include <linux/if_ether.h>
 #include <linux/ip.h>
@@ -491,6 +492,31 @@ namespace pfq {
         }
 
 
+        //! Set the overflow socket, where packets are spilled when the Rx queue is full (-1 to disable).
+        /*!
+         * The overflow socket must share a group with this one.
+         */
+
+        void
+        spill(int id)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_set_spill(q, id));
+        }
+
+
+        //! Return the id of the overflow socket (-1 if none).
+
+        int
+        spill() const
+        {
+            auto q = this->data();
+            int id;
+            throw_if(q, pfq_get_spill(q, &id));
+            return id;
+        }
+
+
         //! Specify the capture length of packets, in bytes.
         /*!
          * Capture length must be set before the socket is enabled.
@@ -539,6 +565,71 @@ namespace pfq {
             return as<size_t>(q, pfq_get_rx_slots(q));
         }
 
+        //! Specify the length of the high-priority Rx queue, in number of packets (0 to disable).
+        /*!
+         * Packets classified by class_high are delivered to this queue,
+         * which read() drains before the Rx queue.
+         */
+
+        void
+        rx_hp_slots(size_t value)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_set_rx_hp_slots(q, value));
+        }
+
+        //! Return the length of the high-priority Rx queue, in number of packets.
+
+        size_t
+        rx_hp_slots() const
+        {
+            auto q = this->data();
+            return pfq_get_rx_hp_slots(q);
+        }
+
+        //! Specify the length of the flow record queue, in number of records (0 to disable).
+        /*!
+         * Flows expired by flow_export are delivered to this queue,
+         * and read with read_flows().
+         */
+
+        void
+        flow_slots(size_t value)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_set_flow_slots(q, value));
+        }
+
+        //! Return the length of the flow record queue, in number of records.
+
+        size_t
+        flow_slots() const
+        {
+            auto q = this->data();
+            return pfq_get_flow_slots(q);
+        }
+
+        //! Specify the length of the flight recorder, in number of packets (0 to disable).
+        /*!
+         * The recorder is attached to a group with group_recorder().
+         */
+
+        void
+        recorder_slots(size_t value)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_set_recorder_slots(q, value));
+        }
+
+        //! Return the length of the flight recorder, in number of packets.
+
+        size_t
+        recorder_slots() const
+        {
+            auto q = this->data();
+            return pfq_get_recorder_slots(q);
+        }
+
         //! Return the length of a Rx slot, in bytes.
 
         size_t
@@ -602,6 +693,10 @@ namespace pfq {
         }
 
         //! Unbind the group from the given device/queue.
+        /*!
+         * A group bound to "any" device is unbound from the given device/queue only,
+         * and still receives the packets of the others.
+         */
 
         void
         unbind_group(int gid, const char *dev, int queue = any_queue)
@@ -819,6 +914,61 @@ namespace pfq {
         }
 
 
+        //! Specify an eBPF program for the given group.
+        /*!
+         * The program is run by the kernel JIT in place of the functional computation.
+         */
+
+        void
+        set_group_ebpf(int gid, int fd)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_group_ebpf(q, gid, fd));
+        }
+
+        //! Reset the eBPF program for the given group.
+
+        void
+        reset_group_ebpf(int gid)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_group_ebpf_reset(q, gid));
+        }
+
+        //! Specify a functional computation for the given group, compiled to eBPF.
+        /*!
+         * The computation is translated into an eBPF program and run by the kernel JIT.
+         * If some function has no eBPF lowering (or the program is rejected by the kernel)
+         * the computation is run by the in-kernel interpreter.
+         * Return true if the eBPF program is in use.
+         */
+
+        template <typename Comp>
+        bool set_group_computation_ebpf(int gid, Comp const &comp)
+        {
+            int fd = -1;
+
+            try
+            {
+                fd = pfq::lang::ebpf::load(pfq::lang::ebpf::compile(comp));
+            }
+            catch(std::runtime_error &)
+            { }
+
+            if (fd >= 0) {
+                auto q = this->data();
+                int ret = pfq_group_ebpf(q, gid, fd);
+                ::close(fd);
+                if (ret == 0)
+                    return true;
+            }
+
+            reset_group_ebpf(gid);
+            set_group_computation(gid, comp);
+            return false;
+        }
+
+
         //! Wait for packets.
         /*!
          * Wait for packets available for reading. A timeout in microseconds can be specified.
@@ -858,9 +1008,50 @@ namespace pfq {
             if (unlikely(!q))
                 throw system_error("PFQ: read: socket not enabled");
 
-            unsigned long int data, qver;
+            // the high-priority queue is drained first...
+            //
+
+            if (unlikely(data_->rx_hp_slots))
+            {
+                auto hp = __atomic_load_n(&q->rx_hp.shinfo, __ATOMIC_RELAXED);
+                if (PFQ_SHARED_QUEUE_LEN(hp) != 0)
+                    return swap_queue(q->rx_hp, hp, data_->rx_hp_queue_addr, data_->rx_hp_queue_size, data_->rx_hp_slots, data_->rx_slot_size);
+            }
+
+            auto data = __atomic_load_n(&q->rx.shinfo, __ATOMIC_RELAXED);
+            if (PFQ_SHARED_QUEUE_LEN(data) == 0)
+            {
+#ifdef PFQ_USE_POLL
+                this->poll(microseconds);
+#else
+                usleep(10);
+                (void)microseconds;
+                return net_queue();
+#endif
+            }
+
+            return swap_queue(q->rx, data, data_->rx_queue_addr, data_->rx_queue_size, data_->rx_slots, data_->rx_slot_size);
+        }
 
-            data = __atomic_load_n(&q->rx.shinfo, __ATOMIC_RELAXED);
+        //! Read flow records in place.
+        /*!
+         * Wait for the flows expired by flow_export and return a 'queue'
+         * descriptor: the payload of each slot is a pfq_flow_record.
+         *
+         * The memory of the flow queue is reset at the next read.
+         * A timeout is specified in microseconds.
+         */
+
+        net_queue
+        read_flows(long int microseconds = -1)
+        {
+            auto q = static_cast<struct pfq_shared_queue *>(data()->shm_addr);
+            if (unlikely(!q))
+                throw system_error("PFQ: read flows: socket not enabled");
+            if (unlikely(!data_->flow_slots))
+                throw system_error("PFQ: read flows: flow queue not enabled");
+
+            auto data = __atomic_load_n(&q->flow.shinfo, __ATOMIC_RELAXED);
             if (PFQ_SHARED_QUEUE_LEN(data) == 0)
             {
 #ifdef PFQ_USE_POLL
@@ -872,34 +1063,81 @@ namespace pfq {
 #endif
             }
 
-            qver = PFQ_SHARED_QUEUE_VER(data);
+            return swap_queue(q->flow, data, data_->flow_queue_addr, data_->flow_queue_size, data_->flow_slots, PFQ_FLOW_SLOT_SIZE);
+        }
+
+    private:
+
+        //! Swap the given Rx queue and return the packets of the previous round.
+
+        net_queue
+        swap_queue(pfq_shared_rx_queue &rx, unsigned long int data, void *addr, size_t size, size_t slots, size_t slot_size)
+        {
+            auto qver = PFQ_SHARED_QUEUE_VER(data);
 
             // at wrap-around reset Rx slots...
             //
 
             if (unlikely(((qver+1) & (PFQ_SHARED_QUEUE_VER_MASK^1))== 0))
             {
-                auto raw = static_cast<char *>(data_->rx_queue_addr) + ((qver+1) & 1) * data_->rx_queue_size;
-                auto end = raw + data_->rx_queue_size;
+                auto raw = static_cast<char *>(addr) + ((qver+1) & 1) * size;
+                auto end = raw + size;
                 const pfq_qver_t rst = qver & 1;
-                for(; raw < end; raw += data_->rx_slot_size)
+                for(; raw < end; raw += slot_size)
                     reinterpret_cast<pfq_pkthdr *>(raw)->info.commit = rst;
             }
 
             // swap the net_queue...
             //
 
-            data = __atomic_exchange_n(&q->rx.shinfo, ((qver+1) << (PFQ_SHARED_QUEUE_LEN_SIZE<<3)), __ATOMIC_RELAXED);
+            data = __atomic_exchange_n(&rx.shinfo, ((qver+1) << (PFQ_SHARED_QUEUE_LEN_SIZE<<3)), __ATOMIC_RELAXED);
 
-            auto queue_len = std::min( static_cast<size_t>(PFQ_SHARED_QUEUE_LEN(data))
-                                      , data_->rx_slots);
+            auto queue_len = std::min(static_cast<size_t>(PFQ_SHARED_QUEUE_LEN(data)), slots);
 
-            return net_queue( static_cast<char *>(data_->rx_queue_addr) + (qver & 1) * data_->rx_queue_size
-                            , data_->rx_slot_size
+            return net_queue( static_cast<char *>(addr) + (qver & 1) * size
+                            , slot_size
                             , queue_len
                             , qver);
         }
 
+    public:
+
+        //! Claim a batch of packets from a queue shared among multiple consumers.
+        /*!
+         * Threads (or processes forked after enable) consuming the same socket
+         * claim batches of at most max packets (0 for no limit) and return them
+         * with release(), once processed. Do not mix with read().
+         */
+
+        net_queue
+        claim(size_t max = 0, long int microseconds = -1)
+        {
+            auto q = this->data();
+            struct pfq_net_queue nq;
+
+            throw_if(q, pfq_claim(q, &nq, max, microseconds));
+            if (nq.len == 0)
+                return net_queue();
+
+            return net_queue(nq.queue, nq.slot_size, nq.len, nq.index);
+        }
+
+        //! Release a batch of packets obtained with claim().
+
+        void
+        release(net_queue const &batch)
+        {
+            auto q = this->data();
+            struct pfq_net_queue nq;
+
+            nq.queue     = static_cast<char *>(const_cast<void *>(batch.data()));
+            nq.len       = batch.size();
+            nq.slot_size = batch.slot_size();
+            nq.index     = static_cast<uint32_t>(batch.index());
+
+            throw_if(q, pfq_release(q, &nq));
+        }
+
         //! Return the current commit version (used internally by the memory mapped queue).
 
         pfq_qver_t
@@ -1041,6 +1279,173 @@ namespace pfq {
             return std::vector<unsigned long>(std::begin(cs.counter), std::end(cs.counter));
         }
 
+        //! Return the profiling counters of the functions of the group computation.
+        /*!
+         * The counters are collected when the pfq module is loaded with lang_profile=1.
+         */
+
+        std::vector<pfq_lang_node_stats>
+        group_profile(int gid) const
+        {
+            std::vector<pfq_lang_node_stats> stats;
+            auto q = this->data();
+            size_t size = 0;
+
+            do
+            {
+                stats.resize(size);
+                size = stats.size();
+                throw_if(q, pfq_get_group_profile(q, gid, stats.data(), &size));
+            }
+            while (size > stats.size());
+
+            stats.resize(size);
+            return stats;
+        }
+
+        //! Recompile the group computation, reordering its filters by the profiling counters.
+
+        void
+        optimize_group(int gid)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_group_optimize(q, gid));
+        }
+
+        //! Enable the ring-occupancy-aware load balancing of the group steering.
+        /*!
+         * The policy is Q_BALANCE_NONE, Q_BALANCE_FLOW or Q_BALANCE_PACKET;
+         * watermarks are percentages of the Rx queue (0 for the defaults).
+         */
+
+        void
+        balance_group(int gid, int policy, unsigned int high = 0, unsigned int low = 0)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_group_balance(q, gid, policy, high, low));
+        }
+
+        //! Attach the flight recorder of the socket to the group (post < 0 to detach).
+        /*!
+         * Once triggered, the recorder keeps 'post' more packets and freezes.
+         * Attaching the recorder again re-arms it.
+         */
+
+        void
+        group_recorder(int gid, int post = 0)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_group_recorder(q, gid, post));
+        }
+
+        //! Trigger the flight recorder of the group.
+
+        void
+        group_recorder_trigger(int gid)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_group_recorder_trigger(q, gid));
+        }
+
+        //! Return the state of the flight recorder (Q_RECORDER_ARMED, Q_RECORDER_TRIGGERED or Q_RECORDER_FROZEN).
+
+        int
+        recorder_state()
+        {
+            auto q = this->data();
+            return as<int>(q, pfq_recorder_state(q));
+        }
+
+        //! Pass the packets of the flight recorder to the callback, from the oldest.
+        /*!
+         * The callable type has the signature of pfq_handler (see dispatch);
+         * packets being overwritten are skipped.
+         */
+
+        template <typename Fun>
+        size_t recorder_dispatch(Fun callback, char *user = nullptr)
+        {
+            struct context { Fun *fun; char *user; } ctx = { &callback, user };
+            auto q = this->data();
+            return as<size_t>(q, pfq_recorder_dispatch(q, [](char *c, const struct pfq_pkthdr *h, const char *data) {
+                auto ctx = reinterpret_cast<context *>(c);
+                (*ctx->fun)(ctx->user, h, data);
+            }, reinterpret_cast<char *>(&ctx)));
+        }
+
+        //! Create a shared map, accessible by the pfq-lang map functions.
+        /*!
+         * The type is Q_MAP_HASH, Q_MAP_ARRAY, Q_MAP_LPM or a sketch; the map id is returned.
+         * The map is destroyed when the socket is closed.
+         */
+
+        int
+        map_create(int type, unsigned int key_size, unsigned int value_size, unsigned int max_entries)
+        {
+            auto q = this->data();
+            return as<int>(q, pfq_map_create(q, type, key_size, value_size, max_entries));
+        }
+
+        //! Create a shared bloom filter for max_entries keys and the false positive rate fpr.
+        /*!
+         * Keys are added by map_update (value nullptr), the filter is cleared by map_delete.
+         */
+
+        int
+        map_create_bloom(unsigned int key_size, unsigned int max_entries, double fpr = 0.01)
+        {
+            auto q = this->data();
+            return as<int>(q, pfq_map_create_bloom(q, key_size, max_entries, fpr));
+        }
+
+        //! Destroy the map (the computations that use it keep it alive).
+
+        void
+        map_destroy(int id)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_map_destroy(q, id));
+        }
+
+        //! Create or update an element of the map.
+        /*!
+         * The change is visible to the running computations without replacing them.
+         */
+
+        void
+        map_update(int id, const void *key, const void *value, int flags = Q_MAP_ANY)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_map_update(q, id, key, value, flags));
+        }
+
+        //! Delete an element of the map.
+
+        void
+        map_delete(int id, const void *key)
+        {
+            auto q = this->data();
+            throw_if(q, pfq_map_delete(q, id, key));
+        }
+
+        //! Lookup an element of the map: return true if found (and the value is copied).
+
+        bool
+        map_lookup(int id, const void *key, void *value) const
+        {
+            auto q = this->data();
+            return as<int>(q, pfq_map_lookup(q, id, key, value)) == 1;
+        }
+
+        //! Get the key following the given one (nullptr for the first key): return false at the end.
+
+        bool
+        map_get_next_key(int id, const void *key, void *next_key) const
+        {
+            auto q = this->data();
+            return as<int>(q, pfq_map_get_next_key(q, id, key, next_key)) == 1;
+        }
+
         //! Return the memory size of the Rx queue.
 
         size_t
@@ -1210,7 +1615,16 @@ namespace pfq {
                    << "disc:" << rhs.disc << ' '
                    << "fail:" << rhs.fail << ' '
                    << "frwd:" << rhs.frwd << ' '
-                   << "kern:" << rhs.kern;
+                   << "kern:" << rhs.kern << ' '
+                   << "plcd:" << rhs.plcd << ' '
+                   << "dvrt:" << rhs.dvrt << ' '
+                   << "spll:" << rhs.spll << ' '
+                   << "hrcv:" << rhs.hrcv << ' '
+                   << "hlst:" << rhs.hlst << ' '
+                   << "chnd:" << rhs.chnd << ' '
+                   << "loop:" << rhs.loop << ' '
+                   << "fexp:" << rhs.fexp << ' '
+                   << "flst:" << rhs.flst;
     }
 
     inline pfq_stats&
@@ -1227,6 +1641,16 @@ namespace pfq {
         lhs.frwd += rhs.frwd;
         lhs.kern += rhs.kern;
 
+        lhs.plcd += rhs.plcd;
+        lhs.dvrt += rhs.dvrt;
+        lhs.spll += rhs.spll;
+        lhs.hrcv += rhs.hrcv;
+        lhs.hlst += rhs.hlst;
+        lhs.chnd += rhs.chnd;
+        lhs.loop += rhs.loop;
+        lhs.fexp += rhs.fexp;
+        lhs.flst += rhs.flst;
+
         return lhs;
     }
 
@@ -1244,6 +1668,16 @@ namespace pfq {
         lhs.frwd -= rhs.frwd;
         lhs.kern -= rhs.kern;
 
+        lhs.plcd -= rhs.plcd;
+        lhs.dvrt -= rhs.dvrt;
+        lhs.spll -= rhs.spll;
+        lhs.hrcv -= rhs.hrcv;
+        lhs.hlst -= rhs.hlst;
+        lhs.chnd -= rhs.chnd;
+        lhs.loop -= rhs.loop;
+        lhs.fexp -= rhs.fexp;
+        lhs.flst -= rhs.flst;
+
         return lhs;
     }
 
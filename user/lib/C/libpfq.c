@@ -417,6 +417,23 @@ pfq_enable(pfq_t *q)
 	q->tx_queue_addr = (char *)(q->shm_addr) + sizeof(struct pfq_shared_queue) + q->rx_queue_size * 2;
 	q->tx_queue_size = q->tx_slots * q->tx_slot_size;
 
+	/* the high-priority Rx queue follows the Tx queues */
+
+	q->rx_hp_queue_size = q->rx_hp_slots * q->rx_slot_size;
+	q->rx_hp_queue_addr = q->rx_hp_slots ? (char *)(q->tx_queue_addr) + q->tx_queue_size * 2 * (1 + Q_MAX_TX_QUEUES) : NULL;
+
+	/* the flow record queue follows the high-priority Rx queue */
+
+	q->flow_queue_size = q->flow_slots * PFQ_FLOW_SLOT_SIZE;
+	q->flow_queue_addr = q->flow_slots ? (char *)(q->tx_queue_addr) + q->tx_queue_size * 2 * (1 + Q_MAX_TX_QUEUES)
+						 + q->rx_hp_queue_size * 2 : NULL;
+
+	/* the flight recorder follows the flow record queue */
+
+	q->recorder_size = q->recorder_slots * q->rx_slot_size;
+	q->recorder_addr = q->recorder_slots ? (char *)(q->tx_queue_addr) + q->tx_queue_size * 2 * (1 + Q_MAX_TX_QUEUES)
+						 + q->rx_hp_queue_size * 2 + q->flow_queue_size * 2 : NULL;
+
 	return Q_OK(q);
 }
 
@@ -520,6 +537,28 @@ pfq_get_weight(pfq_t const *q)
 	return Q_VALUE(q, ret);
 }
 
+
+int
+pfq_set_spill(pfq_t *q, int id)
+{
+	if (setsockopt(q->fd, PF_Q, Q_SO_SET_SPILL, &id, sizeof(id)) == -1) {
+		return Q_ERROR(q, "PFQ: set spill socket");
+	}
+	return Q_OK(q);
+}
+
+
+int
+pfq_get_spill(pfq_t const *q, int *id)
+{
+	socklen_t size = sizeof(*id);
+
+	if (getsockopt(q->fd, PF_Q, Q_SO_GET_SPILL, id, &size) == -1) {
+	        return Q_ERROR(q, "PFQ: get spill socket");
+	}
+	return Q_OK(q);
+}
+
 int
 pfq_ifindex(pfq_t const *q, const char *dev)
 {
@@ -634,6 +673,75 @@ pfq_set_rx_slots(pfq_t *q, size_t value)
 }
 
 
+int
+pfq_set_rx_hp_slots(pfq_t *q, size_t value)
+{
+	int enabled = pfq_is_enabled(q);
+	if (enabled == 1) {
+		return Q_ERROR(q, "PFQ: enabled (high-priority slots could not be set)");
+	}
+	if (setsockopt(q->fd, PF_Q, Q_SO_SET_RX_HP_SLOTS, &value, sizeof(value)) == -1) {
+		return Q_ERROR(q, "PFQ: set high-priority Rx slots error");
+	}
+
+	q->rx_hp_slots = value;
+	return Q_OK(q);
+}
+
+
+size_t
+pfq_get_rx_hp_slots(pfq_t const *q)
+{
+	return q->rx_hp_slots;
+}
+
+
+int
+pfq_set_flow_slots(pfq_t *q, size_t value)
+{
+	int enabled = pfq_is_enabled(q);
+	if (enabled == 1) {
+		return Q_ERROR(q, "PFQ: enabled (flow slots could not be set)");
+	}
+	if (setsockopt(q->fd, PF_Q, Q_SO_SET_FLOW_SLOTS, &value, sizeof(value)) == -1) {
+		return Q_ERROR(q, "PFQ: set flow slots error");
+	}
+
+	q->flow_slots = value;
+	return Q_OK(q);
+}
+
+
+size_t
+pfq_get_flow_slots(pfq_t const *q)
+{
+	return q->flow_slots;
+}
+
+
+int
+pfq_set_recorder_slots(pfq_t *q, size_t value)
+{
+	int enabled = pfq_is_enabled(q);
+	if (enabled == 1) {
+		return Q_ERROR(q, "PFQ: enabled (recorder slots could not be set)");
+	}
+	if (setsockopt(q->fd, PF_Q, Q_SO_SET_RECORDER_SLOTS, &value, sizeof(value)) == -1) {
+		return Q_ERROR(q, "PFQ: set recorder slots error");
+	}
+
+	q->recorder_slots = value;
+	return Q_OK(q);
+}
+
+
+size_t
+pfq_get_recorder_slots(pfq_t const *q)
+{
+	return q->recorder_slots;
+}
+
+
 int
 pfq_set_tx_slots(pfq_t *q, size_t value)
 {
@@ -1555,6 +1663,28 @@ pfq_group_fprog_reset(pfq_t *q, int gid)
 }
 
 
+int
+pfq_group_ebpf(pfq_t *q, int gid, int fd)
+{
+	struct pfq_so_ebpf ebpf = { gid, fd };
+
+        if (setsockopt(q->fd, PF_Q, Q_SO_GROUP_EBPF, &ebpf, sizeof(ebpf)) == -1) {
+		return Q_ERROR(q, "PFQ: set group ebpf error");
+	}
+
+	return Q_OK(q);
+}
+
+
+int
+pfq_group_ebpf_reset(pfq_t *q, int gid)
+{
+	if (pfq_group_ebpf(q, gid, -1) < 0)
+		return Q_ERROR(q, "PFQ: reset group ebpf error");
+	return Q_OK(q);
+}
+
+
 int
 pfq_join_group(pfq_t *q, int gid, unsigned long class_mask, int group_policy)
 {
@@ -1645,6 +1775,170 @@ pfq_get_group_counters(pfq_t const *q, int gid, struct pfq_counters *cs)
 }
 
 
+int
+pfq_group_optimize(pfq_t *q, int gid)
+{
+	if (setsockopt(q->fd, PF_Q, Q_SO_GROUP_OPTIMIZE, &gid, sizeof(gid)) == -1) {
+		return Q_ERROR(q, "PFQ: group optimize error");
+	}
+
+	return Q_OK(q);
+}
+
+
+int
+pfq_group_balance(pfq_t *q, int gid, int policy, unsigned int high, unsigned int low)
+{
+	struct pfq_so_group_balance bal = { gid, policy, high, low };
+
+	if (setsockopt(q->fd, PF_Q, Q_SO_GROUP_BALANCE, &bal, sizeof(bal)) == -1) {
+		return Q_ERROR(q, "PFQ: group balance error");
+	}
+
+	return Q_OK(q);
+}
+
+
+int
+pfq_group_recorder(pfq_t *q, int gid, int post)
+{
+	struct pfq_so_group_recorder rec = { gid, post };
+
+	if (setsockopt(q->fd, PF_Q, Q_SO_GROUP_RECORDER, &rec, sizeof(rec)) == -1) {
+		return Q_ERROR(q, "PFQ: group recorder error");
+	}
+
+	return Q_OK(q);
+}
+
+
+int
+pfq_group_recorder_trigger(pfq_t *q, int gid)
+{
+	if (setsockopt(q->fd, PF_Q, Q_SO_GROUP_RECORDER_TRIGGER, &gid, sizeof(gid)) == -1) {
+		return Q_ERROR(q, "PFQ: group recorder trigger error");
+	}
+
+	return Q_OK(q);
+}
+
+
+int
+pfq_get_group_profile(pfq_t const *q, int gid, struct pfq_lang_node_stats *stats, size_t *size)
+{
+	struct pfq_so_group_profile prof = { gid, *size, stats };
+	socklen_t len = sizeof(prof);
+
+	if (getsockopt(q->fd, PF_Q, Q_SO_GET_GROUP_PROFILE, &prof, &len) == -1) {
+		return Q_ERROR(q, "PFQ: get group profile error");
+	}
+
+	*size = prof.size;
+	return Q_OK(q);
+}
+
+
+int
+pfq_map_create(pfq_t *q, int type, unsigned int key_size, unsigned int value_size, unsigned int max_entries)
+{
+	struct pfq_so_map map = { -1, type, key_size, value_size, max_entries, 0 };
+	socklen_t len = sizeof(map);
+
+	if (getsockopt(q->fd, PF_Q, Q_SO_MAP_CREATE, &map, &len) == -1) {
+		return Q_ERROR(q, "PFQ: map create error");
+	}
+
+	return Q_VALUE(q, map.id);
+}
+
+
+int
+pfq_map_create_bloom(pfq_t *q, unsigned int key_size, unsigned int max_entries, double fpr)
+{
+	struct pfq_so_map map = { -1, Q_MAP_BLOOM, key_size, 0, max_entries, (unsigned int)(fpr * 1000000) };
+	socklen_t len = sizeof(map);
+
+	if (fpr <= 0 || fpr >= 1 || map.fpr == 0) {
+		return Q_ERROR(q, "PFQ: map create error (bloom: bad false positive rate)");
+	}
+
+	if (getsockopt(q->fd, PF_Q, Q_SO_MAP_CREATE, &map, &len) == -1) {
+		return Q_ERROR(q, "PFQ: map create error");
+	}
+
+	return Q_VALUE(q, map.id);
+}
+
+
+int
+pfq_map_destroy(pfq_t *q, int id)
+{
+	if (setsockopt(q->fd, PF_Q, Q_SO_MAP_DESTROY, &id, sizeof(id)) == -1) {
+		return Q_ERROR(q, "PFQ: map destroy error");
+	}
+
+	return Q_OK(q);
+}
+
+
+int
+pfq_map_update(pfq_t *q, int id, const void *key, const void *value, int flags)
+{
+	struct pfq_so_map_elem elem = { id, flags, key, (void *)value };
+
+	if (setsockopt(q->fd, PF_Q, Q_SO_MAP_UPDATE, &elem, sizeof(elem)) == -1) {
+		return Q_ERROR(q, "PFQ: map update error");
+	}
+
+	return Q_OK(q);
+}
+
+
+int
+pfq_map_delete(pfq_t *q, int id, const void *key)
+{
+	struct pfq_so_map_elem elem = { id, 0, key, NULL };
+
+	if (setsockopt(q->fd, PF_Q, Q_SO_MAP_DELETE, &elem, sizeof(elem)) == -1) {
+		return Q_ERROR(q, "PFQ: map delete error");
+	}
+
+	return Q_OK(q);
+}
+
+
+int
+pfq_map_lookup(pfq_t const *q, int id, const void *key, void *value)
+{
+	struct pfq_so_map_elem elem = { id, 0, key, value };
+	socklen_t len = sizeof(elem);
+
+	if (getsockopt(q->fd, PF_Q, Q_SO_MAP_LOOKUP, &elem, &len) == -1) {
+		if (errno == ENOENT)
+			return Q_VALUE(q, 0);
+		return Q_ERROR(q, "PFQ: map lookup error");
+	}
+
+	return Q_VALUE(q, 1);
+}
+
+
+int
+pfq_map_get_next_key(pfq_t const *q, int id, const void *key, void *next_key)
+{
+	struct pfq_so_map_elem elem = { id, 0, key, next_key };
+	socklen_t len = sizeof(elem);
+
+	if (getsockopt(q->fd, PF_Q, Q_SO_MAP_GET_NEXT_KEY, &elem, &len) == -1) {
+		if (errno == ENOENT)
+			return Q_VALUE(q, 0);
+		return Q_ERROR(q, "PFQ: map get next key error");
+	}
+
+	return Q_VALUE(q, 1);
+}
+
+
 int
 pfq_vlan_filters_enable(pfq_t *q, int gid, int toggle)
 {
@@ -1681,16 +1975,60 @@ int pfq_vlan_reset_filter(pfq_t *q, int gid, int vid)
 }
 
 
+/* swap the given Rx queue and return the packets of the previous round */
+
+static size_t
+pfq_swap_queue(struct pfq_shared_rx_queue *rx, unsigned long int data, char *addr, size_t size,
+	       size_t slots, size_t slot_size, struct pfq_net_queue *nq)
+{
+	unsigned long int qver = PFQ_SHARED_QUEUE_VER(data);
+	size_t queue_len;
+
+        /* at wrap-around reset Rx slots... */
+
+        if (unlikely(((qver+1) & (PFQ_SHARED_QUEUE_VER_MASK^1))== 0))
+        {
+            char * raw = addr + ((qver+1) & 1) * size;
+            char * end = raw + size;
+            const pfq_qver_t rst = qver & 1;
+            for(; raw < end; raw += slot_size)
+                ((struct pfq_pkthdr *)raw)->info.commit = rst;
+        }
+
+	/* swap the queue... */
+
+        data = __atomic_exchange_n(&rx->shinfo, ((qver+1) << (PFQ_SHARED_QUEUE_LEN_SIZE<<3)), __ATOMIC_RELAXED);
+
+	queue_len = min(PFQ_SHARED_QUEUE_LEN(data), slots);
+
+	nq->queue = addr + (qver & 1) * size;
+	nq->index = (unsigned int)qver;
+	nq->len   = queue_len;
+        nq->slot_size = slot_size;
+
+	return queue_len;
+}
+
+
 int
 pfq_read(pfq_t *q, struct pfq_net_queue *nq, long int microseconds)
 {
 	struct pfq_shared_queue * qd = (struct pfq_shared_queue *)(q->shm_addr);
-	unsigned long int data, qver;
+	unsigned long int data;
 
         if (unlikely(qd == NULL)) {
 		return Q_ERROR(q, "PFQ: read: socket not enabled");
 	}
 
+	/* the high-priority queue is drained first... */
+
+	if (unlikely(q->rx_hp_slots != 0)) {
+		data = __atomic_load_n(&qd->rx_hp.shinfo, __ATOMIC_RELAXED);
+		if (PFQ_SHARED_QUEUE_LEN(data))
+			return Q_VALUE(q, (int)pfq_swap_queue(&qd->rx_hp, data, q->rx_hp_queue_addr, q->rx_hp_queue_size,
+							      q->rx_hp_slots, q->rx_slot_size, nq));
+	}
+
 	data = __atomic_load_n(&qd->rx.shinfo, __ATOMIC_RELAXED);
 
 	if (unlikely(PFQ_SHARED_QUEUE_LEN(data) == 0)) {
@@ -1704,31 +2042,203 @@ pfq_read(pfq_t *q, struct pfq_net_queue *nq, long int microseconds)
 #endif
 	}
 
-        /* at wrap-around reset Rx slots... */
+	return Q_VALUE(q, (int)pfq_swap_queue(&qd->rx, data, q->rx_queue_addr, q->rx_queue_size,
+					      q->rx_slots, q->rx_slot_size, nq));
+}
 
-	qver = PFQ_SHARED_QUEUE_VER(data);
 
-        if (unlikely(((qver+1) & (PFQ_SHARED_QUEUE_VER_MASK^1))== 0))
-        {
-            char * raw = (char *)(q->rx_queue_addr) + ((qver+1) & 1) * q->rx_queue_size;
-            char * end = raw + q->rx_queue_size;
-            const pfq_qver_t rst = qver & 1;
-            for(; raw < end; raw += q->rx_slot_size)
-                ((struct pfq_pkthdr *)raw)->info.commit = rst;
-        }
+int
+pfq_claim(pfq_t *q, struct pfq_net_queue *nq, size_t max, long int microseconds)
+{
+	struct pfq_shared_queue * qd = (struct pfq_shared_queue *)(q->shm_addr);
+	unsigned long int data, head, pos, len, n, qver;
+	struct pfq_net_queue swapped;
 
-	/* swap the queue... */
+        if (unlikely(qd == NULL)) {
+		return Q_ERROR(q, "PFQ: claim: socket not enabled");
+	}
 
-        data = __atomic_exchange_n(&qd->rx.shinfo, ((qver+1) << (PFQ_SHARED_QUEUE_LEN_SIZE<<3)), __ATOMIC_RELAXED);
+	if (max == 0)
+		max = q->rx_slots;
 
-	size_t queue_len = min(PFQ_SHARED_QUEUE_LEN(data), q->rx_slots);
+	for(;;)
+	{
+		head = __atomic_load_n(&qd->rx.mc.head, __ATOMIC_ACQUIRE);
 
-	nq->queue = (char *)(q->rx_queue_addr) + (qver & 1) * q->rx_queue_size;
-	nq->index = (unsigned int)qver;
-	nq->len   = queue_len;
-        nq->slot_size = q->rx_slot_size;
+		if (unlikely(head == PFQ_SHARED_QUEUE_MC_SWAP)) {
+			pfq_yield();
+			continue;
+		}
+
+		pos = PFQ_SHARED_QUEUE_MC_POS(head);
+		len = PFQ_SHARED_QUEUE_MC_LEN(head);
+
+		/* claim a batch of the current queue... */
+
+		if (pos < len) {
+
+			n = min(max, len - pos);
+
+			if (!__atomic_compare_exchange_n(&qd->rx.mc.head, &head, PFQ_SHARED_QUEUE_MC_HEAD(pos + n, len),
+							 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+				continue;
+
+			/* the queue cannot be swapped until this batch is released:
+			 * the version is the one of the claimed slots */
+
+			qver = __atomic_load_n(&qd->rx.mc.ver, __ATOMIC_ACQUIRE);
+
+			nq->queue = (char *)(q->rx_queue_addr) + (qver & 1) * q->rx_queue_size + pos * q->rx_slot_size;
+			nq->index = (unsigned int)qver;
+			nq->len   = n;
+			nq->slot_size = q->rx_slot_size;
+
+			return Q_VALUE(q, (int)n);
+		}
+
+		/* the queue is exhausted: swap it, once all the batches are released */
+
+		nq->len = 0;
+
+		if (__atomic_load_n(&qd->rx.mc.done, __ATOMIC_ACQUIRE) != len)
+			return Q_VALUE(q, (int)0);
+
+		data = __atomic_load_n(&qd->rx.shinfo, __ATOMIC_RELAXED);
+
+		if (PFQ_SHARED_QUEUE_LEN(data) == 0) {
+#ifdef PFQ_USE_POLL
+			if (pfq_poll(q, microseconds) < 0)
+				return Q_ERROR(q, "PFQ: poll error");
+#else
+			(void)microseconds;
+#endif
+			return Q_VALUE(q, (int)0);
+		}
+
+		if (!__atomic_compare_exchange_n(&qd->rx.mc.head, &head, PFQ_SHARED_QUEUE_MC_SWAP,
+						 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+			continue;
+
+		/* swap the queue and publish it to the consumers (the version is reloaded,
+		 * as another consumer may have swapped it in the meanwhile)... */
+
+		data = __atomic_load_n(&qd->rx.shinfo, __ATOMIC_RELAXED);
+
+		pfq_swap_queue(&qd->rx, data, q->rx_queue_addr, q->rx_queue_size, q->rx_slots, q->rx_slot_size, &swapped);
+
+		__atomic_store_n(&qd->rx.mc.done, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&qd->rx.mc.ver, swapped.index, __ATOMIC_RELAXED);
+		__atomic_store_n(&qd->rx.mc.head, PFQ_SHARED_QUEUE_MC_HEAD(0, swapped.len), __ATOMIC_RELEASE);
+	}
+}
+
+
+int
+pfq_release(pfq_t *q, struct pfq_net_queue const *nq)
+{
+	struct pfq_shared_queue * qd = (struct pfq_shared_queue *)(q->shm_addr);
+
+        if (unlikely(qd == NULL)) {
+		return Q_ERROR(q, "PFQ: release: socket not enabled");
+	}
+
+	if (nq->len)
+		__atomic_add_fetch(&qd->rx.mc.done, nq->len, __ATOMIC_RELEASE);
+
+	return Q_OK(q);
+}
+
+
+int
+pfq_read_flows(pfq_t *q, struct pfq_net_queue *nq, long int microseconds)
+{
+	struct pfq_shared_queue * qd = (struct pfq_shared_queue *)(q->shm_addr);
+	unsigned long int data;
+
+        if (unlikely(qd == NULL)) {
+		return Q_ERROR(q, "PFQ: read flows: socket not enabled");
+	}
+
+	if (unlikely(q->flow_slots == 0)) {
+		return Q_ERROR(q, "PFQ: read flows: flow queue not enabled");
+	}
+
+	data = __atomic_load_n(&qd->flow.shinfo, __ATOMIC_RELAXED);
+
+	if (unlikely(PFQ_SHARED_QUEUE_LEN(data) == 0)) {
+#ifdef PFQ_USE_POLL
+		if (pfq_poll(q, microseconds) < 0)
+			return Q_ERROR(q, "PFQ: poll error");
+#else
+		(void)microseconds;
+		nq->len = 0;
+		return Q_VALUE(q, (int)0);
+#endif
+	}
+
+	return Q_VALUE(q, (int)pfq_swap_queue(&qd->flow, data, q->flow_queue_addr, q->flow_queue_size,
+					      q->flow_slots, PFQ_FLOW_SLOT_SIZE, nq));
+}
+
+
+int
+pfq_recorder_state(pfq_t *q)
+{
+	struct pfq_shared_queue * qd = (struct pfq_shared_queue *)(q->shm_addr);
+
+        if (unlikely(qd == NULL || q->recorder_slots == 0)) {
+		return Q_ERROR(q, "PFQ: recorder not enabled");
+	}
+
+	return Q_VALUE(q, (int)__atomic_load_n(&qd->recorder.state, __ATOMIC_ACQUIRE));
+}
+
+
+int
+pfq_recorder_dispatch(pfq_t *q, pfq_handler_t cb, char *user)
+{
+	struct pfq_shared_queue * qd = (struct pfq_shared_queue *)(q->shm_addr);
+	unsigned long int head, stop, index, end;
+	struct pfq_pkthdr *slot;
+	char *copy;
+	int n = 0;
+
+        if (unlikely(qd == NULL || q->recorder_slots == 0)) {
+		return Q_ERROR(q, "PFQ: recorder not enabled");
+	}
+
+	copy = malloc(q->rx_slot_size);
+	if (copy == NULL) {
+		return Q_ERROR(q, "PFQ: out of memory");
+	}
+
+	/* the oldest packets are the ones after the last recorded */
+
+	head = __atomic_load_n(&qd->recorder.head, __ATOMIC_ACQUIRE);
+	stop = __atomic_load_n(&qd->recorder.stop, __ATOMIC_ACQUIRE);
+	end  = head < stop ? head : stop;
+
+	for(index = end > q->recorder_slots ? end - q->recorder_slots : 0; index < end; index++)
+	{
+		slot = (struct pfq_pkthdr *)((char *)q->recorder_addr + (index % q->recorder_slots) * q->rx_slot_size);
+
+		/* skip the slots being written or already overwritten */
+
+		if (__atomic_load_n(&slot->info.commit, __ATOMIC_ACQUIRE) != (uint32_t)(index + 1))
+			continue;
+
+		memcpy(copy, slot, q->rx_slot_size);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if (__atomic_load_n(&slot->info.commit, __ATOMIC_RELAXED) != (uint32_t)(index + 1))
+			continue;
+
+		cb(user, (struct pfq_pkthdr *)copy, copy + sizeof(struct pfq_pkthdr));
+		n++;
+	}
 
-	return Q_VALUE(q, (int)queue_len);
+	free(copy);
+	return Q_VALUE(q, n);
 }
 
 
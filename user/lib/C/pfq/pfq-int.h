@@ -65,6 +65,18 @@ struct pfq_data_int
 	size_t rx_slots;
 	size_t rx_slot_size;
 
+	void * rx_hp_queue_addr;
+	size_t rx_hp_queue_size;
+	size_t rx_hp_slots;
+
+	void * flow_queue_addr;
+	size_t flow_queue_size;
+	size_t flow_slots;
+
+	void * recorder_addr;
+	size_t recorder_size;
+	size_t recorder_slots;
+
         size_t tx_slots;
 	size_t tx_slot_size;
 
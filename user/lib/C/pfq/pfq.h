@@ -344,6 +344,19 @@ extern int pfq_set_weight(pfq_t *q, int value);
 
 extern int pfq_get_weight(pfq_t const *q);
 
+/*! Set the overflow socket, where packets are spilled when the Rx queue is full. */
+/*!
+ * Packets that do not fit the queue are retried once on the socket with the
+ * given id (e.g. a disk writer with a large queue); -1 disables spilling.
+ * The overflow socket must share a group with this one.
+ */
+
+extern int pfq_set_spill(pfq_t *q, int id);
+
+/*! Get the id of the overflow socket (-1 if none). */
+
+extern int pfq_get_spill(pfq_t const *q, int *id);
+
 
 /*! Specify the capture length of packets, in bytes. */
 /*!
@@ -380,6 +393,50 @@ extern int pfq_set_rx_slots(pfq_t *q, size_t value);
 extern size_t pfq_get_rx_slots(pfq_t const *q);
 
 
+/*! Specify the length of the high-priority Rx queue, in number of packets (0 to disable). */
+/*!
+ * Packets classified by the pfq-lang function class_high are delivered to
+ * this queue, which pfq_read drains before the Rx queue. The consumer is
+ * woken up at once (POLLPRI). Must be set before enabling the socket.
+ */
+
+extern int pfq_set_rx_hp_slots(pfq_t *q, size_t value);
+
+
+/*! Return the length of the high-priority Rx queue, in number of packets. */
+
+extern size_t pfq_get_rx_hp_slots(pfq_t const *q);
+
+
+/*! Specify the length of the flow record queue, in number of records (0 to disable). */
+/*!
+ * Flows expired by the pfq-lang function flow_export are delivered to this
+ * queue as struct pfq_flow_record, read with pfq_read_flows. Must be set
+ * before enabling the socket.
+ */
+
+extern int pfq_set_flow_slots(pfq_t *q, size_t value);
+
+
+/*! Return the length of the flow record queue, in number of records. */
+
+extern size_t pfq_get_flow_slots(pfq_t const *q);
+
+
+/*! Specify the length of the flight recorder, in number of packets (0 to disable). */
+/*!
+ * The recorder uses the Rx slot size and is mapped with the socket memory
+ * (hugepages backed, if available). Must be set before enabling the socket.
+ */
+
+extern int pfq_set_recorder_slots(pfq_t *q, size_t value);
+
+
+/*! Return the length of the flight recorder, in number of packets. */
+
+extern size_t pfq_get_recorder_slots(pfq_t const *q);
+
+
 /*! Return the size of a Rx slot, in bytes. */
 
 extern size_t pfq_get_rx_slot_size(pfq_t const *q);
@@ -426,6 +483,10 @@ extern int pfq_bind_group(pfq_t *q, int gid, const char *dev, int queue);
 
 
 /*! Unbind the group from the given device/queue. */
+/*!
+ * A group bound to "any" device is unbound from the given device/queue only,
+ * and still receives the packets of the others.
+ */
 
 extern int pfq_unbind_group(pfq_t *q, int gid, const char *dev, int queue);
 
@@ -520,6 +581,22 @@ extern int pfq_group_fprog(pfq_t *q, int gid, struct sock_fprog const *);
 extern int pfq_group_fprog_reset(pfq_t *q, int gid);
 
 
+/*! Specify an eBPF program for the given group. */
+/*!
+ * The program (BPF_PROG_TYPE_SOCKET_FILTER) is loaded with bpf(2) and it is
+ * run by the kernel JIT in place of the functional computation. It returns
+ * Q_EBPF_DROP, Q_EBPF_PASS or Q_EBPF_STEER | hash. The file descriptor can be
+ * closed after the call.
+ */
+
+extern int pfq_group_ebpf(pfq_t *q, int gid, int fd);
+
+
+/*! Reset the eBPF program for the given group. */
+
+extern int pfq_group_ebpf_reset(pfq_t *q, int gid);
+
+
 /*! Enable/disable vlan filtering for the given group. */
 
 extern int pfq_vlan_filters_enable(pfq_t *q, int gid, int toggle);
@@ -558,6 +635,53 @@ extern int pfq_poll(pfq_t *q, long int microseconds /* = -1 -> infinite */);
 extern int pfq_read(pfq_t *q, struct pfq_net_queue *nq, long int microseconds);
 
 
+/*! Claim a batch of packets from a queue shared among multiple consumers. */
+/*!
+ * Threads (or processes forked after pfq_enable) consuming the same socket
+ * claim batches of at most max packets (0 for no limit) and release them
+ * with pfq_release, once processed: work is pulled by whichever consumer is
+ * free, with no static split. Return the number of packets claimed.
+ *
+ * The queue is swapped when all the batches are released, hence small
+ * batches keep a slow consumer from stalling the others. Do not mix with
+ * pfq_read on the same socket.
+ */
+
+extern int pfq_claim(pfq_t *q, struct pfq_net_queue *nq, size_t max, long int microseconds);
+
+
+/*! Release a batch of packets obtained with pfq_claim. */
+
+extern int pfq_release(pfq_t *q, struct pfq_net_queue const *nq);
+
+
+/*! Read flow records in place. */
+/*!
+ * Wait for flow records (flow_export) and return the number of records
+ * available. Each slot of the 'pfq_net_queue' holds a pfq_pkthdr followed by
+ * a struct pfq_flow_record; the timestamp of the header is the end of the flow.
+ *
+ * The memory of the flow queue is reset at the next read.
+ * A timeout is specified in microseconds.
+ */
+
+extern int pfq_read_flows(pfq_t *q, struct pfq_net_queue *nq, long int microseconds);
+
+
+/*! Return the state of the flight recorder (Q_RECORDER_ARMED, Q_RECORDER_TRIGGERED or Q_RECORDER_FROZEN). */
+
+extern int pfq_recorder_state(pfq_t *q);
+
+
+/*! Pass the packets of the flight recorder to the callback, from the oldest. */
+/*!
+ * Meant for a frozen recorder: packets being overwritten are skipped, and the
+ * callback is passed a copy of each slot. Return the number of packets.
+ */
+
+extern int pfq_recorder_dispatch(pfq_t *q, pfq_handler_t cb, char *user);
+
+
 /*! Receive packets in the given buffer. */
 /*!
  * Wait for packets and return the number of packets available.
@@ -608,6 +732,101 @@ extern int pfq_get_group_stats(pfq_t const *q, int gid, struct pfq_stats *stats)
 extern int pfq_get_group_counters(pfq_t const *q, int gid, struct pfq_counters *cs);
 
 
+/*! Return the profiling counters of the functions of the group computation. */
+/*!
+ * On input size is the capacity of stats, on output the number of functions.
+ * The counters are collected when the pfq module is loaded with lang_profile=1.
+ */
+
+extern int pfq_get_group_profile(pfq_t const *q, int gid, struct pfq_lang_node_stats *stats, size_t *size);
+
+
+/*! Recompile the group computation, reordering its filters by the profiling counters. */
+/*!
+ * The most selective and cheapest filters of each chain are checked first.
+ * Requires the counters collected with lang_profile=1.
+ */
+
+extern int pfq_group_optimize(pfq_t *q, int gid);
+
+
+/*! Enable the ring-occupancy-aware load balancing of the group steering. */
+/*!
+ * The policy is Q_BALANCE_NONE, Q_BALANCE_FLOW or Q_BALANCE_PACKET.
+ * A socket is congested when its Rx queue fills above the high watermark
+ * (percent) and recovers below the low one; 0 selects the defaults.
+ */
+
+extern int pfq_group_balance(pfq_t *q, int gid, int policy, unsigned int high, unsigned int low);
+
+
+/*! Attach the flight recorder of the socket to the group (post < 0 to detach). */
+/*!
+ * The recorder keeps the last packets of the group, continuously overwritten.
+ * Once triggered, it records 'post' more packets and freezes. Attaching the
+ * recorder again re-arms it.
+ */
+
+extern int pfq_group_recorder(pfq_t *q, int gid, int post);
+
+
+/*! Trigger the flight recorder of the group. */
+/*!
+ * The pfq-lang function recorder_trigger does the same from a computation.
+ */
+
+extern int pfq_group_recorder_trigger(pfq_t *q, int gid);
+
+
+/*! Create a shared map, accessible by the pfq-lang map functions. */
+/*!
+ * The type is Q_MAP_HASH, Q_MAP_ARRAY (uint32_t keys) or Q_MAP_LPM (struct pfq_map_lpm_key keys,
+ * with key_size 8 for IPv4 and 20 for IPv6). Return the map id.
+ * The map is destroyed when the socket is closed.
+ */
+
+extern int pfq_map_create(pfq_t *q, int type, unsigned int key_size, unsigned int value_size, unsigned int max_entries);
+
+
+/*! Create a shared bloom filter (Q_MAP_BLOOM), for max_entries keys and the false positive rate fpr. */
+/*!
+ * Keys are added with pfq_map_update (value NULL) and the filter is cleared
+ * by pfq_map_delete (any key). The filter grows if more keys are added.
+ * Return the map id.
+ */
+
+extern int pfq_map_create_bloom(pfq_t *q, unsigned int key_size, unsigned int max_entries, double fpr);
+
+
+/*! Destroy the map (the computations that use it keep it alive). */
+
+extern int pfq_map_destroy(pfq_t *q, int id);
+
+
+/*! Create or update an element of the map. */
+/*!
+ * Flags are Q_MAP_ANY, Q_MAP_NOEXIST (create only) or Q_MAP_EXIST (update only).
+ * The change is visible to the running computations without replacing them.
+ */
+
+extern int pfq_map_update(pfq_t *q, int id, const void *key, const void *value, int flags);
+
+
+/*! Delete an element of the map. */
+
+extern int pfq_map_delete(pfq_t *q, int id, const void *key);
+
+
+/*! Lookup an element of the map: return 1 if found (and the value is copied), 0 otherwise. */
+
+extern int pfq_map_lookup(pfq_t const *q, int id, const void *key, void *value);
+
+
+/*! Get the key following the given one (NULL for the first key): return 1 if found, 0 at the end. */
+
+extern int pfq_map_get_next_key(pfq_t const *q, int id, const void *key, void *next_key);
+
+
 /*! Transmit the packets in the queue. */
 
 extern int pfq_sync_queue(pfq_t *q, int queue);
@@ -0,0 +1,232 @@
+/***************************************************************
+ *
+ * (C) 2011-16 - Nicola Bonelli <nicola@pfq.io>
+ *
+ ****************************************************************/
+
+//
+// eBPF backend of pfq-lang: the generated programs are checked for the
+// instructions they use and run on crafted frames by the tiny interpreter
+// below (the subset of eBPF emitted by the compiler).
+//
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+
+#include <pfq/pfq.hpp>
+#include <pfq/lang/lang.hpp>
+#include <pfq/lang/default.hpp>
+#include <pfq/lang/ebpf.hpp>
+
+#include "yats.hpp"
+
+using namespace yats;
+using namespace pfq::lang;
+
+
+namespace
+{
+    // run the program on the frame: LD_ABS/LD_IND out of the frame terminate
+    // the program with 0, as in the kernel.
+
+    uint32_t run(std::vector<bpf_insn> const &prog, std::vector<uint8_t> const &frame, uint32_t hash = 0)
+    {
+        __sk_buff ctx;
+        std::memset(&ctx, 0, sizeof(ctx));
+        ctx.hash = hash;
+
+        uint64_t stack[64] = { 0 };
+        uint64_t r[11] = { 0 };
+
+        r[1]  = reinterpret_cast<uintptr_t>(&ctx);
+        r[10] = reinterpret_cast<uintptr_t>(stack + 64);
+
+        auto load = [&](size_t off, int size, uint64_t &ret) -> bool
+        {
+            if (off + static_cast<size_t>(size) > frame.size())
+                return false;
+            ret = 0;
+            for(int i = 0; i < size; i++)
+                ret = ret << 8 | frame[off + static_cast<size_t>(i)];
+            return true;
+        };
+
+        for(size_t pc = 0; pc < prog.size(); pc++)
+        {
+            auto const &i = prog[pc];
+            uint64_t src = BPF_SRC(i.code) == BPF_X ? r[i.src_reg] : static_cast<uint64_t>(static_cast<int64_t>(i.imm));
+
+            switch(BPF_CLASS(i.code))
+            {
+            case BPF_ALU64:
+            case BPF_ALU: {
+                auto &dst = r[i.dst_reg];
+                switch(BPF_OP(i.code))
+                {
+                case BPF_MOV: dst = src; break;
+                case BPF_ADD: dst += src; break;
+                case BPF_AND: dst &= src; break;
+                case BPF_OR:  dst |= src; break;
+                case BPF_XOR: dst ^= src; break;
+                case BPF_LSH: dst <<= src; break;
+                default: throw std::runtime_error("unsupported alu op");
+                }
+                if (BPF_CLASS(i.code) == BPF_ALU)
+                    dst &= 0xffffffff;
+            } break;
+
+            case BPF_LD: {
+                int size = BPF_SIZE(i.code) == BPF_B ? 1 : BPF_SIZE(i.code) == BPF_H ? 2 : 4;
+                int64_t off = i.imm + (BPF_MODE(i.code) == BPF_IND ? static_cast<int64_t>(r[i.src_reg]) : 0);
+                if (off < 0 || !load(static_cast<size_t>(off), size, r[0]))
+                    return 0;
+            } break;
+
+            case BPF_LDX: {
+                auto addr = reinterpret_cast<const char *>(r[i.src_reg] + static_cast<uint64_t>(static_cast<int64_t>(i.off)));
+                if (BPF_SIZE(i.code) == BPF_W) {
+                    uint32_t v; std::memcpy(&v, addr, sizeof(v)); r[i.dst_reg] = v;
+                }
+                else {
+                    std::memcpy(&r[i.dst_reg], addr, sizeof(uint64_t));
+                }
+            } break;
+
+            case BPF_STX: {
+                auto addr = reinterpret_cast<char *>(r[i.dst_reg] + static_cast<uint64_t>(static_cast<int64_t>(i.off)));
+                std::memcpy(addr, &r[i.src_reg], sizeof(uint64_t));
+            } break;
+
+            case BPF_JMP: {
+                switch(BPF_OP(i.code))
+                {
+                case BPF_EXIT: return static_cast<uint32_t>(r[0]);
+                case BPF_JA:   pc += static_cast<size_t>(i.off); break;
+                case BPF_JEQ:  if (r[i.dst_reg] == src) pc += static_cast<size_t>(i.off); break;
+                case BPF_JNE:  if (r[i.dst_reg] != src) pc += static_cast<size_t>(i.off); break;
+                default: throw std::runtime_error("unsupported jmp op");
+                }
+            } break;
+
+            default:
+                throw std::runtime_error("unsupported instruction");
+            }
+        }
+
+        throw std::runtime_error("program without exit");
+    }
+
+
+    // Ethernet frame with the given 802.1Q/802.1ad tags, carrying IPv4 with
+    // the transport protocol (UDP, TCP or ICMP), or ARP (proto = 0)
+
+    std::vector<uint8_t>
+    frame(std::vector<uint16_t> tags, uint8_t proto, uint16_t sport = 0, uint16_t dport = 0)
+    {
+        std::vector<uint8_t> f(12, 0xff);
+
+        auto put16 = [&](uint16_t v) {
+            f.push_back(static_cast<uint8_t>(v >> 8));
+            f.push_back(static_cast<uint8_t>(v));
+        };
+
+        for(auto tpid : tags) {
+            put16(tpid); put16(10);
+        }
+
+        put16(proto ? 0x0800 : 0x0806);
+
+        if (!proto) {
+            f.resize(60, 0);
+            return f;
+        }
+
+        const uint8_t ip[20] = { 0x45, 0, 0, 48, 0, 0, 0, 0, 64, proto, 0, 0, 10, 0, 0, 1, 10, 0, 0, 2 };
+        f.insert(f.end(), ip, ip + 20);
+
+        put16(sport); put16(dport);
+        f.resize(f.size() + 24, 0);
+        return f;
+    }
+
+    const uint32_t passed  = Q_EBPF_PASS;
+    const uint32_t dropped = Q_EBPF_DROP;
+}
+
+
+auto g = Group("PFQ eBPF")
+
+    .Single("no_hardcoded_offsets", []
+    {
+        // the headers are loaded relative to the IP offset (after the VLAN tags)
+
+        auto prog = ebpf::compile(when (has_dst_port(53) & has_src_addr(CIDR{"10.0.0.0/8"}), steer_flow));
+
+        auto abs = std::count_if(std::begin(prog), std::end(prog), [](bpf_insn const &i) {
+                        return BPF_CLASS(i.code) == BPF_LD && BPF_MODE(i.code) == BPF_ABS; });
+
+        Assert(abs, is_equal_to(0));
+    })
+
+    .Single("vlan", []
+    {
+        auto prog = ebpf::compile(udp >> unless (has_dst_port(53), drop));
+
+        std::vector<std::vector<uint16_t>> tags = { {}, {0x8100}, {0x88a8, 0x8100} };
+
+        for(int n = 0; n < 3; n++)
+        {
+            AssertId(n, run(prog, frame(tags[n], 17, 1024, 53)), is_equal_to(passed));
+            AssertId(n, run(prog, frame(tags[n], 17, 1024, 80)), is_equal_to(dropped));
+            AssertId(n, run(prog, frame(tags[n],  6, 1024, 53)), is_equal_to(dropped));
+            AssertId(n, run(prog, frame(tags[n],  0)), is_equal_to(dropped));
+        }
+
+        // more than two tags: not parsed, as by the kernel
+
+        Assert(run(prog, frame({0x8100, 0x8100, 0x8100}, 17, 1024, 53)), is_equal_to(dropped));
+    })
+
+    .Single("steer_flow", []
+    {
+        auto prog = ebpf::compile(steer_flow);
+
+        auto a = run(prog, frame({}, 17, 1024, 53));
+        auto b = run(prog, frame({0x8100}, 17, 1024, 53));
+
+        Assert(a & Q_EBPF_STEER, is_equal_to(Q_EBPF_STEER));
+        Assert(b, is_equal_to(a));
+        Assert(run(prog, frame({}, 0)), is_equal_to(dropped));
+    })
+
+    .Single("endpoint_context", []
+    {
+        auto any = ebpf::compile(when (has_port(53), drop));
+        auto s   = ebpf::compile(function("src", when (has_port(53), drop)));
+        auto d   = ebpf::compile(function("dst", when (has_port(53), drop)));
+
+        Assert(run(any, frame({}, 17, 53, 1024)), is_equal_to(dropped));
+        Assert(run(any, frame({}, 17, 1024, 53)), is_equal_to(dropped));
+        Assert(run(any, frame({}, 17, 1024, 80)), is_equal_to(passed));
+
+        Assert(run(s, frame({}, 17, 53, 1024)), is_equal_to(dropped));
+        Assert(run(s, frame({}, 17, 1024, 53)), is_equal_to(passed));
+
+        Assert(run(d, frame({}, 17, 53, 1024)), is_equal_to(passed));
+        Assert(run(d, frame({}, 17, 1024, 53)), is_equal_to(dropped));
+    })
+
+    .Single("no_lowering", []
+    {
+        AssertThrow(ebpf::compile(udp >> kernel));
+    })
+;
+
+
+int main(int argc, char *argv[])
+{
+    return yats::run(argc, argv);
+}
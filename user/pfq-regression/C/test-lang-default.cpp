@@ -37,6 +37,73 @@ main()
     check_computation(q, when   (has_vid(1), ip >> double_steer_ip) );
     check_computation(q, unless (is_ip, ip >> double_steer_ip) );
     check_computation(q, conditional (is_ip, double_steer_ip, drop  ) );
+    check_computation(q, ip >> steer_flow_frag(Q_FRAG_FALLBACK_ADDR) );
+    check_computation(q, udp >> steer_flow_frag(Q_FRAG_FALLBACK_DROP) );
+
+    // tunnels:
+
+    check_computation(q, when (is_vxlan | is_gre | is_mpls, steer_inner) );
+    check_computation(q, udp >> steer_teid );
+    check_computation(q, vxlan >> steer_inner );
+    check_computation(q, conditional (is_gre, gre >> steer_inner, mpls >> steer_inner) );
+
+    // sampling:
+
+    check_computation(q, sample_flow(100) >> steer_flow );
+    check_computation(q, sample_flow_sym(10) >> sample_packet(2) >> kernel );
+
+    // policing:
+
+    check_computation(q, police_group(1000000, 0) >> steer_flow );
+    check_computation(q, police_group_mark(0, 1000000000, 7) >> police_group_class(10000, 0, 2) >> kernel );
+    check_computation(q, steer_flow >> police_flow(1000, 64) >> police_flow_mark(100, 8, 3) >> police_flow_class(10, 1, 4) );
+
+    // flow export:
+
+    check_computation(q, flow_export(15000, 60000) >> steer_flow );
+
+    // flight recorder:
+
+    check_computation(q, when (is_icmp, recorder_trigger) >> steer_flow );
+
+    // priority:
+
+    check_computation(q, when (is_l3_proto(0x0806) | has_port(179), class_high) >> steer_flow );
+
+    // flattened program: fused, deduplicated and disjoint filters:
+
+    check_computation(q, ip >> udp >> src_port(1024) >> dst_port(53) >> steer_flow );
+    check_computation(q, udp >> udp >> ip >> unit >> dst_port(53) >> dst_port(53) );
+    check_computation(q, udp >> tcp >> steer_flow );
+    check_computation(q, conditional (is_tcp, port(80), udp >> dst_port(53)) );
+
+    // chaining:
+
+    check_computation(q, when (is_tcp, to_group(1)) >> steer_flow );
+
+    // longest prefix match:
+
+    check_computation(q, filter(lpm_src({"10.0.0.0/8", "10.1.0.0/16", "192.168.0.0/24"}, {1, 2, 3})) );
+    check_computation(q, lpm_dst_mark({"10.0.0.0/8", "10.1.0.0/16"}, {}) >> steer_lpm_src({"10.0.0.0/16", "10.1.0.0/16"}, {0, 1}) );
+    check_computation(q, when (lpm_src_tag({"10.0.0.0/8"}, {7}) == 7, log_packet) );
+    check_computation(q, lpm6_filter({"2001:db8::/32", "fe80::/10"}, {}) );
+
+    // payload matching:
+
+    check_computation(q, tcp >> when (payload_match({"GET /admin", "cmd.exe", std::string("\x00\x01", 2)}, 0, 256), kernel) );
+    check_computation(q, udp >> payload_state({"evil.example"}, 12, 0) >> steer_payload({"A", "B"}, 0, 64) );
+
+    // shared maps:
+
+    auto blocklist = q.map_create(Q_MAP_LPM, 8, 4, 1024);
+    auto counters  = q.map_create(Q_MAP_HASH, sizeof(pfq_map_flow_key), 16, 65536);
+    auto talkers   = q.map_create(Q_MAP_COUNT_MIN, 4, 8, 4096);
+    auto flows     = q.map_create_bloom(sizeof(pfq_map_flow_key), 100000, 0.001);
+
+    check_computation(q, unless (map_contains(blocklist, Q_MAP_KEY_SRC_ADDR), map_update(counters, Q_MAP_KEY_FLOW)) );
+    check_computation(q, map_update(talkers, Q_MAP_KEY_SRC_ADDR) >> when (is_heavy_hitter(talkers, Q_MAP_KEY_SRC_ADDR, 1000), kernel) );
+    check_computation(q, map_filter(flows, Q_MAP_KEY_FLOW) >> steer_flow );
+    check_computation(q, when (map_lookup(blocklist, Q_MAP_KEY_DST_ADDR) == 1, drop) >> steer_flow );
 
     return 0;
 }
@@ -33,6 +33,12 @@ main()
     check_computation( q, par7 (ip, ip, ip, ip, ip, ip, ip) );
     check_computation( q, par8 (ip, ip, ip, ip, ip, ip, ip, ip) );
 
+    // GTP:
+
+    check_computation( q, steer_gtp_usr ("10.0.0.0", 8) );
+    check_computation( q, when (is_gtp_up, gtp_up >> steer_inner) );
+    check_computation( q, unless (is_gtp_cp | not_(is_gtp), gtp >> gtp_cp) );
+
     return 0;
 }
 
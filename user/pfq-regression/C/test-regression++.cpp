@@ -5,6 +5,8 @@
 #include <sys/wait.h>
 
 #include <pfq/pfq.hpp>
+#include <pfq/lang/lang.hpp>
+#include <pfq/lang/default.hpp>
 
 #include "yats.hpp"
 
@@ -119,6 +121,32 @@ auto g = Group("PFQ")
     })
 
 
+    .Single("spill", []
+    {
+        pfq::socket x, y;
+        AssertThrow(x.spill(0));
+
+        x.open(pfq::group_policy::undefined, 64);
+        y.open(pfq::group_policy::undefined, 64);
+
+        Assert(x.spill(), is_equal_to(-1));
+        AssertThrow(x.spill(x.id()));
+
+        // the spill socket must share a group
+
+        AssertThrow(x.spill(y.id()));
+
+        x.join_group(23, pfq::group_policy::shared);
+        y.join_group(23, pfq::group_policy::shared);
+
+        x.spill(y.id());
+        Assert(x.spill(), is_equal_to(y.id()));
+
+        x.spill(-1);
+        Assert(x.spill(), is_equal_to(-1));
+    })
+
+
     .Single("caplen", []
     {
         pfq::socket x;
@@ -169,6 +197,87 @@ auto g = Group("PFQ")
     })
 
 
+    .Single("rx_hp_slots", []
+    {
+        pfq::socket x;
+        AssertThrow(x.rx_hp_slots(64));
+
+        x.open(pfq::group_policy::undefined, 64);
+        Assert(x.rx_hp_slots(), is_equal_to(0UL));
+
+        x.rx_hp_slots(64);
+        Assert(x.rx_hp_slots(), is_equal_to(64UL));
+
+        x.enable();
+        AssertThrow(x.rx_hp_slots(128));
+        x.disable();
+    })
+
+
+    .Single("flow_slots", []
+    {
+        pfq::socket x;
+        AssertThrow(x.flow_slots(1024));
+
+        x.open(pfq::group_policy::undefined, 64);
+        Assert(x.flow_slots(), is_equal_to(0UL));
+        AssertThrow(x.read_flows(0));
+
+        x.flow_slots(1024);
+        Assert(x.flow_slots(), is_equal_to(1024UL));
+
+        x.enable();
+        AssertThrow(x.flow_slots(2048));
+        Assert(x.read_flows(0).size(), is_equal_to(0UL));
+        x.disable();
+    })
+
+
+    .Single("recorder_slots", []
+    {
+        pfq::socket x;
+        AssertThrow(x.recorder_slots(1024));
+
+        x.open(pfq::group_policy::undefined, 64);
+        Assert(x.recorder_slots(), is_equal_to(0UL));
+        AssertThrow(x.recorder_state());
+
+        x.recorder_slots(1024);
+        Assert(x.recorder_slots(), is_equal_to(1024UL));
+
+        x.enable();
+        AssertThrow(x.recorder_slots(2048));
+        Assert(x.recorder_state(), is_equal_to(Q_RECORDER_ARMED));
+        Assert(x.recorder_dispatch([](char *, const pfq_pkthdr *, const char *) {}), is_equal_to(0UL));
+        x.disable();
+    })
+
+
+    .Single("group_recorder", []
+    {
+        pfq::socket x(pfq::group_policy::undefined, 64, 1024);
+        x.recorder_slots(1024);
+        x.join_group(22, pfq::group_policy::shared);
+        x.enable();
+
+        AssertThrow(x.group_recorder_trigger(22));
+
+        x.group_recorder(22, 16);
+        Assert(x.recorder_state(), is_equal_to(Q_RECORDER_ARMED));
+
+        x.group_recorder_trigger(22);
+        Assert(x.recorder_state(), is_equal_to(Q_RECORDER_TRIGGERED));
+
+        x.group_recorder(22, 0);
+        x.group_recorder_trigger(22);
+        Assert(x.recorder_state(), is_equal_to(Q_RECORDER_FROZEN));
+
+        x.group_recorder(22, -1);
+        AssertThrow(x.group_recorder_trigger(22));
+        x.disable();
+    })
+
+
     .Single("rx_slot_size", []
     {
         pfq::socket x;
@@ -569,6 +678,56 @@ auto g = Group("PFQ")
     {
         pfq::socket q(64);
         AssertNoThrow(q.egress_unbind());
+    })
+
+    .Single("to_group_access", []
+    {
+        using namespace pfq::lang;
+
+        pfq::socket x(pfq::group_policy::priv, 64);
+        pfq::socket y(pfq::group_policy::priv, 64);
+        pfq::socket z(pfq::group_policy::restricted, 64);
+        pfq::socket w(pfq::group_policy::shared, 64);
+
+        AssertThrow(y.set_group_computation(y.group_id(), to_group(x.group_id())));
+        AssertThrow(x.set_group_computation(x.group_id(), to_group(y.group_id())));
+
+        AssertNoThrow(y.set_group_computation(y.group_id(), to_group(z.group_id())));
+        AssertNoThrow(y.set_group_computation(y.group_id(), to_group(w.group_id())));
+
+        AssertThrow(y.set_group_computation(y.group_id(), to_group(64)));
+    })
+
+    .Single("map_access", []
+    {
+        using namespace pfq::lang;
+
+        pfq::socket x(pfq::group_policy::shared, 64);
+        pfq::socket y(pfq::group_policy::priv, 64);
+        pfq::socket z(pfq::group_policy::undefined, 64);
+
+        auto id = x.map_create(Q_MAP_HASH, 4, 8, 16);
+
+        uint32_t key = 1; uint64_t value = 42, out = 0;
+
+        AssertNoThrow(x.map_update(id, &key, &value));
+
+        AssertThrow(y.map_update(id, &key, &value));
+        AssertThrow(y.map_lookup(id, &key, &out));
+        AssertThrow(y.map_delete(id, &key));
+        AssertThrow(y.set_group_computation(y.group_id(), map_filter(id, Q_MAP_KEY_MARK)));
+
+        // sockets sharing a group with the creator...
+
+        z.join_group(x.group_id(), pfq::group_policy::shared);
+
+        Assert(z.map_lookup(id, &key, &out), is_equal_to(true));
+        Assert(out, is_equal_to(42UL));
+        AssertNoThrow(z.set_group_computation(x.group_id(), map_filter(id, Q_MAP_KEY_MARK)));
+        AssertNoThrow(z.map_delete(id, &key));
+
+        AssertThrow(z.map_destroy(id));
+        AssertNoThrow(x.map_destroy(id));
     });
 
 #if 0
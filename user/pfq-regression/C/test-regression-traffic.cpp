@@ -0,0 +1,574 @@
+/***************************************************************
+ *
+ * (C) 2011-16 - Nicola Bonelli <nicola@pfq.io>
+ *
+ ****************************************************************/
+
+//
+// regression tests driven by traffic: packets are transmitted with PFQ on
+// PFQ_TEST_TX and captured on PFQ_TEST_RX (a PFQ-aware device, connected
+// back-to-back with the first one). Without them the tests are skipped.
+//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#include <pfq/pfq.hpp>
+#include <pfq/lang/lang.hpp>
+#include <pfq/lang/default.hpp>
+
+#include "yats.hpp"
+
+using namespace yats;
+using namespace pfq::lang;
+
+
+namespace traffic
+{
+    const size_t N = 1000;
+
+    bool enabled()
+    {
+        if (getenv("PFQ_TEST_RX") && getenv("PFQ_TEST_TX"))
+            return true;
+        std::cout << "(skipped: PFQ_TEST_RX/PFQ_TEST_TX not set) " << std::flush;
+        return false;
+    }
+
+    const char *rx() { return getenv("PFQ_TEST_RX"); }
+    const char *tx() { return getenv("PFQ_TEST_TX"); }
+
+
+    // Ethernet frame (802.1Q tagged if vid != 0) carrying IPv4 with the given
+    // transport protocol (UDP, TCP or ICMP) or ARP (proto = 0). The last byte of
+    // the source MAC is the tag of the frame, used to count the received ones.
+    //
+
+    std::vector<char>
+    frame(uint8_t tag, uint8_t proto, uint16_t sport = 0, uint16_t dport = 0, uint16_t vid = 0)
+    {
+        const size_t len = 64;
+        std::vector<char> f(len + (vid ? 4 : 0), 0);
+        auto p = reinterpret_cast<unsigned char *>(f.data());
+
+        auto put16 = [](unsigned char *b, uint16_t v) {
+            b[0] = static_cast<unsigned char>(v >> 8);
+            b[1] = static_cast<unsigned char>(v);
+        };
+
+        memset(p, 0xff, 6);                                     // broadcast
+        memcpy(p + 6, "\x02\x00\x00\x00\x00", 5);
+        p[11] = tag;
+        p += 12;
+
+        if (vid) {
+            put16(p, 0x8100); put16(p + 2, vid);
+            p += 4;
+        }
+
+        put16(p, proto ? 0x0800 : 0x0806);
+        p += 2;
+
+        if (!proto)
+            return f;
+
+        auto ip = p;
+        put16(ip + 2, static_cast<uint16_t>(len - 14));
+        ip[0] = 0x45; ip[8] = 64; ip[9] = proto;
+        memcpy(ip + 12, "\xc0\xa8\x00\x01", 4);                 // 192.168.0.1
+        memcpy(ip + 16, "\xc0\xa8\x00\x02", 4);                 // 192.168.0.2
+
+        uint32_t sum = 0;
+        for(int i = 0; i < 20; i += 2)
+            sum += static_cast<uint32_t>(ip[i] << 8 | ip[i+1]);
+        while (sum >> 16)
+            sum = (sum & 0xffff) + (sum >> 16);
+        put16(ip + 10, static_cast<uint16_t>(~sum));
+
+        auto l4 = ip + 20;
+        if (proto == 17 || proto == 6) {
+            put16(l4, sport); put16(l4 + 2, dport);
+        }
+        if (proto == 17)
+            put16(l4 + 4, static_cast<uint16_t>(len - 14 - 20));
+        if (proto == 6)
+            l4[12] = 0x50;                                      // data offset
+        if (proto == 1)
+            l4[0] = 8;                                          // echo request
+
+        return f;
+    }
+
+
+    // transmit the frames 'times' times, and wait for them to be received
+    //
+
+    void inject(std::vector<std::vector<char>> const &frames, size_t times = N)
+    {
+        pfq::socket q(64, 1024, 1024);
+        q.bind_tx(tx(), -1);
+        q.enable();
+
+        for(size_t n = 0; n < times; n++)
+            for(auto &f : frames)
+                while (!q.send(pfq::const_buffer(f.data(), f.size())))
+                    std::this_thread::yield();
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    }
+
+
+    // number of packets received by the socket, for each tag
+    //
+
+    std::vector<size_t> count(pfq::socket &q)
+    {
+        std::vector<size_t> n(256, 0);
+        for(int empty = 0; empty < 3; )
+        {
+            auto many = q.read(100000);
+            if (many.empty()) {
+                empty++;
+                continue;
+            }
+            for(auto it = std::begin(many), it_e = std::end(many); it != it_e; ++it)
+            {
+                while (!it.ready())
+                    std::this_thread::yield();
+                if (it->caplen >= 12)
+                    n[static_cast<const unsigned char *>(it.data())[11]]++;
+            }
+        }
+        return n;
+    }
+
+
+    // pfq-lang profiling (module parameter): when enabled the computations
+    // are evaluated by the tree walking engine instead of the flattened program
+    //
+
+    bool lang_profile(bool enable)
+    {
+        const char *param = "/sys/module/pfq/parameters/lang_profile";
+        int prev = 0;
+        std::ifstream(param) >> prev;
+        std::ofstream(param) << (enable ? 1 : 0) << std::endl;
+        return prev != 0;
+    }
+
+
+    // batch evaluation of pfq-lang (module parameter): the computations are
+    // evaluated over the capture batch instead of per packet
+    //
+
+    bool lang_batch(bool enable)
+    {
+        const char *param = "/sys/module/pfq/parameters/lang_batch";
+        int prev = 0;
+        std::ifstream(param) >> prev;
+        std::ofstream(param) << (enable ? 1 : 0) << std::endl;
+        return prev != 0;
+    }
+
+
+    // global counter from /proc/net/pfq/global
+    //
+
+    long global(std::string const &name)
+    {
+        std::ifstream in("/proc/net/pfq/global");
+        std::string line;
+        while (std::getline(in, line))
+        {
+            std::istringstream ss(line);
+            std::string key, colon;
+            long value;
+            if ((ss >> key >> colon >> value) && key == name)
+                return value;
+        }
+        return -1;
+    }
+}
+
+
+auto g = Group("PFQ traffic")
+
+    .Single("to_group_chain", []
+    {
+        if (!traffic::enabled())
+            return;
+
+        pfq::socket x(pfq::group_policy::undefined, 64, 4096);
+        pfq::socket y(pfq::group_policy::undefined, 64, 4096);
+
+        x.join_group(60, pfq::group_policy::shared);
+        y.join_group(61, pfq::group_policy::shared);
+
+        x.bind_group(60, traffic::rx(), -1);
+        x.set_group_computation(60, udp >> when (has_dst_port(40048), to_group(61)));
+
+        x.enable();
+        y.enable();
+
+        traffic::inject({ traffic::frame(1, 17, 1024, 40048), traffic::frame(2, 17, 1024, 40049) });
+
+        // the group 61 is bound to no device: it receives the chained packets only
+
+        auto xs = traffic::count(x), ys = traffic::count(y);
+
+        Assert(ys[1], is_equal_to(traffic::N));
+        Assert(ys[2], is_equal_to(0UL));
+        Assert(xs[1], is_equal_to(traffic::N));
+
+        Assert(x.group_stats(60).chnd, is_greater_equal(traffic::N));
+        Assert(y.group_stats(61).recv, is_greater_equal(traffic::N));
+    })
+
+
+    .Single("to_group_loop", []
+    {
+        if (!traffic::enabled())
+            return;
+
+        pfq::socket x(pfq::group_policy::undefined, 64, 4096);
+        pfq::socket y(pfq::group_policy::undefined, 64, 4096);
+
+        x.join_group(62, pfq::group_policy::shared);
+        y.join_group(63, pfq::group_policy::shared);
+
+        x.bind_group(62, traffic::rx(), -1);
+        x.set_group_computation(62, udp >> when (has_dst_port(40062), to_group(63)));
+        y.set_group_computation(63, to_group(62));
+
+        x.enable();
+        y.enable();
+
+        auto loop = traffic::global("loop");
+
+        traffic::inject({ traffic::frame(1, 17, 1024, 40062) });
+
+        // each group evaluates a packet once: the chain back to 62 is stopped
+
+        Assert(traffic::count(x)[1], is_equal_to(traffic::N));
+        Assert(traffic::count(y)[1], is_equal_to(traffic::N));
+        Assert(traffic::global("loop") - loop, is_greater_equal(static_cast<long>(traffic::N)));
+    })
+
+
+    .Single("class_high_per_group", []
+    {
+        if (!traffic::enabled())
+            return;
+
+        pfq::socket x(pfq::group_policy::undefined, 64, 4096);
+        pfq::socket y(pfq::group_policy::undefined, 64, 4096);
+
+        x.rx_hp_slots(1024);
+        y.rx_hp_slots(1024);
+
+        x.join_group(58, pfq::group_policy::shared);
+        y.join_group(59, pfq::group_policy::shared);
+
+        x.bind_group(58, traffic::rx(), -1);
+        y.bind_group(59, traffic::rx(), -1);
+
+        x.set_group_computation(58, udp >> class_high);
+
+        x.enable();
+        y.enable();
+
+        traffic::inject({ traffic::frame(1, 17, 1024, 53) });
+
+        Assert(traffic::count(x)[1], is_equal_to(traffic::N));
+        Assert(traffic::count(y)[1], is_equal_to(traffic::N));
+
+        // the priority set by the computation of 58 does not leak to the group 59
+
+        Assert(x.stats().hrcv, is_greater_equal(traffic::N));
+        Assert(y.stats().hrcv, is_equal_to(0UL));
+    })
+
+
+    .Single("unbind_any_device", []
+    {
+        if (!traffic::enabled())
+            return;
+
+        pfq::socket q(pfq::group_policy::undefined, 64, 4096);
+
+        q.join_group(54, pfq::group_policy::shared);
+        q.bind_group(54, "any", -1);
+        q.enable();
+
+        traffic::inject({ traffic::frame(1, 17, 1024, 53) });
+
+        Assert(traffic::count(q)[1], is_equal_to(traffic::N));
+
+        // unbinding the device excludes it from the group bound to any device...
+
+        q.unbind_group(54, traffic::rx(), -1);
+
+        traffic::inject({ traffic::frame(1, 17, 1024, 53) });
+
+        Assert(traffic::count(q)[1], is_equal_to(0UL));
+
+        // ...until the group is bound to it again
+
+        q.bind_group(54, traffic::rx(), -1);
+
+        traffic::inject({ traffic::frame(1, 17, 1024, 53) });
+
+        Assert(traffic::count(q)[1], is_equal_to(traffic::N));
+    })
+
+
+    .Single("batch_equivalence", []
+    {
+        if (!traffic::enabled())
+            return;
+
+        pfq::socket x(pfq::group_policy::undefined, 64, 8192);
+        pfq::socket y(pfq::group_policy::undefined, 64, 8192);
+
+        x.join_group(55, pfq::group_policy::shared);
+        y.join_group(55, pfq::group_policy::shared);
+
+        x.bind_group(55, traffic::rx(), -1);
+        x.set_group_computation(55, unless (is_udp, drop) >> steer_flow);
+
+        x.enable();
+        y.enable();
+
+        std::vector<std::vector<char>> frames;
+        for(uint8_t f = 1; f <= 8; f++)
+            frames.push_back(traffic::frame(f, f & 1 ? 17 : 6, static_cast<uint16_t>(1024 + f), 53));
+
+        auto prev = traffic::lang_batch(false);
+
+        traffic::inject(frames);
+        auto xs = traffic::count(x), ys = traffic::count(y);
+
+        traffic::lang_batch(true);
+
+        traffic::inject(frames);
+        auto xb = traffic::count(x), yb = traffic::count(y);
+
+        traffic::lang_batch(prev);
+
+        // the same packets reach the same sockets in both modes
+
+        Assert(xb, is_equal_to(xs));
+        Assert(yb, is_equal_to(ys));
+
+        for(uint8_t f = 1; f <= 8; f++)
+            AssertId(f, xs[f] + ys[f], is_equal_to(f & 1 ? traffic::N : 0UL));
+    })
+
+
+    .Single("group_profile", []
+    {
+        if (!traffic::enabled())
+            return;
+
+        pfq::socket q(pfq::group_policy::undefined, 64, 4096);
+
+        q.join_group(56, pfq::group_policy::shared);
+        q.bind_group(56, traffic::rx(), -1);
+        q.set_group_computation(56, ip >> udp >> dst_port(53));
+        q.enable();
+
+        auto prev = traffic::lang_profile(true);
+
+        traffic::inject({ traffic::frame(1, 17, 1024, 53), traffic::frame(2, 6, 1024, 80) });
+
+        traffic::lang_profile(prev);
+
+        auto prof = q.group_profile(56);
+
+        Assert(traffic::count(q)[1], is_equal_to(traffic::N));
+        Assert(prof.empty(), is_false());
+
+        // every function of the computation is counted
+
+        for(size_t n = 0; n < prof.size(); n++)
+            AssertId(static_cast<int>(n), prof[n].invoke, is_greater(0UL));
+
+        Assert(prof.front().invoke, is_greater_equal(2 * traffic::N));
+        Assert(prof.front().pass, is_greater_equal(2 * traffic::N));
+        Assert(prof.back().pass, is_greater_equal(traffic::N));
+    })
+
+
+    .Single("balance_full_ring", []
+    {
+        if (!traffic::enabled())
+            return;
+
+        const size_t slots = 512, flows = 16;
+
+        pfq::socket x(pfq::group_policy::undefined, 64, slots);
+        pfq::socket y(pfq::group_policy::undefined, 64, 32768);
+
+        x.join_group(57, pfq::group_policy::shared);
+        y.join_group(57, pfq::group_policy::shared);
+
+        x.bind_group(57, traffic::rx(), -1);
+        x.set_group_computation(57, steer_flow);
+        x.balance_group(57, Q_BALANCE_PACKET);
+
+        x.enable();
+        y.enable();
+
+        std::vector<std::vector<char>> frames;
+        for(size_t f = 0; f < flows; f++)
+            frames.push_back(traffic::frame(static_cast<uint8_t>(f + 1), 17, static_cast<uint16_t>(1024 + f), 53));
+
+        auto total = [&](std::vector<size_t> const &n) {
+            size_t sum = 0;
+            for(size_t f = 1; f <= flows; f++)
+                sum += n[f];
+            return sum;
+        };
+
+        // x is not read: once its ring is above the high watermark it is skipped...
+
+        traffic::inject(frames);
+
+        auto ys = traffic::count(y);
+        auto xs = traffic::count(x);
+        auto dvrt = x.group_stats(57).dvrt;
+
+        Assert(total(xs), is_less_equal(slots));
+        Assert(total(xs) + total(ys), is_equal_to(flows * traffic::N));
+        Assert(dvrt, is_greater(0UL));
+
+        // ...and once drained, the flows return to the hash split
+
+        traffic::inject(frames, 10);
+
+        xs = traffic::count(x);
+        ys = traffic::count(y);
+
+        size_t on_x = 0;
+        for(size_t f = 1; f <= flows; f++)
+        {
+            AssertId(static_cast<int>(f), xs[f] + ys[f], is_equal_to(10UL));
+            AssertId(static_cast<int>(f), xs[f] == 0 || ys[f] == 0, is_true());
+            on_x += xs[f] ? 1 : 0;
+        }
+
+        Assert(on_x, is_greater(0UL));
+        Assert(on_x, is_less(flows));
+        Assert(x.group_stats(57).dvrt, is_equal_to(dvrt));
+    })
+;
+
+
+// the flattened program (fused, deduplicated and reordered filters) must
+// select the same packets as the tree walking engine
+//
+
+template <typename Comp>
+void check_equivalence(Comp comp, std::vector<size_t> const &expect = {})
+{
+    static int id;
+    id++;
+
+    const std::vector<std::vector<char>> frames =
+    {
+        traffic::frame(1, 17, 1024, 53),
+        traffic::frame(2, 17, 1024, 80),
+        traffic::frame(3,  6, 1024, 80),
+        traffic::frame(4,  6, 2000, 53),
+        traffic::frame(5,  1),
+        traffic::frame(6,  0),
+        traffic::frame(7, 17, 1024, 53, 10),
+        traffic::frame(8, 17, 53, 1024),
+    };
+
+    pfq::socket q(pfq::group_policy::undefined, 64, 8192);
+    q.join_group(64 - 2, pfq::group_policy::shared);
+    q.bind_group(64 - 2, traffic::rx(), -1);
+    q.set_group_computation(64 - 2, comp);
+    q.enable();
+
+    auto prev = traffic::lang_profile(true);
+
+    traffic::inject(frames);
+    auto tree = traffic::count(q);
+
+    traffic::lang_profile(false);
+
+    traffic::inject(frames);
+    auto flat = traffic::count(q);
+
+    // the filters reordered by the profiling counters...
+
+    q.optimize_group(64 - 2);
+
+    traffic::inject(frames);
+    auto opt = traffic::count(q);
+
+    traffic::lang_profile(prev);
+
+    AssertId(id, flat, is_equal_to(tree));
+    AssertId(id, opt,  is_equal_to(tree));
+
+    for(size_t tag = 0; tag < expect.size(); tag++)
+        AssertId(id * 256 + static_cast<int>(tag), tree[tag + 1], is_equal_to(expect[tag] ? traffic::N : 0UL));
+}
+
+
+auto e = Group("PFQ flattened program")
+
+    .Single("fusion", []
+    {
+        if (!traffic::enabled())
+            return;
+
+        check_equivalence(ip >> udp >> dst_port(53), {1, 0, 0, 0, 0, 0});
+        check_equivalence(udp >> src_port(1024) >> dst_port(53), {1, 0, 0, 0, 0, 0});
+        check_equivalence(filter(is_udp) >> port(53) >> flow);
+    })
+
+    .Single("dedupe", []
+    {
+        if (!traffic::enabled())
+            return;
+
+        check_equivalence(udp >> udp >> ip >> unit >> dst_port(53) >> dst_port(53), {1, 0, 0, 0, 0, 0});
+        check_equivalence(flow >> ip >> tcp, {0, 0, 1, 1, 0, 0, 0, 0});
+    })
+
+    .Single("disjoint_drop", []
+    {
+        if (!traffic::enabled())
+            return;
+
+        check_equivalence(udp >> tcp, {0, 0, 0, 0, 0, 0, 0, 0});
+        check_equivalence(flow >> icmp, {0, 0, 0, 0, 0, 0, 0, 0});
+    })
+
+    .Single("test_in_branches", []
+    {
+        if (!traffic::enabled())
+            return;
+
+        check_equivalence(conditional (is_tcp, port(80), udp >> dst_port(53)), {1, 0, 1, 0, 0, 0});
+        check_equivalence(when (has_port(53), ip >> udp >> drop) >> unless (is_ip, drop), {0, 1, 1, 0, 1, 0});
+        check_equivalence(vlan >> udp >> dst_port(53));
+    })
+;
+
+
+int main(int argc, char *argv[])
+{
+    return yats::run(argc, argv);
+}
@@ -592,7 +592,7 @@ try
         std::cout << "*** Warning: HugePages not mounted ***" << std::endl;
 
     unsigned long long sum, flows, old = 0;
-    pfq_stats sum_stats, old_stats = {0,0,0,0,0,0,0,0};
+    pfq_stats sum_stats, old_stats = {};
 
     signal(SIGINT, sighandler);
 
@@ -614,7 +614,7 @@ try
 
         sum = 0;
         flows = 0;
-        sum_stats = {0,0,0,0,0,0,0,0};
+        sum_stats = {};
 
         std::for_each(thread_ctx.begin(), thread_ctx.end(), [&](const thread::context *c) {
             sum += c->read();
@@ -325,7 +325,7 @@ namespace thread
         std::tuple<pfq_stats, uint64_t, uint64_t, uint64_t, uint64_t>
         stats() const
         {
-            pfq_stats ret = {0,0,0,0,0,0,0,0};
+            pfq_stats ret = {};
 
             ret += m_pfq.stats();
 
@@ -1153,7 +1153,7 @@ try
         t->detach();
     });
 
-    pfq_stats cur, prec = {0,0,0,0,0,0,0,0};
+    pfq_stats cur, prec = {};
 
     uint64_t sent, sent_ = 0;
     uint64_t band, band_ = 0;
@@ -1170,7 +1170,7 @@ try
     {
         std::this_thread::sleep_for(std::chrono::seconds(1));
 
-        cur = {0,0,0,0,0,0,0,0};
+        cur = {};
         sent = 0;
         band = 0;
         gros = 0;
@@ -1226,7 +1226,7 @@ try
     std::cout << "Shutting down sockets in 1 sec..." << std::endl;
     std::this_thread::sleep_for(std::chrono::seconds(1));
 
-    cur  = {0,0,0,0,0,0,0,0};
+    cur  = {};
     sent = 0;
 
     std::for_each(thread_ctx.begin(), thread_ctx.end(), [&](const thread::context *c)
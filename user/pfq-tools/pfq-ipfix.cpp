@@ -0,0 +1,396 @@
+/***************************************************************
+ *
+ * (C) 2011-16 - Nicola Bonelli <nicola@pfq.io>
+ *
+ ****************************************************************/
+
+#include <iostream>
+#include <sstream>
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <system_error>
+
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <pfq/pfq.hpp>
+#include <pfq/lang/lang.hpp>
+#include <pfq/lang/default.hpp>
+
+#include <more/pretty.hpp>
+
+using namespace more;
+using namespace pfq;
+using namespace pfq::lang;
+
+
+//
+// reference consumer of flow_export: the flow records of the group are
+// written in IPFIX (RFC 7011) to a file (RFC 5655) or to a UDP collector.
+//
+
+namespace opt
+{
+    std::string dev;
+    std::string output;
+    std::string collector;
+    int gid = 42;
+    uint32_t idle = 15000;
+    uint32_t active = 60000;
+    uint32_t domain = 0;
+    size_t slots = 8192;
+    bool deliver = false;
+    std::atomic_bool stop;
+}
+
+
+void usage(std::string name)
+{
+    throw std::runtime_error
+    (
+        "usage: " + std::move(name) + " [OPTIONS]\n\n"
+        " -i --interface DEV                    Export the flows of the given device\n"
+        " -g --group INT                        Group id (default 42)\n"
+        " -d --idle INT                         Idle timeout, msec (default 15000)\n"
+        " -a --active INT                       Active timeout, msec (default 60000)\n"
+        " -q --slots INT                        Flow record slots (default 8192)\n"
+        " -D --domain INT                       Observation domain id (default 0)\n"
+        " -w --write FILE                       Write the IPFIX messages to file (default stdout)\n"
+        " -c --collector HOST:PORT              Send the IPFIX messages to a UDP collector\n"
+        " -p --packets                          Deliver the packets to the socket too (default: records only)\n"
+        " -h --help                             Display this help\n"
+    );
+}
+
+
+namespace ipfix
+{
+    enum : uint16_t
+    {
+        version         = 10,
+        template_set    = 2,
+        template_ipv4   = 256,
+        template_ipv6   = 257
+    };
+
+    const size_t max_message = 1400;    // fits a UDP datagram
+
+    // information elements (id, length) of the data records, addresses excluded
+    //
+
+    const uint16_t common_fields[][2] =
+    {
+        {   7, 2 },     // sourceTransportPort
+        {  11, 2 },     // destinationTransportPort
+        {   4, 1 },     // protocolIdentifier
+        {   6, 2 },     // tcpControlBits
+        { 136, 1 },     // flowEndReason
+        {  10, 4 },     // ingressInterface
+        {   2, 8 },     // packetDeltaCount
+        {   1, 8 },     // octetDeltaCount
+        { 152, 8 },     // flowStartMilliseconds
+        { 153, 8 }      // flowEndMilliseconds
+    };
+
+
+    struct message
+    {
+        std::vector<uint8_t> buf;
+        size_t set = 0;                 // offset of the open set (0 = none)
+        uint16_t set_id = 0;
+
+        void put8 (uint8_t v)  { buf.push_back(v); }
+        void put16(uint16_t v) { put8(static_cast<uint8_t>(v >> 8)); put8(static_cast<uint8_t>(v)); }
+        void put32(uint32_t v) { put16(static_cast<uint16_t>(v >> 16)); put16(static_cast<uint16_t>(v)); }
+        void put64(uint64_t v) { put32(static_cast<uint32_t>(v >> 32)); put32(static_cast<uint32_t>(v)); }
+        void put(void const *p, size_t n) { auto b = static_cast<uint8_t const *>(p); buf.insert(buf.end(), b, b + n); }
+
+        void patch16(size_t off, uint16_t v)
+        {
+            buf[off] = static_cast<uint8_t>(v >> 8);
+            buf[off+1] = static_cast<uint8_t>(v);
+        }
+
+        void begin(uint32_t sequence)
+        {
+            buf.clear();
+            set = 0;
+            put16(version);
+            put16(0);                   // length
+            put32(static_cast<uint32_t>(time(nullptr)));
+            put32(sequence);
+            put32(opt::domain);
+        }
+
+        void open_set(uint16_t id)
+        {
+            if (set && set_id == id)
+                return;
+            close_set();
+            set = buf.size();
+            set_id = id;
+            put16(id);
+            put16(0);
+        }
+
+        void close_set()
+        {
+            if (set)
+                patch16(set + 2, static_cast<uint16_t>(buf.size() - set));
+            set = 0;
+        }
+
+        bool empty() const
+        {
+            return buf.size() <= 16;    // message header only
+        }
+
+        std::vector<uint8_t> const &end()
+        {
+            close_set();
+            patch16(2, static_cast<uint16_t>(buf.size()));
+            return buf;
+        }
+    };
+
+
+    void add_templates(message &m)
+    {
+        m.open_set(template_set);
+
+        for(auto v6 : { false, true })
+        {
+            m.put16(v6 ? template_ipv6 : template_ipv4);
+            m.put16(2 + sizeof(common_fields)/sizeof(common_fields[0]));
+
+            m.put16(v6 ? 27 : 8);       // sourceIPv6Address/sourceIPv4Address
+            m.put16(v6 ? 16 : 4);
+            m.put16(v6 ? 28 : 12);      // destinationIPv6Address/destinationIPv4Address
+            m.put16(v6 ? 16 : 4);
+
+            for(auto const &f : common_fields)
+            {
+                m.put16(f[0]);
+                m.put16(f[1]);
+            }
+        }
+
+        m.close_set();
+    }
+
+
+    void add_record(message &m, pfq_flow_record const &r)
+    {
+        auto v6 = r.ipver == 6;
+        m.open_set(v6 ? template_ipv6 : template_ipv4);
+
+        m.put(r.saddr, v6 ? 16 : 4);
+        m.put(r.daddr, v6 ? 16 : 4);
+        m.put(&r.sport, 2);             // network byte order
+        m.put(&r.dport, 2);
+        m.put8(r.proto);
+        m.put16(r.tcp_flags);
+        m.put8(r.reason);
+        m.put32(static_cast<uint32_t>(r.ifindex));
+        m.put64(r.packets);
+        m.put64(r.bytes);
+        m.put64(r.first / 1000000);
+        m.put64(r.last / 1000000);
+    }
+}
+
+
+struct exporter
+{
+    FILE *file = nullptr;
+    int fd = -1;
+    sockaddr_storage addr;
+    socklen_t addr_len = 0;
+
+    exporter()
+    {
+        if (!opt::collector.empty())
+        {
+            auto colon = opt::collector.rfind(':');
+            if (colon == std::string::npos)
+                throw std::runtime_error("collector: HOST:PORT expected");
+
+            addrinfo hints = {}, *res;
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_DGRAM;
+
+            auto host = opt::collector.substr(0, colon), port = opt::collector.substr(colon+1);
+            if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0)
+                throw std::runtime_error("collector: " + opt::collector + " not found");
+
+            fd = ::socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+            memcpy(&addr, res->ai_addr, res->ai_addrlen);
+            addr_len = res->ai_addrlen;
+            freeaddrinfo(res);
+
+            if (fd == -1)
+                throw std::system_error(errno, std::generic_category(), "collector socket");
+        }
+        else
+        {
+            file = opt::output.empty() ? stdout : fopen(opt::output.c_str(), "wb");
+            if (!file)
+                throw std::system_error(errno, std::generic_category(), opt::output);
+        }
+    }
+
+    ~exporter()
+    {
+        if (fd != -1)
+            ::close(fd);
+        if (file && file != stdout)
+            fclose(file);
+        else if (file)
+            fflush(file);
+    }
+
+    void send(std::vector<uint8_t> const &msg)
+    {
+        if (fd != -1) {
+            if (sendto(fd, msg.data(), msg.size(), 0, reinterpret_cast<sockaddr *>(&addr), addr_len) == -1)
+                std::cerr << "collector: " << strerror(errno) << std::endl;
+        }
+        else if (fwrite(msg.data(), 1, msg.size(), file) != msg.size())
+            throw std::system_error(errno, std::generic_category(), "write");
+    }
+};
+
+
+void sighandler(int)
+{
+    opt::stop.store(true, std::memory_order_relaxed);
+}
+
+
+int
+main(int argc, char *argv[])
+try
+{
+    signal(SIGINT, sighandler);
+
+    for(int i = 1; i < argc; ++i)
+    {
+        auto param = [&]() -> std::string {
+            if (++i == argc)
+                throw std::runtime_error(std::string(argv[i-1]) + ": argument missing");
+            return argv[i];
+        };
+
+        if (any_strcmp(argv[i], "-i", "--interface")) { opt::dev = param(); continue; }
+        if (any_strcmp(argv[i], "-g", "--group"))     { opt::gid = std::stoi(param()); continue; }
+        if (any_strcmp(argv[i], "-d", "--idle"))      { opt::idle = static_cast<uint32_t>(std::stoul(param())); continue; }
+        if (any_strcmp(argv[i], "-a", "--active"))    { opt::active = static_cast<uint32_t>(std::stoul(param())); continue; }
+        if (any_strcmp(argv[i], "-q", "--slots"))     { opt::slots = std::stoul(param()); continue; }
+        if (any_strcmp(argv[i], "-D", "--domain"))    { opt::domain = static_cast<uint32_t>(std::stoul(param())); continue; }
+        if (any_strcmp(argv[i], "-w", "--write"))     { opt::output = param(); continue; }
+        if (any_strcmp(argv[i], "-c", "--collector")) { opt::collector = param(); continue; }
+
+        if (any_strcmp(argv[i], "-p", "--packets"))
+        {
+            opt::deliver = true;
+            continue;
+        }
+
+        if (any_strcmp(argv[i], "-h", "-?", "--help"))
+            usage(argv[0]);
+
+        throw std::runtime_error(std::string(argv[i]) + " unknown option!");
+    }
+
+    if (opt::dev.empty())
+        usage(argv[0]);
+
+    exporter out;
+
+    pfq::socket q(group_policy::undefined, 64, 1024);
+
+    q.flow_slots(opt::slots);
+    q.join_group(opt::gid, group_policy::shared);
+    q.bind_group(opt::gid, opt::dev.c_str(), -1);
+
+    if (opt::deliver)
+        q.set_group_computation(opt::gid, flow_export(opt::idle, opt::active));
+    else
+        q.set_group_computation(opt::gid, flow_export(opt::idle, opt::active) >> drop);
+
+    q.enable();
+
+    std::cerr << "exporting the flows of " << opt::dev << " (idle " << opt::idle << " msec, active "
+              << opt::active << " msec) to " << (!opt::collector.empty() ? opt::collector : !opt::output.empty() ? opt::output : "stdout") << std::endl;
+
+    // templates are sent with the first message and then every 100 messages
+    // (UDP collectors may join at any time)...
+    //
+
+    ipfix::message msg;
+    uint32_t sequence = 0;
+    size_t messages = 0;
+
+    auto flush = [&] {
+        if (!msg.empty())
+        {
+            out.send(msg.end());
+            messages++;
+        }
+        msg.begin(sequence);
+        if (messages % 100 == 0)
+            ipfix::add_templates(msg);
+    };
+
+    msg.begin(sequence);
+    ipfix::add_templates(msg);
+
+    auto last_flush = std::chrono::steady_clock::now();
+
+    while (!opt::stop.load(std::memory_order_relaxed))
+    {
+        if (opt::deliver)
+            q.read(0);
+
+        auto many = q.read_flows(100000);
+
+        for(auto it = std::begin(many), it_e = std::end(many); it != it_e; ++it)
+        {
+            while (!it.ready())
+                std::this_thread::yield();
+
+            auto rec = reinterpret_cast<pfq_flow_record const *>(it.data());
+
+            if (msg.buf.size() + 96 > ipfix::max_message)
+                flush();
+
+            ipfix::add_record(msg, *rec);
+            sequence++;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_flush > std::chrono::seconds(1))
+        {
+            flush();
+            last_flush = now;
+        }
+    }
+
+    flush();
+
+    auto s = q.stats();
+    std::cerr << "flow records exported: " << s.fexp << ", lost: " << s.flst << std::endl;
+}
+catch(std::exception &e)
+{
+    std::cerr << e.what() << std::endl;
+}
@@ -0,0 +1,183 @@
+/***************************************************************
+ *
+ * (C) 2011-16 - Nicola Bonelli <nicola@pfq.io>
+ *
+ ****************************************************************/
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+
+#include <thread>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <algorithm>
+
+#include <pfq/pfq.hpp>
+
+#include <more/vt100.hpp>
+#include <more/pretty.hpp>
+
+using namespace more;
+using namespace pfq;
+
+
+namespace opt
+{
+    int gid = 0;
+    int interval = 1;
+    bool once = false;
+    bool optimize = false;
+    std::atomic_bool stop;
+}
+
+
+void usage(std::string name)
+{
+    throw std::runtime_error
+    (
+        "usage: " + std::move(name) + " [OPTIONS]\n\n"
+        " -g --group INT                        Group id (default 0)\n"
+        " -i --interval INT                     Refresh interval in seconds (default 1)\n"
+        " -1 --once                             Print the listing once and exit\n"
+        " -O --optimize                         Reorder the filters of the computation by the counters\n"
+        " -h --help                             Display this help\n\n"
+        "note: load the pfq module with lang_profile=1 to collect the counters.\n"
+    );
+}
+
+
+// annotated listing of the group computation: one line per function,
+// with the rate of the last interval and the totals.
+//
+
+void
+listing(std::vector<pfq_lang_node_stats> const &now, std::vector<pfq_lang_node_stats> const &prev, int interval)
+{
+    std::cout << std::left
+              << std::setw(5)  << "#"
+              << std::setw(24) << "function"
+              << std::setw(8)  << ">->"
+              << std::right
+              << std::setw(14) << "calls/sec"
+              << std::setw(16) << "calls"
+              << std::setw(16) << "pass"
+              << std::setw(16) << "drop"
+              << std::setw(8)  << "drop%"
+              << std::setw(12) << "cycles"
+              << std::endl;
+
+    for(size_t n = 0; n < now.size(); n++)
+    {
+        auto const &s = now[n];
+
+        auto delta = n < prev.size() && std::string(prev[n].symbol) == s.symbol ? s.invoke - prev[n].invoke : 0;
+
+        std::cout << std::left
+                  << std::setw(5)  << n
+                  << std::setw(24) << s.symbol
+                  << std::setw(8)  << (s.next == -1 ? std::string("-") : std::to_string(s.next))
+                  << std::right
+                  << std::setw(14) << delta/static_cast<unsigned long>(interval)
+                  << std::setw(16) << s.invoke
+                  << std::setw(16) << s.pass
+                  << std::setw(16) << s.drop
+                  << std::setw(8)  << std::fixed << std::setprecision(1) << (s.invoke ? 100.0 * static_cast<double>(s.drop)/static_cast<double>(s.invoke) : 0.0)
+                  << std::setw(12) << (s.samples ? s.cycles/s.samples : 0)
+                  << std::endl;
+    }
+}
+
+
+void sighandler(int)
+{
+    opt::stop.store(true, std::memory_order_relaxed);
+}
+
+
+int
+main(int argc, char *argv[])
+try
+{
+    signal(SIGINT, sighandler);
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if (any_strcmp(argv[i], "-g", "--group"))
+        {
+            if (++i == argc)
+                throw std::runtime_error("group id missing");
+
+            opt::gid = std::atoi(argv[i]);
+            continue;
+        }
+
+        if (any_strcmp(argv[i], "-i", "--interval"))
+        {
+            if (++i == argc)
+                throw std::runtime_error("interval missing");
+
+            opt::interval = std::max(1, std::atoi(argv[i]));
+            continue;
+        }
+
+        if (any_strcmp(argv[i], "-1", "--once"))
+        {
+            opt::once = true;
+            continue;
+        }
+
+        if (any_strcmp(argv[i], "-O", "--optimize"))
+        {
+            opt::optimize = true;
+            continue;
+        }
+
+        if (any_strcmp(argv[i], "-h", "-?", "--help"))
+            usage(argv[0]);
+
+        throw std::runtime_error(std::string(argv[i]) + " unknown option!");
+    }
+
+    pfq::socket q(group_policy::undefined, 64, 1024);
+
+    if (opt::optimize)
+    {
+        q.optimize_group(opt::gid);
+        std::cout << "group " << opt::gid << ": computation optimized." << std::endl;
+    }
+
+    std::vector<pfq_lang_node_stats> prev;
+
+    for(;;)
+    {
+        auto now = q.group_profile(opt::gid);
+
+        if (!opt::once)
+            std::cout << vt100::HOME << vt100::EDOWN;
+
+        std::cout << "pfq-lang profile: group " << opt::gid << " (" << now.size() << " functions)\n" << std::endl;
+
+        if (now.empty())
+            std::cout << "no computation." << std::endl;
+        else
+            listing(now, prev, opt::interval);
+
+        if (opt::once)
+            break;
+
+        prev = std::move(now);
+
+        std::this_thread::sleep_for(std::chrono::seconds(opt::interval));
+        if (opt::stop.load(std::memory_order_relaxed))
+            break;
+    }
+}
+catch(std::exception &e)
+{
+    std::cerr << e.what() << std::endl;
+}
@@ -0,0 +1,215 @@
+/***************************************************************
+ *
+ * (C) 2011-16 - Nicola Bonelli <nicola@pfq.io>
+ *
+ ****************************************************************/
+
+#include <iostream>
+#include <sstream>
+
+#include <string>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <system_error>
+
+#include <pfq/pfq.hpp>
+
+#include <more/pretty.hpp>
+
+using namespace more;
+using namespace pfq;
+
+
+//
+// flight recorder: the last packets of the group are kept in the recorder
+// of this socket. When the recorder is triggered (SIGUSR1, -t, or the
+// pfq-lang function recorder_trigger) and frozen, it is dumped to a pcap file.
+//
+
+namespace opt
+{
+    std::string dev;
+    std::string output = "recorder.pcap";
+    int gid = 42;
+    int post = 0;
+    size_t slots = 65536;
+    size_t caplen = 1514;
+    bool trigger = false;
+    bool loop = false;
+    std::atomic_bool stop;
+    std::atomic_bool signal;
+}
+
+
+void usage(std::string name)
+{
+    throw std::runtime_error
+    (
+        "usage: " + std::move(name) + " [OPTIONS]\n\n"
+        " -g --group INT                        Group id (default 42)\n"
+        " -i --interface DEV                    Bind the group to the given device\n"
+        " -q --slots INT                        Recorder slots (default 65536)\n"
+        " -c --caplen INT                       Capture length (default 1514)\n"
+        " -p --post INT                         Packets recorded after the trigger (default 0)\n"
+        " -w --write FILE                       Dump to the given pcap file (default recorder.pcap)\n"
+        " -t --trigger                          Trigger the recorder immediately\n"
+        " -l --loop                             Re-arm the recorder after each dump (FILE.n)\n"
+        " -h --help                             Display this help\n\n"
+        "note: send SIGUSR1 to trigger the recorder.\n"
+    );
+}
+
+
+namespace pcap
+{
+    struct file_header
+    {
+        uint32_t magic;
+        uint16_t version_major;
+        uint16_t version_minor;
+        int32_t  thiszone;
+        uint32_t sigfigs;
+        uint32_t snaplen;
+        uint32_t linktype;
+    };
+
+    struct packet_header
+    {
+        uint32_t sec;
+        uint32_t nsec;
+        uint32_t caplen;
+        uint32_t len;
+    };
+
+    const uint32_t magic_nsec = 0xa1b23c4d;     // nanosecond resolution
+    const uint32_t linktype_ethernet = 1;
+}
+
+
+size_t
+dump(pfq::socket &q, std::string const &name)
+{
+    auto file = fopen(name.c_str(), "wb");
+    if (!file)
+        throw std::system_error(errno, std::generic_category(), name);
+
+    pcap::file_header fh = { pcap::magic_nsec, 2, 4, 0, 0, static_cast<uint32_t>(opt::caplen), pcap::linktype_ethernet };
+    fwrite(&fh, sizeof(fh), 1, file);
+
+    auto n = q.recorder_dispatch([](char *user, const pfq_pkthdr *h, const char *data)
+    {
+        auto f = reinterpret_cast<FILE *>(user);
+        pcap::packet_header ph = { h->tstamp.tv.sec, h->tstamp.tv.nsec, h->caplen, h->len };
+        fwrite(&ph, sizeof(ph), 1, f);
+        fwrite(data, 1, h->caplen, f);
+
+    }, reinterpret_cast<char *>(file));
+
+    fclose(file);
+    return n;
+}
+
+
+void sighandler(int sig)
+{
+    if (sig == SIGUSR1)
+        opt::signal.store(true, std::memory_order_relaxed);
+    else
+        opt::stop.store(true, std::memory_order_relaxed);
+}
+
+
+int
+main(int argc, char *argv[])
+try
+{
+    signal(SIGINT, sighandler);
+    signal(SIGUSR1, sighandler);
+
+    for(int i = 1; i < argc; ++i)
+    {
+        auto param = [&]() -> std::string {
+            if (++i == argc)
+                throw std::runtime_error(std::string(argv[i-1]) + ": argument missing");
+            return argv[i];
+        };
+
+        if (any_strcmp(argv[i], "-g", "--group"))     { opt::gid = std::stoi(param()); continue; }
+        if (any_strcmp(argv[i], "-i", "--interface")) { opt::dev = param(); continue; }
+        if (any_strcmp(argv[i], "-q", "--slots"))     { opt::slots = std::stoul(param()); continue; }
+        if (any_strcmp(argv[i], "-c", "--caplen"))    { opt::caplen = std::stoul(param()); continue; }
+        if (any_strcmp(argv[i], "-p", "--post"))      { opt::post = std::stoi(param()); continue; }
+        if (any_strcmp(argv[i], "-w", "--write"))     { opt::output = param(); continue; }
+
+        if (any_strcmp(argv[i], "-t", "--trigger"))
+        {
+            opt::trigger = true;
+            continue;
+        }
+
+        if (any_strcmp(argv[i], "-l", "--loop"))
+        {
+            opt::loop = true;
+            continue;
+        }
+
+        if (any_strcmp(argv[i], "-h", "-?", "--help"))
+            usage(argv[0]);
+
+        throw std::runtime_error(std::string(argv[i]) + " unknown option!");
+    }
+
+    // the socket joins the group in the management class: packets are
+    // not steered to it, but copied to its recorder...
+    //
+
+    pfq::socket q(group_policy::undefined, opt::caplen, 64);
+
+    q.recorder_slots(opt::slots);
+    q.join_group(opt::gid, group_policy::shared, class_mask::control);
+
+    if (!opt::dev.empty())
+        q.bind_group(opt::gid, opt::dev.c_str(), -1);
+
+    q.enable();
+    q.group_recorder(opt::gid, opt::post);
+
+    std::cerr << "recording group " << opt::gid << " (" << opt::slots << " slots, post-trigger "
+              << opt::post << " packets)..." << std::endl;
+
+    if (opt::trigger)
+        q.group_recorder_trigger(opt::gid);
+
+    for(size_t round = 0; !opt::stop.load(std::memory_order_relaxed); )
+    {
+        if (opt::signal.exchange(false, std::memory_order_relaxed))
+            q.group_recorder_trigger(opt::gid);
+
+        if (q.recorder_state() != Q_RECORDER_FROZEN)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+
+        auto name = opt::loop ? opt::output + "." + std::to_string(round++) : opt::output;
+        auto n = dump(q, name);
+
+        std::cerr << "recorder frozen: " << n << " packets dumped to " << name << std::endl;
+
+        if (!opt::loop)
+            break;
+
+        q.group_recorder(opt::gid, opt::post);
+    }
+
+    q.group_recorder(opt::gid, -1);
+}
+catch(std::exception &e)
+{
+    std::cerr << e.what() << std::endl;
+}
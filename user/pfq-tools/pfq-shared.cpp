@@ -0,0 +1,262 @@
+/***************************************************************
+ *
+ * (C) 2011-16 - Nicola Bonelli <nicola@pfq.io>
+ *
+ ****************************************************************/
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+
+#include <thread>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <algorithm>
+
+#include <pfq/pfq.hpp>
+#include <pfq/lang/lang.hpp>
+#include <pfq/lang/default.hpp>
+
+#include <more/vt100.hpp>
+#include <more/pretty.hpp>
+
+using namespace more;
+using namespace pfq;
+using namespace pfq::lang;
+
+
+//
+// benchmark of the shared multi-consumer queue (claim/release) against the
+// per-socket steering, with unbalanced consumers: consumer 0 spends
+// 'unbalance' times the work of the others on each packet.
+//
+
+namespace opt
+{
+    std::string dev;
+    int gid = 42;
+    size_t consumers = 4;
+    size_t caplen = 64;
+    size_t slots = 4096;
+    size_t batch = 32;
+    size_t work = 100;
+    size_t unbalance = 4;
+    size_t seconds = 10;
+    bool shared = false;
+    std::atomic_bool stop;
+}
+
+
+void usage(std::string name)
+{
+    throw std::runtime_error
+    (
+        "usage: " + std::move(name) + " [OPTIONS]\n\n"
+        " -i --interface DEV                    Capture from the given device\n"
+        " -g --group INT                        Group id (default 42)\n"
+        " -n --consumers INT                    Number of consumer threads (default 4)\n"
+        " -s --shared                           Consumers claim batches from a single shared queue\n"
+        "                                       (default: one socket per consumer, steered by flow)\n"
+        " -b --batch INT                        Max packets per claimed batch (default 32)\n"
+        " -w --work INT                         Per-packet work units (default 100)\n"
+        " -u --unbalance INT                    Work factor of the slow consumer 0 (default 4)\n"
+        " -c --caplen INT                       Capture length (default 64)\n"
+        " -q --slots INT                        Rx queue slots (default 4096)\n"
+        " -t --seconds INT                      Duration of the test (default 10)\n"
+        " -h --help                             Display this help\n"
+    );
+}
+
+
+static inline uint32_t
+spin(pfq_pkthdr const &h, size_t units)
+{
+    uint32_t x = h.len;
+    for(size_t n = 0; n < units; n++)
+        x = x * 1664525 + 1013904223;
+    return x;
+}
+
+
+struct consumer
+{
+    std::atomic_ulong packets;
+    uint32_t sink;
+
+    consumer()
+    : packets(0), sink(0)
+    {}
+};
+
+
+template <typename Read, typename Release>
+void process(consumer &c, size_t units, Read read, Release release)
+{
+    while (!opt::stop.load(std::memory_order_relaxed))
+    {
+        auto many = read();
+
+        for(auto it = std::begin(many), it_e = std::end(many); it != it_e; ++it)
+        {
+            while (!it.ready())
+                std::this_thread::yield();
+
+            c.sink += spin(*it, units);
+        }
+
+        release(many);
+
+        c.packets.fetch_add(many.size(), std::memory_order_relaxed);
+    }
+}
+
+
+void sighandler(int)
+{
+    opt::stop.store(true, std::memory_order_relaxed);
+}
+
+
+int
+main(int argc, char *argv[])
+try
+{
+    signal(SIGINT, sighandler);
+
+    for(int i = 1; i < argc; ++i)
+    {
+        auto param = [&]() -> size_t {
+            if (++i == argc)
+                throw std::runtime_error(std::string(argv[i-1]) + ": argument missing");
+            return static_cast<size_t>(std::atoi(argv[i]));
+        };
+
+        if (any_strcmp(argv[i], "-i", "--interface"))
+        {
+            if (++i == argc)
+                throw std::runtime_error("interface missing");
+            opt::dev = argv[i];
+            continue;
+        }
+
+        if (any_strcmp(argv[i], "-g", "--group"))     { opt::gid = static_cast<int>(param()); continue; }
+        if (any_strcmp(argv[i], "-n", "--consumers")) { opt::consumers = std::max<size_t>(1, param()); continue; }
+        if (any_strcmp(argv[i], "-b", "--batch"))     { opt::batch = param(); continue; }
+        if (any_strcmp(argv[i], "-w", "--work"))      { opt::work = param(); continue; }
+        if (any_strcmp(argv[i], "-u", "--unbalance")) { opt::unbalance = std::max<size_t>(1, param()); continue; }
+        if (any_strcmp(argv[i], "-c", "--caplen"))    { opt::caplen = param(); continue; }
+        if (any_strcmp(argv[i], "-q", "--slots"))     { opt::slots = param(); continue; }
+        if (any_strcmp(argv[i], "-t", "--seconds"))   { opt::seconds = param(); continue; }
+
+        if (any_strcmp(argv[i], "-s", "--shared"))
+        {
+            opt::shared = true;
+            continue;
+        }
+
+        if (any_strcmp(argv[i], "-h", "-?", "--help"))
+            usage(argv[0]);
+
+        throw std::runtime_error(std::string(argv[i]) + " unknown option!");
+    }
+
+    if (opt::dev.empty())
+        usage(argv[0]);
+
+    // open the sockets: a single one shared among the consumers, or one per consumer...
+    //
+
+    std::vector<std::unique_ptr<pfq::socket>> sockets;
+
+    for(size_t n = 0; n < (opt::shared ? 1 : opt::consumers); n++)
+    {
+        sockets.emplace_back(new pfq::socket(group_policy::undefined, opt::caplen, opt::slots));
+
+        auto &q = *sockets.back();
+
+        q.join_group(opt::gid, group_policy::shared);
+        q.timestamping_enable(false);
+
+        if (n == 0)
+        {
+            q.bind_group(opt::gid, opt::dev.c_str(), -1);
+            if (!opt::shared)
+                q.set_group_computation(opt::gid, steer_flow);
+        }
+
+        q.enable();
+    }
+
+    std::cout << (opt::shared ? "shared queue" : "per-socket steering") << ": "
+              << opt::consumers << " consumers, work " << opt::work
+              << ", slow consumer x" << opt::unbalance << std::endl;
+
+    // start the consumers...
+    //
+
+    std::vector<consumer> stats(opt::consumers);
+    std::vector<std::thread> threads;
+
+    for(size_t n = 0; n < opt::consumers; n++)
+    {
+        auto units = n == 0 ? opt::work * opt::unbalance : opt::work;
+
+        if (opt::shared)
+        {
+            auto &q = *sockets.front();
+            threads.emplace_back([&q, &stats, n, units] {
+                process(stats[n], units, [&] { return q.claim(opt::batch, 10000); },
+                                         [&] (net_queue const &b) { q.release(b); });
+            });
+        }
+        else
+        {
+            auto &q = *sockets[n];
+            threads.emplace_back([&q, &stats, n, units] {
+                process(stats[n], units, [&] { return q.read(10000); },
+                                         [&] (net_queue const &) { });
+            });
+        }
+    }
+
+    // report once per second...
+    //
+
+    std::vector<unsigned long> prev(opt::consumers, 0);
+
+    for(size_t sec = 0; sec < opt::seconds && !opt::stop.load(std::memory_order_relaxed); sec++)
+    {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        pfq_stats tot = {};
+        for(auto &q : sockets)
+            tot += q->stats();
+
+        unsigned long rate = 0;
+
+        std::cout << std::setw(4) << sec << ": ";
+        for(size_t n = 0; n < opt::consumers; n++)
+        {
+            auto now = stats[n].packets.load(std::memory_order_relaxed);
+            std::cout << pretty_number(now - prev[n]) << ' ';
+            rate += now - prev[n];
+            prev[n] = now;
+        }
+
+        std::cout << "| total: " << pretty_number(rate) << " pps, recv: " << tot.recv << " lost: " << tot.lost << std::endl;
+    }
+
+    opt::stop.store(true, std::memory_order_relaxed);
+
+    for(auto &t : threads)
+        t.join();
+}
+catch(std::exception &e)
+{
+    std::cerr << e.what() << std::endl;
+}
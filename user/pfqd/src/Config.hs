@@ -1,12 +1,20 @@
+{-# LANGUAGE OverloadedStrings #-}
+
 module Config where
 
 import qualified Network.PFQ as Q
 import Network.PFQ.Lang
 
+import Control.Applicative
+import Data.Aeson
+import Data.Aeson.Types (Parser)
 import Data.List
 import Data.List.Split
 import Data.Monoid
 
+import qualified Data.ByteString.Lazy.Char8 as BL
+import qualified Data.Text as T
+
 -- |NetDevice data type.
 
 data NetDevice =  NetDevice
@@ -35,7 +43,7 @@ dev str
 -- | Group policy
 
 data Policy = Restricted | Shared
-                deriving (Show, Read)
+                deriving (Eq, Show, Read)
 
 -- | Group data type.
 
@@ -46,3 +54,59 @@ data Group = Group
             ,   output    :: [NetDevice]
             ,   function  :: Function (Qbuff -> Action Qbuff)
             }
+
+
+-- | Runtime program of a group: pfq-lang source text or JSON description
+-- ([FunctionDescr]), loaded without rebuilding the daemon.
+
+data Program = Source String
+             | Descr  String
+                deriving (Eq, Show)
+
+
+-- | Runtime group configuration (live reconfigurable).
+
+data GroupConfig = GroupConfig
+            {   cfgPolicy  :: Policy
+            ,   cfgGid     :: Int
+            ,   cfgInput   :: [NetDevice]
+            ,   cfgOutput  :: [NetDevice]
+            ,   cfgProgram :: Program
+            }
+            deriving (Eq, Show)
+
+
+instance FromJSON Policy where
+    parseJSON = withText "Policy" $ \p -> case T.toLower p of
+        "restricted" -> return Restricted
+        "shared"     -> return Shared
+        _            -> fail $ "unknown policy " ++ T.unpack p
+
+
+instance FromJSON NetDevice where
+    parseJSON (String str) = return $ dev (T.unpack str)
+    parseJSON (Object o)   = NetDevice <$> o .:  "dev"
+                                       <*> o .:? "queue"  .!= Q.getConstant Q.any_queue
+                                       <*> o .:? "weight" .!= 1
+                                       <*> (maybe Q.class_default (Q.ClassMask . fromInteger) <$> o .:? "class")
+    parseJSON _            = empty
+
+
+-- | Group in JSON format:
+--
+-- { "policy": "restricted", "gid": 1, "input": ["eth0.1"], "output": [{"dev": "eth2", "weight": 2}],
+--   "program": "ip >-> steer_flow" }
+--
+-- The program can be given as pfq-lang source ("program") or as a JSON computation ("computation").
+
+instance FromJSON GroupConfig where
+    parseJSON = withObject "Group" $ \o -> GroupConfig
+                    <$> o .:? "policy" .!= Restricted
+                    <*> o .:  "gid"
+                    <*> o .:? "input"  .!= []
+                    <*> o .:? "output" .!= []
+                    <*> (Source <$> o .: "program" <|> Descr . BL.unpack . encode <$> (o .: "computation" :: Parser Value))
+
+
+loadConfig :: FilePath -> IO (Either String [GroupConfig])
+loadConfig file = eitherDecode <$> BL.readFile file
@@ -19,12 +19,19 @@
 --  The full GNU General Public License is included in this distribution in
 --  the file called "COPYING".
 
+{-# LANGUAGE TupleSections #-}
+
 module Daemon where
 
 import Control.Concurrent
+import Control.Exception as E
 import Control.Monad
+import Data.IORef
 import Data.List
 import Data.List.Split
+import Data.Time.Clock
+
+import qualified Data.Map as M
 
 import System.Log.Logger
 import System.Directory
@@ -92,3 +99,139 @@ runCompiler :: IO (ExitCode, String, String)
 runCompiler = readProcessWithExitCode "ghc" ["--make", "Main", "-o", "pfqd", "-lpfq", "-XOverloadedStrings"] ""
 
 
+-- Live reconfiguration
+--
+-- The configuration (JSON) is reloaded at runtime; the new groups are diffed
+-- against the running ones and only the differences are applied in place:
+-- program swap, bind/unbind of changed inputs, open/close of changed egress.
+
+
+data GroupState = GroupState
+    {   gsConfig :: GroupConfig
+    ,   gsEgress :: [(NetDevice, PfqHandle)]
+    }
+
+
+type DaemonState = M.Map Int GroupState
+
+
+isLiveConfig :: FilePath -> Bool
+isLiveConfig = (== ".json") . takeExtension
+
+
+liveDaemon :: Options -> PfqHandlePtr -> IO ()
+liveDaemon opts ctrl = do
+    state <- newIORef M.empty
+    mtime <- newIORef Nothing
+    forever $ do
+        E.handle (\e -> errorM "daemon" (show (e :: SomeException))) $ do
+            t <- getModificationTime (config_file opts)
+            t' <- readIORef mtime
+            when (Just t /= t') $ do
+                writeIORef mtime (Just t)
+                loadConfig (config_file opts) >>= either
+                    (\msg -> errorM "daemon" ("Configuration error: " ++ msg))
+                    (reconfigure ctrl state)
+        threadDelay 1000000
+
+
+reconfigure :: PfqHandlePtr -> IORef DaemonState -> [GroupConfig] -> IO ()
+reconfigure ctrl state cfg = do
+    old <- readIORef state
+    let new = M.fromList $ map (\g -> (cfgGid g, g)) cfg
+    infoM "daemon" $ "Applying configuration for " ++ show (M.size new) ++ " group(s)..."
+
+    forM_ (M.elems (old `M.difference` new)) $ \gs ->
+        tryGroup (cfgGid $ gsConfig gs) (removeGroup ctrl gs)
+
+    groups <- forM (M.toList new) $ \(g, conf) ->
+        fmap (g,) <$> case M.lookup g old of
+            Nothing -> tryGroup g (addGroup ctrl conf)
+            Just gs | gsConfig gs == conf -> return (Just gs)
+                    | cfgPolicy (gsConfig gs) /= cfgPolicy conf -> tryGroup g (removeGroup ctrl gs >> addGroup ctrl conf)
+                    | otherwise -> tryGroup g (updateGroup ctrl gs conf)
+
+    writeIORef state $ M.union (M.fromList [ x | Just x <- groups ]) (old `M.intersection` new)
+  where tryGroup g action = (Just <$> action) `E.catch` \e -> do
+            errorM "daemon" ("    group " ++ show g ++ ": " ++ show (e :: SomeException))
+            return Nothing
+
+
+addGroup :: PfqHandlePtr -> GroupConfig -> IO GroupState
+addGroup ctrl conf@(GroupConfig pol gid ins outs prog) = do
+    infoM "daemon" $ "    new group " ++ show gid ++ " for dev " ++ show ins
+    Q.joinGroup ctrl gid class_control (mkPolicy pol)
+    setProgram ctrl gid prog
+    forM_ ins $ bindInput ctrl gid
+    GroupState conf <$> mapM (openEgress gid pol) outs
+
+
+removeGroup :: PfqHandlePtr -> GroupState -> IO ()
+removeGroup ctrl (GroupState (GroupConfig _ gid ins _ _) egrs) = do
+    infoM "daemon" $ "    removing group " ++ show gid
+    forM_ ins $ unbindInput ctrl gid
+    mapM_ (closeEgress gid) egrs
+    Q.leaveGroup ctrl gid
+
+
+updateGroup :: PfqHandlePtr -> GroupState -> GroupConfig -> IO GroupState
+updateGroup ctrl (GroupState old egrs) conf@(GroupConfig pol gid ins outs prog) = do
+    infoM "daemon" $ "    updating group " ++ show gid
+    when (cfgProgram old /= prog) $ setProgram ctrl gid prog
+    forM_ (ins \\ cfgInput old) $ bindInput ctrl gid
+    forM_ (cfgInput old \\ ins) $ unbindInput ctrl gid
+    let (keep, drop') = partition ((`elem` outs) . fst) egrs
+    mapM_ (closeEgress gid) drop'
+    new <- mapM (openEgress gid pol) (outs \\ map fst keep)
+    return $ GroupState conf (keep ++ new)
+
+
+setProgram :: PfqHandlePtr -> Int -> Program -> IO ()
+setProgram ctrl gid prog = do
+    t0 <- getCurrentTime
+    case prog of
+        Source str -> Q.setGroupComputationFromString ctrl gid str
+        Descr json -> Q.setGroupComputationFromJSON ctrl gid json
+    t1 <- getCurrentTime
+    infoM "daemon" $ "    group " ++ show gid ++ ": program loaded in " ++ show (diffUTCTime t1 t0)
+
+
+openEgress :: Int -> Policy -> NetDevice -> IO (NetDevice, PfqHandle)
+openEgress gid pol d = do
+    h <- Q.openNoGroup 1520 8192 1520 8192
+    withPfq h $ \q -> bindOutput q (gid, pol, d)
+    return (d, h)
+
+
+-- the socket is closed here, not left to the finalizer of the handle
+
+closeEgress :: Int -> (NetDevice, PfqHandle) -> IO ()
+closeEgress gid (NetDevice d hq _ _, h) = unbind `E.finally` Q.closeHandle h
+  where unbind = withPfq h $ \q -> do
+            infoM "daemon" ("    egress unbind on dev " ++ d ++ ", port " ++ show hq)
+            Q.egressUnbind q
+            Q.leaveGroup q gid
+
+
+bindInput :: PfqHandlePtr -> Int -> NetDevice ->  IO ()
+bindInput q gid (NetDevice d hq _ _) =
+    Q.bindGroup q gid d hq
+
+
+unbindInput :: PfqHandlePtr -> Int -> NetDevice ->  IO ()
+unbindInput q gid (NetDevice d hq _ _) =
+    Q.unbindGroup q gid d hq
+
+
+bindOutput :: PfqHandlePtr -> (Int, Policy, NetDevice) ->  IO ()
+bindOutput q (gid, pol, NetDevice d hq w cl) = bindEgress q gid d hq
+    where bindEgress q gid dev queue = do
+            infoM "daemon" ("    egress bind on dev " ++ dev ++ ", port " ++ show queue ++ ", class " ++ show cl)
+            Q.joinGroup q gid cl (mkPolicy pol)
+            Q.egressBind q dev queue
+            Q.setWeight q w
+
+
+mkPolicy :: Policy -> Q.GroupPolicy
+mkPolicy Shared     = Q.policy_shared
+mkPolicy Restricted = Q.policy_restricted
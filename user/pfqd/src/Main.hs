@@ -41,6 +41,7 @@ import System.Environment
 import System.Console.CmdArgs
 import System.Directory
 import System.IO.Error
+import System.Exit
 
 import Network.PFQ as Q
 import Network.PFQ.Lang
@@ -60,11 +61,13 @@ main = do
 
     -- read command-line options
 
-    opts  <- cmdArgsRun options
+    opts'  <- cmdArgsRun options
 
     -- force to call help in case config_file is not specified
 
-    when (null $ config_file opts) $ withArgs ["--help"] $ void (cmdArgsRun options)
+    when (null $ config_file opts') $ withArgs ["--help"] $ void (cmdArgsRun options)
+
+    opts <- (\file -> opts' { config_file = file }) <$> canonicalizePath (config_file opts')
 
     -- open log...
 
@@ -86,6 +89,15 @@ main = do
         getProcessID >>= \me ->
             error $ "error: another session is running with pid " ++ show (head $ filter (/= me) ps)
 
+    -- live configuration (JSON): groups are reconfigured in place, no rebuild
+
+    when (isLiveConfig $ config_file opts) $ do
+        infoM "daemon" "PFQd started (live configuration)!"
+        runDetached Nothing DevNull $
+            (Q.openNoGroup 1520 8192 1520 8192 >>= \hq -> withPfq hq (liveDaemon opts))
+                `E.catch` (\e -> errorM "daemon" (show (e :: SomeException)))
+        exitSuccess
+
     -- rebuild itself
 
     if dont_rebuild opts
@@ -113,20 +125,6 @@ countEgress :: [Group] -> Int
 countEgress gs = sum $ map (\Group{ output = out } -> length out) gs
 
 
-bindInput :: PfqHandlePtr -> Int -> NetDevice ->  IO ()
-bindInput q gid (NetDevice d hq _ _) =
-    Q.bindGroup q gid d hq
-
-
-bindOutput :: PfqHandlePtr -> (Int, Policy, NetDevice) ->  IO ()
-bindOutput q (gid, pol, NetDevice d hq w cl) = bindEgress q gid d hq
-    where bindEgress q gid dev queue = do
-            infoM "daemon" ("    egress bind on dev " ++ dev ++ ", port " ++ show queue ++ ", class " ++ show cl)
-            Q.joinGroup q gid cl (mkPolicy pol)
-            Q.egressBind q dev queue
-            Q.setWeight q w
-
-
 runQSetup :: Options -> PfqHandlePtr -> [PfqHandlePtr] -> IO ()
 runQSetup opts ctrl egrs = do
     infoM "daemon" $ "Running daemon with " ++ show opts
@@ -142,11 +140,6 @@ runQSetup opts ctrl egrs = do
         forM_ ins $ \dev -> bindInput ctrl gid dev
 
 
-mkPolicy :: Policy -> Q.GroupPolicy
-mkPolicy Shared     = Q.policy_shared
-mkPolicy Restricted = Q.policy_restricted
-
-
 pidof :: String -> IO [ProcessID]
 pidof name = (map Prelude.read . words) <$> catchIOError (readProcess "/bin/pidof" [name] "") (const $ return [])
 
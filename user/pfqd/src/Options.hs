@@ -36,7 +36,7 @@ data Options = Options
 
 options :: Mode (CmdArgs Options)
 options = cmdArgsMode $ Options
-    {   config_file  = ""    &= typ "FILE" &= help "Config file"
+    {   config_file  = ""    &= typ "FILE" &= help "Config file (.hs compiled, .json live reconfigurable)"
     ,   dont_rebuild = False &= help "Don't rebuild itself"
 
     } &= summary "pfqd: pfq group manager." &= program "pfqd"